@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+# regenerate src/crc32_table.h - the slicing-by-8 tables for crc32.c. the tables
+# are a pure function of the polynomial, so they are generated once and checked
+# in (like the cheby headers) rather than built at runtime: they live in flash
+# on the mcu, need no init, and firmware + host share the exact same bytes.
+#
+# run: ./gen_crc32_table.py > src/crc32_table.h
+
+POLY = 0xEDB88320  # ieee 802.3, reflected
+SLICES = 8
+
+
+def main():
+    t = [[0] * 256 for _ in range(SLICES)]
+    for i in range(256):
+        c = i
+        for _ in range(8):
+            c = (POLY ^ (c >> 1)) if (c & 1) else (c >> 1)
+        t[0][i] = c
+    for k in range(1, SLICES):
+        for i in range(256):
+            p = t[k - 1][i]
+            t[k][i] = t[0][p & 0xFF] ^ (p >> 8)
+
+    print("// GENERATED by lib/bootloader/gen_crc32_table.py - do not edit.")
+    print("// slicing-by-8 tables for crc32 (poly 0x%08X, reflected). table k maps a" % POLY)
+    print("// byte to its crc contribution k bytes ahead of the end of an 8-byte block.")
+    print()
+    print("#ifndef BOOTLOADER_CRC32_TABLE_H")
+    print("#define BOOTLOADER_CRC32_TABLE_H")
+    print()
+    print("#include <stdint.h>")
+    print()
+    print("static const uint32_t crc32_table[%d][256] = {" % SLICES)
+    for k in range(SLICES):
+        print("  {")
+        for r in range(0, 256, 6):
+            row = ", ".join("0x%08XU" % v for v in t[k][r:r + 6])
+            print("    %s," % row)
+        print("  },")
+    print("};")
+    print()
+    print("#endif // BOOTLOADER_CRC32_TABLE_H")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+// boot pointer: which QSPI app slot is active, whether the image in it has
+// booted, and how many boots have tried it since. an app update goes into the
+// other slot and flips the pointer once the image verified, so nothing is ever
+// copied between the slots: the image that was active stays where it is, as the
+// fallback.
+//
+// the pointer is a log of records over two 4KB NOR sectors in the params slot
+// (BL_PARAMS_BOOT, BL_PARAMS_BOOT_2), append-only between erases, so a state
+// change costs one 16-byte program:
+//
+//   { 'BPTR', seq, active, confirmed, tries, 0xFF, crc }
+//   seq = one more than the record before it
+//   crc = crc32 of the record's first 12 bytes
+//
+// the intact record with the highest seq is the state. a power cut mid-program
+// leaves a torn record, which is skipped (and written past), so the state is
+// the one before it. when the sector in use is full the next record goes to the
+// start of the other one, erased first - the full sector still holds the state
+// until the new record is in. no record at all is the layout before the
+// pointer: slot 1 active and booted.
+//
+// at boot (bl_main's cascade): an unconfirmed slot gets a try counted before
+// it is staged, and is confirmed once its app has come up and said so
+// (confirm.h: the next boot writes it). one that has had BL_BOOT_TRIES boots
+// without that is given up: the pointer goes back to the other slot.
+//
+// unlike resume_log.h, every call here is blocking - it waits out each flash
+// operation it starts (the part must not be in memory-mapped mode).
+
+#ifndef BOOTLOADER_BOOT_PTR_H
+#define BOOTLOADER_BOOT_PTR_H
+
+#include <stdint.h>
+
+#include "bootloader/flash_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_BOOT_REC_MAGIC 0x52545042U // 'BPTR'
+#define BL_BOOT_TRIES     3U          // unconfirmed boots before giving a slot up
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+  uint8_t active;    // 0 = BL_SLOT_APP_0, 1 = BL_SLOT_APP_1
+  uint8_t confirmed; // 1 once the app in it came up
+  uint8_t tries;     // boots started on it while unconfirmed
+  uint8_t rsvd;      // 0xFF
+  uint32_t crc;      // crc32 of the fields above
+} bl_boot_rec;
+
+#define BL_BOOT_RECS (BL_NOR_SECTOR / sizeof(bl_boot_rec))
+
+typedef struct {
+  const bl_nor *nor;
+  uint32_t off[2];   // device offsets of the two log sectors
+  bl_boot_rec cur;   // the state (seq 0: no record yet)
+  uint32_t sec;      // the sector the next record goes to
+  uint32_t n;        //   records in it, torn ones included
+} bl_boot;
+
+// read the pointer from the log sectors at `off0` and `off1`. returns 0, or
+// negative on a read error (the state is then the no-record default)
+int bl_boot_open(bl_boot *b, const bl_nor *nor, uint32_t off0, uint32_t off1);
+
+// a boot starts: count a try on an unconfirmed slot (unless `count` is 0),
+// or give it up if it has had BL_BOOT_TRIES. `*first` is the slot to try first
+// (0/1), the other one after it. returns 0, or negative on a flash error
+// (`*first` is still set)
+int bl_boot_begin(bl_boot *b, int count, unsigned *first);
+
+// the app in slot `slot` (0/1) came up: make it the active slot, confirmed.
+// writes nothing if it already is. returns 0, or negative on a flash error
+int bl_boot_booted(bl_boot *b, unsigned slot);
+
+// the slot an app update goes into: the one that is not active
+unsigned bl_boot_update_slot(const bl_boot *b);
+
+// an update verified in slot `slot`: make it the active slot, unconfirmed.
+// returns 0, or negative on a flash error
+int bl_boot_install(bl_boot *b, unsigned slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_BOOT_PTR_H
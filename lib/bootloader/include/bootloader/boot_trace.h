@@ -0,0 +1,126 @@
+// boot trace: where the time from reset to the app goes. the bootloader marks
+// the end of each boot phase (QSPI bringup, the update window, the boot
+// pointer, each slot header checked and each slot staged, the FPGA, the jump) with the
+// core's cycle counter, in a record that lives in RAM the startup code does not
+// touch (BL_TRACE_RAM, memmap.h), so it survives into the app and across a
+// reset:
+//
+//   { 'BTRC', cpu_hz, boot, count, dropped, flags, marks[16], crc }
+//   mark = { cycles, phase, arg }
+//   crc  = crc32 of everything before it, kept current by every mark
+//
+// the area holds two records. `cur` is this boot's, from bl_trace_begin on; the
+// app may add marks of its own to it (BL_TRACE_APP + n). `last` is the most
+// recent boot that got as far as the jump - what bl_trace_begin found in `cur`
+// if it did. that is the one the update session hands a host (BL_TRACE): the
+// host resets the board into the bootloader, and the boot before that reset is
+// the one it asks about. a reset before the jump leaves `last` as it was.
+//
+// a mark holds the counter's low 32 bits, and a phase is the difference from
+// the mark before it modulo 2^32 - exact unless the phase took longer than one
+// wrap (8.9 s at 480 MHz). the update window can: 30 s when the app asked for
+// it, and a host session of any length. so it is timed with a bl_trace_clock,
+// which bl_update_run samples on every poll (far more often than once a wrap)
+// and which adds up the cycles between samples; its mark's arg carries the
+// wraps (BL_TRACE_ARG_WRAPS), and bl_trace_span adds them back.
+
+#ifndef BOOTLOADER_BOOT_TRACE_H
+#define BOOTLOADER_BOOT_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_TRACE_MAGIC 0x43525442U // 'BTRC'
+#define BL_TRACE_MARKS 16U
+
+// what a mark ends (bl_trace_mark.phase)
+enum bl_trace_phase {
+  BL_TRACE_RESET  = 0, // main() reached: the counter starts. arg: 0
+  BL_TRACE_QSPI   = 1, // QSPI bringup. arg: 1 = up
+  BL_TRACE_UPDATE = 2, // the update window. arg: 1 = a host session ran,
+                       //   | the counter's wraps << 8 (BL_TRACE_ARG_WRAPS)
+  BL_TRACE_BOOT   = 3, // boot pointer read, a try counted. arg: the slot first (0/1)
+  BL_TRACE_HEADER = 4, // an app slot's header checked. arg: slot (0/1), | 0x100 if bad
+  BL_TRACE_STAGE  = 5, // an app slot staged. arg: slot, | 0x100 if it failed,
+                       //   | 0x200 if exec already held it
+  BL_TRACE_JUMP   = 6, // about to jump to the app
+  BL_TRACE_FPGA   = 7, // the FPGA's load finished (after the stage it overlaps).
+                       //   arg: the bitstream up (0 active, 1 golden), 0x100 if none,
+                       //   0x200 if the bootloader does not load it (BL_FPGA_LOAD)
+  BL_TRACE_APP    = 16 // the app's own marks: BL_TRACE_APP + n
+};
+
+#define BL_TRACE_ARG_BAD  0x100U
+#define BL_TRACE_ARG_SKIP 0x200U
+#define BL_TRACE_ARG_WRAPS 0xFF00U // BL_TRACE_UPDATE: whole 2^32-cycle wraps
+
+// bl_boot_trace.flags
+#define BL_TRACE_F_JUMPED 0x0001U // the boot reached BL_TRACE_JUMP
+
+#pragma pack(push, 1)
+typedef struct {
+  uint32_t cycles;   // cycle counter at the end of the phase
+  uint16_t phase;    // enum bl_trace_phase
+  uint16_t arg;      // per phase, above
+} bl_trace_entry;
+
+// also the BL_TRACE payload
+typedef struct {
+  uint32_t magic;    // BL_TRACE_MAGIC
+  uint32_t cpu_hz;   // the counter's rate
+  uint32_t boot;     // boots since the record was last found garbage (power-on)
+  uint8_t count;     // marks in use
+  uint8_t dropped;   // marks that did not fit
+  uint16_t flags;    // BL_TRACE_F_*
+  bl_trace_entry marks[BL_TRACE_MARKS];
+  uint32_t crc;      // crc32 of the fields above
+} bl_boot_trace;
+#pragma pack(pop)
+
+// what sits at BL_TRACE_RAM
+typedef struct {
+  bl_boot_trace cur;
+  bl_boot_trace last;
+} bl_trace_area;
+
+// the cycles of a phase that may outlast a wrap, added up sample by sample
+typedef struct {
+  uint32_t last;     // the counter at the last sample
+  uint64_t elapsed;  // cycles since the mark the phase started at
+} bl_trace_clock;
+
+// a boot starts (`cycles` is the counter now): keep what `a->cur` holds as
+// `a->last` if it reached the jump, and start `a->cur` over with a
+// BL_TRACE_RESET mark
+void bl_trace_begin(bl_trace_area *a, uint32_t cpu_hz, uint32_t cycles);
+
+// a phase ended at `cycles`. a mark past BL_TRACE_MARKS is counted in dropped
+void bl_trace_mark(bl_boot_trace *t, uint16_t phase, uint16_t arg, uint32_t cycles);
+
+// 0 if `t` is an intact record (magic, count, crc), else -1
+int bl_trace_check(const bl_boot_trace *t);
+
+// cycles between mark i-1 and mark i (0 for the first), wraps included
+uint64_t bl_trace_span(const bl_boot_trace *t, unsigned i);
+
+// start timing a phase at `t`'s last mark
+void bl_trace_clock_start(bl_trace_clock *c, const bl_boot_trace *t);
+
+// the counter now reads `cycles`: at least once a wrap
+void bl_trace_clock_poll(bl_trace_clock *c, uint32_t cycles);
+
+// the wraps so far, as BL_TRACE_ARG_WRAPS bits for the phase's mark (255 at
+// most: 38 minutes at 480 MHz)
+uint16_t bl_trace_clock_arg(const bl_trace_clock *c);
+
+// short name of a phase ("qspi", "update", ...; "app" for BL_TRACE_APP + n)
+const char *bl_trace_phase_name(uint16_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_BOOT_TRACE_H
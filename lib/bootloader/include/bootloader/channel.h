@@ -0,0 +1,59 @@
+// transmit scheduling for the channels that share the update line (protocol.h,
+// enum bl_channel): which queued frame goes out next. the update protocol's
+// control frames (all but DATA) go first, always - an ack, a nak or a DONE
+// never waits behind the bulk it steers. log text, telemetry and bulk DATA
+// share the rest by deficit round robin: each class is credited its quantum of
+// bytes per round and sends while its head frame fits the credit, so under a
+// saturating bulk stream each gets its quantum's share of the line and a short
+// frame waits one round at most. a class with nothing queued keeps no credit.
+//
+// only the policy lives here. each side keeps its own queues (the host's
+// link_engine, the board's log ring) and asks which one to send from.
+
+#ifndef BOOTLOADER_CHANNEL_H
+#define BOOTLOADER_CHANNEL_H
+
+#include <stdint.h>
+
+#include "bootloader/protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bl_tx_class {
+  BL_TX_CONTROL   = 0, // BL_CH_UPDATE, anything but DATA: strict priority
+  BL_TX_LOG       = 1, // BL_CH_LOG
+  BL_TX_TELEMETRY = 2, // BL_CH_TELEMETRY
+  BL_TX_BULK      = 3, // BL_CH_UPDATE DATA (and any channel this end does not know)
+  BL_TX_CLASSES,
+};
+
+// default bytes per round: about 10% of a saturated line for log text, 5% for
+// telemetry, the rest for one full DATA frame a round
+#define BL_SCHED_QUANTUM_LOG       128U
+#define BL_SCHED_QUANTUM_TELEMETRY 64U
+#define BL_SCHED_QUANTUM_BULK      (8U + BL_MAX_PAYLOAD + 4U)
+
+typedef struct {
+  uint32_t quantum[BL_TX_CLASSES]; // bytes per round (CONTROL's is unused), > 0
+  uint32_t deficit[BL_TX_CLASSES]; // credit left this round
+  uint8_t  turn;                   // the class whose round it is
+  uint8_t  credited;               //   its quantum already added
+} bl_sched;
+
+// the class a frame on channel `ch` of `type` goes out in
+uint8_t bl_tx_class(uint8_t ch, uint8_t type);
+
+// default quanta, no credit. the quanta may be changed afterwards
+void bl_sched_init(bl_sched *s);
+
+// the class to send from next, given the byte length of each class's head frame
+// (0 = nothing queued); -1 if all are empty. the caller sends that head frame
+int bl_sched_pick(bl_sched *s, const uint32_t head[BL_TX_CLASSES]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_CHANNEL_H
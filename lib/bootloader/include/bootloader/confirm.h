@@ -0,0 +1,63 @@
+// boot confirmation: how the app tells the bootloader that it came up, so a
+// slot is confirmed by the app that runs from it and not by the bootloader that
+// staged it - an image that stages and verifies but hangs or faults on its way
+// up still gets BL_BOOT_TRIES boots and is given up (boot_ptr.h).
+//
+// the bootloader arms a word in backup SRAM (BL_CONFIRM_RAM, memmap.h) with the
+// slot it is about to jump to, and the app, once it is up (its threads
+// started, the FPGA answering, whatever "up" means to it), marks it:
+//
+//   bl_confirm_set((bl_confirm *)BL_CONFIRM_RAM);
+//
+//   { 'BTOK', slot, state, check }
+//   state = armed, then up
+//   check = ~(magic ^ slot ^ state << 16)
+//
+// the next boot takes the word before it counts a try: a slot whose app marked
+// it up is confirmed in the boot pointer then. the word is cleared whatever it
+// held - it is good for one boot.
+//
+// a power-on boot finds the backup SRAM garbage, so it cannot tell whether the
+// app confirmed; it does not spend a try either (bl_boot_begin's `count`), or
+// a good image on a board that is only ever switched off and on would be given
+// up before anything carried its word through a reset.
+
+#ifndef BOOTLOADER_CONFIRM_H
+#define BOOTLOADER_CONFIRM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_CONFIRM_MAGIC 0x4B4F5442U // 'BTOK'
+
+enum bl_confirm_state {
+  BL_CONFIRM_ARMED = 1, // the bootloader jumped to `slot`
+  BL_CONFIRM_UP    = 2, // ... and its app came up
+};
+
+typedef struct {
+  uint32_t magic;     // BL_CONFIRM_MAGIC
+  uint16_t slot;      // the app slot started (0/1)
+  uint16_t state;     // enum bl_confirm_state
+  uint32_t check;     // ~(magic ^ slot ^ state << 16)
+} bl_confirm;
+
+// bootloader side: slot `slot` (0/1) is about to run
+void bl_confirm_arm(bl_confirm *c, unsigned slot);
+
+// app side: it is up. a word the bootloader did not arm (the app started some
+// other way, a debugger) is left alone
+void bl_confirm_set(bl_confirm *c);
+
+// bootloader side, at the next boot: 1 if the app in `*slot` marked itself up,
+// else 0. clears the word
+int bl_confirm_take(bl_confirm *c, unsigned *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_CONFIRM_H
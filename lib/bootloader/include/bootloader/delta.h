@@ -0,0 +1,92 @@
+// delta updates: rebuild a new image from the installed one plus a patch, in
+// bounded RAM. the patch is a bsdiff-style op stream (mkupdate --delta builds
+// it); each op is
+//
+//   varint add, varint insert, zigzag varint seek,
+//   the add part:    runs of { varint same, varint changed, changed bytes }
+//                    covering `add` bytes exactly
+//   the insert part: `insert` raw bytes
+//
+// add copies `add` bytes of the base from the read position, adding (mod 256)
+// a difference that is 0 for the `same` bytes and the next patch byte for the
+// `changed` ones - a rebuild shifts code and retargets addresses, so most of a
+// diff is zero and the runs stay short. insert appends new bytes; seek then
+// moves the base read position. ops repeat until the image is complete.
+//
+// the decoder takes patch bytes in order, in whatever pieces they arrive, and
+// writes the image in order into whatever room the caller has. base bytes come
+// through a small read cache that the caller fills (the base lives in NOR, and
+// may only be read while the part is idle). no allocation.
+
+#ifndef BOOTLOADER_DELTA_H
+#define BOOTLOADER_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_DELTA_MAGIC    0x4C444D53U // 'SMDL' - a patch file from mkupdate
+#define BL_DELTA_BASE_BUF 256U        // base read cache (one NOR page)
+
+// patch file as mkupdate writes it: this header, then the op stream. only the
+// op stream goes over the wire; the header fields ride in the manifest
+#pragma pack(push, 1)
+typedef struct {
+  uint32_t magic;        // BL_DELTA_MAGIC
+  uint16_t target;       // enum bl_target
+  uint16_t flags;        // 0
+  uint32_t version;      // version of the rebuilt image
+  uint32_t base_length;  // the installed blob the patch applies to
+  uint32_t base_crc32;
+  uint32_t image_length; // the blob it rebuilds
+  uint32_t image_crc32;
+} bl_delta_header;
+#pragma pack(pop)
+
+enum bl_delta_status {
+  BL_DELTA_MORE = 0, // all input used: feed more patch bytes
+  BL_DELTA_FULL = 1, // no room left for output
+  BL_DELTA_BASE = 2, // read base [want_off, want_off + want_n) into base_buf
+  BL_DELTA_DONE = 3, // the image is complete
+  BL_DELTA_BAD  = 4, // malformed patch (or not for this base)
+};
+
+typedef struct {
+  uint32_t base_len;   // installed image bytes
+  uint32_t out_len;    // image bytes the patch rebuilds
+  uint32_t out;        // image bytes produced so far
+  uint32_t pos;        // base read position
+  uint8_t  state;
+  uint8_t  shift;      // varint being read
+  uint32_t v;
+  uint32_t add;        // bytes left in the current op's add part
+  uint32_t ins;        //   ... and its insert part
+  int32_t  seek;
+  uint32_t same;       // current run of the add part: unchanged bytes left
+  uint32_t changed;    //   ... then changed bytes left
+  uint32_t base_off;   // base_buf holds base [base_off, base_off + base_n)
+  uint32_t base_n;
+  uint32_t want_off;   // BL_DELTA_BASE: the range to load
+  uint32_t want_n;
+  uint8_t  base_buf[BL_DELTA_BASE_BUF];
+} bl_delta;
+
+void bl_delta_init(bl_delta *d, uint32_t base_len, uint32_t out_len);
+
+// decode patch bytes in[0, n) into image bytes out[0, cap). stops when the
+// input is used up, the output is full, a base read is needed, or the image is
+// complete; *used / *made say how far it got. returns an enum bl_delta_status
+int bl_delta_run(bl_delta *d, const uint8_t *in, size_t n, size_t *used, uint8_t *out,
+                 size_t cap, size_t *made);
+
+// after BL_DELTA_BASE: base_buf now holds base [want_off, want_off + want_n)
+void bl_delta_base_loaded(bl_delta *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_DELTA_H
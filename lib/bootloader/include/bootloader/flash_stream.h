@@ -0,0 +1,91 @@
+// stream an image into a NOR flash slot while it is still arriving. the image
+// is staged a 4KB sector at a time in two buffers: while one fills from DATA
+// frames, the other (complete) one is programmed page by page. erases run ahead
+// of the data, in 64KB blocks where the slot allows it. every flash operation
+// is only STARTED here - bl_fstream_poll issues at most one per call and
+// returns while the part is busy, so the caller keeps receiving in between.
+// after the last byte, bl_fstream_verify reads the slot back and checks the
+// whole-image crc. no allocation; the staging buffers live in the struct.
+
+#ifndef BOOTLOADER_FLASH_STREAM_H
+#define BOOTLOADER_FLASH_STREAM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_NOR_PAGE    256U
+#define BL_NOR_SECTOR  4096U
+#define BL_NOR_BLOCK   65536U
+
+// a NOR part (device-relative offsets). erase and program start the operation
+// and return at once; busy reports whether it is still running. all return 0 on
+// success, negative on error (busy: 1 = busy, 0 = idle)
+typedef struct {
+  void *ctx;
+  int (*erase)(void *ctx, uint32_t off, uint32_t size); // BL_NOR_SECTOR or BL_NOR_BLOCK
+  int (*program)(void *ctx, uint32_t off, const uint8_t *p, uint32_t n); // within one page
+  int (*busy)(void *ctx);
+  int (*read)(void *ctx, uint32_t off, uint8_t *p, uint32_t n); // blocking
+} bl_nor;
+
+typedef struct {
+  const bl_nor *nor;
+  uint32_t base;      // device offset of the slot (sector aligned)
+  uint32_t length;    // image bytes
+  uint32_t erased;    // bytes from base erased (or erasing) so far
+  uint32_t lo;        // oldest sector not yet programmed; buf[lo & 1]
+  uint32_t have[2];   // bytes staged for sector lo / lo + 1 (by buffer)
+  uint32_t page;      // next page of sector lo to program
+  uint32_t crc;       // running crc32 of the staged image, in image order
+  int err;
+  uint8_t buf[2][BL_NOR_SECTOR];
+} bl_fstream;
+
+// start a stream of `length` bytes to the slot at device offset `base`.
+// returns 0, or negative if base is not sector aligned
+int bl_fstream_begin(bl_fstream *fs, const bl_nor *nor, uint32_t base, uint32_t length);
+
+// continue a stream whose first `done` bytes (a sector multiple) are already in
+// the slot, their running crc32 (bl_fstream_raw_crc) `crc`. call after begin;
+// returns 0, or negative if done is not a sector multiple within the image
+int bl_fstream_resume(bl_fstream *fs, uint32_t done, uint32_t crc);
+
+// image bytes below this offset can be staged right now (sectors lo and lo+1)
+uint32_t bl_fstream_limit(const bl_fstream *fs);
+
+// where image bytes [off, off+len) go in the staging buffers, so a frame parser
+// can write them in place; NULL if not stageable now or the range spans two
+// sectors. the bytes only count once bl_fstream_write() is called for them
+uint8_t *bl_fstream_slot(bl_fstream *fs, uint32_t off, uint32_t len);
+
+// stage image bytes [off, off+len) (each byte exactly once, any order within the
+// limit). copies unless p is already the bl_fstream_slot() pointer. returns 0, or
+// negative if the range is outside the limit
+int bl_fstream_write(bl_fstream *fs, uint32_t off, const uint8_t *p, uint32_t len);
+
+// advance the flash side: if the part is idle, start the next page program of
+// a complete sector or the next erase ahead. returns 1 while work is pending
+// (busy, or waiting for data), 0 once the whole image is programmed, negative on
+// a flash error
+int bl_fstream_poll(bl_fstream *fs);
+
+// crc32 of everything staged so far, folded in sector by sector as each one goes
+// to flash - after poll has returned 0, the crc of the image as received
+uint32_t bl_fstream_crc(const bl_fstream *fs);
+
+// the running (not finalised) crc32 of the sectors programmed so far, [0, lo *
+// BL_NOR_SECTOR) - what a resume needs
+uint32_t bl_fstream_raw_crc(const bl_fstream *fs);
+
+// after poll has returned 0: read the slot back and compare its crc32 with
+// `crc`. returns 0 if it matches
+int bl_fstream_verify(bl_fstream *fs, uint32_t crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_FLASH_STREAM_H
@@ -0,0 +1,115 @@
+// load the FPGA's bitstream while the app stages. the bitstream sits in a QSPI
+// slot (BL_SLOT_FPGA_ACTIVE, BL_SLOT_FPGA_GOLDEN) behind a bl_image_header,
+// like an app; with the QSPI memory-mapped, DMA streams it straight out of the
+// map into the FPGA's configuration port, a chunk at a time, while the CPU is
+// busy copying the app into bank 2 (bootloader/stage_pipe.h). the CPU only
+// starts each chunk: bl_fpga_poll is cheap enough to call from the staging
+// loop's flash-busy wait, so the load costs the boot little more than the wait
+// for DONE after the copy.
+//
+// the FPGA checks the bitstream itself (its own crc): a bad one never raises
+// DONE. the slot's header is checked before any of it is sent. a load counts
+// once DONE is up and the design answers with its magic (core.magic, 0xACE1,
+// over FMC); until then the DAC is held muted, so a half-configured FPGA never
+// reaches the speaker. the active bitstream is tried first; if its header is
+// bad, the DMA fails, DONE does not come or the magic is wrong, the FPGA is
+// reset and the golden one goes in. if that fails too the DAC stays muted.
+//
+// the QSPI map must stay up while a chunk is in flight: a caller that needs
+// indirect mode (writing the staging record, the boot pointer) pauses the load
+// around it.
+//
+// the hardware sits behind bl_fpga_ops, so the sequencing, timeouts and
+// fallback are host-tested with mocked DMA completion and DONE.
+
+#ifndef BOOTLOADER_FPGA_LOAD_H
+#define BOOTLOADER_FPGA_LOAD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_FPGA_MAGIC    0xACE1U  // core.magic once the design runs
+#define BL_FPGA_CHUNK    0x8000U  // bytes per DMA transfer (a stream takes < 64K items)
+#define BL_FPGA_CHUNK_MS 100U     // a chunk that takes longer failed (32KB >= 5 MHz)
+#define BL_FPGA_DONE_MS  50U      // from the last byte to DONE
+#define BL_FPGA_MAGIC_MS 100U     // from DONE to the magic (PLL lock, reset release)
+
+// the hardware. begin resets the FPGA into configuration and opens the port
+// (stopping any transfer a failed load left running); send starts a DMA of n
+// bytes out of the map and returns; busy: 1 = the DMA runs, 0 = it finished,
+// negative = it failed; end closes the port after the last byte. those return
+// 0, or negative on error. done is the DONE pin (1 = configured); magic reads
+// core.magic; mute holds the DAC at silence (1) or lets it go (0); ms is a
+// millisecond clock
+typedef struct {
+  void *ctx;
+  int (*begin)(void *ctx);
+  int (*send)(void *ctx, const uint8_t *p, uint32_t n);
+  int (*busy)(void *ctx);
+  int (*end)(void *ctx);
+  int (*done)(void *ctx);
+  uint16_t (*magic)(void *ctx);
+  void (*mute)(void *ctx, int on);
+  uint32_t (*ms)(void *ctx);
+} bl_fpga_ops;
+
+enum bl_fpga_state {
+  BL_FPGA_IDLE,       // not begun
+  BL_FPGA_SEND,       // streaming the bitstream
+  BL_FPGA_WAIT_DONE,  // all sent, waiting for DONE
+  BL_FPGA_WAIT_MAGIC, // DONE up, waiting for the magic
+  BL_FPGA_READY,      // running, the DAC let go
+  BL_FPGA_FAILED      // neither bitstream came up, the DAC held muted
+};
+
+// why a bitstream did not come up (bl_fpga.why[])
+enum bl_fpga_why {
+  BL_FPGA_OK,
+  BL_FPGA_E_HEADER, // the slot's header is bad, nothing sent
+  BL_FPGA_E_PORT,   // begin / send / end failed
+  BL_FPGA_E_DMA,    // a chunk failed or overran BL_FPGA_CHUNK_MS
+  BL_FPGA_E_DONE,   // DONE did not come up
+  BL_FPGA_E_MAGIC   // DONE came, the magic did not
+};
+
+typedef struct {
+  const bl_fpga_ops *ops;
+  const uint8_t *slot[2]; // the active and the golden slot, memory-mapped
+  uint8_t state;          // enum bl_fpga_state
+  uint8_t cur;            // the slot being loaded (0 active, 1 golden)
+  uint8_t why[2];         // enum bl_fpga_why, per slot
+  uint8_t paused;
+  uint8_t inflight;       // a chunk is out
+  uint16_t got;           // the last magic read
+  const uint8_t *img;     // the bitstream being sent
+  uint32_t length;
+  uint32_t sent;          // bytes handed to the DMA
+  uint32_t t0;            // when the current wait started
+  uint32_t chunks;
+} bl_fpga;
+
+// mute the DAC and start loading `active` (or `golden`, if its header is bad):
+// both are slot bases with a bl_image_header
+void bl_fpga_begin(bl_fpga *f, const bl_fpga_ops *ops, const void *active, const void *golden);
+
+// move the load on without waiting: retire a finished chunk and start the
+// next, or check DONE / the magic. returns the state (enum bl_fpga_state)
+int bl_fpga_poll(bl_fpga *f);
+
+// stop starting chunks and wait out the one in flight (up to BL_FPGA_CHUNK_MS),
+// so the QSPI map can go away; bl_fpga_resume carries on. a chunk timeout
+// counts from when it was started, so time spent paused is not held against it
+void bl_fpga_pause(bl_fpga *f);
+void bl_fpga_resume(bl_fpga *f);
+
+// poll until the load is over: BL_FPGA_READY or BL_FPGA_FAILED
+int bl_fpga_finish(bl_fpga *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_FPGA_LOAD_H
@@ -1,7 +1,10 @@
-// frame reassembly + encoding for the update protocol. feed received bytes one
-// at a time to bl_frame_feed(); it resyncs on the SOF magic, validates the
-// trailing crc32, and hands back a complete frame. bl_frame_encode() builds a
-// frame for transmit. no dynamic allocation - one bl_frame_rx per link.
+// frame reassembly + encoding for the update protocol. feed received bytes to
+// bl_frame_feed_buf() a DMA chunk at a time (or one at a time to
+// bl_frame_feed()); it resyncs on the SOF magic, validates the trailing crc32,
+// and hands back a complete frame. an optional payload sink lets DATA land in
+// its final destination straight from the receive buffer instead of going
+// through rx->frame.payload. bl_frame_encode() builds a frame for transmit. no
+// dynamic allocation - one bl_frame_rx per link.
 
 #ifndef BOOTLOADER_FRAME_H
 #define BOOTLOADER_FRAME_H
@@ -30,19 +33,39 @@ typedef struct {
   uint8_t  payload[BL_MAX_PAYLOAD];
 } bl_frame;
 
+// payload sink: called once a frame header has parsed. return where its
+// hdr->len payload bytes should be written, or NULL to keep them in
+// rx->frame.payload. the bytes are unverified until BL_FRAME_OK comes back, so
+// only hand out memory that may hold garbage until then (e.g. a window slot
+// that has not been received yet)
+typedef uint8_t *(*bl_frame_sink)(void *ctx, const bl_frame *hdr);
+
 typedef struct {
   int      state;
-  uint32_t crc;       // running crc over type..payload
+  uint32_t crc;       // crc over type..payload, folded in per header/payload
   uint8_t  hdr[6];    // type, flags, seq_lo, seq_hi, len_lo, len_hi
   uint8_t  hdr_idx;
   uint16_t pay_idx;
   uint8_t  crcbuf[4];
   uint8_t  crc_idx;
   bl_frame frame;     // valid when BL_FRAME_OK is returned
+  uint8_t *dst;       // where frame's payload landed (frame.payload or sink)
+  bl_frame_sink sink;
+  void    *sink_ctx;
 } bl_frame_rx;
 
 void bl_frame_rx_init(bl_frame_rx *rx);
 
+// install a payload sink (after bl_frame_rx_init, which clears it)
+void bl_frame_rx_set_sink(bl_frame_rx *rx, bl_frame_sink sink, void *ctx);
+
+// feed a run of received bytes. scans for the SOF with memchr, copies header /
+// payload / crc runs whole, and crcs the payload in one pass. stops right after
+// the first complete frame or error so the caller can act on it: returns the
+// bytes consumed and sets *status (enum bl_frame_status). call again with the
+// rest of the buffer.
+size_t bl_frame_feed_buf(bl_frame_rx *rx, const uint8_t *p, size_t n, int *status);
+
 // feed one received byte; returns an enum bl_frame_status
 int bl_frame_feed(bl_frame_rx *rx, uint8_t b);
 
@@ -51,6 +74,10 @@ int bl_frame_feed(bl_frame_rx *rx, uint8_t b);
 size_t bl_frame_encode(uint8_t type, uint16_t seq, const void *payload,
                        uint16_t len, uint8_t *out, size_t cap);
 
+// the same on channel `ch` (enum bl_channel; bl_frame_encode is BL_CH_UPDATE)
+size_t bl_frame_encode_ch(uint8_t ch, uint8_t type, uint16_t seq, const void *payload,
+                          uint16_t len, uint8_t *out, size_t cap);
+
 #ifdef __cplusplus
 }
 #endif
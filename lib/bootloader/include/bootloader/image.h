@@ -8,6 +8,13 @@
 // slot in place (memory-mapped QSPI, so plain pointer access) then stages the
 // image into the internal-flash exec region to run it; the header stays behind
 // in QSPI as metadata. the offset keeps the image VTOR-aligned in the slot too.
+//
+// block table (flags & BL_IMAGE_F_BLOCKS): the pad also carries a crc32 per
+// block of the image, then a crc32 over those, at BL_IMAGE_BLOCKS_AT. blocks are
+// 4KB, or the next power of two that keeps the table within the pad (16KB for a
+// 1MB image). with it a check can stop at the first bad block instead of
+// reading the whole image first, and any block can be re-checked on its own.
+// images without one (older mkupdate) still validate on image_crc32.
 
 #ifndef BOOTLOADER_IMAGE_H
 #define BOOTLOADER_IMAGE_H
@@ -21,6 +28,12 @@ extern "C" {
 #define BL_IMAGE_MAGIC  0x314D4C42U // 'BLM1'
 #define BL_IMAGE_OFFSET 0x200U      // app image sits here in the slot (VTOR-aligned)
 
+#define BL_IMAGE_F_BLOCKS    0x0001U // a block crc table sits in the pad
+#define BL_IMAGE_BLOCK_LOG(flags) (((flags) >> 4) & 0x1FU) // log2 of the block size
+#define BL_IMAGE_BLOCKS_AT   0x20U   // the table's offset in the slot
+#define BL_IMAGE_BLOCKS_MAX  ((BL_IMAGE_OFFSET - BL_IMAGE_BLOCKS_AT) / 4U - 1U) // 119
+#define BL_IMAGE_BLOCK_MIN   4096U
+
 #pragma pack(push, 1)
 typedef struct {
   uint32_t magic;        // BL_IMAGE_MAGIC
@@ -35,9 +48,30 @@ typedef struct {
 
 // validate a stored image whose header sits at `base` (a memory-mapped address:
 // internal flash 0x08.., or QSPI 0x90..). checks magic + header crc, then the
-// app-image crc at base+BL_IMAGE_OFFSET. returns 0 if good, negative otherwise.
+// app image at base+BL_IMAGE_OFFSET: block by block, stopping at the first bad
+// one, if it has a usable block table, else its whole-image crc. returns 0 if
+// good, negative otherwise.
 int bl_image_validate(const void *base);
 
+// only the header part of bl_image_validate (magic + header crc), for a caller
+// that checks the image crc on its own pass over the bytes (bootloader/
+// stage_pipe.h). returns 0 if good, negative otherwise.
+int bl_image_check_header(const void *base);
+
+// the block crc table of the image at `base` (header already checked), or NULL
+// if it has none or the table fails its own crc. *block_size gets the block size
+const uint32_t *bl_image_blocks(const void *base, uint32_t *block_size);
+
+// re-check blocks [first, first + n) of the image at `base` against its table
+// (n is clipped to the image). returns the index of the first bad block, the
+// end of the range if all are good, or -1 if there is no usable table
+int32_t bl_image_check_blocks(const void *base, uint32_t first, uint32_t n);
+
+// build the block table for the image at `base` (header and image in place, the
+// pad erased or zero): writes the table, sets the flags and redoes the header
+// crc. for mkupdate and the host tests
+void bl_image_add_blocks(void *base);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,75 @@
+// compressed transport: the image goes over the wire as one LZ4 block
+// (mkupdate --lz builds it) with every match offset within BL_LZ_WINDOW, so the
+// receiver decompresses with a 4KB history instead of LZ4's 64KB. any LZ4
+// block decoder can still read the stream. the block is
+//
+//   sequences of { token, [literal length bytes], literals,
+//                  offset (u16 le), [match length bytes] }
+//
+// token high nibble = literal count, low nibble = match length - 4, 15 in
+// either meaning "add the following bytes up to one that is not 255". the last
+// sequence has literals only - the image length (from the manifest) says where
+// it stops.
+//
+// the decoder takes compressed bytes in order, in whatever pieces they arrive,
+// and writes the image in order into whatever room the caller has; matches are
+// copied out of the decoder's own history ring. no allocation.
+
+#ifndef BOOTLOADER_LZ_H
+#define BOOTLOADER_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_LZ_MAGIC    0x5A4C4D53U // 'SMLZ' - a compressed image from mkupdate
+#define BL_LZ_WINDOW   4096U       // largest match offset (power of two)
+#define BL_LZ_MIN_MATCH 4U
+
+// compressed file as mkupdate writes it: this header, then the block. only the
+// block goes over the wire; the header fields ride in the manifest
+#pragma pack(push, 1)
+typedef struct {
+  uint32_t magic;        // BL_LZ_MAGIC
+  uint16_t target;       // enum bl_target
+  uint16_t flags;        // 0
+  uint32_t version;
+  uint32_t image_length; // the blob it decompresses to
+  uint32_t image_crc32;
+} bl_lz_header;
+#pragma pack(pop)
+
+enum bl_lz_status {
+  BL_LZ_MORE = 0, // all input used: feed more compressed bytes
+  BL_LZ_FULL = 1, // no room left for output
+  BL_LZ_DONE = 2, // the image is complete
+  BL_LZ_BAD  = 3, // malformed block
+};
+
+typedef struct {
+  uint32_t out_len;  // image bytes the block decompresses to
+  uint32_t out;      // image bytes produced so far
+  uint8_t  state;
+  uint8_t  token;
+  uint16_t offset;
+  uint32_t lit;      // literals left in the current sequence
+  uint32_t match;    // match bytes left
+  uint8_t  hist[BL_LZ_WINDOW]; // the last BL_LZ_WINDOW image bytes, by out
+} bl_lz;
+
+void bl_lz_init(bl_lz *z, uint32_t out_len);
+
+// decompress in[0, n) into out[0, cap). stops when the input is used up, the
+// output is full, or the image is complete; *used / *made say how far it got.
+// returns an enum bl_lz_status
+int bl_lz_run(bl_lz *z, const uint8_t *in, size_t n, size_t *used, uint8_t *out, size_t cap,
+              size_t *made);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_LZ_H
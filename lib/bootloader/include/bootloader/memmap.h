@@ -2,12 +2,14 @@
 // and sizes are the single system map, defined in modules/bootloader/memmap.c
 // (the STM32/APM's view - the FPGA/ACM bitstream is an asset it stores in QSPI).
 //
-// app model: two app IMAGES live in QSPI (slot 0 = last-known-good fallback,
-// slot 1 = newest/active, the update target). the bootloader copies the chosen
-// valid slot into a single fixed internal-flash EXEC region and jumps - so the
-// app is linked once (for the exec address) and the qspi->qspi slot rotation is
-// a plain copy, no relink. the bootloader itself at 0x08000000 is the golden
-// image (recovery); if no app slot validates, it stays resident.
+// app model: two app IMAGES live in QSPI, slots 0 and 1, A/B: a boot pointer in
+// the params slot (bootloader/boot_ptr.h) says which one is active, and an
+// update goes into the other one and flips the pointer - the image it replaces
+// stays put as the fallback. the bootloader copies the chosen valid slot into a
+// single fixed internal-flash EXEC region and jumps - so the app is linked once
+// (for the exec address) and either slot can hold it, no relink. the
+// bootloader itself at 0x08000000 is the golden image (recovery); if no app
+// slot validates, it stays resident.
 
 #ifndef BOOTLOADER_MEMMAP_H
 #define BOOTLOADER_MEMMAP_H
@@ -20,15 +22,28 @@ extern "C" {
 
 enum bl_slot {
   BL_SLOT_APP_EXEC = 0, // internal flash: where the chosen app runs, linked once
-  BL_SLOT_APP_0,        // qspi: app image fallback (last-known-good)
-  BL_SLOT_APP_1,        // qspi: app image active (newest; update target)
+  BL_SLOT_APP_0,        // qspi: app image A (active or fallback: the boot pointer)
+  BL_SLOT_APP_1,        // qspi: app image B
   BL_SLOT_BL_GOLDEN,    // qspi: recovery copy of the bootloader
   BL_SLOT_FPGA_ACTIVE,  // qspi: current fpga bitstream (.bin)
   BL_SLOT_FPGA_GOLDEN,  // qspi: recovery fpga bitstream
-  BL_SLOT_PARAMS,       // qspi: active-slot pointer + boot-confirmed flags
+  BL_SLOT_PARAMS,       // qspi: boot pointer, update progress, staging record
   BL_SLOT_COUNT,
 };
 
+// BL_SLOT_PARAMS layout (offsets into the slot, one 4KB sector each)
+#define BL_PARAMS_BOOT       0x0000U // boot pointer log (bootloader/boot_ptr.h)
+#define BL_PARAMS_RESUME_LOG 0x1000U // update progress log (bootloader/resume_log.h)
+#define BL_PARAMS_STAGED     0x2000U // what the exec region holds (bootloader/stage_rec.h)
+#define BL_PARAMS_BOOT_2     0x3000U // boot pointer log, second sector
+
+// the 4KB backup SRAM, which neither the bootloader nor the app links anything
+// into and the startup code leaves alone, so it keeps its contents across a
+// reset: what the two hand each other
+#define BL_TRACE_RAM      0x38800000U // boot trace, bootloader -> app (boot_trace.h)
+#define BL_UPDATE_REQ_RAM 0x38800400U // update request, app -> bootloader (update_req.h)
+#define BL_CONFIRM_RAM    0x38800420U // boot confirmation, both ways (confirm.h)
+
 typedef struct {
   uint32_t base;     // absolute address (internal flash or memory-mapped qspi)
   uint32_t size;     // bytes reserved for this slot
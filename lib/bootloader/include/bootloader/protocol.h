@@ -20,8 +20,35 @@ extern "C" {
 // largest payload a single frame carries
 #define BL_MAX_PAYLOAD  1024U
 
-// protocol version, bumped on any breaking change to this header
-#define BL_PROTO_VERSION 1U
+// protocol version, bumped on any breaking change to this header.
+// v2: windowed DATA transfer (BL_ACK + BL_ERR_SEQ naks, BL_MANIFEST_F_WINDOWED)
+// v3: stream-to-flash receiver - bl_ack.window changes per ack (0 = hold) and
+//     the receiver requires BL_MANIFEST_F_WINDOWED
+// v4: delta updates (BL_MANIFEST_F_DELTA, the base/image fields of bl_manifest,
+//     BL_ERR_BASE). a plain manifest may still stop after crc32
+// v5: compressed transport (BL_MANIFEST_F_LZ)
+// v6: resumable transfers (BL_RESUME, BL_MANIFEST_F_RESUME)
+// v7: link tuning (BL_LINK, BL_PROBE) - the session's DATA payload size may be
+//     lowered from BL_MAX_PAYLOAD, and the line rate changed, between sessions
+// v8: boot trace (BL_TRACE)
+// v9: bundles (BL_BUNDLE) - several images in one session, committed together
+// v10: channels (bl_frame_hdr.flags, enum bl_channel) - log text and telemetry
+//      from the board on the same line as the update
+#define BL_PROTO_VERSION 10U
+
+// smallest DATA payload BL_LINK can select (a power of two up to BL_MAX_PAYLOAD)
+#define BL_MIN_PAYLOAD  64U
+
+// most DATA frames a windowed receiver can track beyond its cumulative ack
+// (bounded by the bl_ack.sack bitmap width)
+#define BL_WINDOW_MAX   32U
+
+// most images one BL_BUNDLE can announce (the receiver holds each one's
+// manifest until the last is in)
+#define BL_BUNDLE_MAX   4U
+
+// period of the receiver's BL_TELEMETRY frames
+#define BL_TELEMETRY_MS 250U
 
 // frame types
 enum bl_frame_type {
@@ -33,6 +60,34 @@ enum bl_frame_type {
   BL_RESULT     = 0x06, // mcu->host: final verdict (payload: bl_result)
   BL_NAK        = 0x07, // mcu->host: something failed mid-stream (payload: bl_result)
   BL_ABORT      = 0x08, // either way: tear down the session
+  BL_ACK        = 0x09, // mcu->host: windowed DATA progress (payload: bl_ack)
+  BL_RESUME     = 0x0A, // host->mcu: how much of this image is already in the slot?
+                        // (payload: bl_manifest). mcu->host: the answer (bl_resume)
+  BL_LINK       = 0x0B, // host->mcu: change baud and/or DATA payload size (payload:
+                        // bl_link). mcu->host: what it agreed to, at the old baud
+  BL_PROBE      = 0x0C, // host->mcu: len > 0 is a test frame, counted; len 0 asks
+                        // for the count. mcu->host: the count (bl_probe)
+  BL_TRACE      = 0x0D, // host->mcu: no payload. mcu->host: the last boot that reached
+                        // the app, timed (bl_boot_trace, bootloader/boot_trace.h);
+                        // len 0 if none survived
+  BL_BUNDLE     = 0x0E, // host->mcu: the next bl_bundle.parts images are one update
+                        // (payload: bl_bundle). mcu->host: the same, parts 0 if refused
+
+  // the frames of the other channels (enum bl_channel). numbered apart from
+  // the update's, so a peer that never looks at flags drops them as unknown
+  BL_LOG        = 0x40, // BL_CH_LOG: one line of console text (no newline, no NUL)
+  BL_TELEMETRY  = 0x41, // BL_CH_TELEMETRY: the receiver's state (payload: bl_telemetry)
+};
+
+// bl_frame_hdr.flags: the channel a frame belongs to. everything in the update
+// protocol is BL_CH_UPDATE, which is all a v9 peer ever sends; a board sends on
+// the others only to a host whose HELLO said v10 or later, and ignores what it
+// receives on them
+enum bl_channel {
+  BL_CH_UPDATE    = 0,
+  BL_CH_LOG       = 1,
+  BL_CH_TELEMETRY = 2,
+  BL_CH_COUNT,
 };
 
 // which component an image targets - the mcu refuses a mismatched target
@@ -49,9 +104,10 @@ enum bl_status {
   BL_ERR_CRC        = 1, // a frame or the whole-image crc failed
   BL_ERR_TARGET     = 2, // manifest target not supported on this board
   BL_ERR_SIZE       = 3, // image larger than the destination slot
-  BL_ERR_SEQ        = 4, // out-of-order / missing frame
+  BL_ERR_SEQ        = 4, // out-of-order / missing frame (windowed: resend seq)
   BL_ERR_PROTO      = 5, // malformed frame or bad protocol version
   BL_ERR_FLASH      = 6, // write/erase/verify of the destination failed
+  BL_ERR_BASE       = 7, // delta: the installed image is not the patch's base
 };
 
 // frame header as it appears on the wire, immediately followed by payload[len]
@@ -60,7 +116,7 @@ enum bl_status {
 typedef struct {
   uint16_t sof;   // BL_SOF
   uint8_t  type;  // enum bl_frame_type
-  uint8_t  flags; // reserved, 0
+  uint8_t  flags; // enum bl_channel
   uint16_t seq;   // frame sequence, starts at 0
   uint16_t len;   // payload length, 0..BL_MAX_PAYLOAD
 } bl_frame_hdr;
@@ -75,20 +131,103 @@ typedef struct {
 typedef struct {
   uint32_t magic;      // BL_SOF-independent manifest magic (see mkupdate)
   uint16_t target;     // enum bl_target
-  uint16_t reserved;
+  uint16_t flags;      // BL_MANIFEST_F_* (0 = legacy stop-at-the-end stream)
   uint32_t version;    // image version (component-defined)
-  uint32_t length;     // total image byte count
-  uint32_t crc32;      // crc32 over the whole image
+  uint32_t length;     // total image byte count (delta/lz: bytes on the wire)
+  uint32_t crc32;      // crc32 over the whole image (delta/lz: over the wire bytes)
+  // BL_MANIFEST_F_DELTA / _LZ only - a plain manifest may end before these
+  uint32_t base_crc32;   // delta: crc32 of the installed image the patch applies to
+  uint32_t image_length; // byte count of the image the slot receives
+  uint32_t image_crc32;  // crc32 of that image
 } bl_manifest;
 
+// a plain (v2/v3) manifest ends after crc32
+#define BL_MANIFEST_MIN_LEN 20U
+
 // BL_RESULT / BL_NAK payload
 typedef struct {
   uint16_t status;     // enum bl_status
-  uint16_t reserved;
+  uint16_t seq;        // BL_ERR_SEQ: the missing DATA seq to resend, else 0
   uint32_t bytes;      // bytes accepted so far
 } bl_result;
+
+// BL_RESUME answer
+typedef struct {
+  uint32_t offset;     // image bytes already in the slot from an interrupted
+                       // transfer of the same image (a sector multiple); 0 = none
+} bl_resume;
+
+// BL_LINK request / answer. a request's 0 fields keep the current setting. the
+// answer's baud is the rate the mcu switches to right after sending it (0 = it
+// stays; a refused rate is answered 0 too), its payload the DATA payload size
+// now in effect. a switched mcu falls back to the old rate unless an intact
+// frame arrives at the new one within BL_LINK_TRIAL_MS
+typedef struct {
+  uint32_t baud;
+  uint16_t payload;    // a power of two, BL_MIN_PAYLOAD..BL_MAX_PAYLOAD
+  uint16_t reserved;   // 0
+} bl_link;
+
+#define BL_LINK_TRIAL_MS 250U
+
+// BL_PROBE answer: test frames since the last report (which resets both)
+typedef struct {
+  uint16_t got;        // BL_PROBE frames with a payload that arrived intact
+  uint16_t bad;        // frames of any type dropped for a bad crc or length
+} bl_probe;
+
+// BL_BUNDLE request / answer. each image then goes MANIFEST -> DATA.. -> DONE
+// as on its own and gets its RESULT, but the session stays open for the next
+// one, and no image is committed (bl_session_ops.commit) until the last has
+// verified: the last RESULT is the bundle's verdict. a failed image ends the
+// session with nothing committed
+typedef struct {
+  uint16_t parts;      // 2..BL_BUNDLE_MAX
+  uint16_t reserved;   // 0
+} bl_bundle;
+
+// BL_TELEMETRY payload: what the receiver is doing, sent every
+// BL_TELEMETRY_MS while a session is open
+typedef struct {
+  uint32_t ms;         // since the session started
+  uint32_t bytes;      // DATA bytes accepted for the current image
+  uint32_t frames;     // intact frames received in the session
+  uint16_t bad;        // frames dropped for a bad crc or length in the session
+  uint8_t  window;     // the window the last ack advertised
+  uint8_t  busy;       // 1 while flash work holds the window shut
+} bl_telemetry;
+
+// BL_ACK payload - cumulative + selective ack for windowed DATA
+typedef struct {
+  uint16_t next;       // every DATA seq before this has been received
+  uint16_t window;     // frames the receiver accepts in [next, next+window).
+                       // may grow or shrink between acks; 0 = accepted, hold
+  uint32_t sack;       // bit i set: seq next+1+i already received
+} bl_ack;
 #pragma pack(pop)
 
+// bl_manifest.flags
+//   WINDOWED: DATA seq n carries image bytes [n*chunk, n*chunk+len) where chunk
+//   is the session payload size (min of both sides' bl_hello.max_payload, or
+//   what BL_LINK set since). the receiver acks with BL_ACK, naks a gap with
+//   BL_NAK/BL_ERR_SEQ, and the host keeps up to bl_ack.window frames in
+//   flight, resending only what was lost.
+#define BL_MANIFEST_F_WINDOWED 0x0001U
+//   DELTA: the DATA frames carry a patch (bootloader/delta.h) against the image
+//   installed for the target, identified by base_crc32. the receiver checks the
+//   base before opening the window (BL_ERR_BASE if it differs), rebuilds the
+//   new image into the slot as the patch arrives, and judges it by image_crc32.
+//   requires WINDOWED.
+//   LZ: the DATA frames carry the image compressed (bootloader/lz.h); the
+//   receiver decompresses as they arrive. requires WINDOWED, excludes DELTA.
+//   RESUME: continue an interrupted transfer of this image from the offset
+//   BL_RESUME reported. the receiver skips the slot preparation, and its first
+//   ack has next = offset / chunk; if its progress log no longer matches the
+//   image it starts over and the ack says 0. plain (not DELTA/LZ) images only.
+#define BL_MANIFEST_F_DELTA    0x0002U
+#define BL_MANIFEST_F_LZ       0x0004U
+#define BL_MANIFEST_F_RESUME   0x0008U
+
 // manifest magic (spells "SMUP" - signalmesh update)
 #define BL_MANIFEST_MAGIC 0x50554D53U
 
@@ -0,0 +1,72 @@
+// transfer progress log for resumable updates: one 4KB NOR sector (in the
+// params slot) that says which image is being streamed into a slot and how much
+// of it is safely programmed. it is append-only between erases, so progress
+// costs one small page program per committed sector and no erase:
+//
+//   record 0     head: which image, from its manifest
+//                { 'SMRH', crc32, length, target | flags << 16 }
+//   record 1..   mark: { 'SMRK', done, crc, check }
+//                done  = image bytes programmed (a sector multiple)
+//                crc   = running crc32 (not finalised) of image [0, done)
+//                check = crc32 of the head and the mark's first 12 bytes
+//
+// the first program writes the head and the first mark together (both sit in
+// the first page), so a head is never trusted on its own. the scan stops at the
+// first erased or torn record and keeps the last mark that checks out - a power
+// cut mid-program costs at most the sector it was logging. a full log stops
+// advancing (256 records: the head and one mark per sector of a 1MB slot).
+//
+// only STARTS flash operations (like flash_stream.h); reads are blocking and
+// expect the part idle.
+
+#ifndef BOOTLOADER_RESUME_LOG_H
+#define BOOTLOADER_RESUME_LOG_H
+
+#include <stdint.h>
+
+#include "bootloader/flash_stream.h"
+#include "bootloader/protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_RLOG_HEAD_MAGIC 0x48524D53U // 'SMRH'
+#define BL_RLOG_MARK_MAGIC 0x4B524D53U // 'SMRK'
+
+typedef struct {
+  uint32_t magic;
+  uint32_t a; // head: manifest crc32     mark: done
+  uint32_t b; // head: manifest length    mark: crc
+  uint32_t c; // head: target | flags<<16 mark: check
+} bl_rlog_rec;
+
+#define BL_RLOG_RECS (BL_NOR_SECTOR / sizeof(bl_rlog_rec))
+
+typedef struct {
+  const bl_nor *nor;
+  uint32_t off;     // device offset of the log sector
+  bl_rlog_rec head; // the image the log is about
+  uint32_t n;       // records in the log, head included (0 = empty)
+  uint32_t done;    // image bytes the last good mark vouches for
+  uint32_t crc;     // running crc32 of image [0, done)
+} bl_rlog;
+
+// read the log at `off`. returns 0 with done/crc set if it is about the image
+// `m` describes and has a good mark, else -1 (done = 0)
+int bl_rlog_open(bl_rlog *l, const bl_nor *nor, uint32_t off, const bl_manifest *m);
+
+// start over for the image `m` describes: starts the sector erase. returns 0, or
+// negative on a flash error
+int bl_rlog_reset(bl_rlog *l, const bl_nor *nor, uint32_t off, const bl_manifest *m);
+
+// log that image [0, done) is programmed and its running crc32 is `crc`: starts
+// one page program (the head too, on the first mark). the part must be idle.
+// returns 0 if started, 1 if the log is full (nothing to do), negative on error
+int bl_rlog_mark(bl_rlog *l, uint32_t done, uint32_t crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_RESUME_LOG_H
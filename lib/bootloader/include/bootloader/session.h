@@ -0,0 +1,165 @@
+// one firmware-update session on the receive side (MANIFEST -> DATA.. -> DONE),
+// independent of the transport and the flash part so the same code runs in the
+// bootloader and in host tests. received bytes go through the span parser; DATA
+// is placed by seq straight into the flash staging buffers (flash_stream.h),
+// which are programmed while the rest of the image is still arriving - no RAM
+// copy of the image. the ack window the host sees is the smaller of the
+// receive window and what the staging buffers can take, so a sender can never
+// outrun the flash. the verdict at DONE comes from a readback of the slot.
+//
+// needs a windowed sender (BL_MANIFEST_F_WINDOWED): a plain stream cannot be
+// held off while the flash catches up, so it is refused with BL_ERR_PROTO.
+//
+// a delta session (BL_MANIFEST_F_DELTA) carries a patch instead (delta.h), an
+// lz session (BL_MANIFEST_F_LZ) the image compressed (lz.h). either has to be
+// decoded in order, so DATA lands in a small ring of frames instead; the
+// decoder drains the ring in order (a patch reads the installed image from the
+// part between flash operations) and stages the image as above. the window is
+// whatever the ring has free.
+//
+// a plain session can be resumed (BL_RESUME, BL_MANIFEST_F_RESUME): with a log
+// sector from the board it keeps a progress log (resume_log.h) - reset at every
+// manifest, one mark per programmed sector - and a transfer cut off by a stall
+// or a reset continues from the last mark instead of from byte zero.
+//
+// between sessions the host may tune the link (BL_LINK, BL_PROBE): lower the
+// DATA payload size, and - if the board can - move to another baud, which the
+// board falls back from unless it hears an intact frame at the new rate. test
+// frames are counted, along with the frames the parser dropped, so the host
+// can measure the error rate at each step. BL_TRACE, at any time, is answered
+// with the board's boot trace.
+//
+// only BL_CH_UPDATE frames reach the session: the board's log and telemetry
+// channels (protocol.h, bl_channel) go the other way, and the board's loop
+// sends them between the session's own replies. bl_session_telemetry() fills
+// in the telemetry record.
+//
+// a bundle (BL_BUNDLE) is several sessions' worth of images in one: each is
+// received and verified as above and gets its RESULT, but its commit is held
+// until the last one has verified, and the session ends only after that one
+// (or at the first that fails, with nothing committed). two images of a
+// bundle may not share a target - they would share a slot.
+
+#ifndef BOOTLOADER_SESSION_H
+#define BOOTLOADER_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bootloader/boot_trace.h"
+#include "bootloader/delta.h"
+#include "bootloader/flash_stream.h"
+#include "bootloader/frame.h"
+#include "bootloader/lz.h"
+#include "bootloader/protocol.h"
+#include "bootloader/resume_log.h"
+#include "bootloader/window.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the board side of a session
+typedef struct {
+  void *ctx;
+  // send one framed reply to the host
+  void (*send)(void *ctx, uint8_t type, const void *pl, uint16_t len);
+  // resolve a manifest target to its slot (device offset + size); 0 if known
+  int (*slot)(void *ctx, uint16_t target, uint32_t *dev_off, uint32_t *size);
+  // an accepted manifest, before its slot is touched (e.g. make room for the
+  // image). may take a while: the host is held at window 0
+  void (*prepare)(void *ctx, const bl_manifest *m);
+  // optional: called while waiting on the flash at DONE (NULL = spin)
+  void (*idle)(void *ctx);
+  // optional: where the installed image a delta for `target` applies to sits
+  // once prepare has run (device offset + byte count); 0 if there is one. NULL
+  // = no delta updates
+  int (*base)(void *ctx, uint16_t target, uint32_t *dev_off, uint32_t *len);
+  // optional: device offset of a 4KB sector for the progress log; 0 if there
+  // is one. NULL = transfers are not resumable
+  int (*log)(void *ctx, uint32_t *dev_off);
+  // optional: switch the line to `baud` once the reply now being sent is out
+  // (and back unless an intact frame follows within BL_LINK_TRIAL_MS); 0 if it
+  // will. NULL = the baud is fixed
+  int (*set_baud)(void *ctx, uint32_t baud);
+  // optional: the image checked out at DONE (transfer crc and readback), before
+  // the verdict goes out - e.g. point the boot at it (in a bundle: every image,
+  // in order, at the last one's DONE). 0 if done; otherwise the verdict is
+  // BL_ERR_FLASH. NULL = nothing to do
+  int (*commit)(void *ctx, const bl_manifest *m);
+  // optional: the boot trace a BL_TRACE asks for (boot_trace.h), NULL if there
+  // is none. NULL = BL_TRACE is answered empty
+  const bl_boot_trace *(*trace)(void *ctx);
+} bl_session_ops;
+
+// DATA frames a delta/lz session holds (its window)
+#define BL_DECODE_RING 8U
+
+// how a session's DATA becomes the image
+enum bl_codec {
+  BL_CODEC_PLAIN = 0, // DATA is the image
+  BL_CODEC_DELTA = 1, // a patch against the installed image
+  BL_CODEC_LZ    = 2, // the image, compressed
+};
+
+typedef struct {
+  const bl_session_ops *ops;
+  const bl_nor *nor;
+  bl_frame_rx rx;
+  bl_manifest manifest;
+  int have_manifest;
+  uint32_t recv;     // DATA bytes received (image, or patch)
+  uint16_t status;   // enum bl_status of the last verdict
+  int answered;      // status is a DONE's verdict: a DONE again (its RESULT was
+                     //   lost) gets it again, until the next MANIFEST or BUNDLE
+  bl_rxwin win;
+  int ack_due;       // state moved since the last BL_ACK
+  uint16_t adv;      // window in the last BL_ACK
+  bl_fstream fs;
+  bl_rlog log;
+  int logging;        // plain session with a progress log: mark each sector
+  uint32_t logged;    //   sectors marked (fs.lo at the last mark)
+  uint8_t codec;      // enum bl_codec
+  uint16_t chunk;     // DATA payload size (BL_MAX_PAYLOAD unless BL_LINK lowered it)
+  uint32_t frames;    // intact frames parsed, any type
+  uint16_t bad;       // frames the parser dropped (BL_TELEMETRY; probe.bad is per report)
+  bl_probe probe;     // BL_PROBE counts since the last report
+  // delta/lz sessions only
+  uint32_t base_off;  // delta: device offset of the installed image
+  uint16_t dseq;      // oldest frame not yet decoded, ring[dseq % RING]
+  uint16_t dpos;      //   bytes of it decoded
+  uint32_t pcrc;      // running crc32 of the decoded DATA
+  union {
+    bl_delta delta;
+    bl_lz lz;
+  } dec;
+  uint8_t ring[BL_DECODE_RING][BL_MAX_PAYLOAD];
+  // bundles only
+  uint8_t parts;      // images the bundle announced (0 = not in one)
+  uint8_t nheld;      //   of them verified, their commit held for the last
+  bl_manifest held[BL_BUNDLE_MAX];
+} bl_session;
+
+void bl_session_init(bl_session *s, const bl_session_ops *ops, const bl_nor *nor);
+
+// feed a run of received bytes. returns 1 once the session is over (RESULT, or
+// a NAK that ends it, has been sent - in a bundle, the last image's), else 0.
+// keep feeding after it until the line goes quiet: a host whose RESULT was
+// lost sends the DONE again and is answered with the same verdict
+int bl_session_feed(bl_session *s, const uint8_t *p, size_t n);
+
+// call between received chunks and whenever the link is idle: starts the next
+// flash operation if the part is free (a delta/lz session decodes what it can
+// first) and sends a BL_ACK if one is due (one per call at most). returns 1
+// while flash work is outstanding, 0 when idle, -1 if a flash error or a bad
+// patch ended the session (BL_NAK/BL_ERR_FLASH or BL_ERR_PROTO sent)
+int bl_session_poll(bl_session *s);
+
+// the session's state as a BL_TELEMETRY record, `ms` into it
+void bl_session_telemetry(const bl_session *s, uint32_t ms, bl_telemetry *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_SESSION_H
@@ -0,0 +1,82 @@
+// stage an image into internal flash in one streaming pass: the source (the
+// memory-mapped QSPI slot) is read a little ahead into a ring, crc'd as it
+// arrives, and programmed a flash word at a time, with each sector erased just
+// before its first word. each word is crc'd back out of flash as soon as its
+// program completes. reading and crc work run while the flash is busy, so the
+// copy takes about as long as the flash work alone - not a validate pass over
+// QSPI, then the erase and program, then a verify pass over flash.
+//
+// the flash ops only START an operation (like bl_nor in flash_stream.h): erase
+// and program run in the part while the pipeline reads on, and one operation
+// is in flight at a time (erase and program share the bank). both crcs are
+// checked against the header's at the end; a source mismatch means the slot
+// was bad and what went into flash is garbage. with the image's block crc table
+// (image.h) each block is checked as soon as it is read and as soon as it is
+// programmed, so a bad slot stops the copy at its first bad block - before the
+// erases of the sectors past it.
+
+#ifndef BOOTLOADER_STAGE_PIPE_H
+#define BOOTLOADER_STAGE_PIPE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_IFLASH_SECTOR 0x20000U // H7: 128KB erase sectors
+#define BL_IFLASH_WORD   32U      // H7: 256-bit program granule
+#define BL_STAGE_RING    4096U    // source read ahead of the programming
+#define BL_STAGE_READ    32U      // source read granule, one word: at the APM's
+                                  // QSPI clock that takes as long as its program,
+                                  // so a longer read leaves the flash idle
+
+// the destination (offsets into the region). erase and program start the
+// operation and return; busy: 1 = busy, 0 = idle, negative = the last one
+// failed. all others return 0, or negative on error
+typedef struct {
+  void *ctx;
+  int (*erase)(void *ctx, uint32_t off);                      // the sector at off
+  int (*program)(void *ctx, uint32_t off, const uint8_t *w);  // one BL_IFLASH_WORD
+  int (*busy)(void *ctx);
+  const uint8_t *map; // the region, readable: programmed words are crc'd here
+} bl_iflash;
+
+// the source image (offsets into the image). blocking; 0 or negative
+typedef struct {
+  void *ctx;
+  int (*read)(void *ctx, uint32_t off, uint8_t *p, uint32_t n);
+} bl_stage_src;
+
+typedef struct {
+  uint32_t length;
+  uint32_t read;    // source bytes in (crc'd), ring holds [prog, read)
+  uint32_t prog;    // bytes handed to program
+  uint32_t done;    // bytes programmed and crc'd back
+  uint32_t erased;  // region bytes erased (or erasing)
+  uint32_t src_crc; // running, over [0, read)
+  uint32_t dst_crc; // running, over [0, done)
+  const uint32_t *blocks; // block crc table (NULL: none)
+  uint32_t block_size;
+  uint32_t src_blk; // running, over the block being read
+  uint32_t dst_blk; // running, over the block being programmed
+  uint32_t erases;
+  uint32_t words;
+  int pending;      // operation in flight
+  uint8_t ring[BL_STAGE_RING];
+} bl_stage_pipe;
+
+// copy `length` bytes of `src` to the start of `fl`'s region, and check both
+// copies against `image_crc32` - and block by block against `blocks` (from
+// bl_image_blocks, `block_size` bytes each; NULL: none). returns 0, -1 on a
+// flash error, -2 on a source read error, -3 if the source's crc is wrong, -4
+// if the flash copy's is
+int bl_stage_pipe_run(bl_stage_pipe *sp, const bl_iflash *fl, const bl_stage_src *src,
+                      uint32_t length, uint32_t image_crc32, const uint32_t *blocks,
+                      uint32_t block_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_STAGE_PIPE_H
@@ -0,0 +1,62 @@
+// staging record: which image the internal-flash exec region was last staged
+// from, so a boot that would copy the same image again can jump straight to it.
+// one record in its own params sector (BL_PARAMS_STAGED), written only after a
+// staging run verified, and erased before the next one touches the exec region:
+//
+//   { 'BSTG', target, slot, version, length, image_crc32, crc }
+//   crc = crc32 of the record's first 24 bytes
+//
+// a match is on the image (target, version, length, crc), not on the slot it
+// came from - the same image sent again lands in the other slot, and the exec
+// copy is still good for it. a record is only a reason to look: the skip
+// also needs the exec region's crc to match (a debugger may have flashed it
+// since). the record keeps that crc off a region a power cut left half
+// programmed - on the H7 a torn flash word reads back as a double ECC error and
+// a bus fault, not as a mismatch.
+
+#ifndef BOOTLOADER_STAGE_REC_H
+#define BOOTLOADER_STAGE_REC_H
+
+#include <stdint.h>
+
+#include "bootloader/image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_STAGE_REC_MAGIC 0x47545342U // 'BSTG'
+
+typedef struct {
+  uint32_t magic;       // BL_STAGE_REC_MAGIC
+  uint16_t target;      // from the slot's image header
+  uint16_t slot;        // enum bl_slot it was copied from (reported, not matched)
+  uint32_t version;
+  uint32_t length;
+  uint32_t image_crc32;
+  uint32_t crc;         // crc32 of the fields above
+} bl_stage_rec;
+
+enum bl_stage_plan {
+  BL_STAGE_SKIP = 0,    // exec already holds the image: jump
+  BL_STAGE_COPY = 1,    // erase, program and verify exec first
+  BL_STAGE_TOO_BIG = -1 // the image does not fit the exec region
+};
+
+// fill `r` for the image header `h` was staged from `slot`
+void bl_stage_rec_make(bl_stage_rec *r, const bl_image_header *h, uint16_t slot);
+
+// 1 if `r` is an intact record (magic and crc), else 0
+int bl_stage_rec_ok(const bl_stage_rec *r);
+
+// what booting the image `h` describes takes, given the record `rec` and the
+// exec region at `exec` (`exec_size` bytes). reads exec only if the record is
+// intact and about that image
+enum bl_stage_plan bl_stage_plan(const bl_stage_rec *rec, const bl_image_header *h,
+                                 const void *exec, uint32_t exec_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_STAGE_REC_H
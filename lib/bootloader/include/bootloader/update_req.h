@@ -0,0 +1,82 @@
+// update request: how the running app asks the bootloader for update mode, so
+// a boot that nobody asked about goes straight to the app instead of waiting
+// out a listen window for a host that almost never comes.
+//
+// the app (on a HELLO on its own UART, a command, ...) writes a request into
+// the backup SRAM word the bootloader reads at reset (BL_UPDATE_REQ_RAM,
+// memmap.h) and resets itself:
+//
+//   bl_update_req_set((bl_update_req *)BL_UPDATE_REQ_RAM, BL_REQ_HOST);
+//   NVIC_SystemReset();
+//
+//   { 'UPRQ', reason, ~reason, ~magic }
+//
+// the bootloader decides from the request and the reset cause, and clears the
+// request whatever it decides - it is good for one boot:
+//
+//   request, software reset  -> update mode now, BL_REQ_LISTEN_MS for the host
+//   pin reset (the button)   -> the old listen window, BL_PIN_LISTEN_MS: the
+//                               way in for a host when the app cannot ask
+//   anything else            -> no window: power-on, a watchdog, or a request
+//                               left from before some other reset (stale)
+//
+// with no app to boot the bootloader listens for good (bl_main's golden loop),
+// so skipping the window never locks a host out of a board without an app.
+
+#ifndef BOOTLOADER_UPDATE_REQ_H
+#define BOOTLOADER_UPDATE_REQ_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BL_REQ_MAGIC      0x51525055U // 'UPRQ'
+#define BL_REQ_LISTEN_MS  30000U      // asked for: the host is waiting on the reset
+#define BL_PIN_LISTEN_MS  5000U       // reset button: the window every boot used to get
+
+// why the app asked (reported on the console and in the boot trace)
+enum bl_req_reason {
+  BL_REQ_NONE    = 0,
+  BL_REQ_HOST    = 1, // a HELLO arrived on the app's UART
+  BL_REQ_COMMAND = 2, // a command (console, control message) asked for it
+  BL_REQ_APP     = 3, // the app's own reasons from here on
+};
+
+// the reset that started this boot, as the bootloader reads it (RCC_RSR)
+enum bl_reset_cause {
+  BL_RESET_POWER    = 0, // power-on or brown-out: backup SRAM is garbage
+  BL_RESET_PIN      = 1, // NRST, the reset button or a debugger
+  BL_RESET_SOFTWARE = 2, // NVIC_SystemReset
+  BL_RESET_WATCHDOG = 3, // IWDG/WWDG
+  BL_RESET_OTHER    = 4,
+};
+
+typedef struct {
+  uint32_t magic;     // BL_REQ_MAGIC
+  uint16_t reason;    // enum bl_req_reason
+  uint16_t nreason;   // ~reason
+  uint32_t nmagic;    // ~BL_REQ_MAGIC
+} bl_update_req;
+
+// what this boot does before the cascade
+typedef struct {
+  uint32_t listen_ms; // the update window (0 = straight to the app)
+  uint16_t reason;    // the request it honours (BL_REQ_NONE: none)
+  uint8_t stale;      // 1 if a request was there but not honoured
+} bl_boot_plan;
+
+// app side: ask the next boot for update mode (then reset). returns with the
+// request out of the D-cache and in the SRAM
+void bl_update_req_set(bl_update_req *r, uint16_t reason);
+
+// bootloader side: plan this boot from the request word and the reset cause,
+// and clear the word
+void bl_update_req_take(bl_update_req *r, enum bl_reset_cause cause, bl_boot_plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_UPDATE_REQ_H
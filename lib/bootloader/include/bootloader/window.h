@@ -0,0 +1,52 @@
+// receive-side bookkeeping for windowed DATA transfers (BL_MANIFEST_F_WINDOWED).
+// tracks the cumulative ack point plus a bitmap of frames that arrived ahead of
+// it, so a corrupted frame costs one resend instead of the whole image. the
+// caller places accepted payloads itself (seq * chunk) - this only decides what
+// is new, what is a duplicate, and which gap to nak. no allocation.
+
+#ifndef BOOTLOADER_WINDOW_H
+#define BOOTLOADER_WINDOW_H
+
+#include <stdint.h>
+
+#include "bootloader/protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bl_win_status {
+  BL_WIN_NEW     = 0, // first copy of this seq: store the payload
+  BL_WIN_DUP     = 1, // already have it (resend raced an ack): drop, re-ack
+  BL_WIN_OUTSIDE = 2, // beyond the advertised window: drop, re-ack
+};
+
+typedef struct {
+  uint16_t next;     // cumulative: every seq before this has arrived
+  uint16_t size;     // window in frames, 1..BL_WINDOW_MAX
+  uint32_t sack;     // bit i set: seq next+1+i has arrived
+  uint16_t nak_seq;  // gap already nak'd (one nak per hole)
+  uint8_t  nak_sent;
+} bl_rxwin;
+
+void bl_rxwin_init(bl_rxwin *w, uint16_t size);
+
+// account for a crc-valid DATA frame; returns an enum bl_win_status
+int bl_rxwin_accept(bl_rxwin *w, uint16_t seq);
+
+// 1 if seq is inside the window and not received yet - i.e. a payload for it may
+// be written to its slot before its crc is checked. does not change state
+int bl_rxwin_want(const bl_rxwin *w, uint16_t seq);
+
+// returns 1 (and the first missing seq) if frames arrived past a hole that has
+// not been nak'd yet; 0 otherwise
+int bl_rxwin_gap(bl_rxwin *w, uint16_t *missing);
+
+// fill a BL_ACK payload with the current state
+void bl_rxwin_ack(const bl_rxwin *w, bl_ack *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOTLOADER_WINDOW_H
@@ -0,0 +1,26 @@
+// writes into the backup SRAM that have to outlive the reset after them. the
+// M7's D-cache holds that SRAM write-back, so a word still in the cache at the
+// reset is lost with it: a setter cleans its word out to the SRAM and waits for
+// the write before it returns. the host builds (tools/fw_update tests) have no
+// cache to clean.
+
+#ifndef BOOTLOADER_BACKUP_RAM_H
+#define BOOTLOADER_BACKUP_RAM_H
+
+#include <stdint.h>
+
+#if defined(__arm__)
+#include "hal.h"
+
+static inline void bl_backup_flush(const volatile void *p, uint32_t n) {
+  SCB_CleanDCache_by_Addr((uint32_t *)(uintptr_t)p, (int32_t)n);
+  __DSB();
+}
+#else
+static inline void bl_backup_flush(const volatile void *p, uint32_t n) {
+  (void)p;
+  (void)n;
+}
+#endif
+
+#endif // BOOTLOADER_BACKUP_RAM_H
@@ -0,0 +1,123 @@
+#include "bootloader/boot_ptr.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "bootloader/crc32.h"
+
+#define READ_RECS (BL_NOR_PAGE / sizeof(bl_boot_rec)) // records per read
+
+static uint32_t rec_crc(const bl_boot_rec *r) {
+  return bl_crc32(r, offsetof(bl_boot_rec, crc));
+}
+
+static int rec_ok(const bl_boot_rec *r) {
+  return r->magic == BL_BOOT_REC_MAGIC && r->crc == rec_crc(r) && r->active <= 1U &&
+         r->confirmed <= 1U;
+}
+
+static int rec_erased(const bl_boot_rec *r) {
+  const uint8_t *p = (const uint8_t *)r;
+  for (unsigned i = 0; i < sizeof(*r); i++) {
+    if (p[i] != 0xFFU) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int wait_idle(const bl_nor *nor) {
+  int busy;
+  while ((busy = nor->busy(nor->ctx)) == 1) {
+  }
+  return busy;
+}
+
+int bl_boot_open(bl_boot *b, const bl_nor *nor, uint32_t off0, uint32_t off1) {
+  uint32_t used[2] = {0U, 0U};
+  memset(b, 0, sizeof(*b));
+  b->nor = nor;
+  b->off[0] = off0;
+  b->off[1] = off1;
+  b->cur.active = 1U; // no record: the fixed layout, slot 1 active
+  b->cur.confirmed = 1U;
+  if (wait_idle(nor) != 0) {
+    return -1;
+  }
+  int found = 0;
+  for (uint32_t s = 0; s < 2U; s++) {
+    for (uint32_t i = 0; i < BL_BOOT_RECS; i += READ_RECS) {
+      bl_boot_rec r[READ_RECS];
+      if (nor->read(nor->ctx, b->off[s] + i * sizeof(bl_boot_rec), (uint8_t *)r, sizeof(r)) != 0) {
+        b->n = used[b->sec];
+        return -1;
+      }
+      for (uint32_t k = 0; k < READ_RECS; k++) {
+        if (rec_erased(&r[k])) {
+          continue;
+        }
+        used[s] = i + k + 1U;
+        if (rec_ok(&r[k]) && (!found || r[k].seq > b->cur.seq)) {
+          b->cur = r[k];
+          b->sec = s;
+          found = 1;
+        }
+      }
+    }
+  }
+  b->n = used[b->sec];
+  return 0;
+}
+
+// append the next state; a full sector moves the log to the other one
+static int put(bl_boot *b, uint8_t active, uint8_t confirmed, uint8_t tries) {
+  const bl_nor *nor = b->nor;
+  bl_boot_rec r = {BL_BOOT_REC_MAGIC, b->cur.seq + 1U, active, confirmed, tries, 0xFFU, 0U};
+  r.crc = rec_crc(&r);
+  if (b->n >= BL_BOOT_RECS) {
+    uint32_t other = b->sec ^ 1U;
+    if (nor->erase(nor->ctx, b->off[other], BL_NOR_SECTOR) != 0 || wait_idle(nor) != 0) {
+      return -1;
+    }
+    b->sec = other;
+    b->n = 0U;
+  }
+  uint32_t at = b->off[b->sec] + b->n * sizeof(r);
+  b->n++; // taken, even if the program fails part way
+  if (nor->program(nor->ctx, at, (const uint8_t *)&r, sizeof(r)) != 0 || wait_idle(nor) != 0) {
+    return -1;
+  }
+  b->cur = r;
+  return 0;
+}
+
+int bl_boot_begin(bl_boot *b, int count, unsigned *first) {
+  const bl_boot_rec *c = &b->cur;
+  *first = c->active;
+  if (c->confirmed) {
+    return 0;
+  }
+  if (c->tries >= BL_BOOT_TRIES) {
+    *first = c->active ^ 1U; // given up: back to the other slot
+    return put(b, (uint8_t)*first, 1U, 0U);
+  }
+  if (!count) {
+    return 0;
+  }
+  return put(b, c->active, 0U, (uint8_t)(c->tries + 1U));
+}
+
+int bl_boot_booted(bl_boot *b, unsigned slot) {
+  if (b->cur.active == slot && b->cur.confirmed) {
+    return 0;
+  }
+  return put(b, (uint8_t)slot, 1U, 0U);
+}
+
+unsigned bl_boot_update_slot(const bl_boot *b) {
+  return b->cur.active ^ 1U;
+}
+
+int bl_boot_install(bl_boot *b, unsigned slot) {
+  return put(b, (uint8_t)slot, 0U, 0U);
+}
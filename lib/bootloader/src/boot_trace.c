@@ -0,0 +1,84 @@
+#include "bootloader/boot_trace.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "bootloader/crc32.h"
+
+static uint32_t trace_crc(const bl_boot_trace *t) {
+  return bl_crc32(t, offsetof(bl_boot_trace, crc));
+}
+
+int bl_trace_check(const bl_boot_trace *t) {
+  if (t->magic != BL_TRACE_MAGIC || t->count > BL_TRACE_MARKS || t->crc != trace_crc(t)) {
+    return -1;
+  }
+  return 0;
+}
+
+void bl_trace_begin(bl_trace_area *a, uint32_t cpu_hz, uint32_t cycles) {
+  uint32_t boot = 1U;
+  if (bl_trace_check(&a->cur) == 0) {
+    boot = a->cur.boot + 1U;
+    if ((a->cur.flags & BL_TRACE_F_JUMPED) != 0U) {
+      a->last = a->cur;
+    }
+  } else if (bl_trace_check(&a->last) != 0) {
+    memset(&a->last, 0, sizeof(a->last)); // power-on: RAM holds garbage
+  }
+  memset(&a->cur, 0, sizeof(a->cur));
+  a->cur.magic = BL_TRACE_MAGIC;
+  a->cur.cpu_hz = cpu_hz;
+  a->cur.boot = boot;
+  bl_trace_mark(&a->cur, BL_TRACE_RESET, 0U, cycles);
+}
+
+void bl_trace_mark(bl_boot_trace *t, uint16_t phase, uint16_t arg, uint32_t cycles) {
+  if (t->count < BL_TRACE_MARKS) {
+    bl_trace_entry *m = &t->marks[t->count++];
+    m->cycles = cycles;
+    m->phase = phase;
+    m->arg = arg;
+  } else if (t->dropped < 0xFFU) {
+    t->dropped++;
+  }
+  if (phase == BL_TRACE_JUMP) {
+    t->flags |= BL_TRACE_F_JUMPED;
+  }
+  t->crc = trace_crc(t);
+}
+
+uint64_t bl_trace_span(const bl_boot_trace *t, unsigned i) {
+  if (i == 0U || i >= t->count) {
+    return 0U;
+  }
+  uint64_t span = t->marks[i].cycles - t->marks[i - 1U].cycles; // modulo 2^32
+  if (t->marks[i].phase == BL_TRACE_UPDATE) {
+    span += (uint64_t)((t->marks[i].arg & BL_TRACE_ARG_WRAPS) >> 8) << 32;
+  }
+  return span;
+}
+
+void bl_trace_clock_start(bl_trace_clock *c, const bl_boot_trace *t) {
+  c->last = (t->count != 0U) ? t->marks[t->count - 1U].cycles : 0U;
+  c->elapsed = 0U;
+}
+
+void bl_trace_clock_poll(bl_trace_clock *c, uint32_t cycles) {
+  c->elapsed += (uint32_t)(cycles - c->last);
+  c->last = cycles;
+}
+
+uint16_t bl_trace_clock_arg(const bl_trace_clock *c) {
+  uint64_t wraps = c->elapsed >> 32;
+  return (uint16_t)(((wraps < 0xFFU) ? wraps : 0xFFU) << 8);
+}
+
+const char *bl_trace_phase_name(uint16_t phase) {
+  static const char *const names[] = {"reset", "qspi", "update", "boot ptr",
+                                      "header", "stage", "jump", "fpga"};
+  if (phase < sizeof(names) / sizeof(names[0])) {
+    return names[phase];
+  }
+  return (phase >= BL_TRACE_APP) ? "app" : "?";
+}
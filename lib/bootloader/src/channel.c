@@ -0,0 +1,58 @@
+#include "bootloader/channel.h"
+
+#include <string.h>
+
+uint8_t bl_tx_class(uint8_t ch, uint8_t type) {
+  switch (ch) {
+    case BL_CH_UPDATE:
+      return (type == BL_DATA) ? (uint8_t)BL_TX_BULK : (uint8_t)BL_TX_CONTROL;
+    case BL_CH_LOG:
+      return BL_TX_LOG;
+    case BL_CH_TELEMETRY:
+      return BL_TX_TELEMETRY;
+    default:
+      return BL_TX_BULK;
+  }
+}
+
+void bl_sched_init(bl_sched *s) {
+  memset(s, 0, sizeof(*s));
+  s->quantum[BL_TX_CONTROL] = 1U;
+  s->quantum[BL_TX_LOG] = BL_SCHED_QUANTUM_LOG;
+  s->quantum[BL_TX_TELEMETRY] = BL_SCHED_QUANTUM_TELEMETRY;
+  s->quantum[BL_TX_BULK] = BL_SCHED_QUANTUM_BULK;
+  s->turn = BL_TX_LOG;
+}
+
+int bl_sched_pick(bl_sched *s, const uint32_t head[BL_TX_CLASSES]) {
+  if (head[BL_TX_CONTROL] != 0U) {
+    return BL_TX_CONTROL;
+  }
+  int any = 0;
+  for (unsigned c = BL_TX_LOG; c < BL_TX_CLASSES; c++) {
+    if (head[c] == 0U) {
+      s->deficit[c] = 0U;
+    } else {
+      any = 1;
+    }
+  }
+  if (!any) {
+    return -1;
+  }
+  // ends within a few rounds: a queued class gains its quantum every round
+  for (;;) {
+    uint8_t c = s->turn;
+    if (head[c] != 0U) {
+      if (!s->credited) {
+        s->deficit[c] += s->quantum[c];
+        s->credited = 1U;
+      }
+      if (head[c] <= s->deficit[c]) {
+        s->deficit[c] -= head[c];
+        return c;
+      }
+    }
+    s->turn = (uint8_t)((c + 1U < BL_TX_CLASSES) ? c + 1U : BL_TX_LOG);
+    s->credited = 0U;
+  }
+}
@@ -0,0 +1,35 @@
+#include "bootloader/confirm.h"
+
+#include "backup_ram.h"
+
+static uint32_t check(const bl_confirm *c) {
+  return ~(c->magic ^ c->slot ^ ((uint32_t)c->state << 16));
+}
+
+static void put(bl_confirm *c, uint16_t slot, uint16_t state) {
+  c->slot = slot;
+  c->state = state;
+  c->magic = BL_CONFIRM_MAGIC;
+  c->check = check(c);
+  bl_backup_flush(c, sizeof(*c));
+}
+
+void bl_confirm_arm(bl_confirm *c, unsigned slot) {
+  put(c, (uint16_t)slot, BL_CONFIRM_ARMED);
+}
+
+void bl_confirm_set(bl_confirm *c) {
+  if (c->magic == BL_CONFIRM_MAGIC && c->check == check(c) && c->state == BL_CONFIRM_ARMED) {
+    put(c, c->slot, BL_CONFIRM_UP);
+  }
+}
+
+int bl_confirm_take(bl_confirm *c, unsigned *slot) {
+  int up = c->magic == BL_CONFIRM_MAGIC && c->check == check(c) && c->state == BL_CONFIRM_UP &&
+           c->slot <= 1U;
+  *slot = c->slot;
+  c->magic = 0U;
+  c->check = 0U;
+  bl_backup_flush(c, sizeof(*c));
+  return up;
+}
@@ -0,0 +1,221 @@
+#include "bootloader/delta.h"
+
+#include <string.h>
+
+enum {
+  D_ADD,           // op header: varint add
+  D_INS,           //            varint insert
+  D_SEEK,          //            zigzag varint seek
+  D_SAME,          // add run:   varint same
+  D_CHANGED,       //            varint changed
+  D_SAME_BYTES,    // copying unchanged base bytes
+  D_CHANGED_BYTES, // base + patch byte
+  D_INS_BYTES,     // raw patch bytes
+  D_DONE,
+  D_BAD,
+};
+
+void bl_delta_init(bl_delta *d, uint32_t base_len, uint32_t out_len) {
+  memset(d, 0, sizeof(*d));
+  d->base_len = base_len;
+  d->out_len = out_len;
+  d->state = (out_len != 0U) ? D_ADD : D_DONE;
+}
+
+void bl_delta_base_loaded(bl_delta *d) {
+  d->base_off = d->want_off;
+  d->base_n = d->want_n;
+}
+
+// one varint byte (LEB128, up to 32 bits). 1 = complete (in d->v), 0 = more,
+// -1 = too long
+static int varint(bl_delta *d, uint8_t b) {
+  if (d->shift > 28U || (d->shift == 28U && (b & 0x70U) != 0U)) {
+    return -1;
+  }
+  d->v |= (uint32_t)(b & 0x7FU) << d->shift;
+  if ((b & 0x80U) != 0U) {
+    d->shift += 7U;
+    return 0;
+  }
+  d->shift = 0U;
+  return 1;
+}
+
+static void end_op(bl_delta *d) {
+  int64_t pos = (int64_t)d->pos + d->seek;
+  if (pos < 0 || pos > (int64_t)d->base_len) {
+    d->state = D_BAD;
+    return;
+  }
+  d->pos = (uint32_t)pos;
+  d->state = (d->out == d->out_len) ? D_DONE : D_ADD;
+}
+
+// what comes next inside the add part of an op (or after it)
+static void next_in_add(bl_delta *d) {
+  if (d->same != 0U) {
+    d->state = D_SAME_BYTES;
+  } else if (d->changed != 0U) {
+    d->state = D_CHANGED_BYTES;
+  } else if (d->add != 0U) {
+    d->state = D_SAME;
+  } else if (d->ins != 0U) {
+    d->state = D_INS_BYTES;
+  } else {
+    end_op(d);
+  }
+}
+
+// a complete varint in d->v for the current header state
+static void field(bl_delta *d) {
+  uint32_t v = d->v;
+  d->v = 0U;
+  uint32_t room = d->out_len - d->out;
+  switch (d->state) {
+    case D_ADD:
+      if (v > room || v > d->base_len - d->pos) {
+        d->state = D_BAD;
+        return;
+      }
+      d->add = v;
+      d->state = D_INS;
+      return;
+    case D_INS:
+      if (v > room - d->add) {
+        d->state = D_BAD;
+        return;
+      }
+      d->ins = v;
+      d->state = D_SEEK;
+      return;
+    case D_SEEK:
+      d->seek = (int32_t)(v >> 1) ^ -(int32_t)(v & 1U);
+      next_in_add(d);
+      return;
+    case D_SAME:
+      d->same = v;
+      d->state = D_CHANGED;
+      return;
+    default: // D_CHANGED
+      if (d->same > d->add || v > d->add - d->same || d->same + v == 0U) {
+        d->state = D_BAD;
+        return;
+      }
+      d->changed = v;
+      next_in_add(d);
+      return;
+  }
+}
+
+// base bytes available in the cache at the read position (0: load first)
+static uint32_t cached(const bl_delta *d) {
+  if (d->pos < d->base_off || d->pos >= d->base_off + d->base_n) {
+    return 0U;
+  }
+  return d->base_off + d->base_n - d->pos;
+}
+
+static uint32_t min3(uint32_t a, size_t b, size_t c) {
+  uint32_t m = (b < a) ? (uint32_t)b : a;
+  return (c < m) ? (uint32_t)c : m;
+}
+
+int bl_delta_run(bl_delta *d, const uint8_t *in, size_t n, size_t *used, uint8_t *out,
+                 size_t cap, size_t *made) {
+  size_t i = 0;
+  size_t o = 0;
+  int st = -1;
+  while (st < 0) {
+    uint32_t k;
+    switch (d->state) {
+      case D_DONE:
+        st = BL_DELTA_DONE;
+        break;
+      case D_BAD:
+        st = BL_DELTA_BAD;
+        break;
+
+      case D_SAME_BYTES:
+      case D_CHANGED_BYTES:
+        if (o == cap) {
+          st = BL_DELTA_FULL;
+          break;
+        }
+        if (d->state == D_CHANGED_BYTES && i == n) {
+          st = BL_DELTA_MORE;
+          break;
+        }
+        k = cached(d);
+        if (k == 0U) {
+          uint32_t left = d->base_len - d->pos;
+          d->want_off = d->pos;
+          d->want_n = (left < BL_DELTA_BASE_BUF) ? left : BL_DELTA_BASE_BUF;
+          st = BL_DELTA_BASE;
+          break;
+        }
+        {
+          const uint8_t *b = d->base_buf + (d->pos - d->base_off);
+          if (d->state == D_SAME_BYTES) {
+            k = min3(k, d->same, cap - o);
+            memcpy(out + o, b, k);
+            d->same -= k;
+          } else {
+            k = min3(k, d->changed, cap - o);
+            k = (n - i < k) ? (uint32_t)(n - i) : k;
+            for (uint32_t j = 0; j < k; j++) {
+              out[o + j] = (uint8_t)(b[j] + in[i + j]);
+            }
+            i += k;
+            d->changed -= k;
+          }
+        }
+        o += k;
+        d->pos += k;
+        d->add -= k;
+        d->out += k;
+        if (d->same == 0U && (d->state == D_SAME_BYTES || d->changed == 0U)) {
+          next_in_add(d);
+        }
+        break;
+
+      case D_INS_BYTES:
+        if (o == cap) {
+          st = BL_DELTA_FULL;
+          break;
+        }
+        if (i == n) {
+          st = BL_DELTA_MORE;
+          break;
+        }
+        k = min3(d->ins, cap - o, n - i);
+        memcpy(out + o, in + i, k);
+        i += k;
+        o += k;
+        d->ins -= k;
+        d->out += k;
+        if (d->ins == 0U) {
+          end_op(d);
+        }
+        break;
+
+      default: // a header or run varint
+        if (i == n) {
+          st = BL_DELTA_MORE;
+          break;
+        }
+        {
+          int r = varint(d, in[i++]);
+          if (r < 0) {
+            d->state = D_BAD;
+          } else if (r > 0) {
+            field(d);
+          }
+        }
+        break;
+    }
+  }
+  *used = i;
+  *made = o;
+  return st;
+}
@@ -0,0 +1,160 @@
+#include "bootloader/flash_stream.h"
+
+#include <string.h>
+
+#include "bootloader/crc32.h"
+
+static uint32_t nsectors(const bl_fstream *fs) {
+  return (fs->length + BL_NOR_SECTOR - 1U) / BL_NOR_SECTOR;
+}
+
+// bytes of image in sector s (the last one may be short)
+static uint32_t sector_len(const bl_fstream *fs, uint32_t s) {
+  uint32_t off = s * BL_NOR_SECTOR;
+  uint32_t left = fs->length - off;
+  return (left < BL_NOR_SECTOR) ? left : BL_NOR_SECTOR;
+}
+
+int bl_fstream_begin(bl_fstream *fs, const bl_nor *nor, uint32_t base, uint32_t length) {
+  if ((base % BL_NOR_SECTOR) != 0U) {
+    return -1;
+  }
+  fs->nor = nor;
+  fs->base = base;
+  fs->length = length;
+  fs->erased = 0U;
+  fs->lo = 0U;
+  fs->have[0] = 0U;
+  fs->have[1] = 0U;
+  fs->page = 0U;
+  fs->crc = BL_CRC32_INIT;
+  fs->err = 0;
+  return 0;
+}
+
+int bl_fstream_resume(bl_fstream *fs, uint32_t done, uint32_t crc) {
+  if ((done % BL_NOR_SECTOR) != 0U || done > fs->length) {
+    return -1;
+  }
+  // the sectors after `done` may hold a torn program: erase from there again
+  fs->lo = done / BL_NOR_SECTOR;
+  fs->erased = done;
+  fs->crc = crc;
+  return 0;
+}
+
+uint32_t bl_fstream_limit(const bl_fstream *fs) {
+  uint32_t end = (fs->lo + 2U) * BL_NOR_SECTOR;
+  return (end < fs->length) ? end : fs->length;
+}
+
+uint8_t *bl_fstream_slot(bl_fstream *fs, uint32_t off, uint32_t len) {
+  uint32_t s = off / BL_NOR_SECTOR;
+  if (len == 0U || s < fs->lo || off + len > bl_fstream_limit(fs) ||
+      (off + len - 1U) / BL_NOR_SECTOR != s) {
+    return NULL;
+  }
+  return fs->buf[s & 1U] + (off % BL_NOR_SECTOR);
+}
+
+int bl_fstream_write(bl_fstream *fs, uint32_t off, const uint8_t *p, uint32_t len) {
+  if (off < fs->lo * BL_NOR_SECTOR || off + len > bl_fstream_limit(fs)) {
+    return -1;
+  }
+  // a range may straddle the two staged sectors
+  while (len > 0U) {
+    uint32_t s = off / BL_NOR_SECTOR;
+    uint32_t in = off % BL_NOR_SECTOR;
+    uint32_t n = BL_NOR_SECTOR - in;
+    if (n > len) {
+      n = len;
+    }
+    uint8_t *dst = fs->buf[s & 1U] + in;
+    if (dst != p) {
+      memcpy(dst, p, n);
+    }
+    fs->have[s & 1U] += n;
+    off += n;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int bl_fstream_poll(bl_fstream *fs) {
+  const bl_nor *nor = fs->nor;
+  if (fs->err != 0) {
+    return fs->err;
+  }
+  int b = nor->busy(nor->ctx);
+  if (b != 0) {
+    if (b < 0) {
+      fs->err = -1;
+      return fs->err;
+    }
+    return 1;
+  }
+
+  uint32_t n_sec = nsectors(fs);
+  if (fs->lo >= n_sec) {
+    return 0; // everything programmed, part idle
+  }
+
+  // program first: it frees a staging buffer (and so the sender's window)
+  uint32_t slen = sector_len(fs, fs->lo);
+  uint32_t idx = fs->lo & 1U;
+  if (fs->have[idx] == slen && fs->erased >= (fs->lo + 1U) * BL_NOR_SECTOR) {
+    if (fs->page == 0U) {
+      fs->crc = bl_crc32_update(fs->crc, fs->buf[idx], slen); // sectors complete in order
+    }
+    uint32_t o = fs->page * BL_NOR_PAGE;
+    uint32_t n = (slen - o < BL_NOR_PAGE) ? (slen - o) : BL_NOR_PAGE;
+    if (nor->program(nor->ctx, fs->base + fs->lo * BL_NOR_SECTOR + o, fs->buf[idx] + o, n) != 0) {
+      fs->err = -2;
+      return fs->err;
+    }
+    fs->page++;
+    if (fs->page * BL_NOR_PAGE >= slen) {
+      fs->have[idx] = 0U;
+      fs->page = 0U;
+      fs->lo++;
+    }
+    return 1;
+  }
+
+  // otherwise erase ahead, in whole 64KB blocks where they fit inside the image
+  uint32_t end = n_sec * BL_NOR_SECTOR;
+  if (fs->erased < end) {
+    uint32_t at = fs->base + fs->erased;
+    uint32_t size = ((at % BL_NOR_BLOCK) == 0U && fs->erased + BL_NOR_BLOCK <= end)
+                        ? BL_NOR_BLOCK
+                        : BL_NOR_SECTOR;
+    if (nor->erase(nor->ctx, at, size) != 0) {
+      fs->err = -3;
+      return fs->err;
+    }
+    fs->erased += size;
+  }
+  return 1; // erasing, or waiting for the rest of sector lo
+}
+
+uint32_t bl_fstream_crc(const bl_fstream *fs) {
+  return bl_crc32_final(fs->crc);
+}
+
+uint32_t bl_fstream_raw_crc(const bl_fstream *fs) {
+  return fs->crc;
+}
+
+int bl_fstream_verify(bl_fstream *fs, uint32_t crc) {
+  const bl_nor *nor = fs->nor;
+  uint32_t c = BL_CRC32_INIT;
+  for (uint32_t off = 0; off < fs->length; off += BL_NOR_SECTOR) {
+    uint32_t n = (fs->length - off < BL_NOR_SECTOR) ? (fs->length - off) : BL_NOR_SECTOR;
+    if (nor->read(nor->ctx, fs->base + off, fs->buf[0], n) != 0) {
+      return -1;
+    }
+    c = bl_crc32_update(c, fs->buf[0], n);
+  }
+  return (bl_crc32_final(c) == crc) ? 0 : -2;
+}
@@ -0,0 +1,144 @@
+#include "bootloader/fpga_load.h"
+#include "bootloader/image.h"
+#include "bootloader/protocol.h"
+
+#include <stddef.h>
+
+static uint32_t since(const bl_fpga *f) { return f->ops->ms(f->ops->ctx) - f->t0; }
+
+// start on slot f->cur: check its header, reset the FPGA into configuration.
+// on failure the next slot is tried (or the load gives up)
+static void load(bl_fpga *f);
+
+// the current slot did not come up: the golden one next, unless that was it
+static void give_up(bl_fpga *f, uint8_t why) {
+  f->why[f->cur] = why;
+  f->inflight = 0U;
+  if (f->cur == 0U) {
+    f->cur = 1U;
+    load(f);
+    return;
+  }
+  f->state = BL_FPGA_FAILED; // the DAC stays muted
+}
+
+static void load(bl_fpga *f) {
+  const bl_image_header *h = (const bl_image_header *)f->slot[f->cur];
+  if (h == NULL || bl_image_check_header(h) != 0 || h->length == 0U ||
+      (h->target != BL_TARGET_FPGA_GW2AR18 && h->target != BL_TARGET_FPGA_GW5A25)) {
+    give_up(f, BL_FPGA_E_HEADER);
+    return;
+  }
+  f->img = f->slot[f->cur] + BL_IMAGE_OFFSET;
+  f->length = h->length;
+  f->sent = 0U;
+  f->chunks = 0U;
+  f->inflight = 0U;
+  f->state = BL_FPGA_SEND;
+  f->t0 = f->ops->ms(f->ops->ctx);
+  if (f->ops->begin(f->ops->ctx) != 0) {
+    give_up(f, BL_FPGA_E_PORT);
+  }
+}
+
+void bl_fpga_begin(bl_fpga *f, const bl_fpga_ops *ops, const void *active, const void *golden) {
+  f->ops = ops;
+  f->slot[0] = (const uint8_t *)active;
+  f->slot[1] = (const uint8_t *)golden;
+  f->cur = 0U;
+  f->why[0] = BL_FPGA_OK;
+  f->why[1] = BL_FPGA_OK;
+  f->paused = 0U;
+  f->got = 0U;
+  ops->mute(ops->ctx, 1);
+  load(f);
+}
+
+// BL_FPGA_SEND: the chunk out, or the next one
+static void send_step(bl_fpga *f) {
+  if (f->inflight) {
+    int b = f->ops->busy(f->ops->ctx);
+    if (b < 0) {
+      give_up(f, BL_FPGA_E_DMA);
+      return;
+    }
+    if (b > 0) {
+      if (since(f) > BL_FPGA_CHUNK_MS) {
+        give_up(f, BL_FPGA_E_DMA);
+      }
+      return;
+    }
+    f->inflight = 0U;
+  }
+  if (f->sent >= f->length) {
+    if (f->ops->end(f->ops->ctx) != 0) {
+      give_up(f, BL_FPGA_E_PORT);
+      return;
+    }
+    f->state = BL_FPGA_WAIT_DONE;
+    f->t0 = f->ops->ms(f->ops->ctx);
+    return;
+  }
+  if (f->paused) {
+    return;
+  }
+  uint32_t n = f->length - f->sent;
+  if (n > BL_FPGA_CHUNK) {
+    n = BL_FPGA_CHUNK;
+  }
+  f->t0 = f->ops->ms(f->ops->ctx);
+  if (f->ops->send(f->ops->ctx, f->img + f->sent, n) != 0) {
+    give_up(f, BL_FPGA_E_PORT);
+    return;
+  }
+  f->sent += n;
+  f->inflight = 1U;
+  f->chunks++;
+}
+
+int bl_fpga_poll(bl_fpga *f) {
+  switch (f->state) {
+  case BL_FPGA_SEND:
+    send_step(f);
+    break;
+  case BL_FPGA_WAIT_DONE:
+    if (f->ops->done(f->ops->ctx)) {
+      f->state = BL_FPGA_WAIT_MAGIC;
+      f->t0 = f->ops->ms(f->ops->ctx);
+    } else if (since(f) > BL_FPGA_DONE_MS) {
+      give_up(f, BL_FPGA_E_DONE);
+    }
+    break;
+  case BL_FPGA_WAIT_MAGIC:
+    // the design's FMC side answers once its clocks are up; until then a read
+    // returns whatever the bus floats to
+    f->got = f->ops->magic(f->ops->ctx);
+    if (f->got == BL_FPGA_MAGIC) {
+      f->state = BL_FPGA_READY;
+      f->ops->mute(f->ops->ctx, 0);
+    } else if (since(f) > BL_FPGA_MAGIC_MS) {
+      give_up(f, BL_FPGA_E_MAGIC);
+    }
+    break;
+  default:
+    break;
+  }
+  return f->state;
+}
+
+void bl_fpga_pause(bl_fpga *f) {
+  f->paused = 1U;
+  while (f->state == BL_FPGA_SEND && f->inflight) {
+    send_step(f);
+  }
+}
+
+void bl_fpga_resume(bl_fpga *f) { f->paused = 0U; }
+
+int bl_fpga_finish(bl_fpga *f) {
+  f->paused = 0U;
+  while (f->state != BL_FPGA_READY && f->state != BL_FPGA_FAILED && f->state != BL_FPGA_IDLE) {
+    bl_fpga_poll(f);
+  }
+  return f->state;
+}
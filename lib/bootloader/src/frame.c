@@ -22,75 +22,141 @@ static void resync(bl_frame_rx *rx) {
   rx->crc_idx = 0;
 }
 
-int bl_frame_feed(bl_frame_rx *rx, uint8_t b) {
-  switch (rx->state) {
-    case S_SOF1:
-      if (b == SOF_LO) {
-        rx->state = S_SOF2;
-      }
-      return BL_FRAME_MORE;
-
-    case S_SOF2:
-      if (b == SOF_HI) {
-        // start of a frame: crc covers everything from here (type..payload)
-        rx->crc = BL_CRC32_INIT;
-        rx->hdr_idx = 0;
-        rx->state = S_HDR;
-      } else if (b == SOF_LO) {
-        // could be the real low byte after a stray 0xA5; stay armed
+void bl_frame_rx_set_sink(bl_frame_rx *rx, bl_frame_sink sink, void *ctx) {
+  rx->sink = sink;
+  rx->sink_ctx = ctx;
+}
+
+// header complete: decode it and pick where the payload goes. returns
+// BL_FRAME_BAD_LEN (resynced) or BL_FRAME_MORE
+static int header_done(bl_frame_rx *rx) {
+  rx->frame.type  = rx->hdr[0];
+  rx->frame.flags = rx->hdr[1];
+  rx->frame.seq   = (uint16_t)(rx->hdr[2] | (rx->hdr[3] << 8));
+  rx->frame.len   = (uint16_t)(rx->hdr[4] | (rx->hdr[5] << 8));
+  if (rx->frame.len > BL_MAX_PAYLOAD) {
+    resync(rx);
+    return BL_FRAME_BAD_LEN;
+  }
+  // crc runs once per header / payload, not per byte, so it gets the
+  // slicing-by-8 path over the whole run
+  rx->crc = bl_crc32_update(BL_CRC32_INIT, rx->hdr, 6U);
+
+  rx->dst = NULL;
+  if (rx->sink != NULL && rx->frame.len > 0U) {
+    rx->dst = rx->sink(rx->sink_ctx, &rx->frame);
+  }
+  if (rx->dst == NULL) {
+    rx->dst = rx->frame.payload;
+  }
+  rx->pay_idx = 0;
+  rx->crc_idx = 0;
+  rx->state = (rx->frame.len == 0U) ? S_CRC : S_PAYLOAD;
+  return BL_FRAME_MORE;
+}
+
+static int crc_done(bl_frame_rx *rx) {
+  uint32_t got = (uint32_t)rx->crcbuf[0] |
+                 ((uint32_t)rx->crcbuf[1] << 8) |
+                 ((uint32_t)rx->crcbuf[2] << 16) |
+                 ((uint32_t)rx->crcbuf[3] << 24);
+  uint32_t calc = bl_crc32_final(rx->crc);
+  resync(rx);
+  return (got == calc) ? BL_FRAME_OK : BL_FRAME_BAD_CRC;
+}
+
+static size_t min_sz(size_t a, size_t b) { return (a < b) ? a : b; }
+
+size_t bl_frame_feed_buf(bl_frame_rx *rx, const uint8_t *p, size_t n, int *status) {
+  size_t i = 0;
+  *status = BL_FRAME_MORE;
+
+  while (i < n) {
+    switch (rx->state) {
+      case S_SOF1: {
+        // skip line noise / gaps between frames in one scan
+        const uint8_t *q = (const uint8_t *)memchr(p + i, SOF_LO, n - i);
+        if (q == NULL) {
+          return n;
+        }
+        i = (size_t)(q - p) + 1U;
         rx->state = S_SOF2;
-      } else {
-        rx->state = S_SOF1;
+        break;
       }
-      return BL_FRAME_MORE;
-
-    case S_HDR:
-      rx->hdr[rx->hdr_idx++] = b;
-      rx->crc = bl_crc32_update(rx->crc, &b, 1);
-      if (rx->hdr_idx == 6U) {
-        rx->frame.type  = rx->hdr[0];
-        rx->frame.flags = rx->hdr[1];
-        rx->frame.seq   = (uint16_t)(rx->hdr[2] | (rx->hdr[3] << 8));
-        rx->frame.len   = (uint16_t)(rx->hdr[4] | (rx->hdr[5] << 8));
-        if (rx->frame.len > BL_MAX_PAYLOAD) {
-          resync(rx);
-          return BL_FRAME_BAD_LEN;
+
+      case S_SOF2:
+        if (p[i] == SOF_HI) {
+          // start of a frame: crc covers everything from here (type..payload)
+          rx->hdr_idx = 0;
+          rx->state = S_HDR;
+        } else if (p[i] != SOF_LO) {
+          // a repeated 0xA5 could be the real low byte after a stray one; stay
+          // armed for it, otherwise start over
+          rx->state = S_SOF1;
+        }
+        i++;
+        break;
+
+      case S_HDR: {
+        size_t k = min_sz(6U - rx->hdr_idx, n - i);
+        memcpy(rx->hdr + rx->hdr_idx, p + i, k);
+        rx->hdr_idx = (uint8_t)(rx->hdr_idx + k);
+        i += k;
+        if (rx->hdr_idx == 6U) {
+          int st = header_done(rx);
+          if (st != BL_FRAME_MORE) {
+            *status = st;
+            return i;
+          }
         }
-        rx->pay_idx = 0;
-        rx->state = (rx->frame.len == 0U) ? S_CRC : S_PAYLOAD;
+        break;
       }
-      return BL_FRAME_MORE;
-
-    case S_PAYLOAD:
-      rx->frame.payload[rx->pay_idx++] = b;
-      rx->crc = bl_crc32_update(rx->crc, &b, 1);
-      if (rx->pay_idx == rx->frame.len) {
-        rx->crc_idx = 0;
-        rx->state = S_CRC;
+
+      case S_PAYLOAD: {
+        size_t k = min_sz((size_t)rx->frame.len - rx->pay_idx, n - i);
+        memcpy(rx->dst + rx->pay_idx, p + i, k);
+        rx->pay_idx = (uint16_t)(rx->pay_idx + k);
+        i += k;
+        if (rx->pay_idx == rx->frame.len) {
+          rx->crc = bl_crc32_update(rx->crc, rx->dst, rx->frame.len);
+          rx->state = S_CRC;
+        }
+        break;
       }
-      return BL_FRAME_MORE;
-
-    case S_CRC:
-      rx->crcbuf[rx->crc_idx++] = b;
-      if (rx->crc_idx == 4U) {
-        uint32_t got = (uint32_t)rx->crcbuf[0] |
-                       ((uint32_t)rx->crcbuf[1] << 8) |
-                       ((uint32_t)rx->crcbuf[2] << 16) |
-                       ((uint32_t)rx->crcbuf[3] << 24);
-        uint32_t calc = bl_crc32_final(rx->crc);
-        resync(rx);
-        return (got == calc) ? BL_FRAME_OK : BL_FRAME_BAD_CRC;
+
+      case S_CRC: {
+        size_t k = min_sz(4U - rx->crc_idx, n - i);
+        memcpy(rx->crcbuf + rx->crc_idx, p + i, k);
+        rx->crc_idx = (uint8_t)(rx->crc_idx + k);
+        i += k;
+        if (rx->crc_idx == 4U) {
+          *status = crc_done(rx);
+          return i;
+        }
+        break;
       }
-      return BL_FRAME_MORE;
 
-    default:
-      resync(rx);
-      return BL_FRAME_MORE;
+      default:
+        resync(rx);
+        break;
+    }
   }
+  return n;
+}
+
+int bl_frame_feed(bl_frame_rx *rx, uint8_t b) {
+  int st;
+  (void)bl_frame_feed_buf(rx, &b, 1U, &st);
+  return st;
 }
 
 size_t bl_frame_encode(uint8_t type, uint16_t seq, const void *payload,
                        uint16_t len, uint8_t *out, size_t cap) {
+  return bl_frame_encode_ch(BL_CH_UPDATE, type, seq, payload, len, out, cap);
+}
+
+size_t bl_frame_encode_ch(uint8_t ch, uint8_t type, uint16_t seq, const void *payload,
+                          uint16_t len, uint8_t *out, size_t cap) {
   size_t need = 8U + (size_t)len + 4U;
   if (len > BL_MAX_PAYLOAD || cap < need) {
     return 0;
@@ -99,7 +165,7 @@ size_t bl_frame_encode(uint8_t type, uint16_t seq, const void *payload,
   out[0] = SOF_LO;
   out[1] = SOF_HI;
   out[2] = type;
-  out[3] = 0; // flags
+  out[3] = ch; // flags
   out[4] = (uint8_t)(seq & 0xFFU);
   out[5] = (uint8_t)(seq >> 8);
   out[6] = (uint8_t)(len & 0xFFU);
@@ -1,10 +1,10 @@
 #include "bootloader/image.h"
 #include "bootloader/crc32.h"
 
-// validate a stored image: magic, header crc (over the header with header_crc32
-// zeroed), and the app-image crc over `length` bytes at base+BL_IMAGE_OFFSET.
-// all memory-mapped, so this is plain pointer access.
-int bl_image_validate(const void *base) {
+#include <stddef.h>
+
+// magic, and the header crc (over the header with header_crc32 zeroed)
+int bl_image_check_header(const void *base) {
   const bl_image_header *h = (const bl_image_header *)base;
   if (h->magic != BL_IMAGE_MAGIC) {
     return -1;
@@ -15,6 +15,82 @@ int bl_image_validate(const void *base) {
   if (bl_crc32(&tmp, sizeof(tmp)) != h->header_crc32) {
     return -2;
   }
+  return 0;
+}
+
+static uint32_t block_count(uint32_t length, uint32_t block_size) {
+  return (length + block_size - 1U) / block_size;
+}
+
+const uint32_t *bl_image_blocks(const void *base, uint32_t *block_size) {
+  const bl_image_header *h = (const bl_image_header *)base;
+  uint32_t lg = BL_IMAGE_BLOCK_LOG(h->flags);
+  if ((h->flags & BL_IMAGE_F_BLOCKS) == 0U || lg < 12U || lg > 24U) {
+    return NULL;
+  }
+  uint32_t bs = 1UL << lg;
+  uint32_t n = block_count(h->length, bs);
+  const uint32_t *t = (const uint32_t *)((const uint8_t *)base + BL_IMAGE_BLOCKS_AT);
+  if (n > BL_IMAGE_BLOCKS_MAX || bl_crc32(t, n * 4U) != t[n]) {
+    return NULL;
+  }
+  *block_size = bs;
+  return t;
+}
+
+int32_t bl_image_check_blocks(const void *base, uint32_t first, uint32_t n) {
+  const bl_image_header *h = (const bl_image_header *)base;
+  uint32_t bs;
+  const uint32_t *t = bl_image_blocks(base, &bs);
+  if (t == NULL) {
+    return -1;
+  }
+  uint32_t count = block_count(h->length, bs);
+  uint32_t end = (first < count && n < count - first) ? first + n : count;
+  const uint8_t *img = (const uint8_t *)base + BL_IMAGE_OFFSET;
+  for (uint32_t i = first; i < end; i++) {
+    uint32_t len = (i + 1U < count) ? bs : h->length - i * bs;
+    if (bl_crc32(img + i * bs, len) != t[i]) {
+      return (int32_t)i;
+    }
+  }
+  return (int32_t)end;
+}
+
+void bl_image_add_blocks(void *base) {
+  bl_image_header *h = (bl_image_header *)base;
+  uint32_t lg = 12U;
+  while (block_count(h->length, 1UL << lg) > BL_IMAGE_BLOCKS_MAX) {
+    lg++;
+  }
+  uint32_t bs = 1UL << lg;
+  uint32_t n = block_count(h->length, bs);
+  uint32_t *t = (uint32_t *)((uint8_t *)base + BL_IMAGE_BLOCKS_AT);
+  const uint8_t *img = (const uint8_t *)base + BL_IMAGE_OFFSET;
+  for (uint32_t i = 0; i < n; i++) {
+    t[i] = bl_crc32(img + i * bs, (i + 1U < n) ? bs : h->length - i * bs);
+  }
+  t[n] = bl_crc32(t, n * 4U);
+  h->flags = (uint16_t)((h->flags & ~0x01F1U) | BL_IMAGE_F_BLOCKS | (lg << 4));
+  h->header_crc32 = 0U;
+  h->header_crc32 = bl_crc32(h, sizeof(*h));
+}
+
+// validate a stored image: the header, then the app image at base+
+// BL_IMAGE_OFFSET - by its block table if it has one, else by the crc over
+// `length` bytes. all memory-mapped, so this is plain pointer access.
+int bl_image_validate(const void *base) {
+  const bl_image_header *h = (const bl_image_header *)base;
+  int rc = bl_image_check_header(base);
+  if (rc != 0) {
+    return rc;
+  }
+
+  uint32_t bs;
+  if (bl_image_blocks(base, &bs) != NULL) {
+    uint32_t count = block_count(h->length, bs);
+    return (bl_image_check_blocks(base, 0U, count) == (int32_t)count) ? 0 : -3;
+  }
 
   const uint8_t *img = (const uint8_t *)base + BL_IMAGE_OFFSET;
   if (bl_crc32(img, h->length) != h->image_crc32) {
@@ -0,0 +1,164 @@
+#include "bootloader/lz.h"
+
+#include <string.h>
+
+enum {
+  Z_TOKEN,
+  Z_LIT_LEN,   // literal length bytes
+  Z_LIT,       // literals
+  Z_OFF_LO,
+  Z_OFF_HI,
+  Z_MATCH_LEN, // match length bytes
+  Z_MATCH,     // copying out of the history
+  Z_DONE,
+  Z_BAD,
+};
+
+#define HMASK (BL_LZ_WINDOW - 1U)
+
+void bl_lz_init(bl_lz *z, uint32_t out_len) {
+  memset(z, 0, sizeof(*z));
+  z->out_len = out_len;
+  z->state = (out_len != 0U) ? Z_TOKEN : Z_DONE;
+}
+
+static void after_literals(bl_lz *z) {
+  // the last sequence stops after its literals
+  z->state = (z->out == z->out_len) ? Z_DONE : Z_OFF_LO;
+}
+
+static void after_match(bl_lz *z) {
+  z->state = (z->out == z->out_len) ? Z_DONE : Z_TOKEN;
+}
+
+// a length field is complete: does it fit in what is left of the image?
+static int fits(const bl_lz *z, uint32_t n) {
+  return n <= z->out_len - z->out;
+}
+
+// one header byte (token, length or offset)
+static void header_byte(bl_lz *z, uint8_t b) {
+  switch (z->state) {
+    case Z_TOKEN:
+      z->token = b;
+      z->lit = b >> 4;
+      z->match = (b & 0x0FU) + BL_LZ_MIN_MATCH;
+      if (z->lit == 15U) {
+        z->state = Z_LIT_LEN;
+      } else if (z->lit != 0U) {
+        z->state = fits(z, z->lit) ? Z_LIT : Z_BAD;
+      } else {
+        after_literals(z);
+      }
+      return;
+    case Z_LIT_LEN:
+      z->lit += b;
+      if (!fits(z, z->lit)) {
+        z->state = Z_BAD;
+      } else if (b != 255U) {
+        z->state = Z_LIT;
+      }
+      return;
+    case Z_OFF_LO:
+      z->offset = b;
+      z->state = Z_OFF_HI;
+      return;
+    case Z_OFF_HI:
+      z->offset = (uint16_t)(z->offset | ((uint16_t)b << 8));
+      if (z->offset == 0U || z->offset > BL_LZ_WINDOW || z->offset > z->out) {
+        z->state = Z_BAD;
+      } else if ((z->token & 0x0FU) == 15U) {
+        z->state = Z_MATCH_LEN;
+      } else {
+        z->state = fits(z, z->match) ? Z_MATCH : Z_BAD;
+      }
+      return;
+    default: // Z_MATCH_LEN
+      z->match += b;
+      if (!fits(z, z->match)) {
+        z->state = Z_BAD;
+      } else if (b != 255U) {
+        z->state = Z_MATCH;
+      }
+      return;
+  }
+}
+
+static uint32_t min3(uint32_t a, size_t b, size_t c) {
+  uint32_t m = (b < a) ? (uint32_t)b : a;
+  return (c < m) ? (uint32_t)c : m;
+}
+
+int bl_lz_run(bl_lz *z, const uint8_t *in, size_t n, size_t *used, uint8_t *out, size_t cap,
+              size_t *made) {
+  size_t i = 0;
+  size_t o = 0;
+  int st = -1;
+  while (st < 0) {
+    uint32_t k;
+    switch (z->state) {
+      case Z_DONE:
+        st = BL_LZ_DONE;
+        break;
+      case Z_BAD:
+        st = BL_LZ_BAD;
+        break;
+
+      case Z_LIT:
+        if (o == cap) {
+          st = BL_LZ_FULL;
+          break;
+        }
+        if (i == n) {
+          st = BL_LZ_MORE;
+          break;
+        }
+        // up to the end of the history ring at a time
+        k = min3(z->lit, cap - o, n - i);
+        if (k > BL_LZ_WINDOW - (z->out & HMASK)) {
+          k = BL_LZ_WINDOW - (z->out & HMASK);
+        }
+        memcpy(out + o, in + i, k);
+        memcpy(z->hist + (z->out & HMASK), in + i, k);
+        i += k;
+        o += k;
+        z->out += k;
+        z->lit -= k;
+        if (z->lit == 0U) {
+          after_literals(z);
+        }
+        break;
+
+      case Z_MATCH:
+        if (o == cap) {
+          st = BL_LZ_FULL;
+          break;
+        }
+        // byte by byte: a match may overlap what it produces (offset < length)
+        k = (z->match < cap - o) ? z->match : (uint32_t)(cap - o);
+        for (uint32_t j = 0; j < k; j++) {
+          uint8_t b = z->hist[(z->out - z->offset) & HMASK];
+          z->hist[z->out & HMASK] = b;
+          out[o + j] = b;
+          z->out++;
+        }
+        o += k;
+        z->match -= k;
+        if (z->match == 0U) {
+          after_match(z);
+        }
+        break;
+
+      default: // a token, length or offset byte
+        if (i == n) {
+          st = BL_LZ_MORE;
+          break;
+        }
+        header_byte(z, in[i++]);
+        break;
+    }
+  }
+  *used = i;
+  *made = o;
+  return st;
+}
@@ -0,0 +1,78 @@
+#include "bootloader/resume_log.h"
+
+#include <string.h>
+
+#include "bootloader/crc32.h"
+
+// what identifies an image to the log: its crc, length, target and codec
+// (not WINDOWED/RESUME, which only say how it is sent)
+static bl_rlog_rec head_of(const bl_manifest *m) {
+  uint32_t codec = m->flags & (BL_MANIFEST_F_DELTA | BL_MANIFEST_F_LZ);
+  bl_rlog_rec h = {BL_RLOG_HEAD_MAGIC, m->crc32, m->length, m->target | (codec << 16)};
+  return h;
+}
+
+static uint32_t check_of(const bl_rlog_rec *head, const bl_rlog_rec *mark) {
+  uint32_t c = bl_crc32_update(BL_CRC32_INIT, head, sizeof(*head));
+  return bl_crc32_final(bl_crc32_update(c, mark, 12U));
+}
+
+int bl_rlog_open(bl_rlog *l, const bl_nor *nor, uint32_t off, const bl_manifest *m) {
+  bl_rlog_rec want = head_of(m);
+  memset(l, 0, sizeof(*l));
+  l->nor = nor;
+  l->off = off;
+  if (nor->read(nor->ctx, off, (uint8_t *)&l->head, sizeof(l->head)) != 0 ||
+      l->head.magic != BL_RLOG_HEAD_MAGIC) {
+    return -1;
+  }
+  l->n = 1U;
+  for (uint32_t i = 1U; i < BL_RLOG_RECS; i++) {
+    bl_rlog_rec r;
+    if (nor->read(nor->ctx, off + i * sizeof(r), (uint8_t *)&r, sizeof(r)) != 0 ||
+        r.magic != BL_RLOG_MARK_MAGIC || r.c != check_of(&l->head, &r)) {
+      break; // erased, or torn by a power cut
+    }
+    l->n = i + 1U;
+    l->done = r.a;
+    l->crc = r.b;
+  }
+  if (memcmp(&l->head, &want, sizeof(want)) != 0 || l->done == 0U) {
+    l->done = 0U;
+    return -1;
+  }
+  return 0;
+}
+
+int bl_rlog_reset(bl_rlog *l, const bl_nor *nor, uint32_t off, const bl_manifest *m) {
+  memset(l, 0, sizeof(*l));
+  l->nor = nor;
+  l->off = off;
+  l->head = head_of(m);
+  return nor->erase(nor->ctx, off, BL_NOR_SECTOR);
+}
+
+int bl_rlog_mark(bl_rlog *l, uint32_t done, uint32_t crc) {
+  bl_rlog_rec rec[2];
+  uint32_t k = 0;
+  if (l->n >= BL_RLOG_RECS) {
+    return 1;
+  }
+  if (l->n == 0U) {
+    rec[k++] = l->head;
+    l->n = 1U;
+  }
+  bl_rlog_rec *mk = &rec[k++];
+  mk->magic = BL_RLOG_MARK_MAGIC;
+  mk->a = done;
+  mk->b = crc;
+  mk->c = check_of(&l->head, mk);
+  uint32_t at = l->off + (l->n + 1U - k) * sizeof(bl_rlog_rec);
+  if (l->nor->program(l->nor->ctx, at, (const uint8_t *)rec, k * sizeof(bl_rlog_rec)) != 0) {
+    return -1;
+  }
+  l->n++;
+  l->done = done;
+  l->crc = crc;
+  return 0;
+}
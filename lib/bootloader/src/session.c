@@ -0,0 +1,612 @@
+#include "bootloader/session.h"
+
+#include <string.h>
+
+#include "bootloader/crc32.h"
+
+static void reply(bl_session *s, uint8_t type, const void *pl, uint16_t len) {
+  s->ops->send(s->ops->ctx, type, pl, len);
+}
+
+static void result(bl_session *s, uint8_t type, uint16_t st) {
+  bl_result r = {.status = st, .seq = 0, .bytes = s->recv};
+  s->status = st;
+  s->have_manifest = 0;
+  reply(s, type, &r, sizeof(r));
+}
+
+// a verdict that ends the session: a bundle's held images are dropped with it
+static void last_result(bl_session *s, uint8_t type, uint16_t st) {
+  s->parts = 0;
+  s->nheld = 0;
+  result(s, type, st);
+}
+
+// bytes DATA seq carries
+static uint32_t frame_len(const bl_session *s, uint16_t seq) {
+  uint32_t left = s->manifest.length - (uint32_t)seq * s->chunk;
+  return (left < s->chunk) ? left : s->chunk;
+}
+
+static uint16_t data_frames(const bl_session *s) {
+  return (uint16_t)((s->manifest.length + s->chunk - 1U) / s->chunk);
+}
+
+// frames from `next` on that the staging buffers (delta/lz: the ring) can take
+// right now
+static uint16_t window_now(const bl_session *s) {
+  if (s->codec != BL_CODEC_PLAIN) {
+    return (uint16_t)(BL_DECODE_RING - (uint16_t)(s->win.next - s->dseq));
+  }
+  uint32_t from = (uint32_t)s->win.next * s->chunk;
+  uint32_t limit = bl_fstream_limit(&s->fs);
+  if (limit <= from) {
+    return 0U;
+  }
+  uint32_t n = (limit - from + s->chunk - 1U) / s->chunk;
+  return (n < s->win.size) ? (uint16_t)n : s->win.size;
+}
+
+static void send_ack(bl_session *s, uint16_t window) {
+  bl_ack a;
+  bl_rxwin_ack(&s->win, &a);
+  a.window = window;
+  s->adv = window;
+  s->ack_due = 0;
+  reply(s, BL_ACK, &a, sizeof(a));
+}
+
+// payload sink: a DATA frame whose slot has not been received yet is parsed
+// straight into the flash staging buffer (delta/lz: its ring slot); anything else
+// stays in the parser. so does a frame whose len is not what its seq carries:
+// placed, it would run over the frames after it, which may be in and acked
+static uint8_t *data_sink(void *ctx, const bl_frame *hdr) {
+  bl_session *s = (bl_session *)ctx;
+  if (hdr->type != BL_DATA || hdr->flags != BL_CH_UPDATE || !s->have_manifest || !bl_rxwin_want(&s->win, hdr->seq)) {
+    return NULL;
+  }
+  if ((uint32_t)hdr->seq * s->chunk >= s->manifest.length || hdr->len != frame_len(s, hdr->seq)) {
+    return NULL;
+  }
+  if (s->codec != BL_CODEC_PLAIN) {
+    return ((uint16_t)(hdr->seq - s->dseq) < BL_DECODE_RING) ? s->ring[hdr->seq % BL_DECODE_RING]
+                                                           : NULL;
+  }
+  return bl_fstream_slot(&s->fs, (uint32_t)hdr->seq * s->chunk, hdr->len);
+}
+
+void bl_session_init(bl_session *s, const bl_session_ops *ops, const bl_nor *nor) {
+  memset(s, 0, sizeof(*s));
+  s->ops = ops;
+  s->nor = nor;
+  s->status = BL_ERR_PROTO;
+  s->chunk = BL_MAX_PAYLOAD;
+  bl_frame_rx_init(&s->rx);
+  bl_frame_rx_set_sink(&s->rx, data_sink, s);
+}
+
+// wait out a running erase/program before a blocking read. 0, or -1 on a flash
+// error
+static int wait_idle(bl_session *s) {
+  const bl_nor *nor = s->nor;
+  int b;
+  while ((b = nor->busy(nor->ctx)) > 0) {
+    if (s->ops->idle != NULL) {
+      s->ops->idle(s->ops->ctx);
+    }
+  }
+  return (b < 0) ? -1 : 0;
+}
+
+// a delta applies to exactly one installed image: find it and check its crc
+// before anything is erased. 0 if it is the patch's base
+static int delta_base(bl_session *s) {
+  const bl_nor *nor = s->nor;
+  uint32_t off, len;
+  if (s->ops->base(s->ops->ctx, s->manifest.target, &off, &len) != 0 || wait_idle(s) != 0) {
+    return -1;
+  }
+  uint32_t c = BL_CRC32_INIT;
+  for (uint32_t o = 0; o < len; o += BL_MAX_PAYLOAD) {
+    uint32_t n = (len - o < BL_MAX_PAYLOAD) ? (len - o) : BL_MAX_PAYLOAD;
+    if (nor->read(nor->ctx, off + o, s->ring[0], n) != 0) {
+      return -1;
+    }
+    c = bl_crc32_update(c, s->ring[0], n);
+  }
+  if (bl_crc32_final(c) != s->manifest.base_crc32) {
+    return -1;
+  }
+  bl_delta_init(&s->dec.delta, len, s->manifest.image_length);
+  s->base_off = off;
+  return 0;
+}
+
+// a plain manifest may stop short of the delta fields
+static void load_manifest(bl_manifest *m, const bl_frame *f) {
+  memset(m, 0, sizeof(*m));
+  memcpy(m, f->payload, (f->len < sizeof(*m)) ? f->len : sizeof(*m));
+}
+
+// where the progress log lives; 0 if the board has one
+static int log_sector(const bl_session *s, uint32_t *off) {
+  return (s->ops->log != NULL) ? s->ops->log(s->ops->ctx, off) : -1;
+}
+
+// image bytes an interrupted plain transfer of `m` left in the slot, per the
+// progress log (0 = none). loads s->log
+static uint32_t resume_point(bl_session *s, const bl_manifest *m) {
+  uint32_t off;
+  if ((m->flags & (BL_MANIFEST_F_DELTA | BL_MANIFEST_F_LZ)) != 0U || log_sector(s, &off) != 0 ||
+      wait_idle(s) != 0 || bl_rlog_open(&s->log, s->nor, off, m) != 0) {
+    return 0U;
+  }
+  return s->log.done;
+}
+
+// an earlier image of this bundle went to `target` (its slot is taken)
+static int held_target(const bl_session *s, uint16_t target) {
+  for (unsigned i = 0; i < s->nheld; i++) {
+    if (s->held[i].target == target) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int handle_manifest(bl_session *s, const bl_frame *f) {
+  s->answered = 0;
+  if (f->len < BL_MANIFEST_MIN_LEN) {
+    last_result(s, BL_NAK, BL_ERR_PROTO);
+    return 1;
+  }
+  load_manifest(&s->manifest, f);
+
+  uint32_t dev_off, size;
+  if (s->ops->slot(s->ops->ctx, s->manifest.target, &dev_off, &size) != 0 ||
+      held_target(s, s->manifest.target)) {
+    last_result(s, BL_NAK, BL_ERR_TARGET);
+    return 1;
+  }
+  if (s->manifest.magic != BL_MANIFEST_MAGIC ||
+      (s->manifest.flags & BL_MANIFEST_F_WINDOWED) == 0U) {
+    last_result(s, BL_NAK, BL_ERR_PROTO);
+    return 1;
+  }
+  uint16_t fl = s->manifest.flags;
+  s->codec = (fl & BL_MANIFEST_F_DELTA) ? BL_CODEC_DELTA
+             : (fl & BL_MANIFEST_F_LZ)  ? BL_CODEC_LZ
+                                        : BL_CODEC_PLAIN;
+  if (s->codec != BL_CODEC_PLAIN &&
+      (f->len < sizeof(bl_manifest) ||
+       (fl & (BL_MANIFEST_F_DELTA | BL_MANIFEST_F_LZ)) ==
+         (BL_MANIFEST_F_DELTA | BL_MANIFEST_F_LZ) ||
+       (s->codec == BL_CODEC_DELTA && s->ops->base == NULL))) {
+    last_result(s, BL_NAK, BL_ERR_PROTO);
+    return 1;
+  }
+  uint32_t img_len = (s->codec != BL_CODEC_PLAIN) ? s->manifest.image_length
+                                                  : s->manifest.length;
+  if (img_len > size || bl_fstream_begin(&s->fs, s->nor, dev_off, img_len) != 0) {
+    last_result(s, BL_NAK, BL_ERR_SIZE);
+    return 1;
+  }
+
+  // a resumed transfer continues after the last logged sector: the slot was
+  // prepared when it started
+  uint32_t from = 0;
+  if ((fl & BL_MANIFEST_F_RESUME) != 0U) {
+    from = resume_point(s, &s->manifest);
+    if (from != 0U && bl_fstream_resume(&s->fs, from, s->log.crc) != 0) {
+      from = 0;
+    }
+  }
+
+  s->recv = from;
+  s->have_manifest = 1;
+  bl_rxwin_init(&s->win, (s->codec != BL_CODEC_PLAIN) ? BL_DECODE_RING : BL_WINDOW_MAX);
+  s->win.next = (uint16_t)(from / s->chunk); // all before it is in the slot
+  s->dseq = 0;
+  s->dpos = 0;
+  s->pcrc = BL_CRC32_INIT;
+  if (s->codec == BL_CODEC_LZ) {
+    bl_lz_init(&s->dec.lz, s->manifest.image_length);
+  }
+  uint32_t log_off;
+  s->logging = s->codec == BL_CODEC_PLAIN && log_sector(s, &log_off) == 0;
+  s->logged = from / BL_NOR_SECTOR;
+  // accept the manifest but hold the sender while the board prepares the
+  // slot; the next poll opens the window
+  send_ack(s, 0U);
+  if (from != 0U) {
+    s->ack_due = 1;
+    return 0;
+  }
+  if (s->ops->prepare != NULL) {
+    s->ops->prepare(s->ops->ctx, &s->manifest);
+  }
+  if (s->codec == BL_CODEC_DELTA && delta_base(s) != 0) {
+    last_result(s, BL_NAK, BL_ERR_BASE);
+    return 1;
+  }
+  // a new transfer: the log forgets the old one before the slot changes (a
+  // delta/lz session only clears it)
+  if (log_sector(s, &log_off) == 0 &&
+      (wait_idle(s) != 0 || bl_rlog_reset(&s->log, s->nor, log_off, &s->manifest) != 0)) {
+    last_result(s, BL_NAK, BL_ERR_FLASH);
+    return 1;
+  }
+  s->ack_due = 1;
+  return 0;
+}
+
+// DATA seq n carries image (delta: patch, lz: compressed) bytes
+// [n * chunk, ...).
+// `data` is where the parser put the payload (already in the staging buffer or
+// ring slot if the sink took it)
+static void handle_data(bl_session *s, const bl_frame *f, const uint8_t *data) {
+  uint32_t off = (uint32_t)f->seq * s->chunk;
+  uint32_t len = s->manifest.length;
+  s->ack_due = 1; // dups/out-of-window too: the host's view is stale
+  if (off + f->len > len || (f->len != s->chunk && off + f->len != len)) {
+    return; // not a frame of this image
+  }
+  if ((s->codec != BL_CODEC_PLAIN) ? (uint16_t)(f->seq - s->dseq) >= BL_DECODE_RING
+               : off + f->len > bl_fstream_limit(&s->fs)) {
+    return; // past what staging can hold (sent before our window shrank)
+  }
+  if (bl_rxwin_accept(&s->win, f->seq) == BL_WIN_NEW) {
+    if (s->codec != BL_CODEC_PLAIN) {
+      uint8_t *slot = s->ring[f->seq % BL_DECODE_RING];
+      if (data != slot) {
+        memcpy(slot, data, f->len);
+      }
+    } else {
+      (void)bl_fstream_write(&s->fs, off, data, f->len);
+    }
+    s->recv += f->len;
+  }
+
+  uint16_t miss;
+  if (bl_rxwin_gap(&s->win, &miss)) {
+    bl_result r = {.status = BL_ERR_SEQ, .seq = miss, .bytes = s->recv};
+    reply(s, BL_NAK, &r, sizeof(r));
+  }
+}
+
+// image bytes decoded so far
+static uint32_t decoded(const bl_session *s) {
+  return (s->codec == BL_CODEC_DELTA) ? s->dec.delta.out : s->dec.lz.out;
+}
+
+// run the session's decoder; returns an enum bl_delta_status (lz never needs
+// the base)
+static int decode(bl_session *s, const uint8_t *in, size_t n, size_t *used, uint8_t *out,
+                  size_t cap, size_t *made) {
+  if (s->codec == BL_CODEC_DELTA) {
+    return bl_delta_run(&s->dec.delta, in, n, used, out, cap, made);
+  }
+  switch (bl_lz_run(&s->dec.lz, in, n, used, out, cap, made)) {
+    case BL_LZ_MORE:
+      return BL_DELTA_MORE;
+    case BL_LZ_FULL:
+      return BL_DELTA_FULL;
+    case BL_LZ_DONE:
+      return BL_DELTA_DONE;
+    default:
+      return BL_DELTA_BAD;
+  }
+}
+
+// decode in-order frames into the staging buffers until the decoder runs out
+// of input, of staging room, or needs the base while the part is busy. 0, or
+// -(enum bl_status) if the session has to end
+static int decode_pump(bl_session *s) {
+  const bl_nor *nor = s->nor;
+  for (;;) {
+    const uint8_t *in = NULL;
+    uint32_t flen = 0;
+    if (s->dseq != s->win.next) {
+      flen = frame_len(s, s->dseq);
+      in = s->ring[s->dseq % BL_DECODE_RING] + s->dpos;
+    }
+    // the rebuilt image goes out in order, up to the end of its staging sector
+    uint32_t off = decoded(s);
+    uint32_t limit = bl_fstream_limit(&s->fs);
+    uint32_t cap = 0;
+    uint8_t *dst = NULL;
+    if (limit > off) {
+      cap = BL_NOR_SECTOR - (off % BL_NOR_SECTOR);
+      cap = (cap < limit - off) ? cap : (limit - off);
+      dst = bl_fstream_slot(&s->fs, off, cap);
+    }
+
+    size_t used, made;
+    int st = decode(s, in, (in != NULL) ? flen - s->dpos : 0U, &used, dst, cap, &made);
+    if (made != 0U) {
+      (void)bl_fstream_write(&s->fs, off, dst, (uint32_t)made);
+    }
+    s->dpos = (uint16_t)(s->dpos + used);
+    if (in != NULL && s->dpos == flen) {
+      s->pcrc = bl_crc32_update(s->pcrc, s->ring[s->dseq % BL_DECODE_RING], flen);
+      s->dseq++;
+      s->dpos = 0;
+    }
+
+    switch (st) {
+      case BL_DELTA_BASE: {
+        int b = nor->busy(nor->ctx);
+        if (b != 0) {
+          return (b < 0) ? -BL_ERR_FLASH : 0; // the next poll, between flash ops
+        }
+        if (nor->read(nor->ctx, s->base_off + s->dec.delta.want_off, s->dec.delta.base_buf,
+                      s->dec.delta.want_n) != 0) {
+          return -BL_ERR_FLASH;
+        }
+        bl_delta_base_loaded(&s->dec.delta);
+        break;
+      }
+      case BL_DELTA_MORE:
+        if (s->dseq == data_frames(s)) {
+          return -BL_ERR_PROTO; // all of the DATA, and the image is still short
+        }
+        if (s->dseq == s->win.next) {
+          return 0;
+        }
+        break;
+      case BL_DELTA_FULL:
+        if (cap == 0U) {
+          return 0;
+        }
+        break;
+      case BL_DELTA_DONE:
+        return 0;
+      default:
+        return -BL_ERR_PROTO;
+    }
+  }
+}
+
+// one round of work: decode what the ring allows (first, so base reads find
+// the part idle), then start the next flash operation. 1 while work is
+// pending, 0 when idle, or -(enum bl_status)
+static int step(bl_session *s) {
+  if (s->codec != BL_CODEC_PLAIN) {
+    int r = decode_pump(s);
+    if (r < 0) {
+      return r;
+    }
+  }
+  // log each sector once it is programmed (the part idle again after its last
+  // page) and before the stream moves on; the last one needs no resume
+  if (s->logging && s->fs.lo != s->logged && s->fs.lo * BL_NOR_SECTOR < s->fs.length) {
+    int b = s->nor->busy(s->nor->ctx);
+    if (b != 0) {
+      return (b < 0) ? -BL_ERR_FLASH : 1;
+    }
+    s->logged = s->fs.lo;
+    int r = bl_rlog_mark(&s->log, s->fs.lo * BL_NOR_SECTOR, bl_fstream_raw_crc(&s->fs));
+    if (r < 0) {
+      return -BL_ERR_FLASH;
+    }
+    if (r == 0) {
+      return 1;
+    }
+  }
+  int r = bl_fstream_poll(&s->fs);
+  return (r < 0) ? -BL_ERR_FLASH : r;
+}
+
+// commit the images of the bundle held so far, then `m`. 0 if all went
+static int commit_all(bl_session *s, const bl_manifest *m) {
+  if (s->ops->commit == NULL) {
+    return 0;
+  }
+  for (unsigned i = 0; i < s->nheld; i++) {
+    if (s->ops->commit(s->ops->ctx, &s->held[i]) != 0) {
+      return -1;
+    }
+  }
+  return s->ops->commit(s->ops->ctx, m);
+}
+
+// the verdict of a DONE, remembered for the DONE again
+static int done_result(bl_session *s, uint16_t st) {
+  s->answered = 1;
+  if (st == BL_OK && s->nheld + 1U < s->parts) {
+    s->held[s->nheld++] = s->manifest; // in a bundle, and not the last image
+    result(s, BL_RESULT, BL_OK);
+    return 0;
+  }
+  if (st == BL_OK) {
+    st = (commit_all(s, &s->manifest) != 0) ? BL_ERR_FLASH : BL_OK;
+  }
+  last_result(s, BL_RESULT, st);
+  return 1;
+}
+
+// returns 1 if the session is over: always, but for a bundle image that
+// verified and is not the last
+static int handle_done(bl_session *s) {
+  if (!s->have_manifest) {
+    if (s->answered) {
+      // the same DONE again: its RESULT was lost. the verdict stands - a
+      // bundle part held or, for the last image, committed or not
+      result(s, BL_RESULT, s->status);
+      return s->parts == 0U;
+    }
+    last_result(s, BL_RESULT, BL_ERR_PROTO);
+    return 1;
+  }
+  if (s->recv != s->manifest.length) {
+    return done_result(s, BL_ERR_SIZE);
+  }
+  // program whatever is still staged (delta/lz: decode the rest of the ring),
+  // then judge the image twice: as received (transfer crc) and as it reads back
+  // from flash
+  int r;
+  while ((r = step(s)) > 0) {
+    if (s->ops->idle != NULL) {
+      s->ops->idle(s->ops->ctx);
+    }
+  }
+  int coded = s->codec != BL_CODEC_PLAIN;
+  uint32_t crc = coded ? s->manifest.image_crc32 : s->manifest.crc32;
+  uint16_t st = BL_OK;
+  if (r < 0) {
+    st = (uint16_t)-r;
+  } else if (coded && (s->dseq != data_frames(s) || decoded(s) != s->manifest.image_length)) {
+    st = BL_ERR_PROTO; // DATA and image do not end together
+  } else if (coded && bl_crc32_final(s->pcrc) != s->manifest.crc32) {
+    st = BL_ERR_CRC;
+  } else if (bl_fstream_crc(&s->fs) != crc) {
+    st = BL_ERR_CRC;
+  } else if (bl_fstream_verify(&s->fs, crc) != 0) {
+    st = BL_ERR_FLASH;
+  }
+  return done_result(s, st);
+}
+
+// BL_RESUME: how much of the image this manifest describes is already in the
+// slot. only between sessions - the log is in use during one
+static void handle_resume(bl_session *s, const bl_frame *f) {
+  bl_resume r = {.offset = 0};
+  if (!s->have_manifest && f->len >= BL_MANIFEST_MIN_LEN) {
+    bl_manifest m;
+    load_manifest(&m, f);
+    r.offset = resume_point(s, &m);
+  }
+  reply(s, BL_RESUME, &r, sizeof(r));
+}
+
+// BL_LINK: take the payload size if it is one we can place (a power of two,
+// so DATA never straddles a staging sector), and ask the board for the baud.
+// only between sessions - the window is counted in frames of one size
+static void handle_link(bl_session *s, const bl_frame *f) {
+  bl_link req = {0};
+  bl_link ans = {0};
+  memcpy(&req, f->payload, (f->len < sizeof(req)) ? f->len : sizeof(req));
+  uint16_t p = req.payload;
+  if (!s->have_manifest && p >= BL_MIN_PAYLOAD && p <= BL_MAX_PAYLOAD && (p & (p - 1U)) == 0U) {
+    s->chunk = p;
+  }
+  if (!s->have_manifest && req.baud != 0U && s->ops->set_baud != NULL &&
+      s->ops->set_baud(s->ops->ctx, req.baud) == 0) {
+    ans.baud = req.baud;
+  }
+  ans.payload = s->chunk;
+  reply(s, BL_LINK, &ans, sizeof(ans));
+}
+
+// BL_PROBE: count a test frame, or report and restart the count
+static void handle_probe(bl_session *s, const bl_frame *f) {
+  if (f->len > 0U) {
+    s->probe.got++;
+    return;
+  }
+  bl_probe r = s->probe;
+  s->probe.got = 0;
+  s->probe.bad = 0;
+  reply(s, BL_PROBE, &r, sizeof(r));
+}
+
+// BL_BUNDLE: the next `parts` images are one update. only between sessions,
+// and not inside another bundle
+static void handle_bundle(bl_session *s, const bl_frame *f) {
+  bl_bundle req = {0};
+  bl_bundle ans = {0};
+  memcpy(&req, f->payload, (f->len < sizeof(req)) ? f->len : sizeof(req));
+  s->answered = 0;
+  if (!s->have_manifest && s->parts == 0U && req.parts >= 2U && req.parts <= BL_BUNDLE_MAX) {
+    s->parts = (uint8_t)req.parts;
+    s->nheld = 0;
+    ans.parts = req.parts;
+  }
+  reply(s, BL_BUNDLE, &ans, sizeof(ans));
+}
+
+// BL_TRACE: the board's boot trace, if it kept an intact one
+static void handle_trace(bl_session *s) {
+  const bl_boot_trace *t = (s->ops->trace != NULL) ? s->ops->trace(s->ops->ctx) : NULL;
+  if (t != NULL && bl_trace_check(t) == 0) {
+    reply(s, BL_TRACE, t, sizeof(*t));
+  } else {
+    reply(s, BL_TRACE, NULL, 0U);
+  }
+}
+
+static int handle_frame(bl_session *s, const bl_frame *f, const uint8_t *data) {
+  switch (f->type) {
+    case BL_MANIFEST:
+      return handle_manifest(s, f);
+    case BL_DATA:
+      if (s->have_manifest) {
+        handle_data(s, f, data);
+      }
+      return 0;
+    case BL_DONE:
+      return handle_done(s);
+    case BL_RESUME:
+      handle_resume(s, f);
+      return 0;
+    case BL_LINK:
+      handle_link(s, f);
+      return 0;
+    case BL_PROBE:
+      handle_probe(s, f);
+      return 0;
+    case BL_TRACE:
+      handle_trace(s);
+      return 0;
+    case BL_BUNDLE:
+      handle_bundle(s, f);
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+int bl_session_feed(bl_session *s, const uint8_t *p, size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    int st;
+    i += bl_frame_feed_buf(&s->rx, p + i, n - i, &st);
+    if (st == BL_FRAME_BAD_CRC || st == BL_FRAME_BAD_LEN) {
+      s->probe.bad++;
+      s->bad++;
+    } else if (st == BL_FRAME_OK) {
+      s->frames++;
+      // the other channels are the board's to send, a host has nothing to say on them
+      if (s->rx.frame.flags == BL_CH_UPDATE && handle_frame(s, &s->rx.frame, s->rx.dst)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void bl_session_telemetry(const bl_session *s, uint32_t ms, bl_telemetry *t) {
+  t->ms = ms;
+  t->bytes = s->have_manifest ? s->recv : 0U;
+  t->frames = s->frames;
+  t->bad = s->bad;
+  t->window = (uint8_t)s->adv;
+  t->busy = (s->have_manifest && s->adv == 0U) ? 1U : 0U;
+}
+
+int bl_session_poll(bl_session *s) {
+  if (!s->have_manifest) {
+    return 0;
+  }
+  int r = step(s);
+  if (r < 0) {
+    last_result(s, BL_NAK, (uint16_t)-r);
+    return -1;
+  }
+  // also re-ack when a programmed sector opened the window further
+  uint16_t w = window_now(s);
+  if (s->ack_due || w > s->adv) {
+    send_ack(s, w);
+  }
+  return r;
+}
@@ -0,0 +1,136 @@
+#include "bootloader/stage_pipe.h"
+#include "bootloader/crc32.h"
+
+#include <stddef.h>
+#include <string.h>
+
+enum { PEND_NONE, PEND_ERASE, PEND_PROG };
+
+// fold `n` bytes at `p`, ending at image offset `end`, into a block's running
+// crc; at the end of a block, check it. 0, or -1 if the block is bad
+static int block_add(const bl_stage_pipe *sp, uint32_t *blk, const uint8_t *p, uint32_t n,
+                     uint32_t end) {
+  if (sp->blocks == NULL) {
+    return 0;
+  }
+  *blk = bl_crc32_update(*blk, p, n);
+  if (end % sp->block_size != 0U && end != sp->length) {
+    return 0;
+  }
+  uint32_t want = sp->blocks[(end - 1U) / sp->block_size];
+  uint32_t got = bl_crc32_final(*blk);
+  *blk = BL_CRC32_INIT;
+  return (got == want) ? 0 : -1;
+}
+
+// the flash is idle: account for what just finished, then start the next
+// operation. returns 1 if one was started, 0 if the word it needs is not read
+// yet, 2 when everything is programmed, -1 on a flash error, -4 on a block
+// that did not program right
+static int flash_step(bl_stage_pipe *sp, const bl_iflash *fl) {
+  if (sp->pending == PEND_PROG) {
+    uint32_t n = sp->length - sp->done;
+    if (n > BL_IFLASH_WORD) {
+      n = BL_IFLASH_WORD;
+    }
+    const uint8_t *p = fl->map + sp->done;
+    sp->dst_crc = bl_crc32_update(sp->dst_crc, p, n);
+    sp->done += n;
+    if (block_add(sp, &sp->dst_blk, p, n, sp->done) != 0) {
+      return -4;
+    }
+  }
+  sp->pending = PEND_NONE;
+  if (sp->prog >= sp->length) {
+    return 2;
+  }
+
+  if (sp->prog >= sp->erased) {
+    if (fl->erase(fl->ctx, sp->erased) != 0) {
+      return -1;
+    }
+    sp->erased += BL_IFLASH_SECTOR;
+    sp->erases++;
+    sp->pending = PEND_ERASE;
+    return 1;
+  }
+
+  uint32_t want = sp->length - sp->prog;
+  if (want > BL_IFLASH_WORD) {
+    want = BL_IFLASH_WORD;
+  }
+  if (sp->read < sp->prog + want) {
+    return 0;
+  }
+  const uint8_t *w = &sp->ring[sp->prog % BL_STAGE_RING];
+  uint8_t tail[BL_IFLASH_WORD];
+  if (want < BL_IFLASH_WORD) {
+    memset(tail, 0xFF, sizeof(tail)); // erased state past the image
+    memcpy(tail, w, want);
+    w = tail;
+  }
+  if (fl->program(fl->ctx, sp->prog, w) != 0) {
+    return -1;
+  }
+  sp->prog += BL_IFLASH_WORD;
+  sp->words++;
+  sp->pending = PEND_PROG;
+  return 1;
+}
+
+int bl_stage_pipe_run(bl_stage_pipe *sp, const bl_iflash *fl, const bl_stage_src *src,
+                      uint32_t length, uint32_t image_crc32, const uint32_t *blocks,
+                      uint32_t block_size) {
+  memset(sp, 0, offsetof(bl_stage_pipe, ring));
+  sp->length = length;
+  sp->src_crc = BL_CRC32_INIT;
+  sp->dst_crc = BL_CRC32_INIT;
+  sp->blocks = blocks;
+  sp->block_size = block_size;
+  sp->src_blk = BL_CRC32_INIT;
+  sp->dst_blk = BL_CRC32_INIT;
+
+  for (;;) {
+    int b = fl->busy(fl->ctx);
+    if (b < 0) {
+      return -1;
+    }
+    if (b == 0) {
+      int r = flash_step(sp, fl);
+      if (r < 0) {
+        return r;
+      }
+      if (r == 2) {
+        break;
+      }
+      if (r == 1) {
+        continue; // started: read while it runs
+      }
+    }
+    // the flash is busy (or waits for this very read): fetch the next piece
+    // if the ring has room past what is not programmed yet
+    uint32_t n = sp->length - sp->read;
+    if (n > BL_STAGE_READ) {
+      n = BL_STAGE_READ;
+    }
+    if (n > 0U && sp->read + n - sp->prog <= BL_STAGE_RING) {
+      uint8_t *p = &sp->ring[sp->read % BL_STAGE_RING];
+      if (src->read(src->ctx, sp->read, p, n) != 0) {
+        return -2;
+      }
+      sp->src_crc = bl_crc32_update(sp->src_crc, p, n);
+      sp->read += n;
+      if (block_add(sp, &sp->src_blk, p, n, sp->read) != 0) {
+        return -3;
+      }
+    }
+  }
+
+  if (bl_crc32_final(sp->src_crc) != image_crc32) {
+    return -3;
+  }
+  if (bl_crc32_final(sp->dst_crc) != image_crc32) {
+    return -4;
+  }
+  return 0;
+}
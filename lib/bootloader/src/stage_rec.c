@@ -0,0 +1,39 @@
+#include "bootloader/stage_rec.h"
+#include "bootloader/crc32.h"
+
+#include <stddef.h>
+
+static uint32_t rec_crc(const bl_stage_rec *r) {
+  return bl_crc32(r, offsetof(bl_stage_rec, crc));
+}
+
+void bl_stage_rec_make(bl_stage_rec *r, const bl_image_header *h, uint16_t slot) {
+  r->magic = BL_STAGE_REC_MAGIC;
+  r->target = h->target;
+  r->slot = slot;
+  r->version = h->version;
+  r->length = h->length;
+  r->image_crc32 = h->image_crc32;
+  r->crc = rec_crc(r);
+}
+
+int bl_stage_rec_ok(const bl_stage_rec *r) {
+  return (r->magic == BL_STAGE_REC_MAGIC && r->crc == rec_crc(r)) ? 1 : 0;
+}
+
+enum bl_stage_plan bl_stage_plan(const bl_stage_rec *rec, const bl_image_header *h,
+                                 const void *exec, uint32_t exec_size) {
+  if (h->length > exec_size) {
+    return BL_STAGE_TOO_BIG;
+  }
+  if (!bl_stage_rec_ok(rec) || rec->target != h->target || rec->version != h->version ||
+      rec->length != h->length || rec->image_crc32 != h->image_crc32) {
+    return BL_STAGE_COPY;
+  }
+  // internal flash at core speed: a few ms for a large app, against seconds of
+  // erase and program
+  if (bl_crc32(exec, h->length) != h->image_crc32) {
+    return BL_STAGE_COPY;
+  }
+  return BL_STAGE_SKIP;
+}
@@ -0,0 +1,34 @@
+#include "bootloader/update_req.h"
+
+#include "backup_ram.h"
+
+static int req_ok(const bl_update_req *r) {
+  return r->magic == BL_REQ_MAGIC && r->nmagic == ~BL_REQ_MAGIC &&
+         (uint16_t)(r->nreason ^ r->reason) == 0xFFFFU && r->reason != BL_REQ_NONE;
+}
+
+void bl_update_req_set(bl_update_req *r, uint16_t reason) {
+  r->reason = reason;
+  r->nreason = (uint16_t)~reason;
+  r->nmagic = ~BL_REQ_MAGIC;
+  r->magic = BL_REQ_MAGIC;
+  bl_backup_flush(r, sizeof(*r)); // in the SRAM before the reset that follows
+}
+
+void bl_update_req_take(bl_update_req *r, enum bl_reset_cause cause, bl_boot_plan *plan) {
+  int asked = req_ok(r);
+  plan->listen_ms = 0U;
+  plan->reason = BL_REQ_NONE;
+  plan->stale = 0U;
+  if (asked && cause == BL_RESET_SOFTWARE) {
+    plan->listen_ms = BL_REQ_LISTEN_MS;
+    plan->reason = r->reason;
+  } else {
+    plan->stale = (uint8_t)asked;
+    if (cause == BL_RESET_PIN) {
+      plan->listen_ms = BL_PIN_LISTEN_MS;
+    }
+  }
+  r->magic = 0U;
+  r->nmagic = 0U;
+}
@@ -0,0 +1,68 @@
+#include "bootloader/window.h"
+
+#include <string.h>
+
+void bl_rxwin_init(bl_rxwin *w, uint16_t size) {
+  memset(w, 0, sizeof(*w));
+  if (size == 0U) {
+    size = 1U;
+  }
+  w->size = (size > BL_WINDOW_MAX) ? (uint16_t)BL_WINDOW_MAX : size;
+}
+
+int bl_rxwin_accept(bl_rxwin *w, uint16_t seq) {
+  uint16_t d = (uint16_t)(seq - w->next);
+  if (d >= 0x8000U) {
+    return BL_WIN_DUP; // behind the cumulative ack
+  }
+  if (d >= w->size) {
+    return BL_WIN_OUTSIDE;
+  }
+
+  if (d == 0U) {
+    // in order: advance past it and anything already sack'd behind it. while
+    // walking, bit i maps to next+i; the final shift restores next+1+i
+    w->next++;
+    while (w->sack & 1U) {
+      w->sack >>= 1;
+      w->next++;
+    }
+    w->sack >>= 1;
+    return BL_WIN_NEW;
+  }
+
+  uint32_t bit = 1UL << (d - 1U);
+  if (w->sack & bit) {
+    return BL_WIN_DUP;
+  }
+  w->sack |= bit;
+  return BL_WIN_NEW;
+}
+
+int bl_rxwin_want(const bl_rxwin *w, uint16_t seq) {
+  uint16_t d = (uint16_t)(seq - w->next);
+  if (d >= w->size) {
+    return 0; // behind (wraps high) or past the window
+  }
+  return (d == 0U) || !(w->sack & (1UL << (d - 1U)));
+}
+
+int bl_rxwin_gap(bl_rxwin *w, uint16_t *missing) {
+  // anything sack'd means `next` itself is the hole
+  if (w->sack == 0U) {
+    return 0;
+  }
+  if (w->nak_sent && w->nak_seq == w->next) {
+    return 0;
+  }
+  w->nak_seq = w->next;
+  w->nak_sent = 1U;
+  *missing = w->next;
+  return 1;
+}
+
+void bl_rxwin_ack(const bl_rxwin *w, bl_ack *a) {
+  a->next = w->next;
+  a->window = w->size;
+  a->sack = w->sack;
+}
@@ -82,6 +82,36 @@ bool qspi_memmap_erase_sector(const qspi_memmap_config_t *cfg, uint32_t off);
 bool qspi_memmap_program(const qspi_memmap_config_t *cfg, uint32_t off,
                          const uint8_t *buf, size_t len);
 
+/**
+ * @brief start erasing the 4KB sector or 64KB block (@p size) at @p off and
+ *        return without waiting (indirect mode). poll qspi_memmap_busy().
+ * @return true if the erase was issued
+ */
+bool qspi_memmap_erase_start(const qspi_memmap_config_t *cfg, uint32_t off,
+                             uint32_t size);
+
+/**
+ * @brief start programming up to one 256-byte page at @p off and return
+ *        without waiting (indirect mode). same rules as qspi_memmap_program().
+ * @return true if the program was issued
+ */
+bool qspi_memmap_program_start(const qspi_memmap_config_t *cfg, uint32_t off,
+                               const uint8_t *buf, size_t len);
+
+/**
+ * @brief read the device busy flag (an erase/program still running)
+ * @return true on success, with the flag in @p busy
+ */
+bool qspi_memmap_busy(const qspi_memmap_config_t *cfg, bool *busy);
+
+/**
+ * @brief read @p len bytes at @p off with indirect fast reads (no need to
+ *        enter memory-mapped mode, no d-cache maintenance by the caller)
+ * @return true on success
+ */
+bool qspi_memmap_read(const qspi_memmap_config_t *cfg, uint32_t off,
+                      uint8_t *buf, size_t len);
+
 /**
  * @brief enter memory-mapped mode using the configured read line width.
  * @return the mapped base pointer (== cfg->base) or NULL on bad args.
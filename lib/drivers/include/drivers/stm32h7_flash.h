@@ -29,6 +29,26 @@ int stm32h7_flash_erase(uint32_t addr, uint32_t len);
 // must be pre-erased. returns 0 on success, negative on error.
 int stm32h7_flash_program(uint32_t addr, const void *src, uint32_t len);
 
+// non-blocking variants, for a caller with other work to overlap (the staging
+// pipeline reads and crc's the next QSPI data meanwhile). each STARTS one
+// operation in the bank holding `addr` and returns; poll stm32h7_flash_busy
+// until it is done before starting the next, and lock the bank at the end.
+// the bank must be idle: they return negative if it is not.
+
+// start erasing the 128KB sector holding addr
+int stm32h7_flash_erase_start(uint32_t addr);
+
+// start programming one 256-bit flash word (STM32H7_FLASH_WORD_BYTES from
+// `word`) at addr, flash-word aligned and erased
+int stm32h7_flash_program_start(uint32_t addr, const void *word);
+
+// 1 while the bank holding addr is busy; then 0, or negative if the operation
+// failed (its error flags are cleared)
+int stm32h7_flash_busy(uint32_t addr);
+
+// lock the bank holding addr again (after the last operation is done)
+void stm32h7_flash_lock(uint32_t addr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -134,6 +134,13 @@ bool w25qxx_qspi_set_quad_enable(WSPIDriver *wspi);
 bool w25qxx_qspi_erase_sector(WSPIDriver *wspi, uint32_t addr);
 bool w25qxx_qspi_program_page(WSPIDriver *wspi, uint32_t addr,
                               const uint8_t *buf, size_t len);
+// non-blocking variants: issue the erase (4KB sector or 64KB block, by size) or
+// page program and return while the part is still busy. poll w25qxx_qspi_busy
+// before the next command
+bool w25qxx_qspi_busy(WSPIDriver *wspi, bool *busy);
+bool w25qxx_qspi_erase_start(WSPIDriver *wspi, uint32_t addr, uint32_t size);
+bool w25qxx_qspi_program_page_start(WSPIDriver *wspi, uint32_t addr,
+                                    const uint8_t *buf, size_t len);
 bool w25qxx_qspi_read(WSPIDriver *wspi, w25qxx_qspi_lines_t lines,
                       uint32_t addr, uint8_t *buf, size_t len);
 
@@ -5,6 +5,7 @@
 #define USBH_MIDI_H
 
 #include "hal_usbh.h"
+#include "midi/midi_queue.h"
 
 #if HAL_USE_USBH && HAL_USBH_USE_ADDITIONAL_CLASS_DRIVERS
 
@@ -32,12 +33,11 @@ struct USBHMIDIDriver {
 extern USBHMIDIDriver USBHMIDID[USBH_MIDI_MAX_INSTANCES];
 extern const usbh_classdriverinfo_t usbhMidiClassDriverInfo;
 
-// note-event hook. the app sets this to react to parsed notes:
-//   on = true  -> note-on  (velocity vel, 1..127)
-//   on = false -> note-off (vel = 0)
-// called from the USB IN-completion context, so keep the handler short.
-typedef void (*usbhmidi_note_cb_t)(uint8_t note, uint8_t vel, bool on);
-void usbhmidiSetNoteCallback(usbhmidi_note_cb_t cb);
+// event queue. the app hands over a queue (midi/midi_queue.h) and drains it
+// from its own thread: the IN completion only pushes each non-empty USB-MIDI
+// packet, stamped with chSysGetRealtimeCounterX(). a full queue drops the
+// packet and counts it (q->dropped).
+void usbhmidiSetQueue(midi_queue *q);
 
 #endif
 
@@ -61,6 +61,40 @@ bool qspi_memmap_program(const qspi_memmap_config_t *cfg, uint32_t off,
   return w25qxx_qspi_program_page(cfg->wspi, off, buf, len);
 }
 
+bool qspi_memmap_erase_start(const qspi_memmap_config_t *cfg, uint32_t off,
+                             uint32_t size) {
+  if (cfg == NULL || off + size > cfg->size_bytes || (off % size) != 0U) {
+    return false;
+  }
+  return w25qxx_qspi_erase_start(cfg->wspi, off, size);
+}
+
+bool qspi_memmap_program_start(const qspi_memmap_config_t *cfg, uint32_t off,
+                               const uint8_t *buf, size_t len) {
+  if (cfg == NULL || buf == NULL || len == 0U) {
+    return false;
+  }
+  if (off + len > cfg->size_bytes) {
+    return false;
+  }
+  return w25qxx_qspi_program_page_start(cfg->wspi, off, buf, len);
+}
+
+bool qspi_memmap_busy(const qspi_memmap_config_t *cfg, bool *busy) {
+  if (cfg == NULL || busy == NULL) {
+    return false;
+  }
+  return w25qxx_qspi_busy(cfg->wspi, busy);
+}
+
+bool qspi_memmap_read(const qspi_memmap_config_t *cfg, uint32_t off,
+                      uint8_t *buf, size_t len) {
+  if (cfg == NULL || buf == NULL || off + len > cfg->size_bytes) {
+    return false;
+  }
+  return w25qxx_qspi_read(cfg->wspi, cfg->lines, off, buf, len);
+}
+
 const volatile void *qspi_memmap_enable(const qspi_memmap_config_t *cfg) {
   wspi_command_t cmd;
 
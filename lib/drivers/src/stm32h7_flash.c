@@ -143,3 +143,59 @@ int stm32h7_flash_program(uint32_t addr, const void *src, uint32_t len) {
   bank_lock(&b);
   return rc;
 }
+
+int stm32h7_flash_erase_start(uint32_t addr) {
+  flash_bank b;
+  bank_for(addr, &b);
+  bank_unlock(&b);
+  if ((*b.sr & (FLASH_SR_BSY | FLASH_SR_QW)) != 0U) {
+    return -1;
+  }
+  uint32_t snb = (addr - b.base) / STM32H7_FLASH_SECTOR_SIZE;
+  uint32_t cr = *b.cr & ~(FLASH_CR_SNB | FLASH_CR_PSIZE | FLASH_CR_PG);
+  cr |= FLASH_CR_SER | (snb << FLASH_CR_SNB_Pos);
+  *b.cr = cr;
+  *b.cr |= FLASH_CR_START;
+  return 0;
+}
+
+int stm32h7_flash_program_start(uint32_t addr, const void *word) {
+  if ((addr & (STM32H7_FLASH_WORD_BYTES - 1U)) != 0U) {
+    return -1;
+  }
+  flash_bank b;
+  bank_for(addr, &b);
+  bank_unlock(&b);
+  if ((*b.sr & (FLASH_SR_BSY | FLASH_SR_QW)) != 0U) {
+    return -2;
+  }
+  uint32_t w[STM32H7_FLASH_WORD_BYTES / 4];
+  memcpy(w, word, sizeof(w)); // the source may be unaligned
+  *b.cr = (*b.cr & ~(FLASH_CR_SER | FLASH_CR_SNB)) | FLASH_CR_PG;
+  volatile uint32_t *dst = (volatile uint32_t *)addr;
+  for (unsigned i = 0; i < STM32H7_FLASH_WORD_BYTES / 4; i++) {
+    dst[i] = w[i];
+  }
+  __DSB();
+  return 0;
+}
+
+int stm32h7_flash_busy(uint32_t addr) {
+  flash_bank b;
+  bank_for(addr, &b);
+  if ((*b.sr & (FLASH_SR_BSY | FLASH_SR_QW)) != 0U) {
+    return 1;
+  }
+  *b.cr &= ~(FLASH_CR_SER | FLASH_CR_SNB | FLASH_CR_PG);
+  if ((*b.sr & FLASH_ERR_MASK) != 0U) {
+    *b.ccr = FLASH_ERR_MASK;
+    return -1;
+  }
+  return 0;
+}
+
+void stm32h7_flash_lock(uint32_t addr) {
+  flash_bank b;
+  bank_for(addr, &b);
+  bank_lock(&b);
+}
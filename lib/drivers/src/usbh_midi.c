@@ -1,7 +1,7 @@
 // USB-MIDI host class driver. registered via HAL_USBH_ADDITIONAL_CLASS_DRIVERS;
 // matches the MIDIStreaming interface (audio class 0x01 / subclass 0x03), opens
-// its bulk IN endpoint, and parses 4-byte USB-MIDI event packets into note
-// events. modeled on the contrib usbh_custom_class_example.
+// its bulk IN endpoint, and queues its 4-byte USB-MIDI event packets for the
+// app (usbhmidiSetQueue). modeled on the contrib usbh_custom_class_example.
 
 #include "hal.h"
 
@@ -27,10 +27,10 @@
 
 USBHMIDIDriver USBHMIDID[USBH_MIDI_MAX_INSTANCES];
 
-// app note-event hook (set via usbhmidiSetNoteCallback); called from _in_cb
-static usbhmidi_note_cb_t midi_note_cb;
-void usbhmidiSetNoteCallback(usbhmidi_note_cb_t cb) {
-  midi_note_cb = cb;
+// app event queue (set via usbhmidiSetQueue); _in_cb is its only producer
+static midi_queue *midi_q;
+void usbhmidiSetQueue(midi_queue *q) {
+  midi_q = q;
 }
 
 // DMA-capable read buffers, one per instance
@@ -48,29 +48,23 @@ const usbh_classdriverinfo_t usbhMidiClassDriverInfo = {
   "MIDI", &class_driver_vmt
 };
 
-// completion callback: parse 4-byte USB-MIDI packets, then re-arm the read
+// completion callback: queue the 4-byte USB-MIDI packets, then re-arm the
+// read. nothing is parsed or acted on here - that is the app thread's job
 static void _in_cb(usbh_urb_t *urb) {
   USBHMIDIDriver *const midip = (USBHMIDIDriver *)urb->userData;
 
   if (urb->status == USBH_URBSTATUS_OK) {
     const uint8_t *const p = midi_inbuf[midip - USBHMIDID];
     const uint32_t n = urb->actualLength;
+    const uint32_t now = chSysGetRealtimeCounterX();
     for (uint32_t i = 0; i + 4U <= n; i += 4U) {
-      const uint8_t cin = p[i] & 0x0FU;       // code index number
-      const uint8_t st  = p[i + 1U];          // MIDI status byte
-      const uint8_t d1  = p[i + 2U];
-      const uint8_t d2  = p[i + 3U];
-      const uint8_t ch  = st & 0x0FU;
-      if (cin == 0x9U && d2 != 0U) {
-        uinfof("MIDI note ON  ch=%u note=%u vel=%u", ch, d1, d2);
-        if (midi_note_cb != NULL) { midi_note_cb(d1, d2, true); }
+      if ((p[i] & 0x0FU) == 0U) {             // CIN 0: reserved / padding
+        continue;
       }
-      else if (cin == 0x8U || (cin == 0x9U && d2 == 0U)) {
-        uinfof("MIDI note OFF ch=%u note=%u", ch, d1);
-        if (midi_note_cb != NULL) { midi_note_cb(d1, 0U, false); }
-      }
-      else if (cin != 0U) {
-        uinfof("MIDI cin=%X %02x %02x %02x", cin, st, d1, d2);
+      uinfof("MIDI %02x %02x %02x %02x", p[i], p[i + 1U], p[i + 2U], p[i + 3U]);
+      if (midi_q != NULL) {
+        midi_event e = {now, {p[i], p[i + 1U], p[i + 2U], p[i + 3U]}};
+        midi_q_push(midi_q, &e);
       }
     }
   }
@@ -529,27 +529,44 @@ bool w25qxx_qspi_set_quad_enable(WSPIDriver *wspi) {
   return w25qxx_qspi_wait_idle(wspi, 1000);
 }
 
-bool w25qxx_qspi_erase_sector(WSPIDriver *wspi, uint32_t addr) {
+bool w25qxx_qspi_busy(WSPIDriver *wspi, bool *busy) {
+  uint8_t sr1;
+  if (!qspi_read_status(wspi, W25QXX_CMD_READ_STATUS_REG1, &sr1)) {
+    return false;
+  }
+  *busy = (sr1 & W25QXX_STATUS_BUSY) != 0U;
+  return true;
+}
+
+bool w25qxx_qspi_erase_start(WSPIDriver *wspi, uint32_t addr, uint32_t size) {
   wspi_command_t cmd;
 
+  if (size != W25QXX_SECTOR_SIZE_BYTES && size != W25QXX_BLOCK64_SIZE_BYTES) {
+    return false;
+  }
   if (!qspi_write_enable(wspi)) {
     return false;
   }
-  cmd.cmd   = W25QXX_CMD_SECTOR_ERASE; // 0x20
+  cmd.cmd   = (size == W25QXX_SECTOR_SIZE_BYTES) ? W25QXX_CMD_SECTOR_ERASE       // 0x20
+                                                 : W25QXX_CMD_64KB_BLOCK_ERASE;  // 0xD8
   cmd.addr  = addr;
   cmd.alt   = 0U;
   cmd.dummy = 0U;
   cmd.cfg   = WSPI_CFG_CMD_MODE_ONE_LINE | WSPI_CFG_ADDR_MODE_ONE_LINE |
               WSPI_CFG_ADDR_SIZE_24 | WSPI_CFG_ALT_MODE_NONE |
               WSPI_CFG_DATA_MODE_NONE | WSPI_CFG_CMD_SIZE_8;
-  if (wspiCommand(wspi, &cmd) != MSG_OK) {
+  return wspiCommand(wspi, &cmd) == MSG_OK;
+}
+
+bool w25qxx_qspi_erase_sector(WSPIDriver *wspi, uint32_t addr) {
+  if (!w25qxx_qspi_erase_start(wspi, addr, W25QXX_SECTOR_SIZE_BYTES)) {
     return false;
   }
   return w25qxx_qspi_wait_idle(wspi, 1000);
 }
 
-bool w25qxx_qspi_program_page(WSPIDriver *wspi, uint32_t addr,
-                              const uint8_t *buf, size_t len) {
+bool w25qxx_qspi_program_page_start(WSPIDriver *wspi, uint32_t addr,
+                                    const uint8_t *buf, size_t len) {
   wspi_command_t cmd;
 
   if (len == 0U || len > W25QXX_PAGE_SIZE_BYTES) {
@@ -568,7 +585,12 @@ bool w25qxx_qspi_program_page(WSPIDriver *wspi, uint32_t addr,
   cmd.cfg   = WSPI_CFG_CMD_MODE_ONE_LINE | WSPI_CFG_ADDR_MODE_ONE_LINE |
               WSPI_CFG_ADDR_SIZE_24 | WSPI_CFG_ALT_MODE_NONE |
               WSPI_CFG_DATA_MODE_ONE_LINE | WSPI_CFG_CMD_SIZE_8;
-  if (wspiSend(wspi, &cmd, len, qspi_bounce) != MSG_OK) {
+  return wspiSend(wspi, &cmd, len, qspi_bounce) == MSG_OK;
+}
+
+bool w25qxx_qspi_program_page(WSPIDriver *wspi, uint32_t addr,
+                              const uint8_t *buf, size_t len) {
+  if (!w25qxx_qspi_program_page_start(wspi, addr, buf, len)) {
     return false;
   }
   return w25qxx_qspi_wait_idle(wspi, 100);
@@ -0,0 +1,60 @@
+// MIDI event queue: the USB-MIDI IN completion (usbh_midi.c, interrupt
+// context) pushes each 4-byte USB-MIDI packet with the time it arrived; the
+// synth thread pops them and does the work - voice allocation, register
+// writes - outside the USB stack.
+//
+// one producer, one consumer, no lock: a power-of-two ring indexed by two
+// free-running counters. `head` is written only by the producer, `tail` only
+// by the consumer; each publishes with a release store and reads the other
+// with an acquire load, so an event's bytes are in place before the consumer
+// can see its slot (and a slot is read out before the producer can reuse it).
+//
+// a full ring drops the new event, never an old one: the notes already queued
+// keep their order, and note-offs queued before the burst still arrive.
+// `dropped` counts the lost events, `overflows` the bursts that lost any, and
+// `high_water` the most events ever waiting - how close the consumer came to
+// falling behind. those three are the producer's; read them for reporting.
+
+#ifndef MIDI_QUEUE_H
+#define MIDI_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIDI_Q_SIZE 128U   // events; a power of two
+
+typedef struct {
+  uint32_t t;        // arrival, in the producer's clock (CPU cycles on the MCU)
+  uint8_t pkt[4];    // USB-MIDI event packet: cable/CIN, then 3 MIDI bytes
+} midi_event;
+
+typedef struct {
+  midi_event ev[MIDI_Q_SIZE];
+  uint32_t head;         // next slot to fill (producer)
+  uint32_t tail;         // next slot to read (consumer)
+  uint32_t dropped;      // events lost to a full ring
+  uint32_t overflows;    // times the ring filled up and started dropping
+  uint32_t high_water;   // most events ever waiting
+  bool full;             // dropping since the last push that fit
+} midi_queue;
+
+void midi_q_init(midi_queue *q);
+
+// producer: queue an event; false (and counted) if the ring is full
+bool midi_q_push(midi_queue *q, const midi_event *e);
+
+// consumer: the oldest event, false if there is none
+bool midi_q_pop(midi_queue *q, midi_event *e);
+
+// events waiting (a snapshot; either side may call it)
+uint32_t midi_q_count(const midi_queue *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MIDI_QUEUE_H
@@ -0,0 +1,103 @@
+// USB-MIDI event packet decoder (USB Device Class Definition for MIDI Devices
+// 1.0, section 4): 4-byte packets in, typed MIDI 1.0 messages out to a sink.
+//
+// the packet's low nibble, the code index number (CIN), says how many of its
+// three MIDI bytes count and what they are; a 16-entry table maps each CIN to
+// that length and its handler:
+//
+//   0x8..0xE  channel voice: note off/on, poly pressure, control change,
+//             program change, channel pressure, pitch bend
+//   0x2, 0x3  system common, 2 and 3 bytes (MTC quarter frame, song position,
+//             song select); 0x5 a 1-byte one (tune request) - or a SysEx end
+//   0x4       SysEx start or continue, 3 bytes
+//   0x5..0x7  SysEx end, with 1..3 bytes
+//   0xF       a single byte: real-time (clock, start, stop, ...)
+//   0x0, 0x1  reserved: ignored
+//
+// SysEx arrives three bytes a packet and is put back together per cable (the
+// high nibble), so SysEx on one cable does not break up SysEx on another; the
+// sink gets the whole message, F0 to F7, once it has ended. a message longer
+// than MIDI_SYSEX_MAX is dropped and counted, as is SysEx on a cable with no
+// buffer (MIDI_SYSEX_CABLES) - channel and system messages work on all 16.
+//
+// no hardware, no allocation: the decoder is fed from the synth thread on the
+// MCU and from packet captures on the host.
+
+#ifndef MIDI_USB_MIDI_H
+#define MIDI_USB_MIDI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MIDI_SYSEX_MAX
+#define MIDI_SYSEX_MAX    128U   // bytes of one SysEx message, F0 and F7 included
+#endif
+#ifndef MIDI_SYSEX_CABLES
+#define MIDI_SYSEX_CABLES 2U     // cables 0..n-1 can carry SysEx
+#endif
+
+enum midi_msg_type {
+  MIDI_NOTE_OFF,       // a = note, b = velocity (note-on at velocity 0 too)
+  MIDI_NOTE_ON,        // a = note, b = velocity, 1..127
+  MIDI_POLY_PRESSURE,  // a = note, b = pressure
+  MIDI_CONTROL,        // a = controller, b = value
+  MIDI_PROGRAM,        // a = program
+  MIDI_CHAN_PRESSURE,  // a = pressure
+  MIDI_PITCH_BEND,     // bend = -8192..8191, 0 centred
+  MIDI_SYSTEM,         // status, a, b: system common (F1..F6)
+  MIDI_REALTIME,       // status: F8..FF
+  MIDI_SYSEX,          // data/len: the whole message, F0 .. F7
+  MIDI_MSG_TYPES
+};
+
+// common controllers
+#define MIDI_CC_MOD_WHEEL 1U
+#define MIDI_CC_SUSTAIN   64U
+
+typedef struct {
+  uint8_t type;          // enum midi_msg_type
+  uint8_t cable;         // 0..15
+  uint8_t channel;       // 0..15, channel messages only
+  uint8_t status;        // the status byte as sent
+  uint8_t a, b;
+  int16_t bend;
+  uint16_t len;          // SysEx
+  const uint8_t *data;   // SysEx; valid only during the sink call
+  uint32_t t;            // the packet's timestamp, as handed in
+} midi_msg;
+
+typedef void (*midi_sink_fn)(void *ctx, const midi_msg *m);
+
+typedef struct {
+  uint8_t buf[MIDI_SYSEX_MAX];
+  uint16_t len;
+  uint8_t state;         // idle, collecting, or skipping an overlong one
+} midi_sysex_buf;
+
+typedef struct {
+  midi_sink_fn sink;
+  void *ctx;
+  midi_sysex_buf sysex[MIDI_SYSEX_CABLES];
+  uint32_t packets;      // packets handed in
+  uint32_t msgs;         // messages handed to the sink
+  uint32_t malformed;    // status byte missing or not what the CIN says
+  uint32_t sysex_dropped; // too long, no buffer for the cable, or cut short
+} midi_decoder;
+
+void midi_dec_init(midi_decoder *d, midi_sink_fn sink, void *ctx);
+
+// one 4-byte USB-MIDI event packet, stamped `t` (passed through to the sink)
+void midi_dec_packet(midi_decoder *d, const uint8_t pkt[4], uint32_t t);
+
+// a bulk IN payload: back-to-back packets (a trailing partial one is ignored)
+void midi_dec_buffer(midi_decoder *d, const uint8_t *buf, size_t len, uint32_t t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MIDI_USB_MIDI_H
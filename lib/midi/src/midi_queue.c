@@ -0,0 +1,49 @@
+#include "midi/midi_queue.h"
+
+#include <string.h>
+
+#define MASK (MIDI_Q_SIZE - 1U)
+
+#if (MIDI_Q_SIZE & (MIDI_Q_SIZE - 1U)) != 0U
+#error "MIDI_Q_SIZE must be a power of two"
+#endif
+
+void midi_q_init(midi_queue *q) {
+  memset(q, 0, sizeof(*q));
+}
+
+bool midi_q_push(midi_queue *q, const midi_event *e) {
+  uint32_t head = q->head;   // ours
+  uint32_t n = head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  if (n >= MIDI_Q_SIZE) {
+    q->dropped++;
+    if (!q->full) {
+      q->full = true;
+      q->overflows++;
+    }
+    return false;
+  }
+  q->full = false;
+  q->ev[head & MASK] = *e;
+  __atomic_store_n(&q->head, head + 1U, __ATOMIC_RELEASE);
+  if (n + 1U > q->high_water) {
+    q->high_water = n + 1U;
+  }
+  return true;
+}
+
+bool midi_q_pop(midi_queue *q, midi_event *e) {
+  uint32_t tail = q->tail;   // ours
+  if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail) {
+    return false;
+  }
+  *e = q->ev[tail & MASK];
+  __atomic_store_n(&q->tail, tail + 1U, __ATOMIC_RELEASE);
+  return true;
+}
+
+uint32_t midi_q_count(const midi_queue *q) {
+  // tail first: head only grows, so it is never behind the tail read before it
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - tail;
+}
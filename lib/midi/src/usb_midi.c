@@ -0,0 +1,180 @@
+#include "midi/usb_midi.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+enum { SX_IDLE, SX_COLLECT, SX_SKIP };
+
+typedef void (*cin_fn)(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                       uint32_t t);
+
+static void emit(midi_decoder *d, midi_msg *m) {
+  d->msgs++;
+  d->sink(d->ctx, m);
+}
+
+static void init_msg(midi_msg *m, uint8_t type, uint8_t cable, uint8_t status, uint32_t t) {
+  memset(m, 0, sizeof(*m));
+  m->type = type;
+  m->cable = cable;
+  m->status = status;
+  m->t = t;
+}
+
+static midi_sysex_buf *sysex_of(midi_decoder *d, uint8_t cable) {
+  return (cable < MIDI_SYSEX_CABLES) ? &d->sysex[cable] : NULL;
+}
+
+// any status other than real-time ends a SysEx (MIDI 1.0): one still open on
+// the cable was cut short
+static void sysex_cut(midi_decoder *d, uint8_t cable) {
+  midi_sysex_buf *sx = sysex_of(d, cable);
+  if (sx != NULL && sx->state != SX_IDLE) {
+    if (sx->state == SX_COLLECT) {
+      d->sysex_dropped++;
+    }
+    sx->state = SX_IDLE;
+  }
+}
+
+static void h_ignore(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                     uint32_t t) {
+  (void)d; (void)cable; (void)cin; (void)b; (void)n; (void)t;
+}
+
+// 0x8..0xE: the status byte must be the message the CIN says
+static void h_channel(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                      uint32_t t) {
+  static const uint8_t type_of[7] = {MIDI_NOTE_OFF, MIDI_NOTE_ON,       MIDI_POLY_PRESSURE,
+                                     MIDI_CONTROL,  MIDI_PROGRAM,       MIDI_CHAN_PRESSURE,
+                                     MIDI_PITCH_BEND};
+  if ((b[0] >> 4) != cin || (b[1] & 0x80U) || (n > 2U && (b[2] & 0x80U))) {
+    d->malformed++;
+    return;
+  }
+  sysex_cut(d, cable);
+  midi_msg m;
+  init_msg(&m, type_of[cin - 0x8U], cable, b[0], t);
+  m.channel = b[0] & 0x0FU;
+  m.a = b[1];
+  m.b = (n > 2U) ? b[2] : 0U;
+  if (m.type == MIDI_NOTE_ON && m.b == 0U) {
+    m.type = MIDI_NOTE_OFF;
+  } else if (m.type == MIDI_PITCH_BEND) {
+    m.bend = (int16_t)((((uint16_t)b[2] << 7) | b[1]) - 8192);
+  }
+  emit(d, &m);
+}
+
+// system common: F1 (MTC quarter frame), F3 (song select) in 2 bytes, F2
+// (song position) in 3, F6 (tune request) in 1
+static void h_common(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                     uint32_t t) {
+  (void)cin;
+  static const uint8_t len_of[8] = {0, 2, 3, 2, 0, 0, 1, 0};   // F0..F7
+  if (b[0] < 0xF0U || b[0] > 0xF7U || len_of[b[0] & 7U] != n ||
+      (n > 1U && (b[1] & 0x80U)) || (n > 2U && (b[2] & 0x80U))) {
+    d->malformed++;
+    return;
+  }
+  sysex_cut(d, cable);
+  midi_msg m;
+  init_msg(&m, MIDI_SYSTEM, cable, b[0], t);
+  m.a = (n > 1U) ? b[1] : 0U;
+  m.b = (n > 2U) ? b[2] : 0U;
+  emit(d, &m);
+}
+
+// 0x4: SysEx start or continue; 0x5..0x7: its end, with 1..3 bytes (0x5 is
+// also a 1-byte system common message)
+static void h_sysex(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                    uint32_t t) {
+  if (cin == 0x5U && b[0] != 0xF7U) {
+    h_common(d, cable, cin, b, n, t);
+    return;
+  }
+  midi_sysex_buf *sx = sysex_of(d, cable);
+  if (sx == NULL) {
+    d->sysex_dropped += (b[0] == 0xF0U) ? 1U : 0U;
+    return;
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    uint8_t c = b[i];
+    bool last = (cin != 0x4U) && (i + 1U == n);
+    if (c == 0xF0U && i == 0U) {
+      if (sx->state == SX_COLLECT) {
+        d->sysex_dropped++;   // a new start: the open one never ended
+      }
+      sx->state = SX_COLLECT;
+      sx->len = 0U;
+    } else if (sx->state == SX_IDLE || (c & 0x80U) != (last ? 0x80U : 0U) ||
+               (last && c != 0xF7U)) {
+      // bytes with no start, a status byte in the data, an end that is not F7
+      d->malformed++;
+      if (sx->state == SX_COLLECT) {
+        d->sysex_dropped++;
+      }
+      sx->state = SX_IDLE;
+      return;
+    }
+    if (sx->state == SX_COLLECT) {
+      if (sx->len == MIDI_SYSEX_MAX) {
+        d->sysex_dropped++;
+        sx->state = SX_SKIP;   // read on to its F7, keep nothing
+      } else {
+        sx->buf[sx->len++] = c;
+      }
+    }
+  }
+  if (cin != 0x4U) {
+    if (sx->state == SX_COLLECT) {
+      midi_msg m;
+      init_msg(&m, MIDI_SYSEX, cable, 0xF0U, t);
+      m.data = sx->buf;
+      m.len = sx->len;
+      emit(d, &m);
+    }
+    sx->state = SX_IDLE;
+  }
+}
+
+// 0xF: one byte. real-time messages can come anywhere, SysEx included
+static void h_single(midi_decoder *d, uint8_t cable, uint8_t cin, const uint8_t *b, uint8_t n,
+                     uint32_t t) {
+  (void)cin; (void)n;
+  if (b[0] < 0xF8U) {
+    d->malformed++;
+    return;
+  }
+  midi_msg m;
+  init_msg(&m, MIDI_REALTIME, cable, b[0], t);
+  emit(d, &m);
+}
+
+static const struct {
+  uint8_t len;   // MIDI bytes in the packet
+  cin_fn fn;
+} cin_tab[16] = {
+  {0U, h_ignore},  {0U, h_ignore},  {2U, h_common},  {3U, h_common},
+  {3U, h_sysex},   {1U, h_sysex},   {2U, h_sysex},   {3U, h_sysex},
+  {3U, h_channel}, {3U, h_channel}, {3U, h_channel}, {3U, h_channel},
+  {2U, h_channel}, {2U, h_channel}, {3U, h_channel}, {1U, h_single},
+};
+
+void midi_dec_init(midi_decoder *d, midi_sink_fn sink, void *ctx) {
+  memset(d, 0, sizeof(*d));
+  d->sink = sink;
+  d->ctx = ctx;
+}
+
+void midi_dec_packet(midi_decoder *d, const uint8_t pkt[4], uint32_t t) {
+  uint8_t cin = pkt[0] & 0x0FU;
+  d->packets++;
+  cin_tab[cin].fn(d, (uint8_t)(pkt[0] >> 4), cin, &pkt[1], cin_tab[cin].len, t);
+}
+
+void midi_dec_buffer(midi_decoder *d, const uint8_t *buf, size_t len, uint32_t t) {
+  for (size_t i = 0; i + 4U <= len; i += 4U) {
+    midi_dec_packet(d, &buf[i], t);
+  }
+}
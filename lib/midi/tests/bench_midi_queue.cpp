@@ -0,0 +1,123 @@
+// host benchmark for the MIDI event queue (midi/midi_queue.h): what a push
+// costs the producer (the USB IN completion's share), and the latency from
+// push to pop with the consumer on its own thread, as a histogram.
+//
+// the producer plays MIDI the way a keyboard sends it: bursts (a chord, a
+// glissando's worth of packets in one USB frame) with gaps between. two
+// consumers:
+//
+//   spin      pops as fast as it can - the queue's own overhead
+//   1 ms tick sleeps 1 ms, drains, repeats - test_midi_synth's synth thread
+//
+//   make bench   (or: ./tests/bench_midi_queue.bin)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "midi/midi_queue.h"
+
+namespace {
+
+using clk = std::chrono::steady_clock;
+
+const auto T0 = clk::now();
+uint32_t now_ns() {
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - T0).count());
+}
+
+void push_cost() {
+  static midi_queue q;
+  midi_q_init(&q);
+  const unsigned n = 10000000U;
+  midi_event e = {0U, {0x09U, 0x90U, 60U, 100U}}, out;
+  auto t0 = clk::now();
+  for (unsigned i = 0; i < n; i++) {
+    e.t = i;
+    midi_q_push(&q, &e);
+    midi_q_pop(&q, &out);
+  }
+  double dt = std::chrono::duration<double>(clk::now() - t0).count();
+  printf("push + pop, one thread: %.2f ns per event\n", dt * 1e9 / n);
+}
+
+// log2 buckets of push-to-pop latency, from <1 us up
+const unsigned BUCKETS = 16U;
+
+void latency(const char *name, bool tick) {
+  static midi_queue q;
+  midi_q_init(&q);
+  std::atomic<bool> done(false);
+  std::vector<uint32_t> lat;
+  lat.reserve(200000U);
+
+  std::thread consumer([&] {
+    midi_event e;
+    for (;;) {
+      bool finished = done.load(std::memory_order_acquire);
+      bool any = false;
+      while (midi_q_pop(&q, &e)) {
+        lat.push_back(now_ns() - e.t);
+        any = true;
+      }
+      if (finished && !any) {
+        break;
+      }
+      if (tick) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  });
+
+  // bursts of 1..24 packets, 0.2..3 ms apart, for about two seconds
+  std::mt19937 rng(1U);
+  midi_event e = {0U, {0x09U, 0x90U, 60U, 100U}};
+  auto end = clk::now() + std::chrono::seconds(2);
+  unsigned sent = 0;
+  while (clk::now() < end) {
+    unsigned burst = 1U + rng() % 24U;
+    for (unsigned i = 0; i < burst; i++) {
+      e.t = now_ns();
+      midi_q_push(&q, &e);
+      sent++;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200U + rng() % 2800U));
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+
+  unsigned hist[BUCKETS] = {};
+  for (uint32_t ns : lat) {
+    unsigned b = 0;
+    for (uint32_t us = ns / 1000U; us != 0U && b < BUCKETS - 1U; us >>= 1) {
+      b++;
+    }
+    hist[b]++;
+  }
+  std::sort(lat.begin(), lat.end());
+  auto pct = [&](double p) { return lat.empty() ? 0.0 : lat[static_cast<size_t>(p * (lat.size() - 1U))] / 1000.0; };
+  printf("%s: %u events, %u dropped, high water %u/%u; latency us p50 %.1f p99 %.1f max %.1f\n", name,
+         sent, q.dropped, q.high_water, MIDI_Q_SIZE, pct(0.5), pct(0.99), pct(1.0));
+  for (unsigned b = 0; b < BUCKETS; b++) {
+    if (hist[b] == 0U) {
+      continue;
+    }
+    unsigned lo = b ? 1U << (b - 1U) : 0U;
+    unsigned bar = static_cast<unsigned>(50.0 * hist[b] / lat.size() + 0.5);
+    printf("  %6u..%-6u us %7u  %s\n", lo, 1U << b, hist[b], std::string(bar, '#').c_str());
+  }
+}
+
+} // namespace
+
+int main() {
+  push_cost();
+  latency("spin", false);
+  latency("1 ms tick", true);
+  return 0;
+}
@@ -0,0 +1,122 @@
+// host benchmark for the USB-MIDI packet decoder (midi/usb_midi.h): packets
+// per second through midi_dec_buffer into a sink that tallies message types.
+//
+// the input is a capture: back-to-back 4-byte USB-MIDI packets, as the bulk IN
+// payloads of a usbmon capture are (Wireshark: usb.capdata, exported as raw
+// bytes). give one as the argument; without one, a generated capture is used -
+// a keyboard player on cable 0 (notes, sustain pedal, mod wheel, pitch bend
+// and aftertouch streams, program changes, MIDI clock) and a synth editor on
+// cable 1 pulling patch dumps as SysEx.
+//
+//   make bench   (or: ./tests/bench_usb_midi.bin [capture.bin])
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "midi/usb_midi.h"
+
+namespace {
+
+void put(std::vector<uint8_t> &cap, uint8_t cable, uint8_t cin, uint8_t b0, uint8_t b1 = 0,
+         uint8_t b2 = 0) {
+  cap.push_back(static_cast<uint8_t>((cable << 4) | cin));
+  cap.push_back(b0);
+  cap.push_back(b1);
+  cap.push_back(b2);
+}
+
+std::vector<uint8_t> generated(unsigned seconds) {
+  std::mt19937 rng(1U);
+  std::vector<uint8_t> cap;
+  for (unsigned ms = 0; ms < seconds * 1000U; ms++) {
+    if (ms % 21U == 0U) {
+      put(cap, 0, 0xFU, 0xF8U); // clock, 24 ppqn at ~120 bpm
+    }
+    if (ms % 125U == 0U) {
+      uint8_t n = static_cast<uint8_t>(48U + rng() % 36U);
+      put(cap, 0, 0x9U, 0x90U, n, static_cast<uint8_t>(1U + rng() % 127U));
+      put(cap, 0, 0x9U, 0x90U, n, 0U);
+    }
+    if (ms % 10U == 0U) { // controller streams, a few at a time
+      put(cap, 0, 0xEU, 0xE0U, static_cast<uint8_t>(rng() & 0x7FU), static_cast<uint8_t>(rng() & 0x7FU));
+      put(cap, 0, 0xBU, 0xB0U, 1U, static_cast<uint8_t>(rng() & 0x7FU));
+      put(cap, 0, 0xDU, 0xD0U, static_cast<uint8_t>(rng() & 0x7FU));
+    }
+    if (ms % 500U == 0U) {
+      put(cap, 0, 0xBU, 0xB0U, 64U, (ms / 500U) % 2U ? 0U : 127U);
+      put(cap, 0, 0xCU, 0xC0U, static_cast<uint8_t>(rng() % 128U));
+    }
+    if (ms % 250U == 0U) { // a 100-byte patch dump
+      put(cap, 1, 0x4U, 0xF0U, 0x43U, 0x00U);
+      for (unsigned i = 0; i < 32U; i++) {
+        put(cap, 1, 0x4U, static_cast<uint8_t>(rng() & 0x7FU), static_cast<uint8_t>(rng() & 0x7FU),
+            static_cast<uint8_t>(rng() & 0x7FU));
+      }
+      put(cap, 1, 0x6U, static_cast<uint8_t>(rng() & 0x7FU), 0xF7U);
+    }
+  }
+  return cap;
+}
+
+struct tally {
+  unsigned long n[MIDI_MSG_TYPES] = {};
+  unsigned long sysex_bytes = 0;
+  static void fn(void *ctx, const midi_msg *m) {
+    tally *t = static_cast<tally *>(ctx);
+    t->n[m->type]++;
+    t->sysex_bytes += m->len;
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> cap;
+  if (argc > 1) {
+    FILE *f = fopen(argv[1], "rb");
+    if (f == nullptr) {
+      printf("can't open %s\n", argv[1]);
+      return 1;
+    }
+    uint8_t buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0U) {
+      cap.insert(cap.end(), buf, buf + got);
+    }
+    fclose(f);
+    printf("capture %s: %zu packets\n", argv[1], cap.size() / 4U);
+  } else {
+    cap = generated(60U);
+    printf("generated capture, 60 s of playing: %zu packets\n", cap.size() / 4U);
+  }
+
+  // one pass for the tally, then timed passes in 64-byte bulk IN transfers
+  tally t;
+  midi_decoder d;
+  midi_dec_init(&d, tally::fn, &t);
+  midi_dec_buffer(&d, cap.data(), cap.size(), 0U);
+  static const char *const names[MIDI_MSG_TYPES] = {"note off", "note on",  "poly pres", "control",
+                                                    "program",  "chan pres", "bend",     "system",
+                                                    "realtime", "sysex"};
+  for (unsigned i = 0; i < MIDI_MSG_TYPES; i++) {
+    if (t.n[i] != 0U) {
+      printf("  %-10s %8lu\n", names[i], t.n[i]);
+    }
+  }
+  printf("  sysex bytes %lu, malformed %u, sysex dropped %u\n", t.sysex_bytes, d.malformed,
+         d.sysex_dropped);
+
+  const unsigned passes = 20U;
+  auto t0 = std::chrono::steady_clock::now();
+  for (unsigned p = 0; p < passes; p++) {
+    for (size_t i = 0; i < cap.size(); i += 64U) {
+      midi_dec_buffer(&d, &cap[i], cap.size() - i < 64U ? cap.size() - i : 64U, 0U);
+    }
+  }
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  double pkts = static_cast<double>(cap.size() / 4U) * passes;
+  printf("decode: %.1f M packets/s (%.2f ns per packet)\n", pkts / dt / 1e6, dt * 1e9 / pkts);
+  return 0;
+}
@@ -0,0 +1,153 @@
+// host test for the MIDI event queue (midi/midi_queue.h): order, the full
+// ring (new events dropped, counted, bursts counted), the high-water mark,
+// counters wrapping past 2^32 - then a producer and a consumer thread running
+// flat out, checking every event arrives whole, in order, once, and that
+// what did not arrive is exactly what was counted as dropped.
+//
+//   make test   (or: ./tests/test_midi_queue.bin)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "midi/midi_queue.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+// event n: a note-on carrying n in its bytes and its time
+midi_event make(uint32_t n) {
+  midi_event e;
+  e.t = n;
+  e.pkt[0] = 0x09U;
+  e.pkt[1] = static_cast<uint8_t>(n);
+  e.pkt[2] = static_cast<uint8_t>(n >> 8);
+  e.pkt[3] = static_cast<uint8_t>(n >> 16);
+  return e;
+}
+bool whole(const midi_event &e) {
+  return e.pkt[0] == 0x09U && e.pkt[1] == static_cast<uint8_t>(e.t) &&
+         e.pkt[2] == static_cast<uint8_t>(e.t >> 8) && e.pkt[3] == static_cast<uint8_t>(e.t >> 16);
+}
+
+void basics() {
+  static midi_queue q;
+  midi_q_init(&q);
+  midi_event e;
+  CHECK(!midi_q_pop(&q, &e) && midi_q_count(&q) == 0U);
+
+  for (uint32_t i = 0; i < MIDI_Q_SIZE; i++) {
+    CHECK(midi_q_push(&q, &(e = make(i))));
+  }
+  CHECK(midi_q_count(&q) == MIDI_Q_SIZE && q.high_water == MIDI_Q_SIZE);
+
+  // full: the new one goes, the queued ones stay; one burst however long
+  CHECK(!midi_q_push(&q, &(e = make(1000))));
+  CHECK(!midi_q_push(&q, &(e = make(1001))));
+  CHECK(q.dropped == 2U && q.overflows == 1U);
+
+  CHECK(midi_q_pop(&q, &e) && e.t == 0U);
+  CHECK(midi_q_push(&q, &(e = make(MIDI_Q_SIZE))));
+  CHECK(!midi_q_push(&q, &(e = make(1002)))); // a second burst
+  CHECK(q.dropped == 3U && q.overflows == 2U);
+
+  for (uint32_t i = 1; i <= MIDI_Q_SIZE; i++) {
+    CHECK(midi_q_pop(&q, &e) && e.t == i && whole(e));
+  }
+  CHECK(!midi_q_pop(&q, &e));
+  CHECK(q.high_water == MIDI_Q_SIZE);
+}
+
+// the counters run free: a queue that has moved 2^32 events on still works
+void wrap() {
+  static midi_queue q;
+  midi_q_init(&q);
+  q.head = q.tail = 0xFFFFFFF0U;
+  uint32_t pushed = 0, popped = 0;
+  midi_event e;
+  for (unsigned round = 0; round < 40U; round++) {
+    for (unsigned i = 0; i < 5U + round % 7U; i++) {
+      CHECK(midi_q_push(&q, &(e = make(pushed++))));
+    }
+    CHECK(midi_q_count(&q) == pushed - popped);
+    for (unsigned i = 0; i < 4U + round % 5U && midi_q_pop(&q, &e); i++) {
+      CHECK(e.t == popped++);
+    }
+  }
+  while (midi_q_pop(&q, &e)) {
+    CHECK(e.t == popped++);
+  }
+  CHECK(popped == pushed && q.dropped == 0U && q.head < 0x1000U);
+}
+
+// producer and consumer on their own threads. a slow consumer (stalls now
+// and then) makes the ring fill up and drop
+void stress(const char *name, uint32_t n, bool stall) {
+  static midi_queue q;
+  midi_q_init(&q);
+  std::atomic<bool> done(false);
+  uint32_t got = 0, out_of_order = 0, torn = 0;
+  int64_t last = -1;
+
+  std::thread consumer([&] {
+    midi_event e;
+    unsigned k = 0;
+    for (;;) {
+      bool finished = done.load(std::memory_order_acquire);
+      if (!midi_q_pop(&q, &e)) {
+        if (finished) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      got++;
+      torn += whole(e) ? 0U : 1U;
+      out_of_order += (static_cast<int64_t>(e.t) > last) ? 0U : 1U;
+      last = e.t;
+      if (stall && ++k % 5000U == 0U) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+  });
+
+  uint32_t accepted = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    midi_event e = make(i);
+    accepted += midi_q_push(&q, &e) ? 1U : 0U;
+    if (i % 64U == 63U) {
+      std::this_thread::yield(); // a burst per USB frame, then a gap
+    }
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+
+  CHECK(torn == 0U && out_of_order == 0U);
+  CHECK(got == accepted && got + q.dropped == n);
+  CHECK(q.high_water <= MIDI_Q_SIZE);
+  CHECK(!stall || q.dropped > 0U);
+  printf("  %-8s %u events: %u delivered, %u dropped in %u overflows, high water %u/%u\n", name, n,
+         got, q.dropped, q.overflows, q.high_water, MIDI_Q_SIZE);
+}
+
+} // namespace
+
+int main() {
+  basics();
+  wrap();
+  printf("producer and consumer threads:\n");
+  stress("keeping up", 2000000U, false);
+  stress("stalling", 2000000U, true);
+  printf("test_midi_queue: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// host test for the USB-MIDI packet decoder (midi/usb_midi.h): every CIN
+// against the message it must produce, note-on at velocity 0, pitch bend at
+// its ends, SysEx put back together from packets (each end length, across
+// interleaved cables, with real-time bytes in between), and what must be
+// dropped or counted: overlong SysEx, SysEx cut short, stray continues, a
+// status byte that disagrees with its CIN, a cable with no SysEx buffer.
+//
+//   make test   (or: ./tests/test_usb_midi.bin)
+
+#include <cstdio>
+#include <vector>
+
+#include "midi/usb_midi.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+// what the sink got, SysEx bytes copied out
+struct got {
+  midi_msg m;
+  std::vector<uint8_t> data;
+};
+
+struct sink {
+  std::vector<got> msgs;
+  static void fn(void *ctx, const midi_msg *m) {
+    got g = {*m, {}};
+    if (m->type == MIDI_SYSEX) {
+      g.data.assign(m->data, m->data + m->len);
+      g.m.data = nullptr;
+    }
+    static_cast<sink *>(ctx)->msgs.push_back(g);
+  }
+};
+
+struct fixture {
+  sink s;
+  midi_decoder d;
+  fixture() { midi_dec_init(&d, sink::fn, &s); }
+  void pkt(uint8_t cable, uint8_t cin, uint8_t b0, uint8_t b1 = 0, uint8_t b2 = 0, uint32_t t = 0) {
+    const uint8_t p[4] = {static_cast<uint8_t>((cable << 4) | cin), b0, b1, b2};
+    midi_dec_packet(&d, p, t);
+  }
+  // a SysEx message cut into packets the way a device sends it
+  void sysex(uint8_t cable, const std::vector<uint8_t> &msg) {
+    size_t i = 0;
+    while (msg.size() - i > 3U) {
+      pkt(cable, 0x4U, msg[i], msg[i + 1U], msg[i + 2U]);
+      i += 3U;
+    }
+    size_t left = msg.size() - i;
+    pkt(cable, static_cast<uint8_t>(0x4U + left), msg[i], left > 1U ? msg[i + 1U] : 0U,
+        left > 2U ? msg[i + 2U] : 0U);
+  }
+  const midi_msg &last() const { return s.msgs.back().m; }
+};
+
+std::vector<uint8_t> sysex_msg(size_t len, uint8_t seed) {
+  std::vector<uint8_t> v(len);
+  v[0] = 0xF0U;
+  for (size_t i = 1; i + 1U < len; i++) {
+    v[i] = static_cast<uint8_t>((seed + i * 7U) & 0x7FU);
+  }
+  v[len - 1U] = 0xF7U;
+  return v;
+}
+
+void channel_voice() {
+  fixture f;
+  f.pkt(0, 0x9U, 0x93U, 60U, 100U, 1234U);
+  CHECK(f.last().type == MIDI_NOTE_ON && f.last().channel == 3U && f.last().a == 60U &&
+        f.last().b == 100U && f.last().t == 1234U && f.last().cable == 0U);
+  f.pkt(0, 0x9U, 0x93U, 60U, 0U);
+  CHECK(f.last().type == MIDI_NOTE_OFF && f.last().a == 60U && f.last().b == 0U);
+  f.pkt(0, 0x8U, 0x80U, 61U, 64U);
+  CHECK(f.last().type == MIDI_NOTE_OFF && f.last().a == 61U && f.last().b == 64U);
+  f.pkt(0, 0xAU, 0xA1U, 62U, 33U);
+  CHECK(f.last().type == MIDI_POLY_PRESSURE && f.last().channel == 1U && f.last().b == 33U);
+  f.pkt(0, 0xBU, 0xB0U, MIDI_CC_SUSTAIN, 127U);
+  CHECK(f.last().type == MIDI_CONTROL && f.last().a == MIDI_CC_SUSTAIN && f.last().b == 127U);
+  f.pkt(0, 0xBU, 0xBFU, MIDI_CC_MOD_WHEEL, 5U);
+  CHECK(f.last().type == MIDI_CONTROL && f.last().channel == 15U && f.last().a == 1U);
+  f.pkt(0, 0xCU, 0xC2U, 17U);
+  CHECK(f.last().type == MIDI_PROGRAM && f.last().a == 17U && f.last().b == 0U);
+  f.pkt(0, 0xDU, 0xD0U, 90U);
+  CHECK(f.last().type == MIDI_CHAN_PRESSURE && f.last().a == 90U);
+  f.pkt(0, 0xEU, 0xE0U, 0x00U, 0x40U);
+  CHECK(f.last().type == MIDI_PITCH_BEND && f.last().bend == 0);
+  f.pkt(0, 0xEU, 0xE0U, 0x00U, 0x00U);
+  CHECK(f.last().bend == -8192);
+  f.pkt(0, 0xEU, 0xE0U, 0x7FU, 0x7FU);
+  CHECK(f.last().bend == 8191);
+  CHECK(f.s.msgs.size() == 11U && f.d.msgs == 11U && f.d.malformed == 0U);
+
+  // any cable: channel messages need no state
+  f.pkt(15, 0x9U, 0x90U, 40U, 1U);
+  CHECK(f.last().cable == 15U && f.last().type == MIDI_NOTE_ON);
+
+  // the status must be what the CIN says, the data bytes data
+  size_t n = f.s.msgs.size();
+  f.pkt(0, 0x9U, 0x80U, 60U, 1U);   // CIN note-on, status note-off
+  f.pkt(0, 0xBU, 0x40U, 1U, 1U);    // running status: not in USB-MIDI
+  f.pkt(0, 0x9U, 0x90U, 0x80U, 1U); // a status byte as the note
+  CHECK(f.s.msgs.size() == n && f.d.malformed == 3U);
+
+  // reserved CINs: nothing, and not malformed
+  f.pkt(0, 0x0U, 0x90U, 60U, 1U);
+  f.pkt(0, 0x1U, 0x90U, 60U, 1U);
+  CHECK(f.s.msgs.size() == n && f.d.malformed == 3U && f.d.packets == 17U);
+}
+
+void system_msgs() {
+  fixture f;
+  f.pkt(0, 0x2U, 0xF1U, 0x35U);
+  CHECK(f.last().type == MIDI_SYSTEM && f.last().status == 0xF1U && f.last().a == 0x35U);
+  f.pkt(0, 0x3U, 0xF2U, 0x10U, 0x20U);
+  CHECK(f.last().status == 0xF2U && f.last().a == 0x10U && f.last().b == 0x20U);
+  f.pkt(0, 0x2U, 0xF3U, 5U);
+  CHECK(f.last().status == 0xF3U && f.last().a == 5U);
+  f.pkt(0, 0x5U, 0xF6U);
+  CHECK(f.last().type == MIDI_SYSTEM && f.last().status == 0xF6U);
+  const uint8_t rt[] = {0xF8U, 0xFAU, 0xFBU, 0xFCU, 0xFEU, 0xFFU};
+  for (uint8_t b : rt) {
+    f.pkt(1, 0xFU, b);
+    CHECK(f.last().type == MIDI_REALTIME && f.last().status == b && f.last().cable == 1U);
+  }
+  size_t n = f.s.msgs.size();
+  f.pkt(0, 0x2U, 0xF2U, 1U);        // song position is 3 bytes
+  f.pkt(0, 0x3U, 0xF4U, 1U, 1U);    // undefined
+  f.pkt(0, 0xFU, 0x90U);            // a single byte that is not real-time
+  CHECK(f.s.msgs.size() == n && f.d.malformed == 3U);
+}
+
+void sysex() {
+  fixture f;
+  // every end length: 1, 2 and 3 bytes in the last packet
+  for (size_t len = 2; len <= 20U; len++) {
+    std::vector<uint8_t> msg = sysex_msg(len, static_cast<uint8_t>(len));
+    f.sysex(0, msg);
+    CHECK(f.last().type == MIDI_SYSEX && f.s.msgs.back().data == msg);
+  }
+  CHECK(f.d.sysex_dropped == 0U && f.d.malformed == 0U);
+
+  // two cables at once, packet by packet, real-time bytes in between
+  std::vector<uint8_t> a = sysex_msg(40, 1), b = sysex_msg(31, 2);
+  fixture g;
+  size_t ia = 0, ib = 0;
+  while (ia < a.size() || ib < b.size()) {
+    for (int side = 0; side < 2; side++) {
+      const std::vector<uint8_t> &m = side ? b : a;
+      size_t &i = side ? ib : ia;
+      uint8_t cable = static_cast<uint8_t>(side);
+      if (i >= m.size()) {
+        continue;
+      }
+      size_t left = m.size() - i;
+      if (left > 3U) {
+        g.pkt(cable, 0x4U, m[i], m[i + 1U], m[i + 2U]);
+        i += 3U;
+      } else {
+        g.pkt(cable, static_cast<uint8_t>(0x4U + left), m[i], left > 1U ? m[i + 1U] : 0U,
+              left > 2U ? m[i + 2U] : 0U);
+        i = m.size();
+      }
+      g.pkt(cable, 0xFU, 0xF8U);
+    }
+  }
+  unsigned clocks = 0;
+  const got *ga = nullptr, *gb = nullptr;
+  for (const got &x : g.s.msgs) {
+    clocks += (x.m.type == MIDI_REALTIME) ? 1U : 0U;
+    if (x.m.type == MIDI_SYSEX) {
+      (x.m.cable == 0U ? ga : gb) = &x;
+    }
+  }
+  CHECK(ga != nullptr && gb != nullptr && ga->data == a && gb->data == b);
+  CHECK(clocks == g.d.packets / 2U && g.d.sysex_dropped == 0U);
+}
+
+void sysex_faults() {
+  fixture f;
+  // exactly MIDI_SYSEX_MAX fits; one more is dropped, and the next one is fine
+  std::vector<uint8_t> fits = sysex_msg(MIDI_SYSEX_MAX, 3);
+  f.sysex(0, fits);
+  CHECK(f.s.msgs.size() == 1U && f.s.msgs.back().data == fits);
+  f.sysex(0, sysex_msg(MIDI_SYSEX_MAX + 1U, 4));
+  f.sysex(0, sysex_msg(MIDI_SYSEX_MAX * 3U, 5));
+  CHECK(f.s.msgs.size() == 1U && f.d.sysex_dropped == 2U && f.d.malformed == 0U);
+  f.sysex(0, fits);
+  CHECK(f.s.msgs.size() == 2U);
+
+  // cut short by a channel message (which still plays), or by a new start
+  f.pkt(0, 0x4U, 0xF0U, 1U, 2U);
+  f.pkt(0, 0x9U, 0x90U, 60U, 100U);
+  CHECK(f.last().type == MIDI_NOTE_ON && f.d.sysex_dropped == 3U);
+  f.pkt(0, 0x4U, 0xF0U, 1U, 2U);
+  f.sysex(0, sysex_msg(9, 6));
+  CHECK(f.s.msgs.back().m.type == MIDI_SYSEX && f.s.msgs.back().data == sysex_msg(9, 6));
+  CHECK(f.d.sysex_dropped == 4U);
+
+  // a continue or an end with no start; a status byte inside; an end not F7
+  size_t n = f.s.msgs.size();
+  f.pkt(0, 0x4U, 1U, 2U, 3U);
+  f.pkt(0, 0x6U, 1U, 0xF7U);
+  f.pkt(0, 0x4U, 0xF0U, 1U, 0x90U);
+  f.pkt(0, 0x4U, 0xF0U, 1U, 2U);
+  f.pkt(0, 0x6U, 1U, 2U);
+  CHECK(f.s.msgs.size() == n && f.d.malformed == 4U && f.d.sysex_dropped == 6U);
+
+  // a cable with no buffer: counted once per message, nothing else breaks
+  uint8_t far = MIDI_SYSEX_CABLES;
+  f.sysex(far, sysex_msg(30, 7));
+  f.pkt(far, 0x9U, 0x90U, 50U, 50U);
+  CHECK(f.s.msgs.size() == n + 1U && f.last().cable == far && f.d.sysex_dropped == 7U);
+}
+
+} // namespace
+
+int main() {
+  channel_voice();
+  system_msgs();
+  sysex();
+  sysex_faults();
+  printf("test_usb_midi: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
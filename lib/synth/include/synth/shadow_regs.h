@@ -0,0 +1,69 @@
+// shadow of the FPGA's cheby `audio` register block (cheby/audio_regs.h) in
+// RAM. the synth writes the shadow as often as it likes; a flush, once per
+// control tick, puts on the FMC bus only the 16-bit registers whose value
+// differs from what the bus last got, lowest address first:
+//
+//   word[]    what the registers should hold
+//   bus[]     what the flushes last wrote (all writable words, after init)
+//   dirty     one bit per 16-bit word: word != bus
+//
+// a register set back to its flushed value before the flush is clean again,
+// so a gate toggled off and on within one tick costs nothing. address order
+// writes a voice's freq high half before its low half, as wr_freq32 did.
+//
+// only the writable words (audio ctrl, each voice's freq and ctrl) are
+// shadowed; the read-only ones (status, sample, dac) are read off the bus.
+// the bus write is a callback: the FMC store on the MCU, a counting fake on
+// the host.
+//
+// not locked: setters and flush run in one context, or the caller keeps the
+// setters out while it flushes (chSysLock around synth_regs_flush when they
+// run from a USB callback).
+
+#ifndef SYNTH_SHADOW_REGS_H
+#define SYNTH_SHADOW_REGS_H
+
+#include <stdint.h>
+
+#include "cheby/audio_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYNTH_REGS_WORDS  (AUDIO_SIZE / 2U)    // 16-bit words in the block
+#define SYNTH_REGS_VOICES ((AUDIO_SIZE - AUDIO_VOICE) / AUDIO_VOICE_SIZE)
+
+// one 16-bit bus write, `off` from the start of the audio block
+typedef void (*synth_regs_wr_fn)(void *ctx, uint32_t off, uint16_t v);
+
+typedef struct {
+  uint16_t word[SYNTH_REGS_WORDS];
+  uint16_t bus[SYNTH_REGS_WORDS];
+  uint64_t dirty;                   // bit n: word n to write
+  uint64_t writable;
+  uint64_t unknown;                 // not written since init: bus[] is a guess
+  synth_regs_wr_fn wr;
+  void *ctx;
+  uint32_t flushes;                 // flushes that wrote anything
+  uint32_t writes;                  // bus writes issued
+} synth_regs;
+
+// every writable register 0 and dirty: the first flush writes them all (all
+// voices gated off, audio ctrl cleared), whatever the FPGA held before
+void synth_regs_init(synth_regs *r, synth_regs_wr_fn wr, void *ctx);
+
+// one 16-bit register, by offset in the block (ignored if not writable)
+void synth_regs_set(synth_regs *r, uint32_t off, uint16_t v);
+
+void synth_regs_voice_freq(synth_regs *r, uint8_t voice, uint32_t inc);
+void synth_regs_voice_ctrl(synth_regs *r, uint8_t voice, uint16_t ctrl);
+
+// write the dirty registers in address order; returns how many
+unsigned synth_regs_flush(synth_regs *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYNTH_SHADOW_REGS_H
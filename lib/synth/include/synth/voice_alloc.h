@@ -0,0 +1,73 @@
+// voice allocation: which of the FPGA's DDS voices plays a MIDI note. every
+// operation is O(1) - no scan over the voices, whatever their count:
+//
+//   note -> voice   a 128-entry map, so note-off finds its voice directly
+//   free            voices that are silent, in the order they went silent
+//   released        voices whose key is up, oldest release first
+//   held            voices whose key is down, oldest note-on first
+//
+// the lists are doubly linked through per-voice next/prev indices; a voice
+// moves to the tail of one on each note-on / note-off, so each head is always
+// the oldest. a note-on takes a free voice; with none, it steals the
+// head of `released` (its tail is fading, or done), and only with none of
+// those the head of `held` - the oldest note still down. the newest note is
+// never stolen while there is another voice (one voice: plain mono, last note
+// wins).
+//
+// released voices stay mapped to their note: playing that note again while it
+// fades takes the same voice back rather than a second one. a voice goes back
+// to `free` only when the caller knows its release has finished
+// (synth_va_idle) - with a gate-only engine that never happens, and released
+// voices are simply reused oldest first.
+//
+// not locked: one context (the USB-MIDI note callback) owns the allocator.
+
+#ifndef SYNTH_VOICE_ALLOC_H
+#define SYNTH_VOICE_ALLOC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYNTH_VA_MAX   64U   // voices the allocator can manage
+#define SYNTH_NOTES    128U
+#define SYNTH_NO_VOICE 0xFFU
+#define SYNTH_NO_NOTE  0xFFU
+
+enum synth_va_state { SYNTH_VA_FREE, SYNTH_VA_RELEASED, SYNTH_VA_HELD, SYNTH_VA_LISTS };
+
+typedef struct {
+  uint8_t voices;
+  uint8_t head[SYNTH_VA_LISTS];   // oldest voice per state (free: any)
+  uint8_t tail[SYNTH_VA_LISTS];
+  uint8_t count[SYNTH_VA_LISTS];
+  uint8_t next[SYNTH_VA_MAX];     // towards the tail
+  uint8_t prev[SYNTH_VA_MAX];
+  uint8_t state[SYNTH_VA_MAX];    // enum synth_va_state
+  uint8_t note[SYNTH_VA_MAX];     // the note a voice plays (or last played)
+  uint8_t note_voice[SYNTH_NOTES];
+  uint32_t steals;                // note-ons that cut another note off
+} synth_va;
+
+// `voices` voices (1..SYNTH_VA_MAX), all free
+void synth_va_init(synth_va *va, unsigned voices);
+
+// a key went down: the voice to play `note` on. *stolen gets the note that
+// voice was playing and must stop (SYNTH_NO_NOTE if it was free, or already
+// `note`)
+uint8_t synth_va_on(synth_va *va, uint8_t note, uint8_t *stolen);
+
+// a key came up: the voice to gate off, or SYNTH_NO_VOICE if `note` is not held
+uint8_t synth_va_off(synth_va *va, uint8_t note);
+
+// a released voice has gone silent: it is free again (ignored if it is not
+// released)
+void synth_va_idle(synth_va *va, uint8_t voice);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYNTH_VOICE_ALLOC_H
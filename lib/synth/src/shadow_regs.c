@@ -0,0 +1,65 @@
+#include "synth/shadow_regs.h"
+
+#include <string.h>
+
+#if AUDIO_SIZE > 128
+#error "audio block outgrew the 64-bit dirty mask"
+#endif
+
+#define WORD(off) ((off) / 2U)
+
+void synth_regs_init(synth_regs *r, synth_regs_wr_fn wr, void *ctx) {
+  memset(r, 0, sizeof(*r));
+  r->wr = wr;
+  r->ctx = ctx;
+  r->writable = 1ULL << WORD(AUDIO_CTRL);
+  for (unsigned v = 0; v < SYNTH_REGS_VOICES; v++) {
+    uint32_t base = AUDIO_VOICE + v * AUDIO_VOICE_SIZE;
+    r->writable |= 3ULL << WORD(base + AUDIO_VOICE_FREQ);
+    r->writable |= 1ULL << WORD(base + AUDIO_VOICE_CTRL);
+  }
+  r->unknown = r->writable;
+  r->dirty = r->writable;
+}
+
+void synth_regs_set(synth_regs *r, uint32_t off, uint16_t v) {
+  uint32_t w = WORD(off);
+  if (w >= SYNTH_REGS_WORDS || !(r->writable & (1ULL << w))) {
+    return;
+  }
+  r->word[w] = v;
+  if (v != r->bus[w] || (r->unknown & (1ULL << w))) {
+    r->dirty |= 1ULL << w;
+  } else {
+    r->dirty &= ~(1ULL << w);   // back to what the bus has
+  }
+}
+
+void synth_regs_voice_freq(synth_regs *r, uint8_t voice, uint32_t inc) {
+  uint32_t off = AUDIO_VOICE + (uint32_t)voice * AUDIO_VOICE_SIZE + AUDIO_VOICE_FREQ;
+  synth_regs_set(r, off + 0U, (uint16_t)(inc >> 16));   // cheby big-endian: high half low addr
+  synth_regs_set(r, off + 2U, (uint16_t)(inc & 0xFFFFU));
+}
+
+void synth_regs_voice_ctrl(synth_regs *r, uint8_t voice, uint16_t ctrl) {
+  synth_regs_set(r, AUDIO_VOICE + (uint32_t)voice * AUDIO_VOICE_SIZE + AUDIO_VOICE_CTRL, ctrl);
+}
+
+unsigned synth_regs_flush(synth_regs *r) {
+  uint64_t d = r->dirty;
+  unsigned n = 0;
+  r->dirty = 0;
+  r->unknown &= ~d;
+  while (d != 0U) {
+    unsigned w = (unsigned)__builtin_ctzll(d);
+    d &= d - 1U;
+    r->wr(r->ctx, w * 2U, r->word[w]);
+    r->bus[w] = r->word[w];
+    n++;
+  }
+  if (n != 0U) {
+    r->flushes++;
+    r->writes += n;
+  }
+  return n;
+}
@@ -0,0 +1,104 @@
+#include "synth/voice_alloc.h"
+
+#include <string.h>
+
+// take v off the list it is on
+static void list_out(synth_va *va, uint8_t v) {
+  uint8_t s = va->state[v];
+  uint8_t p = va->prev[v];
+  uint8_t n = va->next[v];
+  if (p != SYNTH_NO_VOICE) {
+    va->next[p] = n;
+  } else {
+    va->head[s] = n;
+  }
+  if (n != SYNTH_NO_VOICE) {
+    va->prev[n] = p;
+  } else {
+    va->tail[s] = p;
+  }
+  va->count[s]--;
+}
+
+// put v at the tail of list s (the newest)
+static void list_in(synth_va *va, uint8_t v, uint8_t s) {
+  va->state[v] = s;
+  va->next[v] = SYNTH_NO_VOICE;
+  va->prev[v] = va->tail[s];
+  if (va->tail[s] != SYNTH_NO_VOICE) {
+    va->next[va->tail[s]] = v;
+  } else {
+    va->head[s] = v;
+  }
+  va->tail[s] = v;
+  va->count[s]++;
+}
+
+void synth_va_init(synth_va *va, unsigned voices) {
+  if (voices == 0U) {
+    voices = 1U;
+  }
+  if (voices > SYNTH_VA_MAX) {
+    voices = SYNTH_VA_MAX;
+  }
+  memset(va, 0, sizeof(*va));
+  va->voices = (uint8_t)voices;
+  memset(va->head, SYNTH_NO_VOICE, sizeof(va->head));
+  memset(va->tail, SYNTH_NO_VOICE, sizeof(va->tail));
+  memset(va->note, SYNTH_NO_NOTE, sizeof(va->note));
+  memset(va->note_voice, SYNTH_NO_VOICE, sizeof(va->note_voice));
+  for (unsigned v = 0; v < voices; v++) {
+    list_in(va, (uint8_t)v, SYNTH_VA_FREE);
+  }
+}
+
+uint8_t synth_va_on(synth_va *va, uint8_t note, uint8_t *stolen) {
+  note &= 0x7FU;
+  *stolen = SYNTH_NO_NOTE;
+
+  // the note already has a voice (held: a repeated note-on; released: still
+  // fading) - play it there again, as the newest
+  uint8_t v = va->note_voice[note];
+  if (v != SYNTH_NO_VOICE) {
+    list_out(va, v);
+    list_in(va, v, SYNTH_VA_HELD);
+    return v;
+  }
+
+  if (va->head[SYNTH_VA_FREE] != SYNTH_NO_VOICE) {
+    v = va->head[SYNTH_VA_FREE];
+  } else {
+    // the oldest release, else the oldest held note: never the newest, which
+    // is the tail of held and is reached only when it is the only voice
+    v = (va->head[SYNTH_VA_RELEASED] != SYNTH_NO_VOICE) ? va->head[SYNTH_VA_RELEASED]
+                                                        : va->head[SYNTH_VA_HELD];
+    *stolen = va->note[v];
+    va->note_voice[va->note[v]] = SYNTH_NO_VOICE;
+    va->steals++;
+  }
+  list_out(va, v);
+  list_in(va, v, SYNTH_VA_HELD);
+  va->note[v] = note;
+  va->note_voice[note] = v;
+  return v;
+}
+
+uint8_t synth_va_off(synth_va *va, uint8_t note) {
+  uint8_t v = va->note_voice[note & 0x7FU];
+  if (v == SYNTH_NO_VOICE || va->state[v] != SYNTH_VA_HELD) {
+    return SYNTH_NO_VOICE;
+  }
+  list_out(va, v);
+  list_in(va, v, SYNTH_VA_RELEASED);
+  return v;
+}
+
+void synth_va_idle(synth_va *va, uint8_t voice) {
+  if (voice >= va->voices || va->state[voice] != SYNTH_VA_RELEASED) {
+    return;
+  }
+  list_out(va, voice);
+  list_in(va, voice, SYNTH_VA_FREE);
+  va->note_voice[va->note[voice]] = SYNTH_NO_VOICE;
+  va->note[voice] = SYNTH_NO_NOTE;
+}
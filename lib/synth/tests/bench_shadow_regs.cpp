@@ -0,0 +1,280 @@
+// host benchmark: FMC bus writes with the register shadow (synth/shadow_regs.h)
+// against writing each register straight to the bus, as test_midi_synth.c and
+// test_env_autogate.c did. the fake FMC (fake_fmc.h) counts the transactions;
+// the shadow is flushed once per 1 ms control tick. three workloads, played
+// tick by tick:
+//
+//   midi      a minute of playing on 8 voices (synth/voice_alloc.h), gate
+//             only: legato chords every half second, a sixteenth-note line
+//             with repeated notes, and a glissando run now and then. each
+//             note-on was freq (2 writes) + ctrl, each note-off ctrl
+//   envelope  test_env_autogate's firmware ADSR on one voice, pots fixed:
+//             ctrl rewritten every 1 ms whether the level moved or not
+//   poly adsr the midi playing with that ADSR on every voice: 8 ctrl writes
+//             per tick, plus the note-on tuning words
+//
+// printed per workload: bus writes each way, the reduction, and the largest
+// single flush (the worst burst a tick puts on the bus).
+//
+//   make bench   (or: ./tests/bench_shadow_regs.bin)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "fake_fmc.h"
+#include "synth/shadow_regs.h"
+#include "synth/voice_alloc.h"
+
+namespace {
+
+const unsigned VOICES = SYNTH_REGS_VOICES;
+const uint32_t SAMPLE_RATE = 48000U;
+const unsigned WAVE = 0U;
+
+struct event {
+  uint32_t ms;
+  uint8_t note;
+  uint8_t vel;   // 0: note-off
+};
+
+uint16_t voice_ctrl(uint8_t gate, uint8_t wave, uint8_t level) {
+  return static_cast<uint16_t>((gate & 1U) | ((wave & 7U) << 1) | (static_cast<uint16_t>(level) << 8));
+}
+
+uint32_t note_inc(uint8_t n) {
+  double hz = 440.0 * std::pow(2.0, (n - 69) / 12.0);
+  return static_cast<uint32_t>(hz * 4294967296.0 / static_cast<double>(SAMPLE_RATE) + 0.5);
+}
+
+// a minute of playing, sorted by time
+std::vector<event> performance(uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<event> ev;
+  const uint32_t len = 60000U;
+  static const uint8_t roots[4] = {48, 53, 55, 45};
+  static const uint8_t triad[4] = {0, 4, 7, 12};
+  // legato chords: the next chord's note-ons in the same tick as the last
+  // chord's note-offs
+  for (uint32_t t = 0, c = 0; t + 500U <= len; t += 500U, c++) {
+    for (uint8_t s : triad) {
+      uint8_t n = static_cast<uint8_t>(roots[(c / 2U) % 4U] + s);
+      ev.push_back({t, n, 90});
+      ev.push_back({t + 500U, n, 0});
+    }
+  }
+  // sixteenths at 120 bpm, mostly stepwise, often the same note twice
+  uint8_t n = 72;
+  for (uint32_t t = 0; t + 125U <= len; t += 125U) {
+    unsigned r = rng() % 6U;
+    n = static_cast<uint8_t>(r < 2U ? n : (r < 4U ? n + 2U : n - 2U));
+    n = static_cast<uint8_t>(n < 65U ? 65U : (n > 84U ? 84U : n));
+    ev.push_back({t, n, static_cast<uint8_t>(70U + rng() % 40U)});
+    ev.push_back({t + 100U, n, 0});
+  }
+  // every 8 s a two-octave run, a key every 12 ms, each held 30 ms
+  for (uint32_t t = 4000U; t + 400U <= len; t += 8000U) {
+    for (unsigned k = 0; k < 24U; k++) {
+      ev.push_back({t + 12U * k, static_cast<uint8_t>(60U + k), 100});
+      ev.push_back({t + 12U * k + 30U, static_cast<uint8_t>(60U + k), 0});
+    }
+  }
+  std::stable_sort(ev.begin(), ev.end(), [](const event &a, const event &b) {
+    return a.ms < b.ms || (a.ms == b.ms && a.vel == 0U && b.vel != 0U);
+  });
+  return ev;
+}
+
+// test_env_autogate.c's ADSR (1 ms step), with the pots at fixed values
+struct adsr {
+  enum { IDLE, ATTACK, DECAY, SUSTAIN, RELEASE };
+  int env = IDLE;
+  float lvl = 0.0f;
+  float rel_step = 0.0f;
+  float peak = 255.0f;
+
+  static constexpr float SUS = 160.0f;
+  static constexpr float ATK_MS = 300.0f, DEC_MS = 200.0f, REL_MS = 800.0f;
+
+  void gate(bool on, uint8_t vel = 127U) {
+    if (on) {
+      env = ATTACK;
+      peak = 2.0f * vel;
+    } else if (env != IDLE) {
+      env = RELEASE;
+      rel_step = lvl / REL_MS;
+      if (rel_step <= 0.0f) {
+        rel_step = 0.5f;
+      }
+    }
+  }
+  uint8_t step() {
+    float sus = SUS * peak / 255.0f;
+    switch (env) {
+    case ATTACK:
+      lvl += peak / ATK_MS;
+      if (lvl >= peak) {
+        lvl = peak;
+        env = DECAY;
+      }
+      break;
+    case DECAY:
+      lvl -= (peak - sus) / DEC_MS;
+      if (lvl <= sus) {
+        lvl = sus;
+        env = SUSTAIN;
+      }
+      break;
+    case SUSTAIN:
+      lvl = sus;
+      break;
+    case RELEASE:
+      lvl -= rel_step;
+      if (lvl <= 0.0f) {
+        lvl = 0.0f;
+        env = IDLE;
+      }
+      break;
+    default:
+      lvl = 0.0f;
+      break;
+    }
+    return static_cast<uint8_t>(lvl + 0.5f);
+  }
+  uint8_t on() const { return env == IDLE ? 0U : 1U; }
+};
+
+struct result {
+  unsigned long direct = 0;
+  unsigned long shadow = 0;
+  unsigned worst = 0;   // most writes in one flush
+  bool same = true;     // both buses ended up holding the same registers
+};
+
+bool same_regs(const fake_fmc &a, const fake_fmc &b, const synth_regs &r) {
+  for (unsigned w = 0; w < SYNTH_REGS_WORDS; w++) {
+    if (((r.writable >> w) & 1U) && a.mem[w] != b.mem[w]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void flush(synth_regs &r, result &res) {
+  unsigned n = synth_regs_flush(&r);
+  res.worst = n > res.worst ? n : res.worst;
+}
+
+// the same playing twice: straight to one fake bus, through the shadow to
+// another. `env` gives every voice the ADSR, ticked each ms
+result play(const std::vector<event> &ev, bool env) {
+  fake_fmc direct, shadowed;
+  direct.logging = shadowed.logging = false;
+  synth_regs r;
+  synth_regs_init(&r, fake_fmc::bus, &shadowed);
+  synth_regs_flush(&r);
+  unsigned long init_writes = shadowed.writes;
+
+  synth_va va_d, va_s;
+  synth_va_init(&va_d, VOICES);
+  synth_va_init(&va_s, VOICES);
+  adsr env_d[SYNTH_REGS_VOICES], env_s[SYNTH_REGS_VOICES];
+
+  result res;
+  size_t i = 0;
+  uint32_t end = ev.empty() ? 0U : ev.back().ms + 2000U;
+  for (uint32_t ms = 0; ms < end; ms++) {
+    for (; i < ev.size() && ev[i].ms == ms; i++) {
+      const event &e = ev[i];
+      uint8_t stolen;
+      if (e.vel != 0U) {
+        uint8_t v = synth_va_on(&va_d, e.note, &stolen);
+        direct.wr_freq32(voice_freq_off(v), note_inc(e.note));
+        v = synth_va_on(&va_s, e.note, &stolen);
+        synth_regs_voice_freq(&r, v, note_inc(e.note));
+        if (env) {
+          env_d[v].gate(true, e.vel);
+          env_s[v].gate(true, e.vel);
+        } else {
+          direct.wr(voice_ctrl_off(v), voice_ctrl(1U, WAVE, static_cast<uint8_t>(e.vel << 1)));
+          synth_regs_voice_ctrl(&r, v, voice_ctrl(1U, WAVE, static_cast<uint8_t>(e.vel << 1)));
+        }
+      } else {
+        uint8_t v = synth_va_off(&va_d, e.note);
+        synth_va_off(&va_s, e.note);
+        if (v == SYNTH_NO_VOICE) {
+          continue;
+        }
+        if (env) {
+          env_d[v].gate(false);
+          env_s[v].gate(false);
+        } else {
+          direct.wr(voice_ctrl_off(v), voice_ctrl(0U, WAVE, 0U));
+          synth_regs_voice_ctrl(&r, v, voice_ctrl(0U, WAVE, 0U));
+        }
+      }
+    }
+    if (env) {
+      for (unsigned v = 0; v < VOICES; v++) {
+        uint8_t lvl = env_d[v].step();
+        direct.wr(voice_ctrl_off(v), voice_ctrl(env_d[v].on(), WAVE, lvl));
+        lvl = env_s[v].step();
+        synth_regs_voice_ctrl(&r, static_cast<uint8_t>(v), voice_ctrl(env_s[v].on(), WAVE, lvl));
+      }
+    }
+    flush(r, res);
+  }
+  res.direct = direct.writes;
+  res.shadow = shadowed.writes - init_writes;
+  res.same = same_regs(direct, shadowed, r);
+  return res;
+}
+
+// test_env_autogate: one voice, retriggered every 3 s, gate held 400 ms
+result autogate(unsigned cycles) {
+  fake_fmc direct, shadowed;
+  direct.logging = shadowed.logging = false;
+  synth_regs r;
+  synth_regs_init(&r, fake_fmc::bus, &shadowed);
+  synth_regs_flush(&r);
+  unsigned long init_writes = shadowed.writes;
+  adsr d, s;
+  result res;
+  for (uint32_t ms = 0; ms < cycles * 3000U; ms++) {
+    uint32_t t = ms % 3000U;
+    if (t == 0U || t == 400U) {
+      d.gate(t == 0U);
+      s.gate(t == 0U);
+    }
+    uint8_t lvl = d.step();
+    direct.wr(voice_ctrl_off(0), voice_ctrl(d.on(), 2U, lvl));
+    lvl = s.step();
+    synth_regs_voice_ctrl(&r, 0, voice_ctrl(s.on(), 2U, lvl));
+    flush(r, res);
+  }
+  res.direct = direct.writes;
+  res.shadow = shadowed.writes - init_writes;
+  res.same = same_regs(direct, shadowed, r);
+  return res;
+}
+
+bool report(const char *name, const result &res) {
+  printf("  %-10s %10lu %10lu %9.1fx %6u%s\n", name, res.direct, res.shadow,
+         res.shadow ? static_cast<double>(res.direct) / res.shadow : 0.0, res.worst,
+         res.same ? "" : "  (registers differ!)");
+  return res.same;
+}
+
+} // namespace
+
+int main() {
+  std::vector<event> ev = performance(1U);
+  printf("FMC bus writes, shadow flushed each 1 ms tick (%zu MIDI events):\n", ev.size());
+  printf("  %-10s %10s %10s %10s %6s\n", "workload", "direct", "shadow", "fewer", "burst");
+  bool ok = report("midi", play(ev, false));
+  ok &= report("envelope", autogate(20U));
+  ok &= report("poly adsr", play(ev, true));
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+// host benchmark for voice allocation (synth/voice_alloc.h) against the inline
+// allocator test_midi_synth.c had: a scan for a free voice, a round-robin
+// victim when there is none, and a scan again on note-off. two MIDI traces:
+//
+//   chords     : 10-note chords over four octaves, each struck before the last
+//                one is fully let go (legato), so every chord steals
+//   glissando  : a run up and down the keyboard, each key let go three keys
+//                later, at the speed of a palm slide
+//
+// printed per trace and voice count: host time per event (allocate or release,
+// the whole trace timed over many passes), and how the steals went - held
+// notes cut off, released voices taken over mid-fade (the inline allocator
+// frees on note-off; its count is notes struck twice, whose second voice the
+// note-off never found and left gated on), how many cut off the newest
+// note, and how many took a held note while a released one was there to take.
+//
+//   make bench   (or: ./tests/bench_voice_alloc.bin)
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "synth/voice_alloc.h"
+
+namespace {
+
+struct event {
+  uint8_t note;
+  uint8_t on;
+};
+
+using trace = std::vector<event>;
+
+trace chords(unsigned n, uint32_t seed) {
+  std::mt19937 rng(seed);
+  trace t;
+  std::vector<uint8_t> prev;
+  for (unsigned c = 0; c < n; c++) {
+    std::vector<uint8_t> cur;
+    uint8_t root = static_cast<uint8_t>(36U + rng() % 12U);
+    static const uint8_t shape[10] = {0, 7, 12, 16, 19, 24, 28, 31, 36, 40};
+    for (uint8_t s : shape) {
+      cur.push_back(static_cast<uint8_t>(root + s));
+    }
+    for (uint8_t nt : cur) {
+      t.push_back({nt, 1U});
+    }
+    for (uint8_t nt : prev) {
+      t.push_back({nt, 0U});
+    }
+    prev = cur;
+  }
+  for (uint8_t nt : prev) {
+    t.push_back({nt, 0U});
+  }
+  return t;
+}
+
+trace glissando(unsigned passes) {
+  trace t;
+  std::vector<uint8_t> run;
+  for (unsigned p = 0; p < passes; p++) {
+    for (unsigned nt = 21U; nt <= 108U; nt++) {
+      run.push_back(static_cast<uint8_t>(nt));
+    }
+    for (unsigned nt = 107U; nt > 21U; nt--) {
+      run.push_back(static_cast<uint8_t>(nt));
+    }
+  }
+  for (size_t i = 0; i < run.size(); i++) {
+    t.push_back({run[i], 1U});
+    if (i >= 3U) {
+      t.push_back({run[i - 3U], 0U});
+    }
+  }
+  return t;
+}
+
+// test_midi_synth.c's note_cb, minus the register writes
+struct inline_alloc {
+  static constexpr bool frees_on_off = true;
+  unsigned n;
+  uint8_t voice_note[SYNTH_VA_MAX];
+  uint8_t steal_next = 0;
+
+  explicit inline_alloc(unsigned voices) : n(voices) { memset(voice_note, 0xFF, sizeof(voice_note)); }
+  uint8_t on(uint8_t note, uint8_t *stolen) {
+    uint8_t v = 0xFFU;
+    for (uint8_t i = 0; i < n; i++) {
+      if (voice_note[i] == 0xFFU) {
+        v = i;
+        break;
+      }
+    }
+    *stolen = SYNTH_NO_NOTE;
+    if (v == 0xFFU) {
+      v = steal_next;
+      steal_next = static_cast<uint8_t>((steal_next + 1U) % n);
+      *stolen = voice_note[v];
+    }
+    voice_note[v] = note;
+    return v;
+  }
+  uint8_t off(uint8_t note) {
+    for (uint8_t i = 0; i < n; i++) {
+      if (voice_note[i] == note) {
+        voice_note[i] = 0xFFU;
+        return i;
+      }
+    }
+    return SYNTH_NO_VOICE;
+  }
+};
+
+struct va_alloc {
+  static constexpr bool frees_on_off = false; // released voices fade on
+  synth_va va;
+  explicit va_alloc(unsigned voices) { synth_va_init(&va, voices); }
+  uint8_t on(uint8_t note, uint8_t *stolen) { return synth_va_on(&va, note, stolen); }
+  uint8_t off(uint8_t note) { return synth_va_off(&va, note); }
+};
+
+struct quality {
+  unsigned cut = 0;      // a note still held was cut off
+  unsigned faded = 0;    // a released voice was taken over mid-fade
+  unsigned newest = 0;   // the victim was the most recent note-on
+  unsigned held = 0;     // a held note went while a released one was sounding
+};
+
+// steal quality, by replaying the trace and tracking what each voice holds
+template <typename A> quality judge(const trace &t, unsigned voices) {
+  A a(voices);
+  quality q;
+  std::vector<int> held_note(128, 0);  // key down
+  std::vector<int> sounding(128, 0);   // has a voice (held or fading)
+  int last_on = -1;
+  for (const event &e : t) {
+    if (e.on) {
+      uint8_t stolen = 0;
+      a.on(e.note, &stolen);
+      if (stolen != SYNTH_NO_NOTE && stolen != e.note) {
+        q.cut += held_note[stolen] ? 1U : 0U;
+        q.faded += held_note[stolen] ? 0U : 1U;
+        q.newest += (static_cast<int>(stolen) == last_on) ? 1U : 0U;
+        bool any_released = false;
+        for (unsigned n = 0; n < 128U; n++) {
+          any_released |= sounding[n] && !held_note[n];
+        }
+        q.held += (held_note[stolen] && any_released) ? 1U : 0U;
+        sounding[stolen] = 0;
+        held_note[stolen] = 0;
+      }
+      held_note[e.note] = 1;
+      sounding[e.note] = 1;
+      last_on = e.note;
+    } else {
+      a.off(e.note);
+      held_note[e.note] = 0;
+      if (A::frees_on_off) {
+        sounding[e.note] = 0;
+      }
+    }
+  }
+  return q;
+}
+
+template <typename A> double ns_per_event(const trace &t, unsigned voices) {
+  const unsigned reps = 200U;
+  volatile uint8_t sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (unsigned r = 0; r < reps; r++) {
+    A a(voices);
+    for (const event &e : t) {
+      uint8_t stolen = 0;
+      sink = sink + (e.on ? a.on(e.note, &stolen) : a.off(e.note));
+    }
+  }
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return dt * 1e9 / (static_cast<double>(reps) * t.size());
+}
+
+void report(const char *name, const trace &t) {
+  printf("%s (%zu events):\n", name, t.size());
+  printf("  %6s  %-8s %9s %7s %7s %7s %7s\n", "voices", "alloc", "ns/event", "cut", "faded",
+         "newest", "held");
+  const unsigned counts[] = {8U, 32U, SYNTH_VA_MAX};
+  for (unsigned n : counts) {
+    quality qi = judge<inline_alloc>(t, n);
+    quality qa = judge<va_alloc>(t, n);
+    printf("  %6u  %-8s %9.2f %7u %7u %7u %7u\n", n, "inline", ns_per_event<inline_alloc>(t, n),
+           qi.cut, qi.faded, qi.newest, qi.held);
+    printf("  %6u  %-8s %9.2f %7u %7u %7u %7u\n", n, "synth_va", ns_per_event<va_alloc>(t, n),
+           qa.cut, qa.faded, qa.newest, qa.held);
+  }
+}
+
+} // namespace
+
+int main() {
+  report("chords", chords(2000U, 1U));
+  report("glissando", glissando(100U));
+  return 0;
+}
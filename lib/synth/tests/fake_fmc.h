@@ -0,0 +1,44 @@
+// the FPGA's audio register block as the host tests and benches see it: a
+// 16-bit memory behind the synth_regs write callback, counting every bus
+// write and logging their offsets, so a test can check what reached the bus
+// and a bench can count what a workload costs in FMC transactions.
+
+#ifndef SYNTH_TESTS_FAKE_FMC_H
+#define SYNTH_TESTS_FAKE_FMC_H
+
+#include <cstdint>
+#include <vector>
+
+#include "synth/shadow_regs.h"
+
+struct fake_fmc {
+  uint16_t mem[SYNTH_REGS_WORDS] = {};
+  unsigned long writes = 0;
+  std::vector<uint32_t> log;   // offsets written, in bus order
+  bool logging = true;
+
+  // a register write straight to the bus, the way the firmware did it
+  void wr(uint32_t off, uint16_t v) {
+    mem[off / 2U] = v;
+    writes++;
+    if (logging) {
+      log.push_back(off);
+    }
+  }
+  void wr_freq32(uint32_t off, uint32_t f) {
+    wr(off + 0U, static_cast<uint16_t>(f >> 16));
+    wr(off + 2U, static_cast<uint16_t>(f & 0xFFFFU));
+  }
+
+  // the synth_regs backend
+  static void bus(void *ctx, uint32_t off, uint16_t v) { static_cast<fake_fmc *>(ctx)->wr(off, v); }
+};
+
+inline uint32_t voice_freq_off(unsigned v) {
+  return AUDIO_VOICE + v * AUDIO_VOICE_SIZE + AUDIO_VOICE_FREQ;
+}
+inline uint32_t voice_ctrl_off(unsigned v) {
+  return AUDIO_VOICE + v * AUDIO_VOICE_SIZE + AUDIO_VOICE_CTRL;
+}
+
+#endif // SYNTH_TESTS_FAKE_FMC_H
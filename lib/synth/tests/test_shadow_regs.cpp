@@ -0,0 +1,160 @@
+// host test for the audio register shadow (synth/shadow_regs.h) against the
+// fake FMC (fake_fmc.h): the first flush writes every writable register, a
+// flush writes only what changed and in address order, a value set back before
+// the flush costs nothing, read-only registers are never written - then random
+// register traffic, checking after every flush that the bus holds the shadow.
+//
+//   make test   (or: ./tests/test_shadow_regs.bin)
+
+#include <cstdio>
+#include <random>
+
+#include "fake_fmc.h"
+#include "synth/shadow_regs.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+const unsigned WRITABLE = 1U + 3U * SYNTH_REGS_VOICES;   // ctrl, then freq hi/lo + ctrl per voice
+
+bool ascending(const std::vector<uint32_t> &log) {
+  for (size_t i = 1; i < log.size(); i++) {
+    if (log[i] <= log[i - 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void basics() {
+  fake_fmc fmc;
+  for (uint16_t &m : fmc.mem) {
+    m = 0x5A5AU; // whatever the FPGA held
+  }
+  synth_regs r;
+  synth_regs_init(&r, fake_fmc::bus, &fmc);
+
+  // the first flush writes them all, zeros included, lowest address first
+  CHECK(synth_regs_flush(&r) == WRITABLE);
+  CHECK(fmc.log.size() == WRITABLE && ascending(fmc.log));
+  CHECK(fmc.log.front() == AUDIO_CTRL && fmc.log.back() == voice_ctrl_off(SYNTH_REGS_VOICES - 1U));
+  CHECK(fmc.mem[AUDIO_CTRL / 2U] == 0U && fmc.mem[voice_ctrl_off(3) / 2U] == 0U);
+  CHECK(fmc.mem[AUDIO_STATUS / 2U] == 0x5A5AU && fmc.mem[AUDIO_DAC / 2U] == 0x5A5AU);
+  CHECK(synth_regs_flush(&r) == 0U);
+
+  // the same value again: nothing
+  synth_regs_voice_ctrl(&r, 2, 0U);
+  CHECK(synth_regs_flush(&r) == 0U);
+
+  // set, then back before the flush: nothing
+  synth_regs_voice_ctrl(&r, 2, 0x8001U);
+  synth_regs_voice_ctrl(&r, 2, 0U);
+  CHECK(r.dirty == 0U && synth_regs_flush(&r) == 0U);
+
+  // many sets in a tick: one write, the last value
+  fmc.log.clear();
+  for (uint16_t lvl = 0; lvl < 100U; lvl++) {
+    synth_regs_voice_ctrl(&r, 5, static_cast<uint16_t>((lvl << 8) | 1U));
+  }
+  CHECK(synth_regs_flush(&r) == 1U);
+  CHECK(fmc.log.size() == 1U && fmc.log[0] == voice_ctrl_off(5));
+  CHECK(fmc.mem[voice_ctrl_off(5) / 2U] == ((99U << 8) | 1U));
+
+  // a tuning word: high half at the lower address, first; an unchanged half
+  // is not written
+  fmc.log.clear();
+  synth_regs_voice_freq(&r, 1, 0x00258BF2U);
+  CHECK(synth_regs_flush(&r) == 2U);
+  CHECK(fmc.log.size() == 2U && fmc.log[0] == voice_freq_off(1) &&
+        fmc.log[1] == voice_freq_off(1) + 2U);
+  CHECK(fmc.mem[voice_freq_off(1) / 2U] == 0x0025U && fmc.mem[voice_freq_off(1) / 2U + 1U] == 0x8BF2U);
+  fmc.log.clear();
+  synth_regs_voice_freq(&r, 1, 0x00250000U);
+  CHECK(synth_regs_flush(&r) == 1U && fmc.log[0] == voice_freq_off(1) + 2U);
+
+  // writes from several voices come out in address order, not call order
+  fmc.log.clear();
+  synth_regs_voice_ctrl(&r, 7, 1U);
+  synth_regs_voice_freq(&r, 0, 0x12345678U);
+  synth_regs_set(&r, AUDIO_CTRL, AUDIO_CTRL_ENABLE);
+  synth_regs_voice_ctrl(&r, 3, 1U);
+  CHECK(synth_regs_flush(&r) == 5U && ascending(fmc.log));
+  CHECK(fmc.log.front() == AUDIO_CTRL);
+
+  // read-only, padding and out-of-block offsets are never shadowed
+  fmc.log.clear();
+  synth_regs_set(&r, AUDIO_STATUS, 1U);
+  synth_regs_set(&r, AUDIO_SAMPLE, 1U);
+  synth_regs_set(&r, AUDIO_DAC, 1U);
+  synth_regs_set(&r, 0x20U, 1U);
+  synth_regs_set(&r, AUDIO_VOICE + AUDIO_VOICE_CTRL + 2U, 1U);
+  synth_regs_set(&r, AUDIO_SIZE, 1U);
+  synth_regs_set(&r, 0xFFFFU, 1U);
+  CHECK(r.dirty == 0U && synth_regs_flush(&r) == 0U && fmc.log.empty());
+  CHECK(r.writes == fmc.writes);
+}
+
+// random register traffic: after every flush the bus holds the shadow, and
+// the flush wrote exactly the words whose bus value changed
+void random_traffic(uint32_t seed) {
+  std::mt19937 rng(seed);
+  fake_fmc fmc;
+  fmc.logging = false;
+  synth_regs r;
+  synth_regs_init(&r, fake_fmc::bus, &fmc);
+  synth_regs_flush(&r);
+  unsigned bad = 0;
+  for (unsigned tick = 0; tick < 20000U; tick++) {
+    uint16_t before[SYNTH_REGS_WORDS];
+    for (unsigned w = 0; w < SYNTH_REGS_WORDS; w++) {
+      before[w] = fmc.mem[w];
+    }
+    unsigned n = rng() % 12U;
+    for (unsigned i = 0; i < n; i++) {
+      uint8_t v = static_cast<uint8_t>(rng() % SYNTH_REGS_VOICES);
+      switch (rng() % 3U) {
+      case 0: // a few values only, so sets often land back where the bus is
+        synth_regs_voice_ctrl(&r, v, static_cast<uint16_t>(rng() % 3U));
+        break;
+      case 1:
+        synth_regs_voice_freq(&r, v, (rng() % 4U) * 0x00010001U);
+        break;
+      default:
+        synth_regs_set(&r, rng() % (AUDIO_SIZE + 8U), static_cast<uint16_t>(rng() % 2U));
+        break;
+      }
+    }
+    unsigned long w0 = fmc.writes;
+    unsigned got = synth_regs_flush(&r);
+    unsigned changed = 0;
+    for (unsigned w = 0; w < SYNTH_REGS_WORDS; w++) {
+      changed += (fmc.mem[w] != before[w]) ? 1U : 0U;
+      bool writable = (r.writable >> w) & 1U;
+      bad += (writable && fmc.mem[w] != r.word[w]) ? 1U : 0U;
+    }
+    bad += (got != fmc.writes - w0 || got != changed) ? 1U : 0U;
+  }
+  CHECK(bad == 0U);
+  printf("  seed %u: 20000 ticks, %lu bus writes, %u mismatches\n", seed, fmc.writes, bad);
+}
+
+} // namespace
+
+int main() {
+  basics();
+  printf("random register traffic:\n");
+  for (uint32_t seed = 1; seed <= 3U; seed++) {
+    random_traffic(seed);
+  }
+  printf("test_shadow_regs: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+// host test for the voice allocator (synth/voice_alloc.h): the stealing order,
+// the note map and its edge cases, then long random MIDI traces checked step
+// by step against a reference allocator that scans every voice - the policy
+// spelled out the slow way - at several voice counts.
+//
+//   make test   (or: ./tests/test_voice_alloc.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "synth/voice_alloc.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+// the lists agree with the per-voice state, and the note map with the notes
+void check_lists(const synth_va &va) {
+  unsigned seen = 0;
+  for (unsigned s = 0; s < SYNTH_VA_LISTS; s++) {
+    unsigned n = 0;
+    uint8_t prev = SYNTH_NO_VOICE;
+    for (uint8_t v = va.head[s]; v != SYNTH_NO_VOICE; v = va.next[v]) {
+      CHECK(va.state[v] == s && va.prev[v] == prev);
+      prev = v;
+      if (++n > va.voices) {
+        break;
+      }
+    }
+    CHECK(va.tail[s] == prev && va.count[s] == n);
+    seen += n;
+  }
+  CHECK(seen == va.voices);
+  for (unsigned note = 0; note < SYNTH_NOTES; note++) {
+    uint8_t v = va.note_voice[note];
+    CHECK(v == SYNTH_NO_VOICE || (v < va.voices && va.note[v] == note &&
+                                  va.state[v] != SYNTH_VA_FREE));
+  }
+}
+
+uint8_t on(synth_va &va, uint8_t note, uint8_t want_stolen = SYNTH_NO_NOTE) {
+  uint8_t stolen = 0;
+  uint8_t v = synth_va_on(&va, note, &stolen);
+  CHECK(stolen == want_stolen);
+  return v;
+}
+
+void basics() {
+  synth_va va;
+  synth_va_init(&va, 4U);
+  // free voices first, each note its own
+  uint8_t a = on(va, 60), b = on(va, 64), c = on(va, 67), d = on(va, 70);
+  CHECK(a != b && a != c && a != d && b != c && b != d && c != d);
+  CHECK(va.count[SYNTH_VA_HELD] == 4U && va.steals == 0U);
+  check_lists(va);
+
+  // all held: the oldest note goes, never the newest
+  CHECK(on(va, 72, 60) == a);
+  CHECK(on(va, 74, 64) == b);
+  check_lists(va);
+
+  // a released voice goes before any held one, the oldest release first
+  CHECK(synth_va_off(&va, 70) == d);
+  CHECK(synth_va_off(&va, 67) == c);
+  CHECK(on(va, 76, 70) == d);
+  CHECK(on(va, 77, 67) == c);
+  check_lists(va);
+
+  // note-off of a note not held, twice, or stolen: nothing
+  CHECK(synth_va_off(&va, 60) == SYNTH_NO_VOICE);
+  CHECK(synth_va_off(&va, 72) == a);
+  CHECK(synth_va_off(&va, 72) == SYNTH_NO_VOICE);
+
+  // the same note again while it fades takes its voice back
+  CHECK(on(va, 72) == a);
+  CHECK(va.state[a] == SYNTH_VA_HELD);
+  // and a repeated note-on while held keeps it, as the newest
+  CHECK(on(va, 74) == b);
+  CHECK(va.tail[SYNTH_VA_HELD] == b);
+  check_lists(va);
+
+  // a finished release frees the voice and forgets its note
+  CHECK(synth_va_off(&va, 76) == d);
+  synth_va_idle(&va, d);
+  CHECK(va.state[d] == SYNTH_VA_FREE && va.note_voice[76] == SYNTH_NO_VOICE);
+  synth_va_idle(&va, b); // held: ignored
+  CHECK(va.state[b] == SYNTH_VA_HELD);
+  synth_va_idle(&va, 200U); // out of range: ignored
+  CHECK(on(va, 79) == d); // the free voice, nothing stolen
+  check_lists(va);
+}
+
+// one voice is mono: the last note wins
+void mono() {
+  synth_va va;
+  synth_va_init(&va, 1U);
+  CHECK(on(va, 60) == 0U);
+  CHECK(on(va, 62, 60) == 0U);
+  CHECK(synth_va_off(&va, 60) == SYNTH_NO_VOICE);
+  CHECK(synth_va_off(&va, 62) == 0U);
+  check_lists(va);
+
+  synth_va_init(&va, 0U); // clamped
+  CHECK(va.voices == 1U);
+  synth_va_init(&va, 1000U);
+  CHECK(va.voices == SYNTH_VA_MAX);
+  check_lists(va);
+}
+
+// the policy the slow way: every voice scanned, the oldest by stamp
+struct reference {
+  unsigned n;
+  uint8_t state[SYNTH_VA_MAX];
+  uint8_t note[SYNTH_VA_MAX];
+  uint64_t stamp[SYNTH_VA_MAX];
+  uint64_t now = 0;
+
+  explicit reference(unsigned voices) : n(voices) {
+    for (unsigned v = 0; v < n; v++) {
+      state[v] = SYNTH_VA_FREE;
+      note[v] = SYNTH_NO_NOTE;
+      stamp[v] = now++;
+    }
+  }
+  int oldest(uint8_t s) const {
+    int best = -1;
+    for (unsigned v = 0; v < n; v++) {
+      if (state[v] == s && (best < 0 || stamp[v] < stamp[best])) {
+        best = static_cast<int>(v);
+      }
+    }
+    return best;
+  }
+  uint8_t on(uint8_t nt, uint8_t *stolen) {
+    *stolen = SYNTH_NO_NOTE;
+    int v = -1;
+    for (unsigned i = 0; i < n; i++) {
+      if (state[i] != SYNTH_VA_FREE && note[i] == nt) {
+        v = static_cast<int>(i);
+      }
+    }
+    if (v < 0) {
+      v = oldest(SYNTH_VA_FREE);
+      if (v < 0) {
+        v = oldest(SYNTH_VA_RELEASED);
+        if (v < 0) {
+          v = oldest(SYNTH_VA_HELD);
+        }
+        *stolen = note[v];
+      }
+    }
+    state[v] = SYNTH_VA_HELD;
+    note[v] = nt;
+    stamp[v] = now++;
+    return static_cast<uint8_t>(v);
+  }
+  uint8_t off(uint8_t nt) {
+    for (unsigned i = 0; i < n; i++) {
+      if (state[i] == SYNTH_VA_HELD && note[i] == nt) {
+        state[i] = SYNTH_VA_RELEASED;
+        stamp[i] = now++;
+        return static_cast<uint8_t>(i);
+      }
+    }
+    return SYNTH_NO_VOICE;
+  }
+  void idle(uint8_t v) {
+    if (v < n && state[v] == SYNTH_VA_RELEASED) {
+      state[v] = SYNTH_VA_FREE;
+      note[v] = SYNTH_NO_NOTE;
+      stamp[v] = now++;
+    }
+  }
+};
+
+// random traces: notes bunched in a range so they repeat and collide, some
+// note-offs for notes never played, some releases run out
+void against_reference(unsigned voices, uint32_t seed) {
+  std::mt19937 rng(seed);
+  synth_va va;
+  synth_va_init(&va, voices);
+  reference ref(voices);
+  unsigned mismatches = 0;
+  uint32_t ref_steals = 0;
+  for (unsigned i = 0; i < 200000U; i++) {
+    unsigned r = rng() % 100U;
+    uint8_t nt = static_cast<uint8_t>(48U + rng() % 24U);
+    if (r < 50U) {
+      uint8_t s1 = 0, s2 = 0;
+      uint8_t v1 = synth_va_on(&va, nt, &s1);
+      uint8_t v2 = ref.on(nt, &s2);
+      ref_steals += (s2 != SYNTH_NO_NOTE) ? 1U : 0U;
+      mismatches += (v1 != v2 || s1 != s2) ? 1U : 0U;
+    } else if (r < 90U) {
+      mismatches += (synth_va_off(&va, nt) != ref.off(nt)) ? 1U : 0U;
+    } else {
+      uint8_t v = static_cast<uint8_t>(rng() % (voices + 2U));
+      synth_va_idle(&va, v);
+      ref.idle(v);
+    }
+    if (i % 997U == 0U) {
+      check_lists(va);
+    }
+  }
+  check_lists(va);
+  CHECK(mismatches == 0U);
+  CHECK(va.steals == ref_steals);
+  printf("  %2u voices: 200000 events, %6lu steals, %u mismatches\n", voices,
+         static_cast<unsigned long>(va.steals), mismatches);
+}
+
+} // namespace
+
+int main() {
+  basics();
+  mono();
+  printf("against the scanning reference:\n");
+  const unsigned counts[] = {1U, 2U, 8U, 16U, SYNTH_VA_MAX};
+  uint32_t seed = 1U;
+  for (unsigned n : counts) {
+    against_reference(n, seed++);
+  }
+  printf("test_voice_alloc: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
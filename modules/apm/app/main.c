@@ -8,14 +8,83 @@
 #include "bsp/utils/bsp_io.h"
 #include "bsp/configs/bsp_uart_config.h"
 
+#include "bootloader/confirm.h"
+#include "bootloader/frame.h"
+#include "bootloader/memmap.h"
+#include "bootloader/protocol.h"
+#include "bootloader/update_req.h"
 
+#define REQ_BAUD 1000000 // the bootloader's UPD_BAUD: the host opens the line at it
+
+// a HELLO on the update UART, parsed a char at a time while no receive is armed
+static bl_frame_rx hello_rx;
+static binary_semaphore_t hello_sem;
+
+// tell the bootloader this app came up (bootloader/confirm.h): it confirms the
+// slot in the boot pointer on the next boot. until then every boot counts
+// against the slot, and BL_BOOT_TRIES of them send the board back to the image
+// before it
+static void confirm_boot(void) {
+  RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+  PWR->CR1 |= PWR_CR1_DBP; // backup domain writes
+  __DSB();
+  bl_confirm_set((bl_confirm *)BL_CONFIRM_RAM);
+}
+
+// the host's HELLO is the cue for update mode (bootloader/update_req.h). the app
+// does not answer it: it leaves a request for the bootloader and resets, and
+// the bootloader answers the host's next HELLO
+static void rxchar_cb(UARTDriver *uartp, uint16_t c) {
+  (void)uartp;
+  if (bl_frame_feed(&hello_rx, (uint8_t)c) == BL_FRAME_OK && hello_rx.frame.type == BL_HELLO) {
+    chSysLockFromISR();
+    chBSemSignalI(&hello_sem);
+    chSysUnlockFromISR();
+  }
+}
+
+static const UARTConfig hello_cfg = {
+  .txend1_cb  = NULL,
+  .txend2_cb  = NULL,
+  .rxend_cb   = NULL,
+  .rxchar_cb  = rxchar_cb,
+  .rxerr_cb   = NULL,
+  .timeout_cb = NULL,
+  .timeout    = 0,
+  .speed      = REQ_BAUD,
+  .cr1        = 0,
+  .cr2        = USART_CR2_STOP1_BITS,
+  .cr3        = 0,
+};
+
+static void watch_hello(void) {
+  bl_frame_rx_init(&hello_rx);
+  chBSemObjectInit(&hello_sem, true);
+  palSetPadMode(GPIOC, 11, PAL_MODE_ALTERNATE(8)); // UART4_RX
+  palSetPadMode(GPIOC, 10, PAL_MODE_ALTERNATE(8)); // UART4_TX
+  uartStart(&UARTD4, &hello_cfg);
+}
+
+// the request survives the reset in backup SRAM, enabled as in confirm_boot
+static void enter_update(void) {
+  bsp_printf("HELLO on UART4, resetting into update mode\n");
+  RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+  PWR->CR1 |= PWR_CR1_DBP;
+  __DSB();
+  bl_update_req_set((bl_update_req *)BL_UPDATE_REQ_RAM, BL_REQ_HOST);
+  NVIC_SystemReset();
+}
 
 int main(void) {
   bsp_init(); // Call the unified BSP initialization function
 
   bsp_printf("Audio Peripheral Module (APM) Application v1.0.0\n");
+  confirm_boot();
+  watch_hello();
 
   while (true) {
-    chThdSleepMilliseconds(500);
+    if (chBSemWaitTimeout(&hello_sem, TIME_MS2I(500)) == MSG_OK) {
+      enter_update();
+    }
   }
 }
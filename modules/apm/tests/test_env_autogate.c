@@ -16,6 +16,7 @@
 #include "drivers/adc.h"
 #include "cheby/core_regs.h"
 #include "cheby/audio_regs.h"
+#include "synth/shadow_regs.h"
 
 // ---- FMC + audio register access (from test_pot_level.c) ---------------------
 #define FMC_FPGA_BASE 0x60000000UL
@@ -29,12 +30,11 @@ static inline void wr(uint32_t off, uint16_t v) {
 }
 
 #define A_DAC           (AUDIO_BASE + AUDIO_DAC)
-#define A_VOICE_FREQ(i) (AUDIO_BASE + AUDIO_VOICE + (i) * AUDIO_VOICE_SIZE + AUDIO_VOICE_FREQ)
-#define A_VOICE_CTRL(i) (AUDIO_BASE + AUDIO_VOICE + (i) * AUDIO_VOICE_SIZE + AUDIO_VOICE_CTRL)
 
-static inline void wr_freq32(uint32_t base, uint32_t f) {
-  wr(base + 0, (uint16_t)(f >> 16));
-  wr(base + 2, (uint16_t)(f & 0xFFFFU));
+// synth_regs backend: its offsets are from the start of the audio block
+static void audio_bus(void *ctx, uint32_t off, uint16_t v) {
+  (void)ctx;
+  wr(AUDIO_BASE + off, v);
 }
 static inline uint16_t voice_ctrl(uint8_t gate, uint8_t wave, uint8_t level) {
   return (uint16_t)((gate & 1U) | ((wave & 7U) << 1) | ((uint16_t)level << 8));
@@ -131,10 +131,15 @@ int main(void) {
   uint16_t magic = rd(CORE_MAGIC);
   bsp_printf("MAGIC = 0x%04X %s\n", (unsigned)magic, (magic == 0xACE1U) ? "OK" : "FAIL");
 
-  // voice0 at A440, level animated by the envelope below
+  // voice0 at A440, level animated by the envelope below. the envelope
+  // writes the shadow every tick; the flush only touches the bus when the
+  // level (or gate) actually moved
+  static synth_regs regs;
+  synth_regs_init(&regs, audio_bus, NULL);
   uint32_t inc = (uint32_t)(440.0 * 4294967296.0 / (double)SAMPLE_RATE + 0.5);
-  wr_freq32(A_VOICE_FREQ(0), inc);
-  wr(A_VOICE_CTRL(0), voice_ctrl(0U, SYNTH_WAVE, 0U));
+  synth_regs_voice_freq(&regs, 0U, inc);
+  synth_regs_voice_ctrl(&regs, 0U, voice_ctrl(0U, SYNTH_WAVE, 0U));
+  synth_regs_flush(&regs);
 
   palSetPadMode(GPIOA, 4, PAL_MODE_INPUT_ANALOG);
   dacStart(&DACD1, &dac_cfg);
@@ -206,14 +211,15 @@ int main(void) {
 
     uint8_t level = (uint8_t)(lvl + 0.5f);
     uint8_t gate  = (env == ENV_IDLE) ? 0U : 1U;
-    wr(A_VOICE_CTRL(0), voice_ctrl(gate, SYNTH_WAVE, level));
+    synth_regs_voice_ctrl(&regs, 0U, voice_ctrl(gate, SYNTH_WAVE, level));
+    synth_regs_flush(&regs);
 
     if (++dbg >= 250U) {                    // ~4 Hz status
       dbg = 0U;
-      bsp_printf("A=%5u D=%5u S=%5u R=%5u  env=%d lvl=%3u\r\n",
+      bsp_printf("A=%5u D=%5u S=%5u R=%5u  env=%d lvl=%3u  fmc wr=%lu\r\n",
                  (unsigned)pot[CH_ATK], (unsigned)pot[CH_DEC],
                  (unsigned)pot[CH_SUS], (unsigned)pot[CH_REL],
-                 env, (unsigned)level);
+                 env, (unsigned)level, (unsigned long)regs.writes);
     }
 
     if (++t >= PERIOD_MS) { t = 0U; }
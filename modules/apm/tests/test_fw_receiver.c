@@ -70,13 +70,13 @@ static void handle_frame(const bl_frame *f) {
 
     case BL_MANIFEST: {
       if (f->len < sizeof(bl_manifest)) {
-        bl_result r = {.status = BL_ERR_PROTO, .reserved = 0, .bytes = 0};
+        bl_result r = {.status = BL_ERR_PROTO, .seq = 0, .bytes = 0};
         send_frame(BL_NAK, 0U, &r, sizeof(r));
         break;
       }
       memcpy(&manifest, f->payload, sizeof(manifest));
       if (manifest.magic != BL_MANIFEST_MAGIC || !target_ok(manifest.target)) {
-        bl_result r = {.status = BL_ERR_TARGET, .reserved = 0, .bytes = 0};
+        bl_result r = {.status = BL_ERR_TARGET, .seq = 0, .bytes = 0};
         send_frame(BL_NAK, 0U, &r, sizeof(r));
         bsp_printf("MANIFEST rejected: magic=0x%08lX target=%u\r\n",
                    (unsigned long)manifest.magic, (unsigned)manifest.target);
@@ -114,7 +114,7 @@ static void handle_frame(const bl_frame *f) {
       } else {
         st = BL_OK;
       }
-      bl_result r = {.status = st, .reserved = 0, .bytes = img_bytes};
+      bl_result r = {.status = st, .seq = 0, .bytes = img_bytes};
       send_frame(BL_RESULT, 0U, &r, sizeof(r));
       bsp_printf("DONE bytes=%lu crc=0x%08lX (want %lu / 0x%08lX) -> %s\r\n",
                  (unsigned long)img_bytes, (unsigned long)final_crc,
@@ -146,7 +146,7 @@ int main(void) {
       if (s == BL_FRAME_OK) {
         handle_frame(&rx.frame);
       } else if (s == BL_FRAME_BAD_CRC) {
-        bl_result r = {.status = BL_ERR_CRC, .reserved = 0, .bytes = img_bytes};
+        bl_result r = {.status = BL_ERR_CRC, .seq = 0, .bytes = img_bytes};
         send_frame(BL_NAK, 0U, &r, sizeof(r));
         bsp_printf("frame crc bad\r\n");
       }
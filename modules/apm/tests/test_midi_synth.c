@@ -1,13 +1,16 @@
 // minimal MIDI synth: USB-MIDI keyboard -> FPGA DDS voice -> DAC/PA4.
 //
 // ties together the working pieces:
-//   USB host (OTG_FS, PA11/PA12)  -> usbh_midi note events
-//   note -> tuning word           -> acm_top audio voice0 over FMC
+//   USB host (OTG_FS, PA11/PA12)  -> usbh_midi packets, queued (midi/midi_queue.h)
+//   synth thread, 1 ms tick       -> note -> tuning word -> audio register shadow
+//                                    (synth/shadow_regs.h), one flush per tick
+//                                 -> acm_top audio voices over FMC
 //   FPGA dds_synth                -> `sample` register
 //   GPT @ Fs reads sample         -> DAC1/PA4
 //
-// monophonic, notes only (velocity -> level is free, so it's wired). play a key,
-// hear it on PA4. one voice for now; polyphony/voice-allocation comes later.
+// notes (velocity -> level), sustain pedal and pitch bend; midi/usb_midi.h
+// decodes the rest too, unused here. play a key, hear it on PA4. polyphonic:
+// synth/voice_alloc.h picks the voice, one per held note.
 
 #include <math.h>
 
@@ -18,6 +21,10 @@
 #include "bsp/utils/bsp_io.h"
 
 #include "usbh_midi.h"
+#include "midi/midi_queue.h"
+#include "midi/usb_midi.h"
+#include "synth/voice_alloc.h"
+#include "synth/shadow_regs.h"
 #include "cheby/core_regs.h"
 #include "cheby/audio_regs.h"
 
@@ -34,12 +41,11 @@ static inline void wr(uint32_t off, uint16_t v) {
 
 #define A_SAMPLE        (AUDIO_BASE + AUDIO_SAMPLE)
 #define A_DAC           (AUDIO_BASE + AUDIO_DAC)     // FPGA 12-bit DAC-ready code
-#define A_VOICE_FREQ(i) (AUDIO_BASE + AUDIO_VOICE + (i) * AUDIO_VOICE_SIZE + AUDIO_VOICE_FREQ)
-#define A_VOICE_CTRL(i) (AUDIO_BASE + AUDIO_VOICE + (i) * AUDIO_VOICE_SIZE + AUDIO_VOICE_CTRL)
 
-static inline void wr_freq32(uint32_t base, uint32_t f) {
-  wr(base + 0, (uint16_t)(f >> 16));      // cheby big-endian: high half low addr
-  wr(base + 2, (uint16_t)(f & 0xFFFFU));
+// synth_regs backend: its offsets are from the start of the audio block
+static void audio_bus(void *ctx, uint32_t off, uint16_t v) {
+  (void)ctx;
+  wr(AUDIO_BASE + off, v);
 }
 static inline uint16_t voice_ctrl(uint8_t gate, uint8_t wave, uint8_t level) {
   return (uint16_t)((gate & 1U) | ((wave & 7U) << 1) | ((uint16_t)level << 8));
@@ -110,11 +116,18 @@ static const GPTConfig gpt_cfg = {
 static dacsample_t *const dac_src = (dacsample_t *)(FMC_FPGA_BASE + A_DAC);
 
 #define SYNTH_WAVE  0U                  // 0=sine 1=saw 2=square 3=triangle
-#define NVOICES     8U                  // matches audio_regs voice[8]
+// the voice array in audio_regs: voice[8] today, follows the yaml if it grows
+#define NVOICES     ((AUDIO_SIZE - AUDIO_VOICE) / AUDIO_VOICE_SIZE)
 
 static uint32_t note_inc[128];          // MIDI note -> DDS tuning word
-static uint8_t  voice_note[NVOICES];    // MIDI note each voice plays, 0xFF = free
-static uint8_t  steal_next = 0U;        // round-robin victim when all voices busy
+static synth_va voices;                 // which voice plays which note
+static synth_regs regs;                 // audio block shadow, flushed each tick
+static midi_queue midi_in;              // USB IN completion -> synth thread
+static midi_decoder midi_dec;           // queued packets -> synth_msg
+static bool     sustain;                // pedal down (CC 64)
+static bool     pedal_held[128];        // released while the pedal was down
+static double   bend_mul = 1.0;         // pitch bend, as a tuning word factor
+static volatile uint32_t lat_max;       // worst queued -> on the FMC, in cycles
 
 static void build_note_table(void) {
   // inc = note_freq * 2^32 / Fs ; note_freq = 440 * 2^((n-69)/12).
@@ -127,37 +140,99 @@ static void build_note_table(void) {
 }
 
 static void synth_all_off(void) {
-  for (uint8_t i = 0; i < NVOICES; i++) {
-    voice_note[i] = 0xFFU;
-    wr(A_VOICE_CTRL(i), voice_ctrl(0U, SYNTH_WAVE, 0U));
-  }
+  synth_va_init(&voices, NVOICES);
+  synth_regs_init(&regs, audio_bus, NULL);  // every voice gated off, freq 0
+  synth_regs_flush(&regs);
 }
 
-// polyphonic note handler: one DDS voice per held note, FPGA mixes all 8.
-// called from the USB-MIDI driver on each note event (IN-completion context).
-static void note_cb(uint8_t note, uint8_t vel, bool on) {
+// polyphonic note handler: one DDS voice per held note, FPGA mixes them all.
+// the allocator is O(1) either way; when it steals, it's the oldest released
+// voice, else the oldest held note - the gate just moves to the new pitch.
+// only the shadow is written here; the synth thread flushes it.
+static void synth_note(uint8_t note, uint8_t vel, bool on) {
   note &= 0x7FU;
   if (on) {
-    uint8_t v = 0xFFU;                          // grab a free voice...
-    for (uint8_t i = 0; i < NVOICES; i++) {
-      if (voice_note[i] == 0xFFU) { v = i; break; }
-    }
-    if (v == 0xFFU) {                           // ...or steal one (round-robin)
-      v = steal_next;
-      steal_next = (uint8_t)((steal_next + 1U) % NVOICES);
-    }
-    voice_note[v] = note;
-    wr_freq32(A_VOICE_FREQ(v), note_inc[note]);
-    wr(A_VOICE_CTRL(v), voice_ctrl(1U, SYNTH_WAVE, (uint8_t)(vel << 1)));
+    uint8_t stolen;
+    uint8_t v = synth_va_on(&voices, note, &stolen);
+    pedal_held[note] = false;
+    synth_regs_voice_freq(&regs, v, (uint32_t)(note_inc[note] * bend_mul));
+    synth_regs_voice_ctrl(&regs, v, voice_ctrl(1U, SYNTH_WAVE, (uint8_t)(vel << 1)));
   }
   else {
-    for (uint8_t i = 0; i < NVOICES; i++) {     // release the voice on this note
-      if (voice_note[i] == note) {
-        wr(A_VOICE_CTRL(i), voice_ctrl(0U, SYNTH_WAVE, 0U));
-        voice_note[i] = 0xFFU;
-        break;
+    uint8_t v = synth_va_off(&voices, note);    // release the voice on this note
+    if (v != SYNTH_NO_VOICE) {
+      synth_regs_voice_ctrl(&regs, v, voice_ctrl(0U, SYNTH_WAVE, 0U));
+    }
+  }
+}
+
+// decoded MIDI: notes, the sustain pedal (a note let go while it is down keeps
+// its gate until the pedal comes up) and pitch bend (+-2 semitones: every
+// sounding voice retuned; a bend sweep costs a flush per tick, not per message)
+static void synth_msg(void *ctx, const midi_msg *m) {
+  (void)ctx;
+  switch (m->type) {
+    case MIDI_NOTE_ON:
+      synth_note(m->a, m->b, true);
+      break;
+    case MIDI_NOTE_OFF:
+      if (sustain) {
+        pedal_held[m->a] = true;
+      }
+      else {
+        synth_note(m->a, 0U, false);
+      }
+      break;
+    case MIDI_CONTROL:
+      if (m->a == MIDI_CC_SUSTAIN) {
+        sustain = (m->b >= 64U);
+        for (uint8_t n = 0; !sustain && n < 128U; n++) {
+          if (pedal_held[n]) {
+            pedal_held[n] = false;
+            synth_note(n, 0U, false);
+          }
+        }
+      }
+      break;
+    case MIDI_PITCH_BEND:
+      bend_mul = pow(2.0, (double)m->bend / (8192.0 * 6.0));
+      for (uint8_t v = 0; v < NVOICES; v++) {
+        if (voices.note[v] != SYNTH_NO_NOTE) {
+          synth_regs_voice_freq(&regs, v, (uint32_t)(note_inc[voices.note[v]] * bend_mul));
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// the synth thread: each 1 ms tick, decode what the USB side queued, play it,
+// then put the register changes on the FMC in one flush. it is the only one
+// touching the decoder, `voices` and `regs`, so none of them needs a lock.
+static THD_WORKING_AREA(waSynth, 512);
+static THD_FUNCTION(synth_thread, arg) {
+  (void)arg;
+  chRegSetThreadName("synth");
+  for (;;) {
+    midi_event e;
+    uint32_t first = 0U;
+    bool any = false;
+    while (midi_q_pop(&midi_in, &e)) {
+      midi_dec_packet(&midi_dec, e.pkt, e.t);
+      if (!any) {
+        first = e.t;
+        any = true;
+      }
+    }
+    synth_regs_flush(&regs);
+    if (any) {
+      uint32_t lat = chSysGetRealtimeCounterX() - first;
+      if (lat > lat_max) {
+        lat_max = lat;
       }
     }
+    chThdSleepMilliseconds(1);
   }
 }
 
@@ -180,7 +255,7 @@ int main(void) {
   bsp_printf("MAGIC = 0x%04X %s\n", (unsigned)magic, (magic == 0xACE1U) ? "OK" : "FAIL");
 
   build_note_table();
-  synth_all_off();          // all 8 voices gated off to start
+  synth_all_off();          // all voices gated off to start
 
   // DAC on PA4, fed by TIM6-triggered DMA straight from the FPGA dac register
   palSetPadMode(GPIOA, 4, PAL_MODE_INPUT_ANALOG);
@@ -189,8 +264,11 @@ int main(void) {
   dacStartConversion(&DACD1, &dac_grpcfg, dac_src, 1U);   // depth 1 = re-read FMC each tick
   gptStartContinuous(&GPTD6, GPT_HZ / SAMPLE_RATE);       // 25 -> 48 kHz TRGO
 
-  // hand parsed notes to the synth glue
-  usbhmidiSetNoteCallback(note_cb);
+  // the USB side only queues packets; the synth thread plays them
+  midi_q_init(&midi_in);
+  midi_dec_init(&midi_dec, synth_msg, NULL);
+  usbhmidiSetQueue(&midi_in);
+  chThdCreateStatic(waSynth, sizeof(waSynth), NORMALPRIO + 1, synth_thread, NULL);
 
   // USB host on OTG_FS (PA11/PA12) - same bring-up as midi_usb_enum_test.c
   palSetPadMode(GPIOA, 11, PAL_MODE_ALTERNATE(10) | PAL_STM32_OSPEED_HIGHEST);
@@ -205,12 +283,23 @@ int main(void) {
              (unsigned)NVOICES);
 
   uint32_t tick = 0;
+  uint32_t seen_hw = 0, seen_drop = 0, seen_lat = 0;
   for (;;) {
     usbhMainLoop(&USBHD2);
     chThdSleepMilliseconds(5);
     if (++tick >= 200U) {                // ~1 Hz: re-assert FS clock once CMOD=1
       tick = 0;
       *otg_fs_hcfg = (*otg_fs_hcfg & ~0x3u) | 0x1u;
+      // queue health, when it changed: deepest backlog, losses, worst latency
+      if (midi_in.high_water != seen_hw || midi_in.dropped != seen_drop || lat_max != seen_lat) {
+        seen_hw = midi_in.high_water;
+        seen_drop = midi_in.dropped;
+        seen_lat = lat_max;
+        bsp_printf("midi q: high water %lu/%u, dropped %lu in %lu overflows, worst %lu us\n",
+                   (unsigned long)seen_hw, (unsigned)MIDI_Q_SIZE, (unsigned long)seen_drop,
+                   (unsigned long)midi_in.overflows,
+                   (unsigned long)(seen_lat / (STM32_SYS_CK / 1000000U)));
+      }
     }
   }
 }
@@ -0,0 +1,231 @@
+// see bl_fpga.h. bl_fpga_ops over the ChibiOS SPI driver (its TX DMA reads the
+// bitstream straight out of the QSPI map), two GPIOs, FMC and the DAC driver.
+//
+// the configuration port's framing: CS low, write-enable (0x15 0x00), CS high;
+// CS low, config-write (0x3B 0x00), the bitstream in chunks, CS high; CS low,
+// write-disable (0x3A 0x00), CS high. CS stays low across the chunks, so a
+// pause between two of them just stops the clock.
+
+#include "ch.h"
+#include "hal.h"
+
+#include "bl_fpga.h"
+
+#include "bootloader/fpga_load.h"
+#include "bootloader/memmap.h"
+
+#include "bsp/utils/bsp_io.h"
+
+#if BL_FPGA_LOAD
+
+#define FMC_FPGA_BASE 0x60000000UL // core.magic at +0
+
+#define FPGA_CS_PORT    GPIOF
+#define FPGA_CS_PAD     8U
+#define FPGA_RECFG_PORT GPIOF
+#define FPGA_RECFG_PAD  7U
+#define FPGA_DONE_PORT  GPIOF
+#define FPGA_DONE_PAD   6U
+
+// the commands, in flash: the SPI's DMA cannot reach the main stack (DTCM)
+static const uint8_t sspi_write_en[2]  = {0x15U, 0x00U};
+static const uint8_t sspi_write[2]     = {0x3BU, 0x00U};
+static const uint8_t sspi_write_dis[2] = {0x3AU, 0x00U};
+
+static volatile bool spi_failed;
+
+static void spi_error(SPIDriver *spip) {
+  (void)spip;
+  spi_failed = true;
+}
+
+// mode 0, 8-bit: 25 MHz off the 200 MHz PLL1_Q kernel clock
+static const SPIConfig sspi_cfg = {
+  .circular = false,
+  .data_cb  = NULL,
+  .error_cb = spi_error,
+  .ssport   = FPGA_CS_PORT,
+  .sspad    = FPGA_CS_PAD,
+  .cfg1     = SPI_CFG1_MBR_DIV8 | SPI_CFG1_DSIZE_VALUE(7) | SPI_CFG1_FTHLV_VALUE(0),
+  .cfg2     = 0U
+};
+
+static const DACConfig dac_cfg = {
+  .init     = 2048U, // mid-scale: silence
+  .datamode = DAC_DHRM_12BIT_RIGHT,
+  .cr       = 0U
+};
+
+// a two-byte command in its own CS frame
+static void sspi_cmd(const uint8_t *c) {
+  spiSelect(&SPID1);
+  spiSend(&SPID1, 2U, c);
+  spiUnselect(&SPID1);
+}
+
+// reset the FPGA into configuration (RECONFIG_N low, then its init), open a
+// config-write and leave CS down for the bitstream
+static int port_begin(void *ctx) {
+  (void)ctx;
+  if (SPID1.state == SPI_ACTIVE) {
+    spiAbort(&SPID1); // a chunk the last load gave up on
+  }
+  spiUnselect(&SPID1);
+  spi_failed = false;
+  palClearPad(FPGA_RECFG_PORT, FPGA_RECFG_PAD);
+  chThdSleepMilliseconds(1);
+  palSetPad(FPGA_RECFG_PORT, FPGA_RECFG_PAD);
+  chThdSleepMilliseconds(2); // the FPGA clears its SRAM before it listens
+  sspi_cmd(sspi_write_en);
+  spiSelect(&SPID1);
+  spiSend(&SPID1, 2U, sspi_write);
+  return spi_failed ? -1 : 0;
+}
+
+static int port_send(void *ctx, const uint8_t *p, uint32_t n) {
+  (void)ctx;
+  spiStartSend(&SPID1, n, p);
+  return 0;
+}
+
+static int port_busy(void *ctx) {
+  (void)ctx;
+  if (spi_failed) {
+    return -1;
+  }
+  return (SPID1.state == SPI_ACTIVE) ? 1 : 0;
+}
+
+static int port_end(void *ctx) {
+  (void)ctx;
+  spiUnselect(&SPID1);
+  sspi_cmd(sspi_write_dis);
+  return spi_failed ? -1 : 0;
+}
+
+static int port_done(void *ctx) {
+  (void)ctx;
+  return (palReadPad(FPGA_DONE_PORT, FPGA_DONE_PAD) == PAL_HIGH) ? 1 : 0;
+}
+
+static uint16_t fmc_magic(void *ctx) {
+  (void)ctx;
+  return *(volatile const uint16_t *)FMC_FPGA_BASE;
+}
+
+// muted, the DAC sits at mid-scale. let go, it stays there, running: the app's
+// dacStart takes it over without a step on the output
+static void dac_mute(void *ctx, int on) {
+  (void)ctx;
+  if (on) {
+    palSetPadMode(GPIOA, 4, PAL_MODE_INPUT_ANALOG);
+    dacStart(&DACD1, &dac_cfg);
+    dacPutChannelX(&DACD1, 0U, 2048U);
+  }
+}
+
+static uint32_t now_ms(void *ctx) {
+  (void)ctx;
+  return (uint32_t)chTimeI2MS(chVTGetSystemTimeX());
+}
+
+static const bl_fpga_ops ops = {NULL,      port_begin, port_send, port_busy, port_end,
+                                port_done, fmc_magic,  dac_mute,  now_ms};
+
+static bl_fpga fpga;
+
+// the FMC, as the app sets it up (modules/apm/tests/fmc_audio_test.c): the
+// 16-bit multiplexed bus, slow timings, and the window uncached - a cached
+// read of the magic would never see it change
+static void fmc_init(void) {
+  const iomode_t af12 = PAL_MODE_ALTERNATE(12) | PAL_STM32_OSPEED_LOWEST;
+  const iomode_t af9  = PAL_MODE_ALTERNATE(9)  | PAL_STM32_OSPEED_LOWEST;
+  palSetPadMode(GPIOD, 14, af12); palSetPadMode(GPIOD, 15, af12);
+  palSetPadMode(GPIOD, 0,  af12); palSetPadMode(GPIOD, 1,  af12);
+  palSetPadMode(GPIOE, 7,  af12); palSetPadMode(GPIOE, 8,  af12);
+  palSetPadMode(GPIOE, 9,  af12); palSetPadMode(GPIOE, 10, af12);
+  palSetPadMode(GPIOE, 11, af12); palSetPadMode(GPIOE, 12, af12);
+  palSetPadMode(GPIOE, 13, af12); palSetPadMode(GPIOE, 14, af12);
+  palSetPadMode(GPIOE, 15, af12); palSetPadMode(GPIOD, 8,  af12);
+  palSetPadMode(GPIOD, 9,  af12); palSetPadMode(GPIOD, 10, af12);
+  palSetPadMode(GPIOB, 7,  af12); palSetPadMode(GPIOD, 4,  af12);
+  palSetPadMode(GPIOD, 5,  af12); palSetPadMode(GPIOC, 7,  af9);
+  palSetPadMode(GPIOC, 6,  af9);
+
+  rccEnableAHB3(RCC_AHB3ENR_FMCEN, true);
+  FMC_Bank1_R->BTCR[1] = (15U << FMC_BTRx_ADDSET_Pos) | (15U << FMC_BTRx_ADDHLD_Pos) |
+                         (15U << FMC_BTRx_DATAST_Pos) | (15U << FMC_BTRx_BUSTURN_Pos);
+  FMC_Bank1_R->BTCR[0] = FMC_BCR1_FMCEN | FMC_BCRx_MBKEN | FMC_BCRx_MUXEN |
+                         FMC_BCRx_MTYP_0 | FMC_BCRx_MWID_0 | FMC_BCRx_WREN;
+  __DSB();
+
+  ARM_MPU_Disable();
+  MPU->RNR  = 7U;
+  MPU->RBAR = FMC_FPGA_BASE;
+  MPU->RASR = MPU_RASR_ENABLE_Msk | (19U << MPU_RASR_SIZE_Pos) |
+              (1U << MPU_RASR_XN_Pos) | (3U << MPU_RASR_AP_Pos) |
+              (1U << MPU_RASR_B_Pos) | (1U << MPU_RASR_S_Pos);
+  ARM_MPU_Enable(MPU_CTRL_PRIVDEFENA_Msk);
+  SCB_CleanInvalidateDCache();
+  __DSB();
+  __ISB();
+}
+
+void bl_fpga_boot_start(void) {
+  palSetPadMode(GPIOA, 5, PAL_MODE_ALTERNATE(5) | PAL_STM32_OSPEED_HIGHEST); // SCK
+  palSetPadMode(GPIOA, 6, PAL_MODE_ALTERNATE(5) | PAL_STM32_PUPDR_FLOATING); // MISO
+  palSetPadMode(GPIOB, 5, PAL_MODE_ALTERNATE(5) | PAL_STM32_OSPEED_HIGHEST); // MOSI
+  palSetPad(FPGA_CS_PORT, FPGA_CS_PAD);
+  palSetPadMode(FPGA_CS_PORT, FPGA_CS_PAD, PAL_MODE_OUTPUT_PUSHPULL);
+  palSetPad(FPGA_RECFG_PORT, FPGA_RECFG_PAD);
+  palSetPadMode(FPGA_RECFG_PORT, FPGA_RECFG_PAD, PAL_MODE_OUTPUT_PUSHPULL);
+  palSetPadMode(FPGA_DONE_PORT, FPGA_DONE_PAD, PAL_MODE_INPUT);
+  spiStart(&SPID1, &sspi_cfg);
+  fmc_init();
+
+  bl_fpga_begin(&fpga, &ops, (const void *)(uintptr_t)bl_memmap[BL_SLOT_FPGA_ACTIVE].base,
+                (const void *)(uintptr_t)bl_memmap[BL_SLOT_FPGA_GOLDEN].base);
+}
+
+void bl_fpga_boot_poll(void) { (void)bl_fpga_poll(&fpga); }
+
+void bl_fpga_boot_pause(void) { bl_fpga_pause(&fpga); }
+
+void bl_fpga_boot_resume(void) { bl_fpga_resume(&fpga); }
+
+int bl_fpga_boot_finish(void) {
+  static const char *const whys[] = {"ok", "bad header", "port error", "dma failed",
+                                     "no DONE", "wrong magic"};
+  if (fpga.state == BL_FPGA_IDLE) {
+    return -1;
+  }
+  int st = bl_fpga_finish(&fpga);
+  for (unsigned i = 0; i <= fpga.cur; i++) {
+    if (fpga.why[i] != BL_FPGA_OK) {
+      bsp_printf("fpga: %s: %s\r\n", bl_memmap[BL_SLOT_FPGA_ACTIVE + i].name, whys[fpga.why[i]]);
+    }
+  }
+  spiStop(&SPID1);
+  if (st != BL_FPGA_READY) {
+    bsp_printf("fpga: no bitstream came up, DAC stays muted\r\n");
+    return -1;
+  }
+  bsp_printf("fpga: %s up (%lu bytes, %lu chunks)\r\n",
+             bl_memmap[BL_SLOT_FPGA_ACTIVE + fpga.cur].name, (unsigned long)fpga.length,
+             (unsigned long)fpga.chunks);
+  return fpga.cur;
+}
+
+#else // !BL_FPGA_LOAD
+
+void bl_fpga_boot_start(void) {}
+
+void bl_fpga_boot_poll(void) {}
+
+void bl_fpga_boot_pause(void) {}
+
+void bl_fpga_boot_resume(void) {}
+
+int bl_fpga_boot_finish(void) { return -1; }
+
+#endif // BL_FPGA_LOAD
@@ -0,0 +1,41 @@
+// the FPGA's bitstream, loaded during the boot cascade (bootloader/fpga_load.h
+// has the sequencing): started as soon as the QSPI is memory-mapped, moved on
+// from the staging loop's flash waits (bl_stage.c), and finished - DONE and the
+// magic, or the golden bitstream, or given up - before the jump. the DAC is
+// held at mid-scale from the start until the FPGA answers.
+//
+// wiring (the FPGA's slave-SPI configuration port): SPI1 (PA5 SCK, PA6 MISO,
+// PB5 MOSI - free in the bootloader, the app's W25Qxx mux is not driven), CS on
+// PF8, RECONFIG_N on PF7, DONE on PF6 (open drain, pulled up on the board). the
+// magic is read over FMC at 0x60000000 (core.magic), the DAC is DAC1 CH1 (PA4).
+//
+// that wiring is assumed, not taken from a board config, so the load is built
+// only with BL_FPGA_LOAD (CMake option, off by default). without it these calls
+// are no-ops that touch no pins, the FPGA is left to the app as before, and
+// the trace's BL_TRACE_FPGA mark says it was skipped.
+
+#ifndef BL_FPGA_H
+#define BL_FPGA_H
+
+#ifndef BL_FPGA_LOAD
+#define BL_FPGA_LOAD 0
+#endif
+
+// bring up the port, FMC and the DAC (muted), and start on BL_SLOT_FPGA_ACTIVE.
+// the QSPI must be memory-mapped
+void bl_fpga_boot_start(void);
+
+// move the load on; cheap, call it from any wait. nothing before the start
+void bl_fpga_boot_poll(void);
+
+// around anything that takes the QSPI out of memory-mapped mode: no chunk is in
+// flight between the two
+void bl_fpga_boot_pause(void);
+void bl_fpga_boot_resume(void);
+
+// wait for the load to end. returns the slot that came up (0 active, 1 golden),
+// or -1 if neither did (the DAC stays muted), it was never started or it is not
+// built in
+int bl_fpga_boot_finish(void);
+
+#endif // BL_FPGA_H
@@ -1,14 +1,34 @@
 // signalmesh bootloader entry (STM32/APM). runs before the application. it is
 // the golden image: immutable recovery core that accepts updates over UART4.
 //
-// app model: two app images in QSPI - slot 1 = active/newest (update target),
-// slot 0 = last-known-good fallback. on update, the new image is written to
-// slot 1 and the previously-active image is copied down to slot 0. on boot the
-// chosen valid slot is copied into the internal-flash exec region and run.
+// app model: two app images in QSPI, A/B - the boot pointer in the params slot
+// (bootloader/boot_ptr.h) names the active one. on update, the new image is
+// written to the other slot and the pointer flipped to it; the image it
+// replaces is left where it is, as the fallback. on boot the chosen valid slot
+// is copied into the internal-flash exec region and run (the copy is skipped
+// when exec already holds that image - bl_stage.h).
 //
-// boot cascade: slot 1 -> slot 0 -> golden (stay here, print uptime, keep the
-// UART open). SKELETON - the marked steps are yours to fill in. it uses the
-// concrete drivers directly (qspi_memmap, the flash HAL, the UART4 DMA code from
+// boot cascade: the active slot -> the other one -> golden (stay here, print
+// uptime, listen on the UART for good). a slot the pointer has not seen boot yet gets
+// BL_BOOT_TRIES boots for its app to come up and confirm itself
+// (bootloader/confirm.h) before the pointer goes back to the other one; the
+// slot whose app confirmed becomes the confirmed active one on the next boot.
+//
+// each boot phase is timed on the core's cycle counter into a boot trace in
+// backup SRAM (bootloader/boot_trace.h), which the app finds there and a host
+// can fetch after a reset (update.bin --boot-trace).
+//
+// with BL_FPGA_LOAD, the FPGA's bitstream is loaded on the way (bl_fpga.h): DMA
+// streams it from its QSPI slot while the app stages, with the golden bitstream
+// behind it, and the DAC held muted until the FPGA answers.
+//
+// update mode is entered on request, not waited out on every boot: the app
+// leaves an update request in backup SRAM and resets (bootloader/update_req.h),
+// the reset button gives the old listen window, and any other boot goes
+// straight to the cascade.
+//
+// SKELETON - the marked steps are yours to fill in. it uses the concrete
+// drivers directly (qspi_memmap, the flash HAL, the UART4 DMA code from
 // test_uart4_rx_bench.c).
 
 #include "ch.h"
@@ -21,13 +41,18 @@
 #include "drivers/w25qxx.h"
 
 #include "bootloader/protocol.h"
+#include "bootloader/boot_ptr.h"
+#include "bootloader/boot_trace.h"
+#include "bootloader/confirm.h"
 #include "bootloader/frame.h"
 #include "bootloader/crc32.h"
 #include "bootloader/image.h"
 #include "bootloader/memmap.h"
+#include "bootloader/update_req.h"
 
 #include "version_gen.h" // generated: FW_VERSION_STRING etc.
 
+#include "bl_fpga.h"
 #include "bl_update.h"
 #include "bl_stage.h"
 
@@ -89,6 +114,61 @@ static void jump_to_app(uint32_t app_base) {
   }
 }
 
+// the boot trace (bootloader/boot_trace.h) in backup SRAM: it outlives the jump
+// (the app reads it there) and a reset (the next bootloader entry hands it to a
+// host that asks, BL_TRACE)
+static bl_trace_area *const g_trace = (bl_trace_area *)BL_TRACE_RAM;
+
+// open the backup SRAM and start the core's cycle counter from 0
+static void trace_start(void) {
+  RCC->AHB4ENR |= RCC_AHB4ENR_BKPRAMEN;
+  PWR->CR1 |= PWR_CR1_DBP; // backup domain writes
+  __DSB();
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55U; // the M7's DWT is locked out of reset
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  bl_trace_begin(g_trace, STM32_SYS_CK, DWT->CYCCNT);
+}
+
+// a boot phase ended
+static void trace_mark(uint16_t phase, uint16_t arg) {
+  bl_trace_mark(&g_trace->cur, phase, arg, DWT->CYCCNT);
+}
+
+// milliseconds this boot spent in `phase` so far
+static uint32_t trace_ms(uint16_t phase) {
+  const bl_boot_trace *t = &g_trace->cur;
+  uint64_t cyc = 0U;
+  for (unsigned i = 1U; i < t->count; i++) {
+    if (t->marks[i].phase == phase) {
+      cyc += bl_trace_span(t, i);
+    }
+  }
+  return (uint32_t)(cyc * 1000U / t->cpu_hz);
+}
+
+// why this boot happened, from the reset flags (then cleared, so the next
+// reset reads its own). a software reset sets PINRSTF too (the core pulls
+// NRST), so it is tested first
+static enum bl_reset_cause reset_cause(void) {
+  uint32_t rsr = RCC->RSR;
+  RCC->RSR |= RCC_RSR_RMVF;
+  if ((rsr & (RCC_RSR_PORRSTF | RCC_RSR_BORRSTF)) != 0U) {
+    return BL_RESET_POWER;
+  }
+  if ((rsr & RCC_RSR_SFTRSTF) != 0U) {
+    return BL_RESET_SOFTWARE;
+  }
+  if ((rsr & (RCC_RSR_IWDG1RSTF | RCC_RSR_WWDG1RSTF)) != 0U) {
+    return BL_RESET_WATCHDOG;
+  }
+  if ((rsr & RCC_RSR_PINRSTF) != 0U) {
+    return BL_RESET_PIN;
+  }
+  return BL_RESET_OTHER;
+}
+
 int main(void) {
   // minimal init - deliberately NOT bsp_init() (that runs the whole device
   // registry: I2C sensors, INA219s, OLED, LCD - seconds of delay). the
@@ -97,64 +177,162 @@ int main(void) {
   halInit();
   chSysInit();
 
+  // the trace's counter starts here, with the clock tree up (halInit)
+  trace_start();
+
   bsp_io_init(); // debug console on UART5
 
   bsp_printf("\n--- %s ---\r\n", FW_VERSION_STRING);
 
+  // the update request (backup SRAM, open since trace_start) and the reset
+  // cause decide the update window: none unless asked for or the button
+  static const char *const causes[] = {"power-on", "pin", "software", "watchdog", "other"};
+  enum bl_reset_cause cause = reset_cause();
+  bl_boot_plan plan;
+  bl_update_req_take((bl_update_req *)BL_UPDATE_REQ_RAM, cause, &plan);
+  bsp_printf("reset: %s, %s%s\r\n", causes[cause],
+             (plan.reason != BL_REQ_NONE) ? "update requested"
+             : (plan.listen_ms != 0U)     ? "update window"
+                                          : "no update window",
+             plan.stale ? " (stale request dropped)" : "");
+
+  // every phase below ends in a trace mark; the breakdown is printed before
+  // the jump (the update window dominates unless a host is pushing), and the
+  // whole trace goes to the app and, after a reset, to a host that asks
+
   // bring up QSPI (pins + device init). until this succeeds, touching 0x90..
   // bus-faults, so the boot cascade is gated on it.
   int qspi_ready = qspi_bringup();
+  trace_mark(BL_TRACE_QSPI, (uint16_t)qspi_ready);
   bsp_printf("QSPI: %s\r\n",
              qspi_ready ? "up (W25Q128 dual, memmap @ 0x90000000)" : "init FAILED");
 
-  // 1) update mode: give a host a short window to connect on UART4 and push an
-  //    image. bl_update_run receives it (MANIFEST/DATA/DONE), verifies, and
+  // the app the last boot started said it came up: its slot is the confirmed
+  // active one from now on. written before the update window, which may point
+  // the pointer somewhere else
+  static bl_boot boot;
+  const bl_nor *nor = bl_update_nor(&qspi_cfg);
+  uint32_t params = bl_memmap[BL_SLOT_PARAMS].base - qspi_cfg.base;
+  unsigned up;
+  if (bl_confirm_take((bl_confirm *)BL_CONFIRM_RAM, &up) && cause != BL_RESET_POWER &&
+      qspi_ready) {
+    bsp_printf("boot: %s confirmed by its app\r\n", bl_memmap[BL_SLOT_APP_0 + up].name);
+    if (bl_boot_open(&boot, nor, params + BL_PARAMS_BOOT, params + BL_PARAMS_BOOT_2) != 0 ||
+        bl_boot_booted(&boot, up) != 0) {
+      bsp_printf("boot: writing the boot pointer failed\r\n");
+    }
+  }
+
+  // 1) update mode, when the plan above has a window: give a host that long
+  //    to connect on UART4 and push an image. bl_update_run receives it (MANIFEST/DATA/DONE), verifies, and
   //    writes the target QSPI slot; the boot cascade below then boots it.
   //    runs in indirect mode (qspi bringup left it there); the cascade enables
-  //    memory-mapped mode afterwards. on an app update it first rotates the
-  //    current active image (slot1) down to slot0, keeping it as the fallback.
-  if (qspi_ready) {
-    bl_update_run(&qspi_cfg, 5000U); // 5s window to catch a host (tune down later)
+  //    memory-mapped mode afterwards. an app update goes into the inactive slot
+  //    and points the boot pointer at it. a host can also fetch the trace of
+  //    the last boot that reached the app (BL_TRACE).
+  //    it can outlast a wrap of the trace's cycle counter (30 s asked for, a
+  //    long transfer), so it is timed on a clock bl_update_run keeps sampling.
+  if (qspi_ready && plan.listen_ms != 0U) {
+    bl_trace_clock clk;
+    bl_trace_clock_start(&clk, &g_trace->cur);
+    int ran = bl_update_run(&qspi_cfg, plan.listen_ms, &g_trace->last, &clk);
+    uint32_t now = DWT->CYCCNT;
+    bl_trace_clock_poll(&clk, now);
+    bl_trace_mark(&g_trace->cur, BL_TRACE_UPDATE, (uint16_t)ran | bl_trace_clock_arg(&clk), now);
   }
 
-  // 2) boot cascade: newest first, then fallback. needs QSPI (slots live at
-  // 0x90..), so it is skipped until qspi_ready is set above.
+  // 2) boot cascade: the active slot first, then the other one. needs QSPI
+  // (slots live at 0x90..), so it is skipped until qspi_ready is set above.
   if (qspi_ready) {
+    // the boot pointer, still in indirect mode: count this boot against an
+    // unconfirmed slot (or give it up). a power-on boot lost the app's word
+    // with the backup SRAM, so it cannot know the last one failed: no try
+    unsigned first = 1U;
+    if (bl_boot_open(&boot, nor, params + BL_PARAMS_BOOT, params + BL_PARAMS_BOOT_2) != 0 ||
+        bl_boot_begin(&boot, cause != BL_RESET_POWER, &first) != 0) {
+      bsp_printf("boot: boot pointer read/write failed\r\n");
+    }
+    if (boot.cur.confirmed) {
+      bsp_printf("boot: %s first\r\n", bl_memmap[BL_SLOT_APP_0 + first].name);
+    } else {
+      bsp_printf("boot: %s first, unconfirmed (try %u of %u)\r\n",
+                 bl_memmap[BL_SLOT_APP_0 + first].name, (unsigned)boot.cur.tries,
+                 (unsigned)BL_BOOT_TRIES);
+    }
+    trace_mark(BL_TRACE_BOOT, (uint16_t)first);
+
     // enter memory-mapped mode so the slots at 0x90.. are readable by pointer
     qspi_memmap_enable(&qspi_cfg);
     bsp_printf("QSPI ready, reading slots...\n");
 
-    static const enum bl_slot order[] = {BL_SLOT_APP_1, BL_SLOT_APP_0};
+    // the bitstream goes out by DMA from here on; staging moves it along
+    bl_fpga_boot_start();
+
+    const enum bl_slot order[] = {(enum bl_slot)(BL_SLOT_APP_0 + first),
+                                  (enum bl_slot)(BL_SLOT_APP_0 + (first ^ 1U))};
 
     for (unsigned i = 0; i < 2U; i++) {
       enum bl_slot slot = order[i];
-      if (bl_image_validate((const void *)bl_memmap[slot].base) != 0) {
+      uint16_t n = (uint16_t)(slot - BL_SLOT_APP_0);
+      int bad = bl_image_check_header((const void *)bl_memmap[slot].base);
+      trace_mark(BL_TRACE_HEADER, n | ((bad != 0) ? BL_TRACE_ARG_BAD : 0U));
+      if (bad != 0) {
         continue; // stored image bad, try the next
       }
-      // stage: copy the validated image from the QSPI slot into the internal-
-      // flash exec region (bank 2) and verify it, then run the app from flash at
-      // full core speed. if staging fails, fall through to the next slot.
-      if (bl_stage_app(slot) != 0) {
+      // stage: copy the image from the QSPI slot into the internal-flash exec
+      // region (bank 2), checking the slot's image crc and the copy's on the
+      // same pass, then run the app from flash at full core speed - unless exec
+      // already holds that image. if staging fails (a bad slot image included),
+      // fall through to the next slot.
+      int staged = bl_stage_app(&qspi_cfg, slot);
+      trace_mark(BL_TRACE_STAGE, n | ((staged < 0)    ? BL_TRACE_ARG_BAD
+                                      : (staged == 1) ? BL_TRACE_ARG_SKIP
+                                                      : 0U));
+      if (staged < 0) {
         continue;
       }
+      // the FPGA: whatever of the load staging did not cover. the DAC stays
+      // muted if no bitstream came up - the app sees that in the trace, and
+      // that a bootloader built without the load left the FPGA to it
+      int fpga = bl_fpga_boot_finish();
+      trace_mark(BL_TRACE_FPGA, !BL_FPGA_LOAD ? BL_TRACE_ARG_SKIP
+                                : (fpga < 0)  ? BL_TRACE_ARG_BAD
+                                              : (uint16_t)fpga);
+      // it staged and verified; the slot is confirmed once its app says it
+      // came up. the word goes out of the cache with the jump's clean
+      bl_confirm_arm((bl_confirm *)BL_CONFIRM_RAM, n);
       uint32_t app = bl_memmap[BL_SLOT_APP_EXEC].base;
       bsp_printf("booting app from %s -> exec 0x%08lX\r\n", bl_memmap[slot].name,
                  (unsigned long)app);
-      // TODO: load the fpga bitstream (BL_SLOT_FPGA_ACTIVE; golden on failure)
-      // and hold the DAC muted until the FPGA asserts DONE + a magic readback.
+      bsp_printf("boot: qspi %lu ms, update window %lu ms, headers %lu ms, stage %lu ms (%s), "
+                 "fpga +%lu ms, %lu ms since reset\r\n",
+                 (unsigned long)trace_ms(BL_TRACE_QSPI), (unsigned long)trace_ms(BL_TRACE_UPDATE),
+                 (unsigned long)trace_ms(BL_TRACE_HEADER), (unsigned long)trace_ms(BL_TRACE_STAGE),
+                 (staged == 1) ? "skipped" : "copied", (unsigned long)trace_ms(BL_TRACE_FPGA),
+                 (unsigned long)chTimeI2MS(chVTGetSystemTimeX()));
+      trace_mark(BL_TRACE_JUMP, 0U); // the app finds the trace at BL_TRACE_RAM
       jump_to_app(app); // no return on success
     }
+    // no app: the load reads the map, so it finishes first; then back to
+    // indirect mode, which the golden loop's update sessions need
+    (void)bl_fpga_boot_finish();
+    qspi_memmap_disable(&qspi_cfg);
   } else {
     bsp_printf("QSPI not ready...\n");
   }
 
   // 3) golden fallback: no app validated. the bootloader IS the golden image -
-  // stay resident, print uptime, keep the UART link open for a host to push a
-  // new image at any time.
+  // stay resident, print uptime, and listen on UART4 for good (this is how a
+  // board with no app, which cannot ask for update mode, gets one). after a
+  // session, reset so the cascade boots what it wrote.
   bsp_printf("no valid app. staying in bootloader\r\n");
   uint32_t uptime_s = 0U;
   for (;;) {
     bsp_printf("bootloader up %lu s\r\n", (unsigned long)uptime_s++);
-    chThdSleepMilliseconds(1000);
+    if (!qspi_ready) {
+      chThdSleepMilliseconds(1000);
+    } else if (bl_update_run(&qspi_cfg, 1000U, &g_trace->last, NULL) != 0) {
+      NVIC_SystemReset();
+    }
   }
 }
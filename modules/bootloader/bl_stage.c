@@ -3,51 +3,155 @@
 // the raw app binary starting with the app's vector table, so it lands at the
 // exec base (the app is linked once for that address) - the slot's image header
 // stays behind in QSPI as metadata.
+//
+// the copy is one pass (bootloader/stage_pipe.h): the slot is read and crc'd
+// while bank 2 erases and programs, and every word is crc'd back as it lands.
+// that pass is also the slot's image check - the cascade only checked its
+// header - so a bad slot fails here, with exec left for the next slot to
+// overwrite.
+//
+// the staging record is read through the memory map like the slots; clearing
+// and writing it takes indirect mode, so those two steps leave the map and come
+// back (the slot pointers stay valid across that). the FPGA's bitstream streams
+// out of the same map meanwhile (bl_fpga.h): the flash waits move it on, and it
+// is paused while the map is off.
 
 #include "hal.h" // SCB_CleanInvalidateDCache
+#include <string.h>
 
+#include "bl_fpga.h"
 #include "bl_stage.h"
 
 #include "bootloader/image.h"
-#include "bootloader/crc32.h"
+#include "bootloader/stage_pipe.h"
+#include "bootloader/stage_rec.h"
 #include "drivers/stm32h7_flash.h"
 
 #include "bsp/utils/bsp_io.h"
 
-int bl_stage_app(enum bl_slot slot) {
+static bl_stage_pipe pipe; // its source ring is too big for the main stack
+
+// bl_iflash over the exec region; the pipeline's offsets are from its base
+static int exec_erase(void *ctx, uint32_t off) {
+  return stm32h7_flash_erase_start((uint32_t)(uintptr_t)ctx + off);
+}
+
+static int exec_program(void *ctx, uint32_t off, const uint8_t *w) {
+  return stm32h7_flash_program_start((uint32_t)(uintptr_t)ctx + off, w);
+}
+
+static int exec_busy(void *ctx) {
+  bl_fpga_boot_poll();
+  return stm32h7_flash_busy((uint32_t)(uintptr_t)ctx);
+}
+
+// the source: the slot's image, memory-mapped
+static int slot_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  memcpy(p, (const uint8_t *)ctx + off, n);
+  return 0;
+}
+
+// device offset of the record, and its memory-mapped address
+static uint32_t rec_off(const qspi_memmap_config_t *qspi) {
+  return bl_memmap[BL_SLOT_PARAMS].base - qspi->base + BL_PARAMS_STAGED;
+}
+
+static const bl_stage_rec *rec_map(void) {
+  return (const bl_stage_rec *)(uintptr_t)(bl_memmap[BL_SLOT_PARAMS].base + BL_PARAMS_STAGED);
+}
+
+// erase the record's sector (rec = NULL) or program `rec` into it (erased). the
+// map is off meanwhile; back on, its cached view of the record is dropped
+static int rec_write(const qspi_memmap_config_t *qspi, const bl_stage_rec *rec) {
+  bl_fpga_boot_pause();
+  qspi_memmap_disable(qspi);
+  bool ok = (rec == NULL) ? qspi_memmap_erase_sector(qspi, rec_off(qspi))
+                          : qspi_memmap_program(qspi, rec_off(qspi), (const uint8_t *)rec,
+                                                sizeof(*rec));
+  qspi_memmap_enable(qspi);
+  qspi_memmap_invalidate(rec_map(), 32U);
+  bl_fpga_boot_resume();
+  return ok ? 0 : -1;
+}
+
+static int rec_erased(const bl_stage_rec *r) {
+  const uint32_t *w = (const uint32_t *)r;
+  for (unsigned i = 0; i < sizeof(*r) / 4U; i++) {
+    if (w[i] != 0xFFFFFFFFU) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int bl_stage_app(const qspi_memmap_config_t *qspi, enum bl_slot slot) {
   const uint8_t *slot_base = (const uint8_t *)(uintptr_t)bl_memmap[slot].base;
   const bl_image_header *h = (const bl_image_header *)slot_base;
   const uint8_t *img = slot_base + BL_IMAGE_OFFSET;
+  const bl_stage_rec *rec = rec_map();
 
   uint32_t exec = bl_memmap[BL_SLOT_APP_EXEC].base;
   uint32_t exec_size = bl_memmap[BL_SLOT_APP_EXEC].size;
 
-  if (h->length > exec_size) {
+  switch (bl_stage_plan(rec, h, (const void *)(uintptr_t)exec, exec_size)) {
+  case BL_STAGE_TOO_BIG:
     bsp_printf("stage: image %lu > exec region %lu\r\n",
                (unsigned long)h->length, (unsigned long)exec_size);
     return -1;
+  case BL_STAGE_SKIP:
+    bsp_printf("stage: exec already holds %s v%lu (%lu bytes, crc 0x%08lX)\r\n",
+               bl_memmap[slot].name, (unsigned long)h->version, (unsigned long)h->length,
+               (unsigned long)h->image_crc32);
+    return 1;
+  case BL_STAGE_COPY:
+    break;
   }
 
   bsp_printf("stage: %s -> exec 0x%08lX (%lu bytes)\r\n", bl_memmap[slot].name,
              (unsigned long)exec, (unsigned long)h->length);
 
-  if (stm32h7_flash_erase(exec, h->length) != 0) {
-    bsp_printf("stage: erase failed\r\n");
-    return -2;
-  }
-  if (stm32h7_flash_program(exec, img, h->length) != 0) {
-    bsp_printf("stage: program failed\r\n");
-    return -3;
+  // from here until the new record is written exec is in flux: a power cut in
+  // between must not leave a record vouching for it
+  if (!rec_erased(rec) && rec_write(qspi, NULL) != 0) {
+    bsp_printf("stage: clearing the staging record failed\r\n");
+    return -4;
   }
 
   // the program path writes via the flash controller, bypassing the D-cache;
-  // drop stale lines so the verify (and the app's execution) see real flash
+  // drop lines the plan's look at exec left, so the read-back sees real flash
   SCB_CleanInvalidateDCache();
-  SCB_InvalidateICache();
 
-  if (bl_crc32((const void *)(uintptr_t)exec, h->length) != h->image_crc32) {
+  const bl_iflash fl = {(void *)(uintptr_t)exec, exec_erase, exec_program, exec_busy,
+                        (const uint8_t *)(uintptr_t)exec};
+  const bl_stage_src src = {(void *)(uintptr_t)img, slot_read};
+  uint32_t block_size = 0U;
+  const uint32_t *blocks = bl_image_blocks(slot_base, &block_size);
+  int rc = bl_stage_pipe_run(&pipe, &fl, &src, h->length, h->image_crc32, blocks, block_size);
+  stm32h7_flash_lock(exec);
+  SCB_InvalidateICache(); // and anything fetched from the old contents
+
+  switch (rc) {
+  case 0:
+    break;
+  case -1:
+    bsp_printf("stage: flash error after %lu erases, %lu words\r\n",
+               (unsigned long)pipe.erases, (unsigned long)pipe.words);
+    return -2;
+  case -3:
+    bsp_printf("stage: %s image crc mismatch (at +0x%lX)\r\n", bl_memmap[slot].name,
+               (unsigned long)pipe.read);
+    return -5;
+  default:
     bsp_printf("stage: verify crc mismatch\r\n");
-    return -4;
+    return -3;
+  }
+
+  // the record is only a shortcut: if writing it fails, the next boot copies
+  // again, so the staged image still boots
+  bl_stage_rec r;
+  bl_stage_rec_make(&r, h, (uint16_t)slot);
+  if (rec_write(qspi, &r) != 0) {
+    bsp_printf("stage: writing the staging record failed\r\n");
   }
   return 0;
 }
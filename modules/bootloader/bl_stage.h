@@ -1,16 +1,24 @@
 // stage a validated app image out of a QSPI slot into the internal-flash exec
 // region, so the app runs at full core speed from flash instead of XIP from the
 // slow QSPI. the QSPI must be memory-mapped (the source is read by pointer).
+// a staging record in the params slot (bootloader/stage_rec.h) remembers what
+// exec holds, so booting the same image again costs no erase or program.
 
 #ifndef BL_STAGE_H
 #define BL_STAGE_H
 
+#include "drivers/qspi_memmap.h"
+
 #include "bootloader/memmap.h"
 
-// copy the app image from `slot` (a QSPI app slot) into BL_SLOT_APP_EXEC:
-// erase the exec sectors, program the image, then crc-verify the flash copy.
-// the image must already have passed bl_image_validate. returns 0 on success,
-// negative on error (image too big / erase / program / verify).
-int bl_stage_app(enum bl_slot slot);
+// make BL_SLOT_APP_EXEC hold the app image from `slot` (a QSPI app slot). if the
+// staging record says exec already holds it and exec's crc agrees, nothing is
+// written. otherwise: clear the record, copy the image over in one pass that
+// checks the slot's image crc and the flash copy's, then record it. the slot's
+// header must already have passed bl_image_check_header; its image is checked
+// only when it is copied. returns 1 if exec already held it, 0 if it was
+// staged, negative on error (image too big / flash / verify / qspi / bad slot
+// image).
+int bl_stage_app(const qspi_memmap_config_t *qspi, enum bl_slot slot);
 
 #endif // BL_STAGE_H
@@ -1,14 +1,50 @@
 // UART4 firmware-update receiver for the bootloader. reuses the proven UART4
 // async-DMA + handshake pattern from test_uart4_rx_bench.c (the sync uart api is
-// broken on this H7 driver, and we must never uartStop in a loop), then parses
-// the framed protocol (MANIFEST/DATA/DONE), buffers the image in RAM, verifies
-// the transfer crc, and writes it to the target QSPI slot in indirect mode.
+// broken on this H7 driver, and we must never uartStop in a loop), then hands
+// each DMA chunk to the update session (bootloader/session.h): MANIFEST/DATA/
+// DONE parsing, the ack window, and streaming the image into the target QSPI
+// slot while it arrives. the image is never held in RAM - DATA is staged a 4KB
+// sector at a time and programmed (erase ahead, page by page) between chunks,
+// so flash busy time overlaps reception and images can fill the 1MB slots. the
+// verdict at DONE comes from reading the slot back.
+//
+// an app update goes into the app slot the boot pointer (bootloader/boot_ptr.h)
+// does not name, and the pointer is flipped to it once the image verified - the
+// slot that was active is never written, and stays as the fallback. a delta
+// update (mkupdate --delta) sends only a patch against the installed app: the
+// session rebuilds the new image from the active slot into the other one. a
+// compressed update (mkupdate --lz) is decompressed the same way on its way
+// into the slot; the flash copy is always the plain image.
+//
+// a bundle (mkupdate --bundle: the app and the fpga bitstream, say) comes in
+// one session: each image lands in its slot as above, and the session holds
+// the commits - the boot pointer flip - until the last one has verified, so a
+// bundle that fails part way leaves the board booting what it booted before.
+// the bitstream has no second slot and is written in place; mkupdate sends it
+// after the app for that reason.
+//
+// a plain update that stalls (or loses power) is resumable: the session logs
+// each programmed sector in the params slot, and the host asks for the resume
+// point (BL_RESUME) after the next HELLO and sends only the rest.
+//
+// a host may also ask how the last boot went (BL_TRACE): the session answers
+// with the boot trace bl_main passed in.
+//
+// a v10 host also gets the board's side of the story on the same line: the
+// update's console lines on the log channel and, every BL_TELEMETRY_MS, the
+// session's state on the telemetry channel (protocol.h, bl_channel). they are
+// queued, and sent between chunks - one frame per pass of the receive loop,
+// picked by the shared scheduler (bootloader/channel.h) - while the session's
+// replies go out the moment they are made, so an ack never waits behind them.
+//
+// before the manifest the host may tune the link (BL_LINK): the session takes
+// a smaller DATA payload itself, and a new baud is set here once the answer is
+// out - on a trial: without an intact frame at the new rate within
+// BL_LINK_TRIAL_MS the line goes back to the old one.
 //
 // QSPI is left in indirect mode by qspi bringup, so erase/program work directly;
 // bl_main enables memory-mapped mode afterwards for the boot cascade.
 
-#include <string.h>
-
 #include "ch.h"
 #include "hal.h"
 
@@ -17,19 +53,27 @@
 
 #include "drivers/qspi_memmap.h"
 
+#include <string.h>
+
 #include "bootloader/protocol.h"
+#include "bootloader/boot_ptr.h"
+#include "bootloader/boot_trace.h"
+#include "bootloader/channel.h"
 #include "bootloader/frame.h"
-#include "bootloader/crc32.h"
+#include "bootloader/flash_stream.h"
 #include "bootloader/image.h"
 #include "bootloader/memmap.h"
+#include "bootloader/session.h"
 
 #include "bl_update.h"
 
 #define UPD_BAUD       1000000        // match on the host (--baud 1000000)
 #define RXSZ           2048U          // DMA chunk (32-byte aligned multiple)
-#define UPD_MAX_IMAGE  (256U * 1024U) // POC image cap (RAM-buffered)
-#define QSPI_SECTOR    4096U
-#define QSPI_PAGE      256U
+#define UPD_STALL_MS   5000U          // no bytes for this long ends the session (and,
+                                      // after its verdict, the wait for a DONE
+                                      // again: longer than the host's RESULT wait)
+#define LOG_LINE       96U            // longest console line mirrored to the host
+#define LOG_LINES      4U             // lines queued for it (more are dropped)
 
 // --- UART4 DMA plumbing (from test_uart4_rx_bench.c) ---
 CC_ALIGN_DATA(32) static uint8_t rxbuf[2][RXSZ];
@@ -39,21 +83,36 @@ static msg_t rx_mb_buf[16];
 static volatile int phase; // 0 = handshake, 1 = stream
 
 CC_ALIGN_DATA(32) static uint8_t hs_rx[32];
-CC_ALIGN_DATA(32) static uint8_t hs_tx[32]; // outbound frames (ack/result/nak)
+// outbound frames (ack/result/nak, log/telemetry; the largest is a BL_TRACE
+// answer), whole cache lines
+CC_ALIGN_DATA(32) static uint8_t hs_tx[(8U + sizeof(bl_boot_trace) + 4U + 31U) & ~31U];
 static volatile bool hs_rx_done;
 static volatile bool hs_tx_done;
 
+// --- line rate (BL_LINK) ---
+static uint32_t cur_baud;    // what the uart runs at
+static uint32_t next_baud;   // switch to this after the reply going out (0 = none)
+static uint32_t trial_baud;  // on trial: fall back to this (0 = settled)
+static systime_t trial_t0;
+static uint32_t trial_frames; // g_sess.frames when the trial began
+
 // --- session state ---
 static const qspi_memmap_config_t *g_qspi;
-static bl_frame_rx g_rx;
-static bl_manifest g_manifest;
-static int g_have_manifest;
-static uint32_t g_dst_off; // device offset of the target slot
-static uint32_t g_recv;    // bytes buffered
-static uint16_t g_status;  // final status
-
-static uint8_t g_img[UPD_MAX_IMAGE]; // RAM buffer for the incoming image
-CC_ALIGN_DATA(32) static uint8_t rot_buf[QSPI_SECTOR]; // scratch for slot rotation
+static bl_session g_sess; // parser, window, and the 2x4KB flash staging
+static bl_boot g_boot;    // the boot pointer, read at each app manifest
+static const bl_boot_trace *g_trace; // what BL_TRACE answers with
+static bl_trace_clock *g_clock;      // the boot trace's update phase (or NULL)
+
+// --- log / telemetry channels (v10 hosts) ---
+static uint16_t host_ver;     // the HELLO's bl_hello.version
+static int mirror;            // a session with a v10 host is open: queue for it
+static char log_q[LOG_LINES][LOG_LINE];
+static uint8_t log_len[LOG_LINES];
+static uint8_t log_head;
+static uint8_t log_n;
+static bl_sched g_sched;
+static systime_t sess_t0;
+static systime_t tel_t0;      // when the last BL_TELEMETRY went out
 
 // ---- DMA callbacks ----
 static void dispatch(UARTDriver *uartp, size_t got) {
@@ -111,9 +170,21 @@ static const UARTConfig uart_cfg = {
   .cr3        = 0,
 };
 
-// blocking send of a framed reply (small frames fit in the aligned hs_tx buffer)
-static void send_reply(uint8_t type, const void *pl, uint16_t len) {
-  size_t n = bl_frame_encode(type, 0, pl, len, hs_tx, sizeof(hs_tx));
+// change the rate under the running driver: BRR only takes a write with the
+// USART disabled, so UE is dropped around it. the receive DMA stays armed and
+// the driver is never restarted (no uartStop/uartStart in a loop)
+static void set_line_baud(uint32_t baud) {
+  USART_TypeDef *u = UARTD4.usart;
+  u->CR1 &= ~USART_CR1_UE;
+  u->BRR = (UARTD4.clock + baud / 2U) / baud;
+  u->CR1 |= USART_CR1_UE;
+  cur_baud = baud;
+}
+
+// blocking send of a frame on channel ch (small frames fit in the aligned hs_tx
+// buffer)
+static void send_frame(uint8_t ch, uint8_t type, const void *pl, uint16_t len) {
+  size_t n = bl_frame_encode_ch(ch, type, 0, pl, len, hs_tx, sizeof(hs_tx));
   if (n == 0U) {
     return;
   }
@@ -124,173 +195,263 @@ static void send_reply(uint8_t type, const void *pl, uint16_t len) {
     chThdSleepMilliseconds(1);
   }
   chThdSleepMilliseconds(2);
+  if (next_baud != 0U) {
+    // a BL_LINK answer just went out at the old rate
+    trial_baud = cur_baud;
+    set_line_baud(next_baud);
+    next_baud = 0;
+    trial_t0 = chVTGetSystemTimeX();
+    trial_frames = g_sess.frames;
+  }
 }
 
-// erase + program the image into the slot (indirect mode). returns 0 on success
-static int write_slot(uint32_t dev_off, const uint8_t *data, uint32_t len) {
-  for (uint32_t o = 0; o < len; o += QSPI_SECTOR) {
-    if (!qspi_memmap_erase_sector(g_qspi, dev_off + o)) {
-      return -1;
-    }
-  }
-  for (uint32_t o = 0; o < len; o += QSPI_PAGE) {
-    uint32_t chunk = (len - o) < QSPI_PAGE ? (len - o) : QSPI_PAGE;
-    if (!qspi_memmap_program(g_qspi, dev_off + o, data + o, chunk)) {
-      return -1;
-    }
-  }
-  return 0;
+static void send_reply(uint8_t type, const void *pl, uint16_t len) {
+  send_frame(BL_CH_UPDATE, type, pl, len);
 }
 
-// copy the current active image (slot1) down to the fallback slot (slot0) so an
-// update keeps the previous image as last-known-good. only runs if slot1 holds a
-// valid image. the QSPI driver has no indirect read, so we read slot1 via memmap
-// and write slot0 via indirect erase/program - mutually exclusive modes, so we
-// toggle per 4KB chunk (no big scratch buffer; g_img already holds the new
-// image). call in indirect mode; returns having restored indirect mode.
-static void rotate_active_to_fallback(void) {
-  uint32_t s1_base = bl_memmap[BL_SLOT_APP_1].base;
-  uint32_t s0_off = bl_memmap[BL_SLOT_APP_0].base - g_qspi->base;
-  uint32_t fallback_cap = bl_memmap[BL_SLOT_APP_0].size;
-
-  // validate the current active image and read its on-flash size (via memmap)
-  qspi_memmap_enable(g_qspi);
-  qspi_memmap_invalidate((const void *)(uintptr_t)s1_base, 32U);
-  const bl_image_header *h = (const bl_image_header *)(uintptr_t)s1_base;
-  uint32_t total = 0;
-  int valid = 0;
-  if (h->magic == BL_IMAGE_MAGIC &&
-      h->length <= fallback_cap - BL_IMAGE_OFFSET) {
-    total = BL_IMAGE_OFFSET + h->length;
-    qspi_memmap_invalidate((const void *)(uintptr_t)s1_base, (total + 31U) & ~31U);
-    valid = (bl_image_validate((const void *)(uintptr_t)s1_base) == 0);
+// a console line (no newline), mirrored to the host's log channel while a
+// session with a v10 host is open
+static void say(const char *fmt, ...) {
+  char line[LOG_LINE];
+  va_list ap;
+  va_start(ap, fmt);
+  chvsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  bsp_printf("%s\r\n", line);
+  if (!mirror || log_n == LOG_LINES) {
+    return;
   }
-  qspi_memmap_disable(g_qspi);
+  uint8_t i = (uint8_t)((log_head + log_n) % LOG_LINES);
+  size_t n = strlen(line);
+  memcpy(log_q[i], line, n);
+  log_len[i] = (uint8_t)n;
+  log_n++;
+}
 
-  if (!valid) {
-    bsp_printf("rotate: no valid active image, skipping\r\n");
+// send one queued log line or a due telemetry record, whichever the scheduler
+// picks. the session's replies never queue, so they are ahead of these anyway
+static void aux_poll(void) {
+  if (!mirror) {
     return;
   }
-  bsp_printf("rotate: active -> fallback (%lu bytes)\r\n", (unsigned long)total);
+  uint32_t head[BL_TX_CLASSES] = {0};
+  if (log_n != 0U) {
+    head[BL_TX_LOG] = 8U + log_len[log_head] + 4U;
+  }
+  if (chTimeI2MS(chVTTimeElapsedSinceX(tel_t0)) >= BL_TELEMETRY_MS) {
+    head[BL_TX_TELEMETRY] = 8U + sizeof(bl_telemetry) + 4U;
+  }
+  int c = bl_sched_pick(&g_sched, head);
+  if (c == BL_TX_LOG) {
+    send_frame(BL_CH_LOG, BL_LOG, log_q[log_head], log_len[log_head]);
+    log_head = (uint8_t)((log_head + 1U) % LOG_LINES);
+    log_n--;
+  } else if (c == BL_TX_TELEMETRY) {
+    bl_telemetry t;
+    tel_t0 = chVTGetSystemTimeX();
+    bl_session_telemetry(&g_sess, chTimeI2MS(chVTTimeElapsedSinceX(sess_t0)), &t);
+    send_frame(BL_CH_TELEMETRY, BL_TELEMETRY, &t, sizeof(t));
+  }
+}
 
-  for (uint32_t o = 0; o < total; o += QSPI_SECTOR) {
-    uint32_t chunk = (total - o) < QSPI_SECTOR ? (total - o) : QSPI_SECTOR;
+// ---- the QSPI part as the session's NOR device (non-blocking erase/program) ----
+static int nor_erase(void *ctx, uint32_t off, uint32_t size) {
+  (void)ctx;
+  return qspi_memmap_erase_start(g_qspi, off, size) ? 0 : -1;
+}
 
-    // read this 4KB chunk of the active image (memmap)
-    qspi_memmap_enable(g_qspi);
-    qspi_memmap_invalidate((const void *)(uintptr_t)(s1_base + o), QSPI_SECTOR);
-    memcpy(rot_buf, (const void *)(uintptr_t)(s1_base + o), chunk);
-    qspi_memmap_disable(g_qspi);
+static int nor_program(void *ctx, uint32_t off, const uint8_t *p, uint32_t n) {
+  (void)ctx;
+  return qspi_memmap_program_start(g_qspi, off, p, n) ? 0 : -1;
+}
 
-    // erase + program it into the fallback slot (indirect)
-    if (!qspi_memmap_erase_sector(g_qspi, s0_off + o)) {
-      bsp_printf("rotate: erase failed @ +0x%lX\r\n", (unsigned long)(s0_off + o));
-      return;
-    }
-    for (uint32_t p = 0; p < chunk; p += QSPI_PAGE) {
-      uint32_t plen = (chunk - p) < QSPI_PAGE ? (chunk - p) : QSPI_PAGE;
-      if (!qspi_memmap_program(g_qspi, s0_off + o + p, rot_buf + p, plen)) {
-        bsp_printf("rotate: program failed @ +0x%lX\r\n",
-                   (unsigned long)(s0_off + o + p));
-        return;
-      }
-    }
+static int nor_busy(void *ctx) {
+  (void)ctx;
+  bool busy;
+  if (!qspi_memmap_busy(g_qspi, &busy)) {
+    return -1;
   }
-  bsp_printf("rotate: done\r\n");
+  return busy ? 1 : 0;
 }
 
-// handle one complete frame; returns 1 when the session is finished
-static int handle_frame(const bl_frame *f) {
-  switch (f->type) {
-    case BL_MANIFEST: {
-      if (f->len < sizeof(bl_manifest)) {
-        g_status = BL_ERR_PROTO;
-        bl_result r = {.status = BL_ERR_PROTO, .reserved = 0, .bytes = 0};
-        send_reply(BL_NAK, &r, sizeof(r));
-        return 1;
-      }
-      memcpy(&g_manifest, f->payload, sizeof(g_manifest));
-
-      uint32_t slot_base;
-      switch (g_manifest.target) {
-        case BL_TARGET_APM_H755:
-          slot_base = bl_memmap[BL_SLOT_APP_1].base; // active app slot
-          break;
-        case BL_TARGET_FPGA_GW2AR18:
-        case BL_TARGET_FPGA_GW5A25:
-          slot_base = bl_memmap[BL_SLOT_FPGA_ACTIVE].base;
-          break;
-        default:
-          g_status = BL_ERR_TARGET;
-          {
-            bl_result r = {.status = BL_ERR_TARGET, .reserved = 0, .bytes = 0};
-            send_reply(BL_NAK, &r, sizeof(r));
-          }
-          return 1;
-      }
+static int nor_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  (void)ctx;
+  return qspi_memmap_read(g_qspi, off, p, n) ? 0 : -1;
+}
 
-      if (g_manifest.magic != BL_MANIFEST_MAGIC ||
-          g_manifest.length > UPD_MAX_IMAGE) {
-        g_status = (g_manifest.length > UPD_MAX_IMAGE) ? BL_ERR_SIZE : BL_ERR_PROTO;
-        bl_result r = {.status = g_status, .reserved = 0, .bytes = 0};
-        send_reply(BL_NAK, &r, sizeof(r));
-        return 1;
-      }
+static const bl_nor qspi_nor = {
+  .ctx     = NULL,
+  .erase   = nor_erase,
+  .program = nor_program,
+  .busy    = nor_busy,
+  .read    = nor_read,
+};
 
-      g_dst_off = slot_base - g_qspi->base;
-      g_recv = 0;
-      g_have_manifest = 1;
-      bsp_printf("update: manifest target=%u len=%lu -> %s\r\n",
-                 (unsigned)g_manifest.target, (unsigned long)g_manifest.length,
-                 (g_manifest.target == BL_TARGET_APM_H755) ? "app_1" : "fpga_active");
-      return 0;
-    }
+// the boot pointer's log sectors
+static int boot_open(void) {
+  uint32_t params = bl_memmap[BL_SLOT_PARAMS].base - g_qspi->base;
+  return bl_boot_open(&g_boot, &qspi_nor, params + BL_PARAMS_BOOT, params + BL_PARAMS_BOOT_2);
+}
 
-    case BL_DATA: {
-      if (!g_have_manifest) {
-        return 0;
-      }
-      if (g_recv + f->len > UPD_MAX_IMAGE) {
-        g_status = BL_ERR_SIZE;
-        return 0;
-      }
-      memcpy(g_img + g_recv, f->payload, f->len);
-      g_recv += f->len;
-      return 0;
-    }
+const bl_nor *bl_update_nor(const qspi_memmap_config_t *qspi) {
+  g_qspi = qspi;
+  return &qspi_nor;
+}
 
-    case BL_DONE: {
-      uint16_t st;
-      if (!g_have_manifest) {
-        st = BL_ERR_PROTO;
-      } else if (g_recv != g_manifest.length) {
-        st = BL_ERR_SIZE;
-      } else if (bl_crc32(g_img, g_recv) != g_manifest.crc32) {
-        st = BL_ERR_CRC;
-      } else {
-        // for an app update, first move the current active image (slot1) down
-        // to the fallback (slot0) so it stays as last-known-good, then commit
-        // the new image to the active slot. fpga updates have their own
-        // active/golden pair and are not rotated.
-        if (g_manifest.target == BL_TARGET_APM_H755) {
-          rotate_active_to_fallback();
-        }
-        bsp_printf("update: crc ok, writing %lu bytes to slot...\r\n",
-                   (unsigned long)g_recv);
-        st = (write_slot(g_dst_off, g_img, g_recv) == 0) ? BL_OK : BL_ERR_FLASH;
-      }
-      g_status = st;
-      bl_result r = {.status = st, .reserved = 0, .bytes = g_recv};
-      send_reply(BL_RESULT, &r, sizeof(r));
-      return 1;
-    }
+// ---- session callbacks ----
+static void sess_send(void *ctx, uint8_t type, const void *pl, uint16_t len) {
+  (void)ctx;
+  send_reply(type, pl, len);
+}
 
+static int sess_slot(void *ctx, uint16_t target, uint32_t *dev_off, uint32_t *size) {
+  (void)ctx;
+  enum bl_slot slot;
+  switch (target) {
+    case BL_TARGET_APM_H755:
+      if (boot_open() != 0) {
+        return -1;
+      }
+      slot = (enum bl_slot)(BL_SLOT_APP_0 + bl_boot_update_slot(&g_boot)); // not the active one
+      break;
+    case BL_TARGET_FPGA_GW2AR18:
+    case BL_TARGET_FPGA_GW5A25:
+      slot = BL_SLOT_FPGA_ACTIVE;
+      break;
     default:
-      return 0;
+      return -1;
+  }
+  *dev_off = bl_memmap[slot].base - g_qspi->base;
+  *size = bl_memmap[slot].size;
+  return 0;
+}
+
+// runs before the first erase of the target slot. nothing to prepare: an app
+// update goes into the inactive slot (sess_slot), fpga updates have their own
+// active/golden pair
+static void sess_prepare(void *ctx, const bl_manifest *m) {
+  (void)ctx;
+  say("update: manifest target=%u len=%lu%s -> %s",
+      (unsigned)m->target,
+      (unsigned long)m->length,
+      (m->flags & BL_MANIFEST_F_DELTA) ? " (delta)" : (m->flags & BL_MANIFEST_F_LZ) ? " (lz)" : "",
+      (m->target == BL_TARGET_APM_H755)
+        ? bl_memmap[BL_SLOT_APP_0 + bl_boot_update_slot(&g_boot)].name
+        : "fpga_active");
+}
+
+// the image a delta rebuilds from: the active slot's, untouched by the update.
+// its length comes from the stored header; the session checks the patch's base
+// crc over it
+static int sess_base(void *ctx, uint16_t target, uint32_t *dev_off, uint32_t *len) {
+  (void)ctx;
+  if (target != BL_TARGET_APM_H755) {
+    return -1; // the fpga active/golden pair has no second copy to patch from
+  }
+  enum bl_slot active = (enum bl_slot)(BL_SLOT_APP_0 + g_boot.cur.active);
+  bl_image_header h;
+  uint32_t off = bl_memmap[active].base - g_qspi->base;
+  if (!qspi_memmap_read(g_qspi, off, (uint8_t *)&h, sizeof(h)) || h.magic != BL_IMAGE_MAGIC ||
+      h.length > bl_memmap[active].size - BL_IMAGE_OFFSET) {
+    return -1;
+  }
+  *dev_off = off;
+  *len = BL_IMAGE_OFFSET + h.length;
+  return 0;
+}
+
+// an app image verified in the inactive slot: point the next boot at it
+static int sess_commit(void *ctx, const bl_manifest *m) {
+  (void)ctx;
+  if (m->target != BL_TARGET_APM_H755) {
+    return 0;
+  }
+  unsigned slot = bl_boot_update_slot(&g_boot);
+  if (bl_boot_install(&g_boot, slot) != 0) {
+    say("update: writing the boot pointer failed");
+    return -1;
+  }
+  say("update: next boot from %s", bl_memmap[BL_SLOT_APP_0 + slot].name);
+  return 0;
+}
+
+// the progress log sector of resumable updates
+static int sess_log(void *ctx, uint32_t *dev_off) {
+  (void)ctx;
+  *dev_off = bl_memmap[BL_SLOT_PARAMS].base - g_qspi->base + BL_PARAMS_RESUME_LOG;
+  return 0;
+}
+
+// the last boot that reached the app, as bl_main found it
+static const bl_boot_trace *sess_trace(void *ctx) {
+  (void)ctx;
+  return g_trace;
+}
+
+// sample the cycle counter for the boot trace: every poll, far inside a wrap
+static void clock_poll(void) {
+  if (g_clock != NULL) {
+    bl_trace_clock_poll(g_clock, DWT->CYCCNT);
   }
 }
 
-// wait up to window_ms for a HELLO frame. returns 1 if a HELLO arrived
+static void sess_idle(void *ctx) {
+  (void)ctx;
+  chThdSleepMilliseconds(1);
+  clock_poll();
+}
+
+// BL_LINK asks for `baud`: take it if BRR gets within 2% of it at 16x
+// oversampling (the USART kernel clock / 16 at most)
+static int sess_set_baud(void *ctx, uint32_t baud) {
+  (void)ctx;
+  uint32_t clk = UARTD4.clock;
+  if (baud == 0U || baud > clk / 16U) {
+    return -1;
+  }
+  uint32_t brr = (clk + baud / 2U) / baud;
+  uint32_t got = clk / brr;
+  uint32_t err = (got > baud) ? got - baud : baud - got;
+  if (brr > 0xFFFFU || err * 50U > baud) {
+    return -1;
+  }
+  next_baud = baud;
+  return 0;
+}
+
+// a switched line with no intact frame since, for BL_LINK_TRIAL_MS: the host
+// is not on the new rate, go back
+static void check_trial(void) {
+  if (trial_baud == 0U) {
+    return;
+  }
+  if (g_sess.frames != trial_frames) {
+    trial_baud = 0; // heard the host at the new rate
+    return;
+  }
+  if (chTimeI2MS(chVTTimeElapsedSinceX(trial_t0)) >= BL_LINK_TRIAL_MS) {
+    bsp_printf("update: nothing at %lu baud, back to %lu\r\n", (unsigned long)cur_baud,
+               (unsigned long)trial_baud);
+    set_line_baud(trial_baud);
+    trial_baud = 0;
+  }
+}
+
+static const bl_session_ops sess_ops = {
+  .ctx     = NULL,
+  .send    = sess_send,
+  .slot    = sess_slot,
+  .prepare = sess_prepare,
+  .idle    = sess_idle,
+  .base    = sess_base,
+  .log     = sess_log,
+  .set_baud = sess_set_baud,
+  .commit  = sess_commit,
+  .trace   = sess_trace,
+};
+
+// wait up to window_ms for a HELLO frame. returns 1 if a HELLO arrived, and
+// notes the host's protocol version
 static int wait_hello(uint32_t window_ms) {
   const size_t hlen = 8U + sizeof(bl_hello) + 4U;
   phase = 0;
@@ -301,6 +462,7 @@ static int wait_hello(uint32_t window_ms) {
   while (!hs_rx_done && waited < window_ms) {
     chThdSleepMilliseconds(5);
     waited += 5;
+    clock_poll();
   }
   if (!hs_rx_done) {
     uartStopReceive(&UARTD4);
@@ -312,20 +474,30 @@ static int wait_hello(uint32_t window_ms) {
   bl_frame_rx_init(&rx);
   for (size_t i = 0; i < hlen; i++) {
     if (bl_frame_feed(&rx, hs_rx[i]) == BL_FRAME_OK && rx.frame.type == BL_HELLO) {
+      bl_hello h;
+      memcpy(&h, rx.frame.payload, sizeof(h));
+      host_ver = h.version;
       return 1;
     }
   }
   return 0;
 }
 
-int bl_update_run(const qspi_memmap_config_t *qspi, uint32_t window_ms) {
+int bl_update_run(const qspi_memmap_config_t *qspi, uint32_t window_ms,
+                  const bl_boot_trace *trace, bl_trace_clock *clock) {
   g_qspi = qspi;
+  g_trace = trace;
+  g_clock = clock;
 
   palSetPadMode(GPIOC, 11, PAL_MODE_ALTERNATE(8)); // UART4_RX
   palSetPadMode(GPIOC, 10, PAL_MODE_ALTERNATE(8)); // UART4_TX
 
   chMBObjectInit(&rx_mb, rx_mb_buf, 16);
   uartStart(&UARTD4, &uart_cfg);
+  cur_baud = UPD_BAUD;
+  next_baud = 0;
+  trial_baud = 0;
+  mirror = 0;
 
   bsp_printf("update: listening on UART4 @ %u for %lums...\r\n",
              (unsigned)UPD_BAUD, (unsigned long)window_ms);
@@ -342,45 +514,60 @@ int bl_update_run(const qspi_memmap_config_t *qspi, uint32_t window_ms) {
   send_reply(BL_HELLO_ACK, &h, sizeof(h));
 
   // now arm the stream receiver
-  bl_frame_rx_init(&g_rx);
-  g_have_manifest = 0;
-  g_recv = 0;
-  g_status = BL_ERR_PROTO;
+  bl_session_init(&g_sess, &sess_ops, &qspi_nor);
   msg_t junk;
   while (chMBFetchTimeout(&rx_mb, &junk, TIME_IMMEDIATE) == MSG_OK) {
   }
   cur = 0;
   phase = 1;
   uartStartReceive(&UARTD4, RXSZ, rxbuf[cur]);
-  bsp_printf("update: host connected, receiving...\r\n");
-
-  // consume chunks, feed the frame parser, until DONE or a stall
+  log_head = 0;
+  log_n = 0;
+  bl_sched_init(&g_sched);
+  sess_t0 = chVTGetSystemTimeX();
+  tel_t0 = sess_t0;
+  mirror = (host_ver >= 10U);
+  say("update: host connected (v%u), receiving...", (unsigned)host_ver);
+
+  // consume chunks until DONE or a stall. while the flash has work queued, wake
+  // every tick even without data so the next erase/program starts as soon as
+  // the part is free; the UART DMA keeps filling the other buffer meanwhile.
+  // after the verdict, stay on the line until it goes quiet: a host whose
+  // RESULT was lost sends its DONE again, and the session answers it
+  uint32_t quiet_ms = 0;
+  int over = 0;
   for (;;) {
+    clock_poll();
+    int pending = bl_session_poll(&g_sess); // also sends a due ack
+    if (pending < 0) {
+      break; // flash error, nak sent
+    }
+    check_trial();
+    aux_poll();
+    // a baud on trial is watched per tick too, and so is the telemetry clock
+    int tick = pending || trial_baud != 0U || mirror;
     msg_t m;
-    if (chMBFetchTimeout(&rx_mb, &m, TIME_MS2I(5000)) != MSG_OK) {
-      bsp_printf("update: stalled, aborting\r\n");
+    sysinterval_t wait = tick ? TIME_MS2I(1) : TIME_MS2I(UPD_STALL_MS);
+    if (chMBFetchTimeout(&rx_mb, &m, wait) != MSG_OK) {
+      quiet_ms += tick ? 1U : UPD_STALL_MS;
+      if (quiet_ms < UPD_STALL_MS) {
+        continue;
+      }
+      if (!over) {
+        bsp_printf("update: stalled, aborting\r\n");
+      }
       break;
     }
+    quiet_ms = 0;
     uint8_t idx = (uint8_t)(((uint32_t)m >> 16) & 1U);
     size_t len = (size_t)((uint32_t)m & 0xFFFFU);
     cacheBufferInvalidate(rxbuf[idx], RXSZ);
-
-    int fin = 0;
-    for (size_t i = 0; i < len; i++) {
-      if (bl_frame_feed(&g_rx, rxbuf[idx][i]) == BL_FRAME_OK) {
-        if (handle_frame(&g_rx.frame)) {
-          fin = 1;
-          break;
-        }
-      }
-    }
-    if (fin) {
-      break;
-    }
+    over |= bl_session_feed(&g_sess, rxbuf[idx], len);
   }
 
   uartStopReceive(&UARTD4);
-  bsp_printf("update: done, status=%u, %lu bytes\r\n", (unsigned)g_status,
-             (unsigned long)g_recv);
+  mirror = 0;
+  bsp_printf("update: done, status=%u, %lu bytes\r\n", (unsigned)g_sess.status,
+             (unsigned long)g_sess.recv);
   return 1;
 }
@@ -7,16 +7,28 @@
 
 #include "drivers/qspi_memmap.h"
 
+#include "bootloader/boot_trace.h"
+#include "bootloader/flash_stream.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // listen on UART4 for a host HELLO for up to window_ms; if a host connects, run
-// a framed update session (HELLO_ACK -> MANIFEST -> DATA.. -> DONE), verify the
-// transfer crc, write the image to the target QSPI slot, and reply RESULT.
+// a framed update session (HELLO_ACK -> MANIFEST -> DATA.. -> DONE) that streams
+// the image into the target QSPI slot as it arrives, checks the transfer crc and
+// a readback of the slot, and replies RESULT.
+// a BL_TRACE is answered with `trace` (NULL: empty). `clock` (NULL: none) is
+// sampled on the cycle counter at every poll, so the boot trace times the
+// window past a counter wrap (bootloader/boot_trace.h).
 // returns 1 if a session ran, 0 if no host connected in the window.
 // qspi must be initialized in indirect mode (as left by qspi_memmap_init).
-int bl_update_run(const qspi_memmap_config_t *qspi, uint32_t window_ms);
+int bl_update_run(const qspi_memmap_config_t *qspi, uint32_t window_ms,
+                  const bl_boot_trace *trace, bl_trace_clock *clock);
+
+// the QSPI part as a bl_nor (device offsets), for the boot pointer
+// (bootloader/boot_ptr.h). indirect mode only
+const bl_nor *bl_update_nor(const qspi_memmap_config_t *qspi);
 
 #ifdef __cplusplus
 }
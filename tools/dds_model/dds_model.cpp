@@ -0,0 +1,166 @@
+// see dds_model.h
+
+#include "dds_model.h"
+
+#include "cheby/audio_regs.h"
+
+const uint16_t dds_sine_lut[256] = {
+#include "sine_lut.inc"
+};
+
+namespace {
+
+// the sine ROM as wave_s: offset binary to signed, 12 bits up to 16
+struct sine_wave_tab {
+  int16_t v[256];
+  sine_wave_tab() {
+    for (unsigned i = 0; i < 256U; i++) {
+      v[i] = static_cast<int16_t>((dds_sine_lut[i] ^ 0x800U) << 4);
+    }
+  }
+};
+const sine_wave_tab sine_wave;
+
+// one voice over a block: advance the phase, shape, scale, add to the mix.
+// the shapes are branch-free on the phase so the loop vectorizes
+template <typename Shape>
+uint32_t voice_block(int32_t *mix, size_t n, uint32_t ph, uint32_t f, int32_t g, Shape shape) {
+  for (size_t k = 0; k < n; k++) {
+    ph += f;
+    mix[k] += (static_cast<int32_t>(shape(ph)) * g) >> 8;
+  }
+  return ph;
+}
+
+inline int16_t sine_of(uint32_t p) { return sine_wave.v[p >> 24]; }
+inline int16_t saw_of(uint32_t p) { return static_cast<int16_t>((p >> 16) ^ 0x8000U); }
+inline int16_t square_of(uint32_t p) {
+  return static_cast<int16_t>(static_cast<int32_t>(p >> 31) * 0xFFFF - 0x8000);
+}
+inline int16_t tri_of(uint32_t p) {
+  uint32_t ramp = ((p >> 15) ^ (0U - (p >> 31))) & 0xFFFFU;   // phase[31] ? ~p[30:15] : p[30:15]
+  return static_cast<int16_t>(ramp ^ 0x8000U);
+}
+
+} // namespace
+
+int16_t dds_wave_sample(unsigned wave, uint32_t phase) {
+  switch (wave & 3U) {
+  case DDS_SINE:
+    return sine_of(phase);
+  case DDS_SAW:
+    return saw_of(phase);
+  case DDS_SQUARE:
+    return square_of(phase);
+  default:
+    return tri_of(phase);
+  }
+}
+
+uint16_t dds_dac_code(int16_t sample) {
+  int32_t biased = (sample >> 3) + 2048;
+  if (biased < 0) {
+    return 0U;
+  }
+  return static_cast<uint16_t>(biased > 4095 ? 4095 : biased);
+}
+
+uint16_t dds_voice_ctrl_word(bool gate, unsigned wave, uint8_t level) {
+  return static_cast<uint16_t>((gate ? AUDIO_VOICE_CTRL_GATE : 0U) |
+                               ((wave << AUDIO_VOICE_CTRL_WAVE_SHIFT) & AUDIO_VOICE_CTRL_WAVE_MASK) |
+                               (static_cast<unsigned>(level) << AUDIO_VOICE_CTRL_LEVEL_SHIFT));
+}
+
+dds_model::dds_model(unsigned voices)
+    : phase(voices), freq(voices), ctrl(voices), gain(voices), mix_(DDS_BLOCK) {
+  while (voices > (1U << shift)) {
+    shift++;
+  }
+}
+
+void dds_model::reset() {
+  for (unsigned v = 0; v < voices(); v++) {
+    phase[v] = 0U;
+    freq[v] = 0U;
+    ctrl[v] = 0U;
+    gain[v] = 0;
+  }
+  samples = 0U;
+}
+
+void dds_model::voice_freq(unsigned v, uint32_t inc) {
+  if (v < voices()) {
+    freq[v] = inc;
+  }
+}
+
+void dds_model::voice_ctrl(unsigned v, uint16_t c) {
+  if (v < voices()) {
+    // the fields the reg file stores; bits 7:4 are not there
+    ctrl[v] = static_cast<uint16_t>(c & (AUDIO_VOICE_CTRL_GATE_MASK | AUDIO_VOICE_CTRL_WAVE_MASK |
+                                         AUDIO_VOICE_CTRL_LEVEL_MASK));
+    gain[v] = (c & AUDIO_VOICE_CTRL_GATE) ? static_cast<int32_t>(c >> AUDIO_VOICE_CTRL_LEVEL_SHIFT) : 0;
+  }
+}
+
+void dds_model::write(uint32_t off, uint16_t v) {
+  if (off < AUDIO_VOICE) {
+    return;
+  }
+  unsigned voice = (off - AUDIO_VOICE) / AUDIO_VOICE_SIZE;
+  uint32_t reg = (off - AUDIO_VOICE) % AUDIO_VOICE_SIZE;
+  if (voice >= voices()) {
+    return;
+  }
+  if (reg == AUDIO_VOICE_FREQ) {
+    freq[voice] = (freq[voice] & 0x0000FFFFU) | (static_cast<uint32_t>(v) << 16);
+  } else if (reg == AUDIO_VOICE_FREQ + 2U) {
+    freq[voice] = (freq[voice] & 0xFFFF0000U) | v;
+  } else if (reg == AUDIO_VOICE_CTRL) {
+    voice_ctrl(voice, v);
+  }
+}
+
+void dds_model::render(int16_t *out, uint16_t *dac, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    size_t len = (n - done < DDS_BLOCK) ? n - done : DDS_BLOCK;
+    int32_t *mix = mix_.data();
+    for (size_t k = 0; k < len; k++) {
+      mix[k] = 0;
+    }
+    for (unsigned v = 0; v < voices(); v++) {
+      uint32_t ph = phase[v], f = freq[v];
+      int32_t g = gain[v];
+      if (g == 0) {
+        phase[v] = ph + static_cast<uint32_t>(len) * f;   // silent: the phase still runs
+        continue;
+      }
+      switch ((ctrl[v] & AUDIO_VOICE_CTRL_WAVE_MASK) >> AUDIO_VOICE_CTRL_WAVE_SHIFT & 3U) {
+      case DDS_SINE:
+        phase[v] = voice_block(mix, len, ph, f, g, sine_of);
+        break;
+      case DDS_SAW:
+        phase[v] = voice_block(mix, len, ph, f, g, saw_of);
+        break;
+      case DDS_SQUARE:
+        phase[v] = voice_block(mix, len, ph, f, g, square_of);
+        break;
+      default:
+        phase[v] = voice_block(mix, len, ph, f, g, tri_of);
+        break;
+      }
+    }
+    for (size_t k = 0; k < len; k++) {
+      int16_t s = static_cast<int16_t>(mix[k] >> shift);
+      if (out != nullptr) {
+        out[done + k] = s;
+      }
+      if (dac != nullptr) {
+        dac[done + k] = dds_dac_code(s);
+      }
+    }
+    done += len;
+  }
+  samples += n;
+}
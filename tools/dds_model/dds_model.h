@@ -0,0 +1,91 @@
+// bit-exact host model of the FPGA's DDS oscillator bank
+// (modules/acm/acm_fpga/rtl/dds_synth.v) and of the DAC code acm_top makes of
+// its sample, for rendering scores without the board and for checking the RTL
+// against (sim/cocotb: make acm). per voice and sample, as the RTL does it:
+//
+//   phase  += freq                        (32 bits, wraps; gated or not)
+//   wave    sine   (sine_lut[phase>>24] ^ 0x800) << 4
+//           saw    (phase >> 16) ^ 0x8000
+//           square phase[31] ? 0x7FFF : -0x8000
+//           tri    (phase[31] ? ~phase[30:15] : phase[30:15]) ^ 0x8000
+//   scaled  gate ? (wave * level) >> 8 : 0
+//   sample  (sum of scaled) >> 3          (16 bits signed)
+//   dac     clamp((sample >> 3) + 2048, 0, 4095)
+//
+// the sine table is the ROM itself: the Makefile cuts sine_lut.inc out of
+// rtl/sine_lut.v, so the two cannot drift apart.
+//
+// the RTL walks the voices one per clock; the model does one voice at a time
+// over a block of samples instead (phase k of a block is phase + k * freq, no
+// chain from sample to sample), so each inner loop is a plain array loop the
+// compiler vectorizes (sine's table lookup is a gather: scalar loads unless the
+// target has one, e.g. -mavx2). integer sums do not care about order, so this
+// is the same sample the RTL makes. voices that are not gated only advance
+// their phase.
+//
+// the RTL has 8 voices and a fixed >>3; a model with more voices (a bigger
+// bank, for sizing one) uses the same voice datapath and grows the mix shift to
+// log2(voices), so the sum cannot overflow 16 bits either.
+
+#ifndef DDS_MODEL_DDS_MODEL_H
+#define DDS_MODEL_DDS_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define DDS_RTL_VOICES 8U
+#define DDS_CLK_HZ     27000000U    // acm_top clk
+#define DDS_TICK_DIV   562U         // acm_top TICK_DIV: clocks per sample
+#define DDS_FS_HZ      (static_cast<double>(DDS_CLK_HZ) / DDS_TICK_DIV)   // ~48043 Hz
+#define DDS_BLOCK      256U         // samples per render block
+
+enum dds_wave { DDS_SINE, DDS_SAW, DDS_SQUARE, DDS_TRIANGLE };
+
+// the 256-entry, 12-bit unsigned sine ROM, as in rtl/sine_lut.v
+extern const uint16_t dds_sine_lut[256];
+
+// one voice's waveform at an (already advanced) phase, before level: the RTL's
+// wave_s. `wave` is the 3-bit ctrl field; only its low two bits count
+int16_t dds_wave_sample(unsigned wave, uint32_t phase);
+
+// acm_top's DAC code for a mixed sample: 12-bit, 2048 = silence
+uint16_t dds_dac_code(int16_t sample);
+
+// voice ctrl word as the cheby audio block has it: gate | wave << 1 | level << 8
+uint16_t dds_voice_ctrl_word(bool gate, unsigned wave, uint8_t level);
+
+struct dds_model {
+  // per-voice state, one array per field
+  std::vector<uint32_t> phase;
+  std::vector<uint32_t> freq;     // tuning word: note_hz * 2^32 / DDS_FS_HZ
+  std::vector<uint16_t> ctrl;     // as written: gate, wave, level
+  std::vector<int32_t> gain;      // level if gated, else 0
+  unsigned shift = 3;             // mix headroom
+  uint64_t samples = 0;           // rendered since init / reset
+
+  // `voices` voices (8 = the RTL), all at phase 0, freq 0, gated off
+  explicit dds_model(unsigned voices = DDS_RTL_VOICES);
+
+  unsigned voices() const { return static_cast<unsigned>(phase.size()); }
+
+  // rst: phases, tuning words and ctrl to 0 (the register block resets too)
+  void reset();
+
+  void voice_freq(unsigned v, uint32_t inc);
+  void voice_ctrl(unsigned v, uint16_t c);
+
+  // a 16-bit write into the cheby audio block, `off` bytes from its start, as
+  // the FMC would make it: voice freq halves (high word first in address) and
+  // voice ctrl; anything else is not the DDS's and is ignored
+  void write(uint32_t off, uint16_t v);
+
+  // the next n samples (the RTL's sample_o) and their DAC codes; either
+  // pointer may be null
+  void render(int16_t *out, uint16_t *dac, size_t n);
+
+ private:
+  std::vector<int32_t> mix_;      // one block of voice sums
+};
+
+#endif // DDS_MODEL_DDS_MODEL_H
@@ -0,0 +1,179 @@
+// render a MIDI file through the DDS model (dds_model.h) to a .wav, the way
+// the board would play it; or print reference samples for the RTL bench.
+//
+//   ./dds_render.bin song.mid song.wav [--voices 8] [--wave saw] [--dac]
+//   ./dds_render.bin --vectors state.txt
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dds_model.h"
+#include "player.h"
+#include "smf.h"
+#include "wav.h"
+
+namespace {
+
+void usage(const char *prog) {
+  std::cout
+      << "usage: " << prog << " <score.mid> <out.wav> [options]\n"
+      << "       " << prog << " --vectors <state>\n"
+      << "  --voices <n>     DDS voices (default 8, as the FPGA has; more model a\n"
+      << "                   bigger bank - notes play on up to 64 of them)\n"
+      << "  --wave <w>       sine | saw | square | tri (default sine, as the firmware)\n"
+      << "  --dac            write what the DAC is given: the 12-bit code, scaled\n"
+      << "                   back to 16 bits, instead of the FPGA's 16-bit sample\n"
+      << "  --tail <s>       seconds rendered after the last event (default 1)\n"
+      << "  --vectors <f>    reference samples for the cocotb acm bench: <f> sets the\n"
+      << "                   FPGA's 8 voices, one `voice <v> <phase> <freq> <ctrl>`\n"
+      << "                   line each, and `samples <n>` says how many to print;\n"
+      << "                   out comes one `<sample> <dac>` line per sample\n"
+      << "  --help           this message\n";
+}
+
+// a number as C writes it: decimal, 0x hex or 0 octal
+bool number(std::istream &in, unsigned long &v) {
+  std::string tok;
+  if (!(in >> tok)) {
+    return false;
+  }
+  char *end = nullptr;
+  v = std::strtoul(tok.c_str(), &end, 0);
+  return *end == '\0';
+}
+
+int vectors(const std::string &path) {
+  std::ifstream f(path);
+  if (!f) {
+    std::cerr << "can't open " << path << "\n";
+    return 1;
+  }
+  dds_model m;
+  unsigned long n = 0;
+  std::string line;
+  while (std::getline(f, line)) {
+    std::istringstream in(line);
+    std::string what;
+    in >> what;
+    if (what == "voice") {
+      unsigned long v, phase, freq, ctrl;
+      if (!number(in, v) || !number(in, phase) || !number(in, freq) || !number(in, ctrl) ||
+          v >= m.voices()) {
+        std::cerr << "bad line: " << line << "\n";
+        return 1;
+      }
+      m.phase[v] = static_cast<uint32_t>(phase);
+      m.voice_freq(static_cast<unsigned>(v), static_cast<uint32_t>(freq));
+      m.voice_ctrl(static_cast<unsigned>(v), static_cast<uint16_t>(ctrl));
+    } else if (what == "samples") {
+      if (!number(in, n)) {
+        std::cerr << "bad line: " << line << "\n";
+        return 1;
+      }
+    } else if (!what.empty() && what[0] != '#') {
+      std::cerr << "bad line: " << line << "\n";
+      return 1;
+    }
+  }
+  std::vector<int16_t> s(n);
+  std::vector<uint16_t> dac(n);
+  m.render(s.data(), dac.data(), n);
+  for (unsigned long i = 0; i < n; i++) {
+    printf("%d %u\n", s[i], dac[i]);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files;
+  unsigned voices = DDS_RTL_VOICES;
+  unsigned wave = DDS_SINE;
+  bool as_dac = false;
+  double tail = 1.0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&](const char *name) -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << name << " needs an argument\n";
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+
+    if (a == "--vectors") {
+      return vectors(next("--vectors"));
+    } else if (a == "--voices") {
+      voices = static_cast<unsigned>(std::stoi(next("--voices")));
+    } else if (a == "--wave") {
+      std::string w = next("--wave");
+      static const char *const names[] = {"sine", "saw", "square", "tri"};
+      wave = 4U;
+      for (unsigned k = 0; k < 4U; k++) {
+        wave = (w == names[k]) ? k : wave;
+      }
+      if (wave == 4U) {
+        std::cerr << "unknown wave: " << w << "\n";
+        return 2;
+      }
+    } else if (a == "--dac") {
+      as_dac = true;
+    } else if (a == "--tail") {
+      tail = std::stod(next("--tail"));
+    } else if (a == "--help" || a == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else if (!a.empty() && a[0] == '-') {
+      std::cerr << "unknown option: " << a << "\n";
+      usage(argv[0]);
+      return 2;
+    } else {
+      files.push_back(a);
+    }
+  }
+  if (files.size() != 2U || voices == 0U) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<smf_event> ev;
+  std::string err;
+  if (!smf_load(files[0], ev, err)) {
+    std::cerr << files[0] << ": " << err << "\n";
+    return 1;
+  }
+
+  dds_model m(voices);
+  dds_player p(m, wave);
+  std::vector<int16_t> s;
+  std::vector<uint16_t> dac;
+  auto t0 = std::chrono::steady_clock::now();
+  dds_render_score(p, ev, tail, s, &dac);
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  unsigned long clipped = 0;
+  for (size_t i = 0; i < s.size(); i++) {
+    clipped += (dac[i] == 0U || dac[i] == 4095U) ? 1U : 0U;
+    if (as_dac) {
+      s[i] = static_cast<int16_t>((dac[i] - 2048) * 16);
+    }
+  }
+  if (!wav_write(files[1], s.data(), s.size(), p.rate)) {
+    std::cerr << "can't write " << files[1] << "\n";
+    return 1;
+  }
+  double secs = static_cast<double>(s.size()) / p.rate;
+  printf("%s: %zu events, %lu notes (%u stolen) on %u voices, %.1f s\n", files[0].c_str(),
+         ev.size(), p.notes, p.va.steals, voices, secs);
+  printf("rendered in %.3f s (%.0fx real time), dac codes at the rails: %lu\n", dt,
+         dt > 0.0 ? secs / dt : 0.0, clipped);
+  return 0;
+}
@@ -0,0 +1,103 @@
+// see player.h
+
+#include "player.h"
+
+#include <cmath>
+
+namespace {
+
+void note(dds_player &p, uint8_t n, uint8_t vel, bool on) {
+  n &= 0x7FU;
+  if (on) {
+    uint8_t stolen;
+    uint8_t v = synth_va_on(&p.va, n, &stolen);
+    p.pedal_held[n] = false;
+    p.m.voice_freq(v, static_cast<uint32_t>(p.note_inc[n] * p.bend_mul));
+    p.m.voice_ctrl(v, dds_voice_ctrl_word(true, p.wave, static_cast<uint8_t>(vel << 1)));
+    p.notes++;
+  } else {
+    uint8_t v = synth_va_off(&p.va, n);
+    if (v != SYNTH_NO_VOICE) {
+      p.m.voice_ctrl(v, dds_voice_ctrl_word(false, p.wave, 0U));
+    }
+  }
+}
+
+void sink(void *ctx, const midi_msg *msg) {
+  dds_player &p = *static_cast<dds_player *>(ctx);
+  switch (msg->type) {
+  case MIDI_NOTE_ON:
+    note(p, msg->a, msg->b, true);
+    break;
+  case MIDI_NOTE_OFF:
+    if (p.sustain) {
+      p.pedal_held[msg->a] = true;
+    } else {
+      note(p, msg->a, 0U, false);
+    }
+    break;
+  case MIDI_CONTROL:
+    if (msg->a == MIDI_CC_SUSTAIN) {
+      p.sustain = (msg->b >= 64U);
+      for (uint8_t n = 0; !p.sustain && n < 128U; n++) {
+        if (p.pedal_held[n]) {
+          p.pedal_held[n] = false;
+          note(p, n, 0U, false);
+        }
+      }
+    }
+    break;
+  case MIDI_PITCH_BEND:
+    p.bend_mul = std::pow(2.0, static_cast<double>(msg->bend) / (8192.0 * 6.0));
+    for (uint8_t v = 0; v < p.va.voices; v++) {
+      if (p.va.note[v] != SYNTH_NO_NOTE) {
+        p.m.voice_freq(v, static_cast<uint32_t>(p.note_inc[p.va.note[v]] * p.bend_mul));
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+} // namespace
+
+dds_player::dds_player(dds_model &model, unsigned w, unsigned r) : m(model), wave(w), rate(r) {
+  synth_va_init(&va, m.voices() < SYNTH_VA_MAX ? m.voices() : SYNTH_VA_MAX);
+  midi_dec_init(&dec, sink, this);
+  for (int n = 0; n < 128; n++) {
+    double hz = 440.0 * std::pow(2.0, (n - 69) / 12.0);
+    note_inc[n] = static_cast<uint32_t>(hz * 4294967296.0 / rate + 0.5);
+  }
+}
+
+void dds_player::play(const uint8_t *msg, uint8_t len) {
+  // as a USB-MIDI packet on cable 0, so it takes the firmware's decode path
+  const uint8_t pkt[4] = {static_cast<uint8_t>(msg[0] >> 4), msg[0],
+                          static_cast<uint8_t>(len > 1U ? msg[1] : 0U),
+                          static_cast<uint8_t>(len > 2U ? msg[2] : 0U)};
+  midi_dec_packet(&dec, pkt, 0U);
+}
+
+void dds_render_score(dds_player &p, const std::vector<smf_event> &ev, double tail_s,
+                      std::vector<int16_t> &out, std::vector<uint16_t> *dac) {
+  size_t start = out.size();
+  size_t dstart = (dac != nullptr) ? dac->size() : 0U;
+  size_t at = 0;   // samples rendered, from `start`
+  auto upto = [&](size_t n) {
+    if (n > at) {
+      out.resize(start + n);
+      if (dac != nullptr) {
+        dac->resize(dstart + n);
+      }
+      p.m.render(&out[start + at], dac != nullptr ? &(*dac)[dstart + at] : nullptr, n - at);
+      at = n;
+    }
+  };
+  for (const smf_event &e : ev) {
+    upto(static_cast<size_t>(std::llround(e.t * p.rate)));
+    p.play(e.msg, e.len);
+  }
+  double end = (ev.empty() ? 0.0 : ev.back().t) + tail_s;
+  upto(static_cast<size_t>(std::llround(end * p.rate)));
+}
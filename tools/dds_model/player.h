@@ -0,0 +1,52 @@
+// plays MIDI on a dds_model the way the APM firmware's synth does
+// (modules/apm/tests/test_midi_synth.c): each message goes through the same
+// USB-MIDI decoder (lib/midi) and voice allocator (lib/synth); a held note is a
+// gated voice at the note's tuning word with level velocity * 2, and the
+// sustain pedal and pitch bend (+-2 semitones) work as they do there. what the
+// firmware would write to the audio block goes straight into the model, at the
+// sample the event is due rather than at the next 1 ms flush.
+//
+// the tuning words are for the rate the board's DAC plays at (48 kHz), as the
+// firmware's are, and the renderer times events and labels its WAV at that
+// rate too: the result is pitched and timed as the board sounds, though the
+// FPGA makes ~48043 samples a second.
+
+#ifndef DDS_MODEL_PLAYER_H
+#define DDS_MODEL_PLAYER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dds_model.h"
+#include "midi/usb_midi.h"
+#include "smf.h"
+#include "synth/voice_alloc.h"
+
+#define DDS_PLAYER_RATE 48000U
+
+struct dds_player {
+  dds_model &m;
+  synth_va va;                  // up to SYNTH_VA_MAX of the model's voices
+  midi_decoder dec;
+  uint32_t note_inc[128];
+  unsigned wave;                // every voice's: enum dds_wave
+  unsigned rate;
+  bool sustain = false;
+  bool pedal_held[128] = {};
+  double bend_mul = 1.0;
+  unsigned long notes = 0;
+
+  dds_player(dds_model &m, unsigned wave = DDS_SINE, unsigned rate = DDS_PLAYER_RATE);
+  dds_player(const dds_player &) = delete;
+  dds_player &operator=(const dds_player &) = delete;
+
+  // one MIDI channel message, status first (len 2 or 3)
+  void play(const uint8_t *msg, uint8_t len);
+};
+
+// a score: each event played at its sample, then `tail_s` seconds past the
+// last. samples are appended to `out`, their DAC codes to `dac` (may be null)
+void dds_render_score(dds_player &p, const std::vector<smf_event> &ev, double tail_s,
+                      std::vector<int16_t> &out, std::vector<uint16_t> *dac);
+
+#endif // DDS_MODEL_PLAYER_H
@@ -0,0 +1,207 @@
+// see smf.h
+
+#include "smf.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+// a track event before timing: channel message, or a tempo change
+struct raw_event {
+  uint64_t tick;
+  unsigned track;
+  unsigned seq;        // order within the track, for equal ticks
+  uint32_t tempo;      // us per quarter note; 0 = a channel message
+  uint8_t msg[3];
+  uint8_t len;
+};
+
+struct reader {
+  const std::vector<uint8_t> &d;
+  size_t pos;
+  size_t end;
+  bool ok = true;
+
+  bool more() const { return pos < end; }
+  uint8_t u8() {
+    if (pos >= end) {
+      ok = false;
+      return 0U;
+    }
+    return d[pos++];
+  }
+  uint32_t be(unsigned n) {
+    uint32_t v = 0;
+    while (n-- > 0U) {
+      v = (v << 8) | u8();
+    }
+    return v;
+  }
+  // variable-length quantity: 7 bits a byte, at most 4 bytes
+  uint32_t vlq() {
+    uint32_t v = 0;
+    for (unsigned i = 0; i < 4U; i++) {
+      uint8_t b = u8();
+      v = (v << 7) | (b & 0x7FU);
+      if ((b & 0x80U) == 0U) {
+        return v;
+      }
+    }
+    ok = false;
+    return v;
+  }
+  void skip(uint32_t n) {
+    if (n > end - pos) {
+      ok = false;
+      pos = end;
+    } else {
+      pos += n;
+    }
+  }
+};
+
+bool read_track(reader &r, unsigned track, std::vector<raw_event> &ev, std::string &err) {
+  uint64_t tick = 0;
+  uint8_t running = 0;
+  unsigned seq = 0;
+  while (r.more() && r.ok) {
+    tick += r.vlq();
+    uint8_t status = r.u8();
+    uint8_t first = 0;
+    bool have_first = false;
+    if (status < 0x80U) {
+      if (running == 0U) {
+        err = "data byte with no running status";
+        return false;
+      }
+      first = status;
+      have_first = true;
+      status = running;
+    }
+    if (status == 0xFFU) {
+      uint8_t type = r.u8();
+      uint32_t len = r.vlq();
+      if (type == 0x2FU) {
+        return r.ok;   // end of track
+      }
+      if (type == 0x51U && len == 3U) {
+        raw_event e = {tick, track, seq++, r.be(3), {0, 0, 0}, 0};
+        ev.push_back(e);
+      } else {
+        r.skip(len);
+      }
+      continue;
+    }
+    if (status == 0xF0U || status == 0xF7U) {
+      running = 0U;   // SysEx cancels running status
+      r.skip(r.vlq());
+      continue;
+    }
+    if (status >= 0xF0U) {
+      err = "system message in a track";
+      return false;
+    }
+    running = status;
+    uint8_t kind = status >> 4;
+    raw_event e = {tick, track, seq++, 0U, {status, 0, 0}, 3};
+    e.msg[1] = have_first ? first : r.u8();
+    if (kind == 0xCU || kind == 0xDU) {
+      e.len = 2;
+    } else {
+      e.msg[2] = r.u8();
+    }
+    if ((e.msg[1] | e.msg[2]) & 0x80U) {
+      err = "status byte where data was expected";
+      return false;
+    }
+    ev.push_back(e);
+  }
+  if (!r.ok) {
+    err = "track runs past its chunk";
+  }
+  return r.ok;
+}
+
+} // namespace
+
+bool smf_parse(const std::vector<uint8_t> &data, std::vector<smf_event> &out, std::string &err) {
+  out.clear();
+  reader r{data, 0, data.size()};
+  if (r.be(4) != 0x4D546864U || r.be(4) != 6U || !r.ok) {   // "MThd"
+    err = "not a MIDI file (no MThd header)";
+    return false;
+  }
+  unsigned format = r.be(2), tracks = r.be(2), division = r.be(2);
+  if (format > 1U) {
+    err = "format 2 (independent sequences) is not supported";
+    return false;
+  }
+  if (division == 0U) {
+    err = "time division of 0";
+    return false;
+  }
+
+  std::vector<raw_event> ev;
+  unsigned found = 0;
+  while (found < tracks && r.pos + 8U <= data.size()) {
+    uint32_t id = r.be(4), len = r.be(4);
+    if (len > data.size() - r.pos) {
+      err = "chunk runs past the end of the file";
+      return false;
+    }
+    if (id == 0x4D54726BU) {   // "MTrk"; other chunks are skipped
+      reader t{data, r.pos, r.pos + len};
+      if (!read_track(t, found, ev, err)) {
+        return false;
+      }
+      found++;
+    }
+    r.pos += len;
+  }
+  if (found < tracks) {
+    err = "fewer tracks than the header says";
+    return false;
+  }
+
+  std::sort(ev.begin(), ev.end(), [](const raw_event &a, const raw_event &b) {
+    if (a.tick != b.tick) {
+      return a.tick < b.tick;
+    }
+    return a.track != b.track ? a.track < b.track : a.seq < b.seq;
+  });
+
+  // ticks to seconds: per quarter note through the tempo, or SMPTE frames
+  double tick_s = 0.0;
+  bool smpte = (division & 0x8000U) != 0U;
+  if (smpte) {
+    int fps = -static_cast<int8_t>(division >> 8);
+    tick_s = 1.0 / ((fps == 29 ? 29.97 : fps) * (division & 0xFFU));
+  }
+  uint32_t tempo = 500000U;
+  double t = 0.0;
+  uint64_t last = 0;
+  for (const raw_event &e : ev) {
+    double per_tick = smpte ? tick_s : tempo / 1e6 / division;
+    t += static_cast<double>(e.tick - last) * per_tick;
+    last = e.tick;
+    if (e.tempo != 0U) {
+      tempo = e.tempo;
+      continue;
+    }
+    smf_event o = {t, {e.msg[0], e.msg[1], e.msg[2]}, e.len};
+    out.push_back(o);
+  }
+  return true;
+}
+
+bool smf_load(const std::string &path, std::vector<smf_event> &out, std::string &err) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    err = "can't open " + path;
+    return false;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  return smf_parse(data, out, err);
+}
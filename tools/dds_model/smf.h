@@ -0,0 +1,25 @@
+// standard MIDI file (SMF) reader for the renderer: format 0 and 1, every
+// track's channel messages merged into one list in time order, timed in
+// seconds through the file's tempo map (set tempo in any track, as format 1
+// puts it in the first; 120 bpm until one comes). SMPTE time division is
+// read too. SysEx and the other meta events are skipped.
+
+#ifndef DDS_MODEL_SMF_H
+#define DDS_MODEL_SMF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct smf_event {
+  double t;          // seconds from the start
+  uint8_t msg[3];    // status, then data bytes (unused ones 0)
+  uint8_t len;       // 2 or 3
+};
+
+// false, and `err` says why, if `data` is not a MIDI file we can read
+bool smf_parse(const std::vector<uint8_t> &data, std::vector<smf_event> &out, std::string &err);
+
+bool smf_load(const std::string &path, std::vector<smf_event> &out, std::string &err);
+
+#endif // DDS_MODEL_SMF_H
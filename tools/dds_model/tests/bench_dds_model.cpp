@@ -0,0 +1,128 @@
+// host benchmark for the DDS model (dds_model.h): how many times faster than
+// the FPGA (~48043 samples a second) it renders.
+//
+//   bank   every voice gated, a quarter on each waveform, for 8 voices (the
+//          FPGA) up to 256: the block renderer against the clock-by-clock RTL
+//          transcription (rtl_walk.h), which is what a plain per-sample loop
+//          over the voices costs
+//   score  a generated minute of dense playing (chords and runs, sustain
+//          pedal, pitch bend) through the player (player.h) onto 8 and 64
+//          voices, as dds_render does with a MIDI file
+//
+//   make bench   (or: ./tests/bench_dds_model.bin)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "dds_model.h"
+#include "player.h"
+#include "rtl_walk.h"
+
+namespace {
+
+using clk = std::chrono::steady_clock;
+
+double since(clk::time_point t0) { return std::chrono::duration<double>(clk::now() - t0).count(); }
+
+void setup(dds_model &m, rtl_walk &r) {
+  std::mt19937 rng(7U);
+  for (unsigned v = 0; v < m.voices(); v++) {
+    uint32_t f = 2000000U + rng() % 200000000U;
+    uint16_t c = dds_voice_ctrl_word(true, v % 4U, static_cast<uint8_t>(64U + rng() % 192U));
+    m.voice_freq(v, f);
+    m.voice_ctrl(v, c);
+    r.freq[v] = f;
+    r.ctrl(v, c);
+  }
+}
+
+void bank(unsigned voices) {
+  dds_model m(voices);
+  rtl_walk r(voices);
+  setup(m, r);
+  const size_t n = (48043U * 20U * 8U) / voices;   // the same voice-samples each
+  std::vector<int16_t> s(n);
+  std::vector<uint16_t> dac(n);
+
+  auto t0 = clk::now();
+  m.render(s.data(), dac.data(), n);
+  double block = since(t0);
+
+  t0 = clk::now();
+  unsigned long differ = 0;
+  for (size_t k = 0; k < n; k++) {
+    differ += (r.tick() != s[k]) ? 1U : 0U;
+  }
+  double walk = since(t0);
+
+  double sec = static_cast<double>(n) / DDS_FS_HZ;
+  printf("  %3u voices  %7.0fx real time  (%5.2f ns/voice-sample)   rtl walk %5.0fx   differ %lu\n",
+         voices, sec / block, block * 1e9 / (static_cast<double>(n) * voices), sec / walk, differ);
+}
+
+// a minute of playing: a chord every half second with a run over it, the
+// pedal down for every other bar, a bend now and then
+std::vector<smf_event> generated_score() {
+  std::mt19937 rng(3U);
+  std::vector<smf_event> ev;
+  auto put = [&](double t, uint8_t s, uint8_t a, uint8_t b) {
+    smf_event e = {t, {s, a, b}, 3};
+    ev.push_back(e);
+  };
+  for (unsigned beat = 0; beat < 120U; beat++) {
+    double t = beat * 0.5;
+    uint8_t root = static_cast<uint8_t>(36U + rng() % 24U);
+    for (uint8_t iv : {0, 4, 7, 12, 16, 19}) {
+      put(t, 0x90, root + iv, static_cast<uint8_t>(60U + rng() % 60U));
+      put(t + 0.45, 0x80, root + iv, 0);
+    }
+    for (unsigned k = 0; k < 8U; k++) {
+      uint8_t n = static_cast<uint8_t>(60U + rng() % 36U);
+      put(t + k * 0.0625, 0x90, n, 100);
+      put(t + k * 0.0625 + 0.2, 0x80, n, 0);
+    }
+    if (beat % 4U == 0U) {
+      put(t, 0xB0, MIDI_CC_SUSTAIN, (beat / 4U) % 2U ? 0U : 127U);
+    }
+    if (beat % 7U == 0U) {
+      for (unsigned k = 0; k < 20U; k++) {
+        unsigned b = 8192U + k * 400U;
+        put(t + k * 0.005, 0xE0, b & 0x7FU, static_cast<uint8_t>(b >> 7));
+      }
+      put(t + 0.2, 0xE0, 0, 0x40);
+    }
+  }
+  std::stable_sort(ev.begin(), ev.end(),
+                   [](const smf_event &a, const smf_event &b) { return a.t < b.t; });
+  return ev;
+}
+
+void score(const std::vector<smf_event> &ev, unsigned voices) {
+  dds_model m(voices);
+  dds_player p(m, DDS_SAW);
+  std::vector<int16_t> s;
+  std::vector<uint16_t> dac;
+  auto t0 = clk::now();
+  dds_render_score(p, ev, 1.0, s, &dac);
+  double dt = since(t0);
+  double sec = static_cast<double>(s.size()) / p.rate;
+  printf("  %3u voices  %7.0fx real time  %lu notes, %u stolen\n", voices, sec / dt, p.notes,
+         p.va.steals);
+}
+
+} // namespace
+
+int main() {
+  printf("bank, all voices gated:\n");
+  for (unsigned voices : {8U, 16U, 64U, 128U, 256U}) {
+    bank(voices);
+  }
+  std::vector<smf_event> ev = generated_score();
+  printf("score, %zu events over %.0f s:\n", ev.size(), ev.back().t);
+  score(ev, 8U);
+  score(ev, 64U);
+  return 0;
+}
@@ -0,0 +1,80 @@
+// dds_synth.v transcribed clock by clock, for the host tests and benches to
+// hold the block renderer (dds_model.h) against: one voice per clock, the
+// register widths of the RTL (mix 21 bits, mix_sum 22, slices where it slices)
+// and nothing shared with the model but the sine ROM. slow by design.
+//
+// `voices` other than 8 is the parametric RTL with its mix widened and the
+// shift grown to match, as the model does for a bigger bank.
+
+#ifndef DDS_MODEL_TESTS_RTL_WALK_H
+#define DDS_MODEL_TESTS_RTL_WALK_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dds_model.h"
+
+struct rtl_walk {
+  std::vector<uint32_t> phase, freq;
+  std::vector<uint8_t> gate, wave, level;
+  unsigned mix_bits = 21, shift = 3;
+
+  explicit rtl_walk(unsigned voices = DDS_RTL_VOICES)
+      : phase(voices), freq(voices), gate(voices), wave(voices), level(voices) {
+    while (voices > (1U << shift)) {
+      shift++;
+      mix_bits++;
+    }
+  }
+
+  // the low `bits` of v, sign-extended: a Verilog `reg signed [bits-1:0]`
+  static int64_t sext(int64_t v, unsigned bits) {
+    uint64_t m = (1ULL << bits) - 1U;
+    uint64_t u = static_cast<uint64_t>(v) & m;
+    return (u & (1ULL << (bits - 1U))) ? static_cast<int64_t>(u | ~m) : static_cast<int64_t>(u);
+  }
+  static uint32_t bits(uint32_t v, unsigned hi, unsigned lo) {
+    return (v >> lo) & ((hi - lo == 31U) ? 0xFFFFFFFFU : ((1U << (hi - lo + 1U)) - 1U));
+  }
+
+  void ctrl(unsigned v, uint16_t c) {
+    gate[v] = c & 1U;
+    wave[v] = (c >> 1) & 7U;
+    level[v] = static_cast<uint8_t>(c >> 8);
+  }
+
+  // one tick: the ST_RUN walk, vcnt 0..NVOICES-1
+  int16_t tick() {
+    int64_t mix = 0;
+    int16_t sample_o = 0;
+    unsigned n = static_cast<unsigned>(phase.size());
+    for (unsigned vcnt = 0; vcnt < n; vcnt++) {
+      uint32_t phase_next = phase[vcnt] + freq[vcnt];
+      uint32_t phase_top = bits(phase_next, 31, 24);
+      uint32_t sine_u = dds_sine_lut[phase_top];
+      uint32_t saw_u = bits(phase_next, 31, 16);
+      uint32_t tri_ramp = bits(phase_next, 31, 31) ? (~bits(phase_next, 30, 15) & 0xFFFFU)
+                                                   : bits(phase_next, 30, 15);
+      int64_t wave_s = 0;
+      switch (wave[vcnt] & 3U) {
+      case 0: wave_s = sext(((sine_u ^ 0x800U) << 4), 16); break;
+      case 1: wave_s = sext(saw_u ^ 0x8000U, 16); break;
+      case 2: wave_s = bits(phase_next, 31, 31) ? 0x7FFF : -0x8000; break;
+      case 3: wave_s = sext(tri_ramp ^ 0x8000U, 16); break;
+      }
+      int64_t prod = sext(wave_s * level[vcnt], 16 + 9);   // [SAMPLE_W+8:0]
+      int64_t scaled = gate[vcnt] ? sext(prod >> 8, 16) : 0;   // prod[23:8]
+      int64_t mix_sum = sext(mix + scaled, mix_bits + 1U);
+      int16_t mix_out = static_cast<int16_t>(sext(mix_sum >> shift, 16));
+      phase[vcnt] = phase_next;
+      if (vcnt == n - 1U) {
+        sample_o = mix_out;
+      } else {
+        mix = sext(mix + scaled, mix_bits);
+      }
+    }
+    return sample_o;
+  }
+};
+
+#endif // DDS_MODEL_TESTS_RTL_WALK_H
@@ -0,0 +1,210 @@
+// host test for the DDS model (dds_model.h): the sine ROM as cut out of the
+// RTL, each waveform and the DAC code at hand-worked points, gate and level,
+// the audio block register writes, and the block renderer sample for sample
+// against the clock-by-clock transcription of dds_synth.v (rtl_walk.h) over
+// random voice settings changed between renders of every length - for the
+// FPGA's 8 voices and for a 64-voice bank.
+//
+//   make test   (or: ./tests/test_dds_model.bin)
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cheby/audio_regs.h"
+#include "dds_model.h"
+#include "rtl_walk.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+int16_t one(dds_model &m, uint16_t *dac = nullptr) {
+  int16_t s;
+  m.render(&s, dac, 1);
+  return s;
+}
+
+void sine_rom() {
+  // one period, centred on 2048: a bad cut of sine_lut.v shows up here
+  CHECK(dds_sine_lut[0] == 2048U && dds_sine_lut[64] == 4095U && dds_sine_lut[128] == 2048U &&
+        dds_sine_lut[192] == 1U && dds_sine_lut[1] == 2098U && dds_sine_lut[255] == 1998U);
+  bool odd = true;
+  for (unsigned i = 0; i < 128U; i++) {
+    odd = odd && (dds_sine_lut[i] + dds_sine_lut[i + 128U] == 4096U);
+  }
+  CHECK(odd);
+}
+
+void waves() {
+  CHECK(dds_wave_sample(DDS_SINE, 64U << 24) == 32752);    // (4095 ^ 0x800) << 4
+  CHECK(dds_wave_sample(DDS_SINE, 192U << 24) == -32752);  // (1 ^ 0x800) << 4, as signed
+  CHECK(dds_wave_sample(DDS_SINE, 0x00FFFFFFU) == 0);       // still entry 0
+  CHECK(dds_wave_sample(DDS_SAW, 0U) == -32768 && dds_wave_sample(DDS_SAW, 0xFFFFFFFFU) == 32767);
+  CHECK(dds_wave_sample(DDS_SAW, 0x80000000U) == 0 && dds_wave_sample(DDS_SAW, 0x0100FFFFU) == -32512);
+  CHECK(dds_wave_sample(DDS_SQUARE, 0x7FFFFFFFU) == -32768);
+  CHECK(dds_wave_sample(DDS_SQUARE, 0x80000000U) == 32767);
+  CHECK(dds_wave_sample(DDS_TRIANGLE, 0U) == -32768);
+  CHECK(dds_wave_sample(DDS_TRIANGLE, 0x40000000U) == 0);
+  CHECK(dds_wave_sample(DDS_TRIANGLE, 0x7FFF8000U) == 32767);
+  CHECK(dds_wave_sample(DDS_TRIANGLE, 0x80000000U) == 32767);
+  CHECK(dds_wave_sample(DDS_TRIANGLE, 0xFFFF8000U) == -32768);
+  // wave is 3 bits in ctrl; the RTL decodes only the low two
+  CHECK(dds_wave_sample(4U + DDS_SAW, 0x12345678U) == dds_wave_sample(DDS_SAW, 0x12345678U));
+}
+
+void dac() {
+  CHECK(dds_dac_code(0) == 2048U);
+  CHECK(dds_dac_code(-4049) == 1541U);    // -4049 >> 3 = -507
+  CHECK(dds_dac_code(8) == 2049U && dds_dac_code(-1) == 2047U);
+  CHECK(dds_dac_code(16376) == 4095U && dds_dac_code(16383) == 4095U);
+  CHECK(dds_dac_code(16384) == 4095U && dds_dac_code(32767) == 4095U);   // clamped
+  CHECK(dds_dac_code(-16384) == 0U && dds_dac_code(-32768) == 0U);       // clamped
+}
+
+void voice() {
+  dds_model m;
+  uint16_t d;
+  CHECK(one(m, &d) == 0 && d == 2048U);   // nothing gated
+
+  // a full-level saw one step in: (-32512 * 255) >> 8 = -32385, mix >> 3 = -4049
+  m.voice_freq(0, 0x01000000U);
+  m.voice_ctrl(0, dds_voice_ctrl_word(true, DDS_SAW, 255));
+  CHECK(one(m, &d) == -4049 && d == 1541U && m.phase[0] == 0x01000000U);
+
+  // all 8 on a full square: both DAC rails
+  for (unsigned v = 0; v < 8U; v++) {
+    m.phase[v] = 0x40000000U;
+    m.voice_freq(v, 0U);
+    m.voice_ctrl(v, dds_voice_ctrl_word(true, DDS_SQUARE, 255));
+  }
+  CHECK(one(m, &d) == -32640 && d == 0U);   // 8 * ((-32768 * 255) >> 8) >> 3
+  for (unsigned v = 0; v < 8U; v++) {
+    m.phase[v] = 0xC0000000U;
+  }
+  CHECK(one(m, &d) == 32639 && d == 4095U);
+
+  // gate off mutes but the phase runs on; level 0 mutes too
+  dds_model a, b;
+  for (dds_model *x : {&a, &b}) {
+    x->voice_freq(3, 0x00731234U);
+    x->voice_ctrl(3, dds_voice_ctrl_word(true, DDS_TRIANGLE, 200));
+  }
+  std::vector<int16_t> sa(1000), sb(1000);
+  a.render(sa.data(), nullptr, 1000);
+  b.voice_ctrl(3, dds_voice_ctrl_word(false, DDS_TRIANGLE, 200));
+  b.render(sb.data(), nullptr, 400);
+  bool silent = true;
+  for (unsigned i = 0; i < 400U; i++) {
+    silent = silent && sb[i] == 0;
+  }
+  CHECK(silent && b.phase[3] == a.phase[3] - 600U * 0x00731234U);
+  b.voice_ctrl(3, dds_voice_ctrl_word(true, DDS_TRIANGLE, 0));
+  CHECK(one(b) == 0);
+  b.voice_ctrl(3, dds_voice_ctrl_word(true, DDS_TRIANGLE, 200));
+  b.render(&sb[401], nullptr, 599);
+  bool same = true;
+  for (unsigned i = 401; i < 1000U; i++) {
+    same = same && sa[i] == sb[i];
+  }
+  CHECK(same);
+}
+
+void registers() {
+  dds_model m;
+  uint32_t v2 = AUDIO_VOICE + 2U * AUDIO_VOICE_SIZE;
+  m.write(v2 + AUDIO_VOICE_FREQ, 0x1234U);        // freq[31:16]
+  m.write(v2 + AUDIO_VOICE_FREQ + 2U, 0xABCDU);   // freq[15:0]
+  m.write(v2 + AUDIO_VOICE_CTRL, 0xC8F5U);        // level 200, bits 7:4 not kept, wave 2, gate
+  CHECK(m.freq[2] == 0x1234ABCDU && m.ctrl[2] == 0xC805U && m.gain[2] == 200);
+  m.write(v2 + AUDIO_VOICE_FREQ, 0x0001U);
+  CHECK(m.freq[2] == 0x0001ABCDU);
+  // not the DDS's: audio ctrl, status, sample, dac, a voice's spare word, off the end
+  m.write(AUDIO_CTRL, 0xFFFFU);
+  m.write(AUDIO_SAMPLE, 0xFFFFU);
+  m.write(v2 + 6U, 0xFFFFU);
+  m.write(AUDIO_SIZE, 0xFFFFU);
+  CHECK(m.freq[2] == 0x0001ABCDU && m.ctrl[2] == 0xC805U && m.freq[0] == 0U && m.ctrl[0] == 0U);
+  m.reset();
+  CHECK(m.freq[2] == 0U && m.gain[2] == 0 && m.phase[2] == 0U && m.samples == 0U);
+}
+
+// the block renderer against the clock-by-clock RTL, sample for sample
+void against_rtl(unsigned voices, unsigned rounds) {
+  std::mt19937 rng(voices);
+  dds_model m(voices);
+  rtl_walk r(voices);
+  CHECK(m.shift == r.shift);
+  unsigned long compared = 0, differ = 0, loud = 0;
+  for (unsigned round = 0; round < rounds; round++) {
+    unsigned changes = 1U + rng() % voices;
+    for (unsigned c = 0; c < changes; c++) {
+      unsigned v = rng() % voices;
+      // tuning words from sub-audio to near Nyquist, and a few that alias
+      uint32_t f = (rng() % 8U == 0U) ? rng() : (rng() >> (rng() % 16U));
+      uint16_t ctrl = static_cast<uint16_t>(rng());
+      if (rng() % 4U == 0U) {
+        ctrl |= 0xFF01U;   // gated full level: the mix near its limits
+      }
+      m.voice_freq(v, f);
+      m.voice_ctrl(v, ctrl);
+      r.freq[v] = f;
+      r.ctrl(v, ctrl);
+      if (rng() % 16U == 0U) {
+        m.phase[v] = r.phase[v] = rng();
+      }
+    }
+    if (round % 10U == 9U) {
+      // every voice on one full-level square in step: the mix at its limits
+      uint32_t f = rng() >> 12, ph = rng();
+      for (unsigned v = 0; v < voices; v++) {
+        m.voice_freq(v, f);
+        m.voice_ctrl(v, dds_voice_ctrl_word(true, DDS_SQUARE, 255));
+        r.freq[v] = f;
+        r.ctrl(v, dds_voice_ctrl_word(true, DDS_SQUARE, 255));
+        m.phase[v] = r.phase[v] = ph;
+      }
+    }
+    // lengths that end inside a block, on one, and past several
+    size_t n = (rng() % 3U == 0U) ? DDS_BLOCK * (1U + rng() % 3U) : 1U + rng() % 700U;
+    std::vector<int16_t> s(n);
+    std::vector<uint16_t> d(n);
+    m.render(s.data(), d.data(), n);
+    for (size_t k = 0; k < n; k++) {
+      int16_t want = r.tick();
+      differ += (s[k] != want || d[k] != dds_dac_code(want)) ? 1U : 0U;
+      loud += (want == 32639 || want == -32640) ? 1U : 0U;
+    }
+    compared += n;
+  }
+  CHECK(differ == 0U);
+  CHECK(loud > 0U);   // the mix did reach both ends
+  bool phases = true;
+  for (unsigned v = 0; v < voices; v++) {
+    phases = phases && m.phase[v] == r.phase[v];
+  }
+  CHECK(phases);
+  printf("  %u voices: %lu samples, %lu differ\n", voices, compared, differ);
+}
+
+} // namespace
+
+int main() {
+  sine_rom();
+  waves();
+  dac();
+  voice();
+  registers();
+  against_rtl(DDS_RTL_VOICES, 400);
+  against_rtl(64, 60);
+  printf("test_dds_model: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// host test for the score path of the renderer: the MIDI file reader (smf.h)
+// on a two-track file with a tempo change, running status, note-on at
+// velocity 0, SysEx and meta events to skip, SMPTE timing, and files it must
+// refuse; the player (player.h) on notes, stealing, the sustain pedal and
+// pitch bend; a whole score to samples; and the .wav header (wav.h).
+//
+//   make test   (or: ./tests/test_render.bin)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "dds_model.h"
+#include "player.h"
+#include "smf.h"
+#include "wav.h"
+
+namespace {
+
+int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+void be(std::vector<uint8_t> &b, uint32_t v, unsigned n) {
+  while (n-- > 0U) {
+    b.push_back(static_cast<uint8_t>(v >> (8U * n)));
+  }
+}
+
+std::vector<uint8_t> smf(unsigned format, unsigned division,
+                         const std::vector<std::vector<uint8_t>> &tracks) {
+  std::vector<uint8_t> f = {'M', 'T', 'h', 'd'};
+  be(f, 6U, 4);
+  be(f, format, 2);
+  be(f, static_cast<uint32_t>(tracks.size()), 2);
+  be(f, division, 2);
+  for (const std::vector<uint8_t> &t : tracks) {
+    f.insert(f.end(), {'M', 'T', 'r', 'k'});
+    be(f, static_cast<uint32_t>(t.size()), 4);
+    f.insert(f.end(), t.begin(), t.end());
+  }
+  return f;
+}
+
+// 480 ticks a quarter note; the tempo doubles after the first
+const std::vector<uint8_t> conductor = {
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,          // 500000 us / qn
+    0x83, 0x60, 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90,    // +480: 250000
+    0x00, 0xFF, 0x2F, 0x00};
+const std::vector<uint8_t> melody = {
+    0x00, 0x90, 0x3C, 0x64,                    // note on C4
+    0x81, 0x70, 0x40, 0x64,                    // +240, running status: E4
+    0x81, 0x70, 0x3C, 0x00,                    // +240: C4 at velocity 0
+    0x00, 0xF0, 0x03, 0x43, 0x10, 0xF7,        // SysEx, skipped
+    0x00, 0xFF, 0x01, 0x03, 'a', 'b', 'c',     // text, skipped
+    0x83, 0x60, 0xC0, 0x05,                    // +480: program 5
+    0x00, 0x06,                                // running status: program 6
+    0x00, 0xFF, 0x2F, 0x00};
+
+bool near(double a, double b) { return std::fabs(a - b) < 1e-9; }
+
+void smf_read() {
+  std::vector<smf_event> ev;
+  std::string err;
+  CHECK(smf_parse(smf(1, 480, {conductor, melody}), ev, err));
+  CHECK(ev.size() == 5U);
+  if (ev.size() == 5U) {
+    CHECK(near(ev[0].t, 0.0) && ev[0].msg[0] == 0x90U && ev[0].msg[1] == 0x3CU && ev[0].len == 3U);
+    CHECK(near(ev[1].t, 0.25) && ev[1].msg[0] == 0x90U && ev[1].msg[1] == 0x40U);
+    CHECK(near(ev[2].t, 0.5) && ev[2].msg[1] == 0x3CU && ev[2].msg[2] == 0U);
+    CHECK(near(ev[3].t, 0.75) && ev[3].msg[0] == 0xC0U && ev[3].msg[1] == 5U && ev[3].len == 2U);
+    CHECK(near(ev[4].t, 0.75) && ev[4].msg[0] == 0xC0U && ev[4].msg[1] == 6U);
+  }
+
+  // format 0, SMPTE: 25 fps * 40 ticks = 1 ms a tick
+  const std::vector<uint8_t> t0 = {0x83, 0x74, 0x91, 0x45, 0x7F, 0x00, 0xFF, 0x2F, 0x00};
+  CHECK(smf_parse(smf(0, 0xE728U, {t0}), ev, err) && ev.size() == 1U && near(ev[0].t, 0.5));
+
+  // and what it must refuse
+  std::vector<uint8_t> cut = smf(1, 480, {conductor, melody});
+  cut.resize(cut.size() - 10U);
+  CHECK(!smf_parse(cut, ev, err));
+  CHECK(!smf_parse({'R', 'I', 'F', 'F', 0, 0, 0, 6}, ev, err));
+  CHECK(!smf_parse(smf(2, 480, {melody}), ev, err));
+  CHECK(!smf_parse(smf(0, 480, {{0x00, 0x3C, 0x64, 0x00, 0xFF, 0x2F, 0x00}}), ev, err));
+  const std::vector<uint8_t> no_end = {0x00, 0x90, 0x3C};   // note on cut short
+  CHECK(!smf_parse(smf(0, 480, {no_end}), ev, err));
+}
+
+void msg(dds_player &p, uint8_t s, uint8_t a, uint8_t b = 0) {
+  const uint8_t m[3] = {s, a, b};
+  p.play(m, (s >> 4) == 0xCU || (s >> 4) == 0xDU ? 2U : 3U);
+}
+
+void player() {
+  dds_model m;
+  dds_player p(m, DDS_SAW);
+  CHECK(p.note_inc[69] == 39370534U);   // 440 Hz at 48 kHz
+  msg(p, 0x90, 69, 100);
+  CHECK(m.freq[0] == p.note_inc[69] && m.gain[0] == 200 && m.ctrl[0] == 0xC803U);
+  msg(p, 0x80, 69, 0);
+  CHECK(m.gain[0] == 0 && m.freq[0] == p.note_inc[69]);
+
+  // 9 notes on 8 voices: a released voice is taken before a held one
+  dds_model m2;
+  dds_player p2(m2, DDS_SAW);
+  for (uint8_t n = 60; n < 68U; n++) {
+    msg(p2, 0x90, n, 64);
+  }
+  CHECK(p2.va.steals == 0U);
+  uint8_t v60 = p2.va.note_voice[60];
+  msg(p2, 0x90, 60, 0);      // note-on at velocity 0: off
+  CHECK(m2.gain[v60] == 0);
+  msg(p2, 0x90, 80, 64);
+  CHECK(p2.va.steals == 1U && p2.va.note_voice[80] == v60 && m2.freq[v60] == p2.note_inc[80]);
+  msg(p2, 0x90, 81, 64);     // none released: the oldest held, 61
+  CHECK(p2.va.steals == 2U && p2.va.note_voice[61] == SYNTH_NO_VOICE);
+  CHECK(m2.freq[p2.va.note_voice[81]] == p2.note_inc[81]);
+
+  // sustain: a note let go with the pedal down sounds until it comes up
+  uint8_t v = p2.va.note_voice[62];
+  msg(p2, 0xB0, MIDI_CC_SUSTAIN, 127);
+  msg(p2, 0x80, 62, 0);
+  CHECK(m2.gain[v] == 128);
+  msg(p2, 0xB0, MIDI_CC_SUSTAIN, 0);
+  CHECK(m2.gain[v] == 0);
+
+  // bend all the way up: +2 semitones on every sounding voice
+  msg(p2, 0xE0, 0x7F, 0x7F);
+  uint8_t v80 = p2.va.note_voice[80];
+  CHECK(m2.freq[v80] == static_cast<uint32_t>(p2.note_inc[80] * std::pow(2.0, 8191.0 / 49152.0)));
+  CHECK(p.notes == 1U && p2.notes == 10U);
+
+  // a bigger bank: the allocator manages up to SYNTH_VA_MAX of it
+  dds_model big(128);
+  dds_player q(big);
+  CHECK(q.va.voices == SYNTH_VA_MAX);
+}
+
+void score() {
+  std::vector<smf_event> ev;
+  std::string err;
+  CHECK(smf_parse(smf(1, 480, {conductor, melody}), ev, err));
+
+  dds_model m;
+  dds_player p(m, DDS_TRIANGLE);
+  std::vector<int16_t> s;
+  std::vector<uint16_t> dac;
+  dds_render_score(p, ev, 0.1, s, &dac);
+  CHECK(s.size() == 40800U && dac.size() == s.size());   // (0.75 + 0.1) * 48000
+
+  // the same by hand: each note at its sample
+  dds_model r;
+  std::vector<int16_t> w(40800);
+  uint32_t c4 = p.note_inc[60], e4 = p.note_inc[64];
+  r.voice_freq(0, c4);
+  r.voice_ctrl(0, dds_voice_ctrl_word(true, DDS_TRIANGLE, 200));
+  r.render(&w[0], nullptr, 12000);
+  r.voice_freq(1, e4);
+  r.voice_ctrl(1, dds_voice_ctrl_word(true, DDS_TRIANGLE, 200));
+  r.render(&w[12000], nullptr, 12000);
+  r.voice_ctrl(0, dds_voice_ctrl_word(false, DDS_TRIANGLE, 0));
+  r.render(&w[24000], nullptr, 16800);
+  CHECK(s == w);
+  bool codes = true;
+  for (size_t i = 0; i < s.size(); i++) {
+    codes = codes && dac[i] == dds_dac_code(s[i]);
+  }
+  CHECK(codes);
+}
+
+void wav() {
+  const int16_t s[3] = {0, -1, 0x1234};
+  std::vector<uint8_t> b = wav_bytes(s, 3, 48000);
+  const uint8_t head[44] = {'R', 'I', 'F', 'F', 42,  0,   0,   0,   'W', 'A', 'V', 'E', 'f', 'm', 't',
+                            ' ', 16,  0,   0,   0,   1,   0,   1,   0,   0x80, 0xBB, 0, 0, 0x00, 0x77,
+                            1,   0,   2,   0,   16,  0,   'd', 'a', 't', 'a', 6,   0,   0,   0};
+  CHECK(b.size() == 50U && std::equal(head, head + 44, b.begin()));
+  CHECK(b[44] == 0U && b[46] == 0xFFU && b[47] == 0xFFU && b[48] == 0x34U && b[49] == 0x12U);
+}
+
+} // namespace
+
+int main() {
+  smf_read();
+  player();
+  score();
+  wav();
+  printf("test_render: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+// see wav.h
+
+#include "wav.h"
+
+#include <fstream>
+
+namespace {
+
+void le(std::vector<uint8_t> &b, uint32_t v, unsigned n) {
+  for (unsigned i = 0; i < n; i++) {
+    b.push_back(static_cast<uint8_t>(v >> (8U * i)));
+  }
+}
+
+void tag(std::vector<uint8_t> &b, const char *t) {
+  for (unsigned i = 0; i < 4U; i++) {
+    b.push_back(static_cast<uint8_t>(t[i]));
+  }
+}
+
+} // namespace
+
+std::vector<uint8_t> wav_bytes(const int16_t *s, size_t n, unsigned rate) {
+  uint32_t data = static_cast<uint32_t>(n * 2U);
+  std::vector<uint8_t> b;
+  b.reserve(44U + data);
+  tag(b, "RIFF");
+  le(b, 36U + data, 4);
+  tag(b, "WAVE");
+  tag(b, "fmt ");
+  le(b, 16U, 4);
+  le(b, 1U, 2);          // PCM
+  le(b, 1U, 2);          // mono
+  le(b, rate, 4);
+  le(b, rate * 2U, 4);   // bytes per second
+  le(b, 2U, 2);          // block align
+  le(b, 16U, 2);         // bits per sample
+  tag(b, "data");
+  le(b, data, 4);
+  for (size_t i = 0; i < n; i++) {
+    le(b, static_cast<uint16_t>(s[i]), 2);
+  }
+  return b;
+}
+
+bool wav_write(const std::string &path, const int16_t *s, size_t n, unsigned rate) {
+  std::vector<uint8_t> b = wav_bytes(s, n, rate);
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char *>(b.data()), static_cast<std::streamsize>(b.size()));
+  return static_cast<bool>(f);
+}
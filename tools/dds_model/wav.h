@@ -0,0 +1,16 @@
+// 16-bit mono PCM .wav writer
+
+#ifndef DDS_MODEL_WAV_H
+#define DDS_MODEL_WAV_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the RIFF/WAVE bytes for `n` samples at `rate`
+std::vector<uint8_t> wav_bytes(const int16_t *s, size_t n, unsigned rate);
+
+bool wav_write(const std::string &path, const int16_t *s, size_t n, unsigned rate);
+
+#endif // DDS_MODEL_WAV_H
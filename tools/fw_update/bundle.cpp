@@ -0,0 +1,157 @@
+// see bundle.h
+
+#include "bundle.h"
+
+#include <cstring>
+
+#include "bootloader/crc32.h"
+#include "bootloader/delta.h"
+#include "bootloader/image.h"
+#include "bootloader/lz.h"
+
+namespace {
+
+bool fail(std::string *why, const std::string &s) {
+  if (why != nullptr) {
+    *why = s;
+  }
+  return false;
+}
+
+// the header ahead of the wire bytes: copied out, and the rest of the file
+template <typename H> bool split(const std::vector<uint8_t> &file, H &h, update_part &out) {
+  if (file.size() < sizeof(h)) {
+    return false;
+  }
+  memcpy(&h, file.data(), sizeof(h));
+  out.data.assign(file.begin() + sizeof(h), file.end());
+  return true;
+}
+
+} // namespace
+
+bool load_part(const std::vector<uint8_t> &file, update_part &out, std::string *why) {
+  out = update_part{};
+  uint32_t magic = 0;
+  if (file.size() >= sizeof(magic)) {
+    memcpy(&magic, file.data(), sizeof(magic));
+  }
+  bl_manifest &m = out.m;
+  m.magic = BL_MANIFEST_MAGIC;
+  if (magic == BL_DELTA_MAGIC) {
+    // only the op stream goes on the wire, the header becomes the manifest's
+    // base/image fields
+    bl_delta_header dh;
+    if (!split(file, dh, out)) {
+      return fail(why, "truncated patch");
+    }
+    m.target = dh.target;
+    m.flags = BL_MANIFEST_F_DELTA;
+    m.version = dh.version;
+    m.base_crc32 = dh.base_crc32;
+    m.image_length = dh.image_length;
+    m.image_crc32 = dh.image_crc32;
+  } else if (magic == BL_LZ_MAGIC) {
+    bl_lz_header zh;
+    if (!split(file, zh, out)) {
+      return fail(why, "truncated compressed image");
+    }
+    m.target = zh.target;
+    m.flags = BL_MANIFEST_F_LZ;
+    m.version = zh.version;
+    m.image_length = zh.image_length;
+    m.image_crc32 = zh.image_crc32;
+  } else {
+    bl_image_header h;
+    if (file.size() < sizeof(h)) {
+      return fail(why, "too small to be an image blob");
+    }
+    memcpy(&h, file.data(), sizeof(h));
+    if (h.magic != BL_IMAGE_MAGIC) {
+      return fail(why, "bad magic - run mkupdate first");
+    }
+    out.data = file;
+    m.target = h.target;
+    m.flags = 0;
+    m.version = h.version;
+  }
+  m.length = static_cast<uint32_t>(out.data.size());
+  m.crc32 = bl_crc32(out.data.data(), out.data.size());
+  return true;
+}
+
+bool in_place(uint16_t target) { return target != BL_TARGET_APM_H755; }
+
+bool build_bundle(const std::vector<std::vector<uint8_t>> &files, std::vector<uint8_t> &out,
+                  std::string *why) {
+  out.clear();
+  if (files.size() < 2U || files.size() > BL_BUNDLE_MAX) {
+    return fail(why, "a bundle takes 2.." + std::to_string(BL_BUNDLE_MAX) + " parts");
+  }
+  std::vector<bundle_entry> index(files.size());
+  uint32_t at = static_cast<uint32_t>(sizeof(bundle_header) + index.size() * sizeof(bundle_entry));
+  for (size_t i = 0; i < files.size(); i++) {
+    update_part p;
+    std::string e;
+    if (!load_part(files[i], p, &e)) {
+      return fail(why, "part " + std::to_string(i) + ": " + e);
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (index[j].target == p.m.target) {
+        return fail(why, "two parts for target " + std::to_string(p.m.target));
+      }
+    }
+    index[i].target = p.m.target;
+    index[i].reserved = 0;
+    index[i].offset = at;
+    index[i].length = static_cast<uint32_t>(files[i].size());
+    index[i].crc32 = bl_crc32(files[i].data(), files[i].size());
+    at += index[i].length;
+  }
+
+  bundle_header h{};
+  h.magic = BUNDLE_MAGIC;
+  h.parts = static_cast<uint16_t>(files.size());
+  h.flags = 0;
+  h.index_crc32 = bl_crc32(index.data(), index.size() * sizeof(bundle_entry));
+  out.resize(sizeof(h));
+  memcpy(out.data(), &h, sizeof(h));
+  const uint8_t *ix = reinterpret_cast<const uint8_t *>(index.data());
+  out.insert(out.end(), ix, ix + index.size() * sizeof(bundle_entry));
+  for (const std::vector<uint8_t> &f : files) {
+    out.insert(out.end(), f.begin(), f.end());
+  }
+  return true;
+}
+
+bool parse_bundle(const uint8_t *p, size_t n, std::vector<std::vector<uint8_t>> &files,
+                  std::string *why) {
+  files.clear();
+  bundle_header h;
+  if (n < sizeof(h)) {
+    return fail(why, "too small to be a bundle");
+  }
+  memcpy(&h, p, sizeof(h));
+  if (h.magic != BUNDLE_MAGIC) {
+    return fail(why, "not a bundle");
+  }
+  if (h.parts < 2U || h.parts > BL_BUNDLE_MAX ||
+      n < sizeof(h) + static_cast<size_t>(h.parts) * sizeof(bundle_entry)) {
+    return fail(why, "bad bundle index");
+  }
+  std::vector<bundle_entry> index(h.parts);
+  memcpy(index.data(), p + sizeof(h), index.size() * sizeof(bundle_entry));
+  if (bl_crc32(index.data(), index.size() * sizeof(bundle_entry)) != h.index_crc32) {
+    return fail(why, "bundle index fails its crc");
+  }
+  for (const bundle_entry &e : index) {
+    if (e.offset > n || e.length > n - e.offset) {
+      return fail(why, "bundle cut short");
+    }
+    if (bl_crc32(p + e.offset, e.length) != e.crc32) {
+      return fail(why, "a part of the bundle fails its crc");
+    }
+    files.emplace_back(p + e.offset, p + e.offset + e.length);
+  }
+  return true;
+}
@@ -0,0 +1,73 @@
+// update files on the host: what mkupdate writes turned into what goes on the
+// wire, and bundles - several of those files, for different components (the
+// app, an FPGA bitstream), in one file that update.bin sends in one session
+// (BL_BUNDLE, bootloader/session.h). used by mkupdate, update.bin and the host
+// tests.
+//
+// a bundle file (.smbn) - the board never sees it, only the parts it carries:
+//
+//   bundle_header { 'SMBN', parts, flags, index crc32 }
+//   bundle_entry  { target, reserved, offset, length, crc32 } x parts
+//   the parts' files, back to back, in index order
+//
+// the index crc is over the entries, each entry's crc over its part's file.
+// parts go in the order they will be sent: mkupdate puts the A/B ones first
+// (the app, whose slot is not in use), the ones written in place last, so that
+// a failure before the end of the bundle leaves the board as it was where it
+// can.
+
+#ifndef FW_UPDATE_BUNDLE_H
+#define FW_UPDATE_BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bootloader/protocol.h"
+
+#define BUNDLE_MAGIC 0x4E424D53U // 'SMBN'
+
+#pragma pack(push, 1)
+struct bundle_header {
+  uint32_t magic;       // BUNDLE_MAGIC
+  uint16_t parts;       // 2..BL_BUNDLE_MAX
+  uint16_t flags;       // 0
+  uint32_t index_crc32; // over the bundle_entry array
+};
+
+struct bundle_entry {
+  uint16_t target;      // enum bl_target, as the part's own header says
+  uint16_t reserved;    // 0
+  uint32_t offset;      // of the part's file, from the start of the bundle
+  uint32_t length;
+  uint32_t crc32;       // over the part's file
+};
+#pragma pack(pop)
+
+// one image as it goes on the wire: the manifest (windowed/resume flags are
+// send_image's), and the DATA bytes
+struct update_part {
+  bl_manifest m{};
+  std::vector<uint8_t> data;
+};
+
+// a file mkupdate wrote - an image blob (.smup), a patch (.smdl) or a
+// compressed blob (.smlz) - as the part it sends. false if it is none of them
+bool load_part(const std::vector<uint8_t> &file, update_part &out, std::string *why = nullptr);
+
+// a bundle of `files` (each one load_part takes), in the order given. false
+// (`why` says) if there are too few or too many, one is not an update file, or
+// two have the same target
+bool build_bundle(const std::vector<std::vector<uint8_t>> &files, std::vector<uint8_t> &out,
+                  std::string *why = nullptr);
+
+// the parts' files out of a bundle. false if it is not an intact bundle
+bool parse_bundle(const uint8_t *p, size_t n, std::vector<std::vector<uint8_t>> &files,
+                  std::string *why = nullptr);
+
+// the image a part's DATA rebuilds in its slot is written in place - it has no
+// A/B pair (the FPGA bitstream)
+bool in_place(uint16_t target);
+
+#endif // FW_UPDATE_BUNDLE_H
@@ -27,3 +27,12 @@ int serial_setup(int fd, unsigned baud) {
 
   return ioctl(fd, TCSETS2, &tio);
 }
+
+int serial_baud(int fd, unsigned *baud) {
+  struct termios2 tio;
+  if (ioctl(fd, TCGETS2, &tio) != 0) {
+    return -1;
+  }
+  *baud = tio.c_ospeed;
+  return 0;
+}
@@ -12,6 +12,10 @@ extern "C" {
 // limited to the fixed Bxxxxxx constants). returns 0 on success, -1 on error
 int serial_setup(int fd, unsigned baud);
 
+// the output baud fd is set to (on a pty: what the other side last set).
+// returns 0 on success, -1 on error
+int serial_baud(int fd, unsigned *baud);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,209 @@
+// see delta_enc.h
+
+#include "delta_enc.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+using idx = int32_t;
+
+// suffix array of `s` by prefix doubling, with the empty suffix first (sa[0] =
+// n) the way the bsdiff search expects it
+std::vector<idx> suffix_array(const std::vector<uint8_t> &s) {
+  const idx n = static_cast<idx>(s.size());
+  std::vector<idx> sa(static_cast<size_t>(n) + 1U);
+  std::vector<idx> rank(static_cast<size_t>(n) + 1U);
+  std::vector<idx> tmp(static_cast<size_t>(n) + 1U);
+  for (idx i = 0; i <= n; i++) {
+    sa[i] = i;
+    rank[i] = (i < n) ? s[i] + 1 : 0; // the empty suffix sorts first
+  }
+  for (idx k = 1;; k <<= 1) {
+    auto key2 = [&](idx i) { return (i + k <= n) ? rank[i + k] : -1; };
+    auto less = [&](idx a, idx b) {
+      return rank[a] != rank[b] ? rank[a] < rank[b] : key2(a) < key2(b);
+    };
+    std::sort(sa.begin(), sa.end(), less);
+    tmp[sa[0]] = 0;
+    for (idx i = 1; i <= n; i++) {
+      tmp[sa[i]] = tmp[sa[i - 1]] + (less(sa[i - 1], sa[i]) ? 1 : 0);
+    }
+    rank.swap(tmp);
+    if (rank[sa[n]] == n) {
+      break; // all ranks distinct
+    }
+  }
+  return sa;
+}
+
+idx match_len(const uint8_t *a, idx an, const uint8_t *b, idx bn) {
+  idx i = 0;
+  while (i < an && i < bn && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+// longest match of p[0, pn) among the base suffixes sa[st..en]
+idx search(const std::vector<idx> &sa, const uint8_t *old, idx on, const uint8_t *p, idx pn,
+           idx st, idx en, idx &pos) {
+  while (en - st >= 2) {
+    idx x = st + (en - st) / 2;
+    if (memcmp(old + sa[x], p, static_cast<size_t>(std::min(on - sa[x], pn))) < 0) {
+      st = x;
+    } else {
+      en = x;
+    }
+  }
+  idx a = match_len(old + sa[st], on - sa[st], p, pn);
+  idx b = match_len(old + sa[en], on - sa[en], p, pn);
+  pos = (a > b) ? sa[st] : sa[en];
+  return std::max(a, b);
+}
+
+void put_varint(std::vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80U) {
+    out.push_back(static_cast<uint8_t>(v | 0x80U));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// one op: add `add` bytes (new[ns..] against old[os..]), insert `ins` raw bytes
+// from new[ns + add..], then seek the base by `seek`
+void put_op(std::vector<uint8_t> &out, const uint8_t *nw, idx ns, const uint8_t *old, idx os,
+            idx add, idx ins, idx seek) {
+  put_varint(out, static_cast<uint32_t>(add));
+  put_varint(out, static_cast<uint32_t>(ins));
+  put_varint(out, (static_cast<uint32_t>(seek) << 1) ^ static_cast<uint32_t>(seek >> 31));
+
+  // the add part as { same, changed } runs. a changed run swallows zero gaps of
+  // under 3 bytes: cheaper than the two varints of a new run
+  idx i = 0;
+  while (i < add) {
+    idx same = 0;
+    while (i + same < add && nw[ns + i + same] == old[os + i + same]) {
+      same++;
+    }
+    idx c = i + same;
+    idx end = c;
+    while (end < add) {
+      if (nw[ns + end] != old[os + end]) {
+        end++;
+        continue;
+      }
+      idx z = end;
+      while (z < add && z - end < 3 && nw[ns + z] == old[os + z]) {
+        z++;
+      }
+      if (z == add || z - end >= 3) {
+        break;
+      }
+      end = z;
+    }
+    put_varint(out, static_cast<uint32_t>(same));
+    put_varint(out, static_cast<uint32_t>(end - c));
+    for (idx j = c; j < end; j++) {
+      out.push_back(static_cast<uint8_t>(nw[ns + j] - old[os + j]));
+    }
+    i = end;
+  }
+  out.insert(out.end(), nw + ns + add, nw + ns + add + ins);
+}
+
+} // namespace
+
+std::vector<uint8_t> delta_encode(const std::vector<uint8_t> &base,
+                                  const std::vector<uint8_t> &image) {
+  const uint8_t *old = base.data();
+  const uint8_t *nw = image.data();
+  const idx on = static_cast<idx>(base.size());
+  const idx nn = static_cast<idx>(image.size());
+  std::vector<uint8_t> out;
+  std::vector<idx> sa = suffix_array(base);
+
+  // bsdiff's scan: find the next place where an exact match beats the current
+  // alignment by more than 8 bytes, then split the stretch since the last one
+  // into an approximate forward extension of the old alignment (add), literal
+  // bytes (insert), and a backward extension of the new match
+  idx scan = 0, len = 0, pos = 0;
+  idx lastscan = 0, lastpos = 0, lastoffset = 0;
+  while (scan < nn) {
+    idx oldscore = 0;
+    idx scsc = scan += len;
+    for (; scan < nn; scan++) {
+      len = search(sa, old, on, nw + scan, nn - scan, 0, on, pos);
+      for (; scsc < scan + len; scsc++) {
+        if (scsc + lastoffset < on && old[scsc + lastoffset] == nw[scsc]) {
+          oldscore++;
+        }
+      }
+      if ((len == oldscore && len != 0) || len > oldscore + 8) {
+        break;
+      }
+      if (scan + lastoffset < on && old[scan + lastoffset] == nw[scan]) {
+        oldscore--;
+      }
+    }
+    if (len == oldscore && scan != nn) {
+      continue;
+    }
+
+    // forwards from the last match while at least half the bytes agree
+    idx s = 0, sf = 0, lenf = 0;
+    for (idx i = 0; lastscan + i < scan && lastpos + i < on;) {
+      if (old[lastpos + i] == nw[lastscan + i]) {
+        s++;
+      }
+      i++;
+      if (s * 2 - i > sf * 2 - lenf) {
+        sf = s;
+        lenf = i;
+      }
+    }
+    // and backwards from the new one
+    idx lenb = 0;
+    if (scan < nn) {
+      idx sb = 0;
+      s = 0;
+      for (idx i = 1; scan >= lastscan + i && pos >= i; i++) {
+        if (old[pos - i] == nw[scan - i]) {
+          s++;
+        }
+        if (s * 2 - i > sb * 2 - lenb) {
+          sb = s;
+          lenb = i;
+        }
+      }
+    }
+    // overlapping extensions: split where it scores best
+    if (lastscan + lenf > scan - lenb) {
+      idx overlap = (lastscan + lenf) - (scan - lenb);
+      idx ss = 0, lens = 0;
+      s = 0;
+      for (idx i = 0; i < overlap; i++) {
+        if (nw[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i]) {
+          s++;
+        }
+        if (nw[scan - lenb + i] == old[pos - lenb + i]) {
+          s--;
+        }
+        if (s > ss) {
+          ss = s;
+          lens = i + 1;
+        }
+      }
+      lenf += lens - overlap;
+      lenb -= lens;
+    }
+
+    put_op(out, nw, lastscan, old, lastpos, lenf, (scan - lenb) - (lastscan + lenf),
+           (pos - lenb) - (lastpos + lenf));
+    lastscan = scan - lenb;
+    lastpos = pos - lenb;
+    lastoffset = pos - scan;
+  }
+  return out;
+}
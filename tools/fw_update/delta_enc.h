@@ -0,0 +1,18 @@
+// host side of delta updates: build the patch op stream (format in
+// bootloader/delta.h) that turns one image blob into another. the matcher is
+// bsdiff's - a suffix array over the base finds long matches, and each match
+// is extended forwards/backwards while at least half its bytes agree, so code
+// that merely moved (or had its addresses retargeted) becomes a mostly-zero
+// add part rather than new bytes. used by mkupdate --delta and the host tests.
+
+#ifndef FW_UPDATE_DELTA_ENC_H
+#define FW_UPDATE_DELTA_ENC_H
+
+#include <cstdint>
+#include <vector>
+
+// the op stream that rebuilds `image` from `base`
+std::vector<uint8_t> delta_encode(const std::vector<uint8_t> &base,
+                                  const std::vector<uint8_t> &image);
+
+#endif // FW_UPDATE_DELTA_ENC_H
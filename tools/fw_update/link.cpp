@@ -0,0 +1,828 @@
+// see link.h
+
+#include "link.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "custom_baud.h"
+
+using clk = std::chrono::steady_clock;
+
+int open_serial(const std::string &dev, int baud) {
+  int fd = ::open(dev.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "open " << dev << ": " << std::strerror(errno) << "\n";
+    return -1;
+  }
+  if (serial_setup(fd, (unsigned)baud) != 0) {
+    std::cerr << "serial_setup " << baud << ": " << std::strerror(errno) << "\n";
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool send_frame(int fd, uint8_t type, uint16_t seq, const void *pl, uint16_t len, uint8_t ch) {
+  uint8_t tx[8U + BL_MAX_PAYLOAD + 4U];
+  size_t n = bl_frame_encode_ch(ch, type, seq, pl, len, tx, sizeof(tx));
+  if (n == 0) {
+    return false;
+  }
+  size_t off = 0;
+  while (off < n) {
+    ssize_t w = ::write(fd, tx + off, n - off);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    off += static_cast<size_t>(w);
+  }
+  return true;
+}
+
+bool recv_frame(int fd, frame_reader &rd, int timeout_ms, bl_frame &out) {
+  auto deadline = clk::now() + std::chrono::milliseconds(timeout_ms);
+  for (;;) {
+    // anything left over from the last read first
+    while (rd.pos < rd.len) {
+      int st;
+      rd.pos += bl_frame_feed_buf(&rd.rx, rd.buf + rd.pos, rd.len - rd.pos, &st);
+      if (st == BL_FRAME_OK) {
+        out = rd.rx.frame;
+        return true;
+      }
+    }
+
+    int left = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+    struct pollfd p = {fd, POLLIN, 0};
+    int r = ::poll(&p, 1, std::max(left, 0));
+    if (r < 0 && errno != EINTR) {
+      return false;
+    }
+    if (r > 0) {
+      ssize_t n = ::read(fd, rd.buf, sizeof(rd.buf));
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        return false;
+      }
+      rd.len = (n > 0) ? static_cast<size_t>(n) : 0;
+      rd.pos = 0;
+      continue;
+    }
+    if (left <= 0) {
+      return false;
+    }
+  }
+}
+
+bool recv_frame(int fd, int timeout_ms, bl_frame &out) {
+  frame_reader rd;
+  return recv_frame(fd, rd, timeout_ms, out);
+}
+
+link_engine::link_engine(int f) : fd(f), line_free(clk::now()) {
+  saved_flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, saved_flags | O_NONBLOCK);
+  bl_sched_init(&sched);
+}
+
+link_engine::~link_engine() { fcntl(fd, F_SETFL, saved_flags); }
+
+bool link_engine::queue(uint8_t type, uint16_t seq, const void *pl, uint16_t len, long tag,
+                        bool front) {
+  return queue_ch(BL_CH_UPDATE, type, seq, pl, len, tag, front);
+}
+
+bool link_engine::queue_ch(uint8_t ch, uint8_t type, uint16_t seq, const void *pl, uint16_t len,
+                           long tag, bool front) {
+  tx_frame t;
+  t.b.resize(8U + len + 4U);
+  size_t n = bl_frame_encode_ch(ch, type, seq, pl, len, t.b.data(), t.b.size());
+  if (n == 0) {
+    return false;
+  }
+  t.b.resize(n);
+  t.ext = nullptr;
+  t.n = n;
+  t.tag = tag;
+  push(std::move(t), bl_tx_class(ch, type), front);
+  return true;
+}
+
+void link_engine::queue_encoded(const uint8_t *p, size_t n, long tag, bool front) {
+  tx_frame t;
+  t.ext = p;
+  t.n = n;
+  t.tag = tag;
+  push(std::move(t), bl_tx_class(p[3], p[2]), front); // flags, type
+}
+
+void link_engine::push(tx_frame &&t, uint8_t cls, bool front) {
+  std::deque<tx_frame> &d = q[cls];
+  if (!front) {
+    d.push_back(std::move(t));
+  } else {
+    d.insert(d.begin() + ((cur == cls) ? 1 : 0), std::move(t));
+  }
+}
+
+size_t link_engine::queued() const {
+  size_t n = 0;
+  for (const std::deque<tx_frame> &d : q) {
+    n += d.size();
+  }
+  return n;
+}
+
+// the class to keep writing from: the one with a frame under way, else the
+// scheduler's pick (-1: nothing queued)
+int link_engine::next_class() {
+  if (cur >= 0) {
+    return cur;
+  }
+  uint32_t head[BL_TX_CLASSES];
+  for (unsigned c = 0; c < BL_TX_CLASSES; c++) {
+    head[c] = q[c].empty() ? 0U : static_cast<uint32_t>(q[c].front().n);
+  }
+  cur = bl_sched_pick(&sched, head);
+  head_off = 0;
+  return cur;
+}
+
+// bytes the tty may take now. paced: what keeps it within `ahead` of the line,
+// and when nothing does, how long until it will (*wait_ms)
+size_t link_engine::room(int *wait_ms) const {
+  if (line_baud <= 0) {
+    return SIZE_MAX;
+  }
+  double backlog = std::chrono::duration<double>(line_free - clk::now()).count() * line_baud / 10.0;
+  if (backlog < static_cast<double>(ahead)) {
+    return ahead - static_cast<size_t>(std::max(backlog, 0.0));
+  }
+  *wait_ms = 1 + static_cast<int>((backlog - ahead) * 10000.0 / line_baud);
+  return 0;
+}
+
+void encoded_image::build(const uint8_t *data, size_t len, uint16_t ch) {
+  chunk = ch;
+  size_t total = (len + ch - 1U) / ch;
+  wire.assign(len + total * (8U + 4U), 0);
+  at.assign(1, 0);
+  for (size_t n = 0; n < total; n++) {
+    size_t off = n * ch;
+    uint16_t l = static_cast<uint16_t>(std::min<size_t>(ch, len - off));
+    at.push_back(at.back() + bl_frame_encode(BL_DATA, static_cast<uint16_t>(n), data + off, l,
+                                             wire.data() + at.back(), wire.size() - at.back()));
+  }
+}
+
+// one round of the loop: hand the tty what it takes, parse what arrived
+bool link_engine::step(int timeout_ms) {
+  int wait_ms = timeout_ms;
+  size_t can = (queued() != 0U) ? room(&wait_ms) : 0U;
+  // paced and `ahead` bytes out already: only read until the line catches up
+  struct pollfd p = {fd, static_cast<short>(POLLIN | ((can > 0U) ? POLLOUT : 0)), 0};
+  int r = ::poll(&p, 1, std::min(timeout_ms, wait_ms));
+  if (r < 0) {
+    broken = errno != EINTR;
+    return !broken;
+  }
+  if (p.revents & POLLOUT) {
+    while (can > 0U && next_class() >= 0) {
+      tx_frame &t = q[cur].front();
+      size_t n = std::min(t.n - head_off, can);
+      ssize_t w = ::write(fd, t.data() + head_off, n);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        broken = errno != EAGAIN;
+        break;
+      }
+      head_off += static_cast<size_t>(w);
+      wire += static_cast<size_t>(w);
+      if (line_baud > 0) {
+        can -= static_cast<size_t>(w);
+        line_free = std::max(line_free, clk::now()) +
+                    std::chrono::duration_cast<clk::duration>(
+                      std::chrono::duration<double>(w * 10.0 / line_baud));
+      }
+      if (head_off < t.n) {
+        if (static_cast<size_t>(w) < n) {
+          break; // the tty is full
+        }
+        continue;
+      }
+      long tag = t.tag;
+      q[cur].pop_front();
+      cur = -1;
+      head_off = 0;
+      if (tag >= 0 && on_sent) {
+        on_sent(tag);
+      }
+    }
+  }
+  if (p.revents & POLLIN) {
+    ssize_t n = ::read(fd, rd.buf, sizeof(rd.buf));
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      broken = true;
+    }
+    size_t pos = 0;
+    while (n > 0 && pos < static_cast<size_t>(n)) {
+      int st;
+      pos += bl_frame_feed_buf(&rd.rx, rd.buf + pos, static_cast<size_t>(n) - pos, &st);
+      if (st != BL_FRAME_OK) {
+        continue;
+      }
+      if (rd.rx.frame.flags == BL_CH_UPDATE) {
+        inbox.push_back(rd.rx.frame);
+      } else if (on_channel) {
+        on_channel(rd.rx.frame);
+      }
+    }
+  } else if (p.revents & (POLLERR | POLLNVAL)) {
+    broken = true;
+  }
+  return !broken;
+}
+
+bool link_engine::pump(int timeout_ms, bl_frame &out, size_t low) {
+  auto deadline = clk::now() + std::chrono::milliseconds(timeout_ms);
+  for (;;) {
+    if (!inbox.empty()) {
+      out = inbox.front();
+      inbox.pop_front();
+      return true;
+    }
+    int left = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+    if (queued() < low || !step(std::max(left, 0)) || (left <= 0 && inbox.empty())) {
+      return false;
+    }
+  }
+}
+
+bool link_engine::flush(int timeout_ms) {
+  auto deadline = clk::now() + std::chrono::milliseconds(timeout_ms);
+  while (queued() != 0U) {
+    int left = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+    if (left < 0 || !step(left)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool handshake(int fd, bl_hello *ack_out) {
+  bl_hello h;
+  h.version = BL_PROTO_VERSION;
+  h.max_payload = BL_MAX_PAYLOAD;
+  if (!send_frame(fd, BL_HELLO, 0, &h, sizeof(h))) {
+    std::cerr << "failed to send HELLO\n";
+    return false;
+  }
+  tcdrain(fd);
+
+  bl_frame f;
+  if (recv_frame(fd, 1000, f) && f.type == BL_HELLO_ACK) {
+    bl_hello ack;
+    memcpy(&ack, f.payload, sizeof(ack));
+    printf("link established: mcu proto v%u, max payload %u\n", ack.version, ack.max_payload);
+    if (ack_out != nullptr) {
+      *ack_out = ack;
+    }
+    return true;
+  }
+  std::cerr << "no HELLO_ACK (check wiring, baud, and that the framed receiver "
+               "firmware is running)\n";
+  return false;
+}
+
+bool query_resume(int fd, const bl_manifest &m, uint32_t &offset) {
+  offset = 0;
+  if (!send_frame(fd, BL_RESUME, 0, &m, sizeof(m))) {
+    return false;
+  }
+  frame_reader rd;
+  bl_frame f;
+  auto deadline = clk::now() + std::chrono::milliseconds(1000);
+  while (clk::now() < deadline) {
+    int left = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+    if (!recv_frame(fd, rd, left, f)) {
+      break;
+    }
+    if (f.type == BL_RESUME && f.len >= sizeof(bl_resume)) {
+      bl_resume r;
+      memcpy(&r, f.payload, sizeof(r));
+      offset = std::min(r.offset, m.length);
+      return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+
+// send a request and wait for the answer of the same type (anything else that
+// arrives meanwhile is dropped)
+bool ask(int fd, uint8_t type, const void *pl, uint16_t len, int timeout_ms, bl_frame &ans) {
+  if (!send_frame(fd, type, 0, pl, len)) {
+    return false;
+  }
+  tcdrain(fd);
+  frame_reader rd;
+  auto deadline = clk::now() + std::chrono::milliseconds(timeout_ms);
+  while (clk::now() < deadline) {
+    int left = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+    if (!recv_frame(fd, rd, left, ans)) {
+      break;
+    }
+    if (ans.type == type && ans.flags == BL_CH_UPDATE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// the board's probe counts since the last report (resetting them). a request
+// at a rate the board is not on goes unanswered
+bool probe_report(int fd, bl_probe &p, int timeout_ms) {
+  bl_frame f;
+  if (!ask(fd, BL_PROBE, nullptr, 0, timeout_ms, f) || f.len < sizeof(p)) {
+    return false;
+  }
+  memcpy(&p, f.payload, sizeof(p));
+  return true;
+}
+
+// is the board on the tty's rate? a few tries, all well inside its trial
+bool answers(int fd) {
+  bl_probe p;
+  for (int i = 0; i < 3; i++) {
+    if (probe_report(fd, p, 40)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void retune(int fd, int baud) {
+  serial_setup(fd, static_cast<unsigned>(baud));
+  tcflush(fd, TCIFLUSH);
+}
+
+enum class moved { yes, no, lost };
+
+// BL_LINK from `cur` to `to` (payload 0 = keep). the answer comes at the old
+// rate; the board switches 2ms after it, and keeps the new rate only if the
+// host is heard there. if the host cannot confirm it, both go back - unless
+// the board did hear the host and only its answer was lost
+moved move(int fd, int &cur, int to, uint16_t payload, uint16_t &chunk) {
+  bl_link req = {static_cast<uint32_t>((to != cur) ? to : 0), payload, 0};
+  bl_frame f;
+  bool heard = false;
+  for (int i = 0; i < 3 && !heard; i++) {
+    heard = ask(fd, BL_LINK, &req, sizeof(req), 200, f) && f.len >= sizeof(bl_link);
+  }
+  if (!heard) {
+    return answers(fd) ? moved::no : moved::lost;
+  }
+  bl_link ans;
+  memcpy(&ans, f.payload, sizeof(ans));
+  chunk = ans.payload;
+  if (ans.baud == 0U || to == cur) {
+    return moved::no;
+  }
+  usleep(5000);
+  retune(fd, to);
+  if (answers(fd)) {
+    cur = to;
+    return moved::yes;
+  }
+  retune(fd, cur);
+  usleep((BL_LINK_TRIAL_MS + 50U) * 1000U);
+  if (answers(fd)) {
+    return moved::no;
+  }
+  retune(fd, to);
+  if (answers(fd)) {
+    cur = to;
+    return moved::yes;
+  }
+  retune(fd, cur);
+  return moved::lost;
+}
+
+// a burst of test frames at the tty's rate: how many the board counted
+bool measure(int fd, int baud, const tune_opts &o, tune_step &st) {
+  static uint8_t pl[BL_MAX_PAYLOAD];
+  for (size_t i = 0; i < sizeof(pl); i++) {
+    pl[i] = static_cast<uint8_t>(i * 167U + 13U);
+  }
+  bl_probe p;
+  auto t0 = clk::now();
+  if (!probe_report(fd, p, 200)) { // clears the counts
+    return false;
+  }
+  st.rtt_s = std::chrono::duration<double>(clk::now() - t0).count();
+  st.sent = o.burst;
+  for (int i = 0; i < o.burst; i++) {
+    if (!send_frame(fd, BL_PROBE, static_cast<uint16_t>(i), pl, BL_MAX_PAYLOAD)) {
+      return false;
+    }
+  }
+  // the line still has the burst to carry after the tty takes it
+  int drain_ms = static_cast<int>(o.burst * (BL_MAX_PAYLOAD + 12.0) * 10.0 * 1000.0 / baud);
+  bool heard = probe_report(fd, p, drain_ms + 300);
+  for (int i = 0; i < 2 && !heard; i++) {
+    heard = probe_report(fd, p, 100);
+  }
+  st.got = heard ? std::min<int>(p.got, o.burst) : 0; // too noisy even for that
+  double fer = 1.0 - static_cast<double>(st.got) / o.burst;
+  st.ber = (st.got == 0) ? 1.0 : 1.0 - std::pow(1.0 - fer, 1.0 / (8.0 * (BL_MAX_PAYLOAD + 12.0)));
+  return true;
+}
+
+} // namespace
+
+bool fetch_trace(int fd, std::vector<uint8_t> &raw) {
+  raw.clear();
+  bl_frame f;
+  if (!ask(fd, BL_TRACE, nullptr, 0, 1000, f)) {
+    return false;
+  }
+  raw.assign(f.payload, f.payload + f.len);
+  return true;
+}
+
+bool start_bundle(int fd, uint16_t parts) {
+  bl_bundle b = {parts, 0};
+  bl_frame f;
+  if (!ask(fd, BL_BUNDLE, &b, sizeof(b), 1000, f) || f.len < sizeof(b)) {
+    return false;
+  }
+  memcpy(&b, f.payload, sizeof(b));
+  return b.parts == parts;
+}
+
+double link_goodput(const tune_step &st, uint16_t chunk, const tune_opts &o) {
+  double frame = chunk + 12.0;
+  double ok = std::pow(1.0 - std::min(st.ber, 1.0), 8.0 * frame);
+  double rtt = st.rtt_s + static_cast<double>(o.rx_chunk) * 10.0 / st.baud;
+  double per_frame = std::max(frame * 10.0 / st.baud, rtt / o.window) + (1.0 - ok) * rtt;
+  return chunk * ok / per_frame;
+}
+
+bool autotune(int fd, int baud, const tune_opts &o, tune_result &r) {
+  r = tune_result{};
+  r.baud = baud;
+  r.chunk = BL_MAX_PAYLOAD;
+  int cur = baud;
+
+  // climb
+  std::vector<int> rates = {baud};
+  for (int b : o.rates) {
+    if (b > baud && b <= o.max_baud) {
+      rates.push_back(b);
+    }
+  }
+  for (int b : rates) {
+    tune_step st;
+    st.baud = b;
+    if (b != cur) {
+      moved m = move(fd, cur, b, 0, r.chunk);
+      if (m == moved::lost) {
+        r.baud = cur;
+        return false;
+      }
+      if (m == moved::no) {
+        r.steps.push_back(st);
+        break;
+      }
+    }
+    st.up = true;
+    if (!measure(fd, b, o, st)) {
+      r.baud = cur;
+      return false;
+    }
+    r.steps.push_back(st);
+    if (st.got < o.burst * (1.0 - o.give_up)) {
+      break;
+    }
+  }
+
+  // the best point any rate that came up offers
+  int best = baud;
+  uint16_t best_chunk = BL_MAX_PAYLOAD;
+  double best_rate = 0.0;
+  for (const tune_step &st : r.steps) {
+    for (uint16_t c = BL_MIN_PAYLOAD; st.up && c <= BL_MAX_PAYLOAD; c = static_cast<uint16_t>(c * 2U)) {
+      double g = link_goodput(st, c, o);
+      if (g > best_rate) {
+        best = st.baud;
+        best_chunk = c;
+        best_rate = g;
+      }
+    }
+  }
+
+  // settle there
+  moved m = move(fd, cur, best, best_chunk, r.chunk);
+  r.baud = cur;
+  if (m == moved::lost) {
+    return false;
+  }
+  r.rate = best_rate;
+  if (cur != best) {
+    // it would not come back up: what this rate measured, at the chunk now set
+    for (const tune_step &st : r.steps) {
+      if (st.baud == cur) {
+        r.rate = link_goodput(st, r.chunk, o);
+      }
+    }
+  }
+  return true;
+}
+
+namespace {
+
+// DONE, then wait for the verdict. DONE is resent a couple of times in case it
+// was the frame that got hit
+bool finish(link_engine &e, uint16_t seq, const xfer_opts &o, xfer_stats &st) {
+  for (int attempt = 0; attempt < 3 && !st.have_result; attempt++) {
+    e.queue(BL_DONE, seq, nullptr, 0);
+    auto deadline = clk::now() + std::chrono::milliseconds(o.result_ms);
+    bl_frame f;
+    while (clk::now() < deadline) {
+      int left = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clk::now()).count());
+      if (!e.pump(left, f)) {
+        break;
+      }
+      if (f.type == BL_RESULT || (f.type == BL_NAK && f.len >= sizeof(bl_result))) {
+        memcpy(&st.result, f.payload, sizeof(st.result));
+        if (f.type == BL_NAK && st.result.status == BL_ERR_SEQ) {
+          continue; // a late gap nak, not the verdict
+        }
+        st.have_result = true;
+        break;
+      }
+    }
+  }
+  return st.have_result && st.result.status == BL_OK;
+}
+
+// a fatal NAK (size/target/flash): the receiver gave up, stop sending
+bool fatal_nak(const bl_frame &f, xfer_stats &st) {
+  if (f.type != BL_NAK || f.len < sizeof(bl_result)) {
+    return false;
+  }
+  bl_result r;
+  memcpy(&r, f.payload, sizeof(r));
+  if (r.status == BL_ERR_SEQ) {
+    return false;
+  }
+  st.result = r;
+  st.have_result = true;
+  return true;
+}
+
+// frames kept encoded ahead of the tty in the plain stream
+constexpr size_t LEGACY_AHEAD = 16;
+
+// blast everything, verdict at DONE - but a receiver that gives up early
+// (fatal NAK) is heard while the rest is still going out
+bool stream_legacy(link_engine &e, const uint8_t *data, size_t len, const xfer_opts &o,
+                   xfer_stats &st) {
+  const uint16_t chunk = o.chunk;
+  const encoded_image *pre = (o.pre != nullptr && o.pre->chunk == chunk) ? o.pre : nullptr;
+  uint16_t seq = 0;
+  size_t off = 0;
+  while (off < len || e.queued() != 0U) {
+    while (off < len && e.queued() < LEGACY_AHEAD) {
+      uint16_t n = static_cast<uint16_t>(std::min<size_t>(chunk, len - off));
+      size_t k = off / chunk;
+      if (pre != nullptr) {
+        e.queue_encoded(pre->wire.data() + pre->at[k], pre->at[k + 1U] - pre->at[k]);
+        seq++;
+      } else if (!e.queue(BL_DATA, seq++, data + off, n)) {
+        return false;
+      }
+      st.frames++;
+      st.bytes += n;
+      if (o.progress != nullptr) {
+        *o.progress += n;
+      }
+      off += n;
+    }
+    bl_frame f;
+    while (e.pump(50, f, (off < len) ? LEGACY_AHEAD / 2U : 0U)) {
+      if (fatal_nak(f, st)) {
+        return false;
+      }
+    }
+    if (e.broken) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// selective-repeat sender. frame n carries bytes [n*chunk, ...). the receiver
+// acks cumulatively (+ a sack bitmap) and naks the first hole it sees; we resend
+// a nak'd frame at once and anything unacked past the retransmit timeout. frames
+// are queued on the engine as soon as the window allows and their retransmit
+// clock starts once they are written out
+bool stream_windowed(link_engine &e, const uint8_t *data, size_t len, const xfer_opts &o,
+                     uint16_t window, size_t start, xfer_stats &st) {
+  const size_t total = (len + o.chunk - 1U) / o.chunk;
+  const encoded_image *pre =
+    (o.pre != nullptr && o.pre->chunk == o.chunk && o.pre->frames() == total) ? o.pre : nullptr;
+  std::vector<uint8_t> acked(total, 0);
+  std::vector<uint8_t> queued(total, 0); // encoded, not yet all written
+  std::vector<clk::time_point> sent_at(total);
+  std::vector<uint8_t> sends(total, 0);
+
+  // a full window has to drain through the line before its acks can come back
+  // (sized on what we would send: the receiver's window may start out at 0)
+  double frame_s = (8.0 + o.chunk + 4.0) * 10.0 / static_cast<double>(o.baud);
+  auto rto = std::chrono::milliseconds(
+    std::max(50, static_cast<int>(frame_s * o.window * 2000.0)));
+
+  e.on_sent = [&](long n) {
+    queued[static_cast<size_t>(n)] = 0;
+    sent_at[static_cast<size_t>(n)] = clk::now();
+  };
+  auto send_n = [&](size_t n, bool resend) -> bool {
+    size_t off = n * o.chunk;
+    uint16_t l = static_cast<uint16_t>(std::min<size_t>(o.chunk, len - off));
+    if (pre != nullptr) {
+      e.queue_encoded(pre->wire.data() + pre->at[n], pre->at[n + 1U] - pre->at[n],
+                      static_cast<long>(n), resend);
+    } else if (!e.queue(BL_DATA, static_cast<uint16_t>(n), data + off, l, static_cast<long>(n),
+                        resend)) {
+      return false;
+    }
+    queued[n] = 1;
+    st.frames++;
+    st.bytes += l;
+    if (o.progress != nullptr) {
+      *o.progress += l;
+    }
+    if (sends[n]++ > 0U) {
+      st.resent++;
+    }
+    return true;
+  };
+  // 16-bit wire seq -> absolute frame index, relative to the ack point
+  auto expand = [](size_t base, uint16_t s) -> size_t {
+    return base + static_cast<int16_t>(static_cast<uint16_t>(s - static_cast<uint16_t>(base)));
+  };
+
+  size_t base = start; // frames before it are already in the slot
+  size_t next_new = start;
+  auto last_ack = clk::now();
+  auto last_heard = last_ack;
+  bool ok = true;
+  while (ok && base < total) {
+    while (next_new < total && next_new < base + window) {
+      if (!send_n(next_new++, false)) {
+        ok = false;
+        break;
+      }
+    }
+
+    bl_frame f;
+    int wait_ms = static_cast<int>(rto.count() / 4);
+    while (ok && e.pump(wait_ms, f)) {
+      wait_ms = 0; // handle whatever else is in, then go refill
+      last_heard = clk::now();
+      if (f.type == BL_ACK && f.len >= sizeof(bl_ack)) {
+        bl_ack a;
+        memcpy(&a, f.payload, sizeof(a));
+        st.acks++;
+        size_t n = std::min(expand(base, a.next), total);
+        for (; base < n; base++) {
+          acked[base] = 1;
+        }
+        for (unsigned i = 0; i < 32U; i++) {
+          if ((a.sack >> i) & 1U) {
+            size_t s = n + 1U + i;
+            if (s < total) {
+              acked[s] = 1;
+            }
+          }
+        }
+        // the receiver's window moves both ways (a streaming receiver
+        // shrinks it while its flash catches up; 0 = hold)
+        window = std::min(o.window, a.window);
+        last_ack = clk::now();
+      } else if (fatal_nak(f, st)) {
+        ok = false;
+      } else if (f.type == BL_NAK && f.len >= sizeof(bl_result)) {
+        bl_result r;
+        memcpy(&r, f.payload, sizeof(r));
+        st.naks++;
+        size_t s = expand(base, r.seq);
+        if (s < next_new && !acked[s] && !queued[s] && !send_n(s, true)) {
+          ok = false;
+        }
+      }
+    }
+    if (!ok || e.broken) {
+      ok = false;
+      break;
+    }
+
+    // nothing heard for stall_ms, whatever the window: a live receiver acks
+    // every frame, the window-0 probes below included, so the receiver is gone
+    // (reset, unplugged, stalled out)
+    auto now = clk::now();
+    if (now - last_heard > std::chrono::milliseconds(o.stall_ms)) {
+      ok = false;
+      break;
+    }
+    // anything written, not acked, and stale: lost without a nak (tail of the
+    // image, or the resend itself got hit)
+    for (size_t s = base; ok && s < next_new; s++) {
+      if (!acked[s] && !queued[s] && now - sent_at[s] > rto && !send_n(s, true)) {
+        ok = false;
+      }
+    }
+    // held at window 0 with nothing in flight: if the ack that reopens it got
+    // lost we would wait forever, so probe with the next frame now and then
+    if (ok && window == 0U && next_new == base && next_new < total && now - last_ack > rto) {
+      ok = send_n(next_new++, false);
+      last_ack = now;
+    }
+  }
+  e.on_sent = nullptr;
+  return ok;
+}
+
+} // namespace
+
+bool send_image(int fd, bl_manifest m, const uint8_t *data, size_t len, const xfer_opts &o,
+                xfer_stats &st) {
+  st = xfer_stats{};
+  link_engine e(fd);
+  e.on_channel = o.on_channel;
+
+  m.flags = static_cast<uint16_t>(
+    (m.flags & ~(BL_MANIFEST_F_WINDOWED | BL_MANIFEST_F_RESUME)) |
+    (o.windowed ? BL_MANIFEST_F_WINDOWED : 0U) | (o.resume ? BL_MANIFEST_F_RESUME : 0U));
+  auto t0 = clk::now();
+  if (!e.queue(BL_MANIFEST, 0, &m, sizeof(m))) {
+    return false;
+  }
+
+  // a windowed receiver answers the manifest with its window; an older one
+  // (or a test fw) stays silent, so fall back to the plain stream
+  uint16_t window = o.window;
+  size_t start = 0;
+  if (o.windowed) {
+    bl_frame f{};
+    bool got = e.pump(500, f);
+    if (got && f.type == BL_ACK && f.len >= sizeof(bl_ack)) {
+      bl_ack a;
+      memcpy(&a, f.payload, sizeof(a));
+      window = std::min(window, a.window); // 0: accepted, hold until the next ack
+      st.windowed = true;
+      // a resumed transfer: everything before the ack point is in the slot
+      start = std::min<size_t>(a.next, (len + o.chunk - 1U) / o.chunk);
+      st.start = std::min(start * o.chunk, len);
+    } else if (got && fatal_nak(f, st)) {
+      return false;
+    } else {
+      std::cerr << "no windowed ack for the manifest, falling back to a plain stream\n";
+    }
+  }
+
+  bool ok = st.windowed ? stream_windowed(e, data, len, o, window, start, st)
+                        : stream_legacy(e, data, len, o, st);
+  st.wire = e.wire;
+  auto t1 = clk::now();
+  st.stream_s = std::chrono::duration<double>(t1 - t0).count();
+  if (ok) {
+    uint16_t seq = static_cast<uint16_t>((len + o.chunk - 1U) / o.chunk);
+    ok = finish(e, seq, o, st);
+    st.verify_s = std::chrono::duration<double>(clk::now() - t1).count();
+  }
+  return ok;
+}
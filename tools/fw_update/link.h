@@ -0,0 +1,240 @@
+// framed transport helpers for the host side of the update protocol, shared by
+// update.bin and the host tests in tests/. everything talks to a plain fd, so a
+// pty stands in for the USB-UART in tests.
+
+#ifndef FW_UPDATE_LINK_H
+#define FW_UPDATE_LINK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bootloader/channel.h"
+#include "bootloader/frame.h"
+#include "bootloader/protocol.h"
+
+// open the serial device and configure it raw 8N1, no flow control, at an exact
+// baud via termios2 (see custom_baud.c). returns the fd or -1
+int open_serial(const std::string &dev, int baud);
+
+// send one framed packet (on channel `ch`, enum bl_channel), retrying short
+// writes
+bool send_frame(int fd, uint8_t type, uint16_t seq, const void *pl, uint16_t len,
+                uint8_t ch = BL_CH_UPDATE);
+
+// incoming-frame parser that survives across calls: bytes read past the end of
+// one frame are kept for the next, so back-to-back replies (acks) are not lost
+struct frame_reader {
+  bl_frame_rx rx;
+  uint8_t buf[256];
+  size_t len = 0;
+  size_t pos = 0;
+
+  frame_reader() { bl_frame_rx_init(&rx); }
+};
+
+// wait up to timeout_ms (0 = just drain what is already there) for one
+// complete frame
+bool recv_frame(int fd, frame_reader &rd, int timeout_ms, bl_frame &out);
+
+// one-shot variant with a throwaway parser
+bool recv_frame(int fd, int timeout_ms, bl_frame &out);
+
+// full-duplex engine for one transfer. frames are encoded when queued, and one
+// poll() loop writes them whenever the tty takes more (the fd is non-blocking
+// while the engine lives) and parses replies the moment they arrive - the line
+// never idles behind a read, and a NAK is seen while DATA is still going out.
+// single-threaded: the loop is both the writer and the reader.
+//
+// frames queue per transmit class (bootloader/channel.h) and the shared
+// scheduler picks the next one whenever a frame is done: update control frames
+// first, then log, telemetry and bulk DATA by their quanta - a control frame
+// waits for the frame being written at most. that holds for the engine's own
+// queues; what the tty has already taken is out of its hands, so with
+// `line_baud` set the engine also keeps no more than `ahead` bytes ahead of the
+// line (timed at that rate) and holds the rest where it can still reorder it.
+// incoming frames on channels other than BL_CH_UPDATE go to on_channel instead
+// of the inbox (dropped without one)
+struct link_engine {
+  struct tx_frame {
+    std::vector<uint8_t> b;   // encoded, ready for the wire
+    const uint8_t *ext;       // ... or someone else's copy (queue_encoded)
+    size_t n;
+    long tag;                 // passed to on_sent once it is all written (-1 = none)
+    const uint8_t *data() const { return ext ? ext : b.data(); }
+  };
+
+  int fd;
+  int saved_flags;
+  frame_reader rd;
+  std::deque<tx_frame> q[BL_TX_CLASSES];
+  int cur = -1;             // class whose q.front() is partly written (head_off)
+  size_t head_off = 0;
+  bl_sched sched;
+  std::deque<bl_frame> inbox; // parsed, not yet handed out by pump()
+  size_t wire = 0;          // bytes written
+  bool broken = false;      // the fd failed
+  std::function<void(long)> on_sent;
+  std::function<void(const bl_frame &)> on_channel;
+  int line_baud = 0;        // > 0: pace writes to this line rate
+  size_t ahead = 2U * (8U + BL_MAX_PAYLOAD + 4U); //   bytes written ahead of it at most
+
+  explicit link_engine(int fd);
+  ~link_engine(); // restores the fd's flags; whatever is still queued is dropped
+
+  // encode and queue a frame. `front`: ahead of everything not yet started (a
+  // resend goes before new data)
+  bool queue(uint8_t type, uint16_t seq, const void *pl, uint16_t len, long tag = -1,
+             bool front = false);
+
+  // the same on channel `ch` (enum bl_channel)
+  bool queue_ch(uint8_t ch, uint8_t type, uint16_t seq, const void *pl, uint16_t len,
+                long tag = -1, bool front = false);
+
+  // queue a frame encoded elsewhere (an encoded_image); `p` must outlive it
+  void queue_encoded(const uint8_t *p, size_t n, long tag = -1, bool front = false);
+
+  // frames queued, all classes
+  size_t queued() const;
+
+  // write and read until an update frame is complete (true, in `out`),
+  // timeout_ms passes, or fewer than `low` frames are left queued (false: time
+  // to refill)
+  bool pump(int timeout_ms, bl_frame &out, size_t low = 0);
+
+  // write until the queue is empty (frames that arrive meanwhile wait in the
+  // inbox). false on timeout or a failed fd
+  bool flush(int timeout_ms);
+
+ private:
+  std::chrono::steady_clock::time_point line_free; // paced: when the line drains
+  bool step(int timeout_ms);
+  void push(tx_frame &&t, uint8_t cls, bool front);
+  int next_class();
+  size_t room(int *wait_ms) const;
+};
+
+// the DATA frames of an image, encoded once: frame n carries bytes
+// [n*chunk, ...) as seq n. boards flashed in parallel all send from one copy
+struct encoded_image {
+  uint16_t chunk = 0;
+  std::vector<uint8_t> wire; // every frame, back to back
+  std::vector<size_t> at;    // frame n is wire[at[n] .. at[n+1])
+
+  void build(const uint8_t *data, size_t len, uint16_t chunk);
+  size_t frames() const { return at.empty() ? 0U : at.size() - 1U; }
+};
+
+// HELLO/HELLO_ACK: prove the link and learn the mcu's protocol version. the
+// mcu's reply is copied to *ack when given
+bool handshake(int fd, bl_hello *ack = nullptr);
+
+// BL_RESUME: image bytes the receiver already holds from an interrupted
+// transfer of the image `m` describes (0 = none). false if it did not answer
+// (a receiver older than v6)
+bool query_resume(int fd, const bl_manifest &m, uint32_t &offset);
+
+// BL_TRACE (v8 receivers): the board's trace of the last boot that reached the
+// app, the payload as it came (empty: the board kept none; trace_dec.h decodes
+// it). false if it did not answer
+bool fetch_trace(int fd, std::vector<uint8_t> &raw);
+
+// BL_BUNDLE (v9 receivers): the next `parts` images (send_image each) are one
+// update, committed together after the last. false if the board refused or did
+// not answer
+bool start_bundle(int fd, uint16_t parts);
+
+// link tuning (BL_LINK/BL_PROBE, v7 receivers). the baud is stepped up from
+// where the handshake ran through `rates`: at each step both ends switch (the
+// board falls back on its own if the host never shows up at the new rate), and
+// a burst of largest-payload test frames measures how many get through. the
+// climb stops at the first rate the board refuses, that does not come up, or
+// that loses more than `give_up` of the burst. each step's loss implies a
+// bit-error rate and its probe round trip a turnaround time; the (rate,
+// payload) a windowed transfer should get the most image bytes a second
+// through wins (see link_goodput)
+struct tune_opts {
+  std::vector<int> rates = {1000000, 1500000, 2000000, 3000000,
+                            4000000, 6000000, 8000000, 12000000};
+  int max_baud = 12000000; // never propose more (what the host's adapter can do)
+  int burst = 32;          // test frames per step
+  double give_up = 0.5;    // burst loss that ends the climb
+  uint16_t window = 16;    // frames the transfer will keep in flight (xfer_opts)
+  size_t rx_chunk = 2048;  // bytes the board takes per receive (bl_update.c's RXSZ):
+                           // a frame is acked only once that much has arrived
+};
+
+struct tune_step {
+  int baud = 0;
+  bool up = false;        // both ends came up on it
+  int sent = 0;           // test frames
+  int got = 0;            //   the board counted intact
+  double ber = 0.0;       // bit-error rate that loss implies
+  double rtt_s = 0.0;     // request -> answer of a probe report
+};
+
+struct tune_result {
+  int baud = 0;           // where both ends are now
+  uint16_t chunk = 0;     // DATA payload size the board now expects
+  double rate = 0.0;      // image bytes/s predicted there
+  std::vector<tune_step> steps;
+};
+
+// run the search on a board that just answered HELLO (v7 or later) with the
+// tty at `baud`, and settle both ends on the winner. false if the board stopped
+// answering (the tty is left at the last rate it answered on, in r.baud)
+bool autotune(int fd, int baud, const tune_opts &o, tune_result &r);
+
+// image bytes a second a windowed transfer of `chunk`-byte DATA frames should
+// get through on the line `st` measured: frames go out at the line rate or as
+// fast as acks let the window move, whichever is slower, and each frame lost
+// (each data bit flips with probability st.ber) holds the window for a round
+// trip until it is resent
+double link_goodput(const tune_step &st, uint16_t chunk, const tune_opts &o);
+
+struct xfer_opts {
+  bool windowed = true;   // BL_MANIFEST_F_WINDOWED (needs a v2 receiver)
+  uint16_t window = 16;   // frames in flight (capped by the receiver's, per ack)
+  uint16_t chunk = BL_MAX_PAYLOAD;
+  int baud = 2000000;     // line rate, sizes the retransmit timeout
+  int result_ms = 4000;   // how long to wait for RESULT after DONE
+  bool resume = false;    // BL_MANIFEST_F_RESUME: start where the receiver's log
+                          // says (see query_resume), not at byte zero
+  int stall_ms = 5000;    // windowed: no ack for this long, the link is gone
+  const encoded_image *pre = nullptr; // DATA already encoded for this image
+                                      // (used when its chunk matches)
+  std::atomic<size_t> *progress = nullptr; // DATA bytes sent so far, for a
+                                           // watcher in another thread
+  std::function<void(const bl_frame &)> on_channel; // the board's log/telemetry
+                                                    // frames meanwhile (v10)
+};
+
+struct xfer_stats {
+  size_t frames = 0;      // DATA frames written, resends included
+  size_t resent = 0;      // how many of those were resends
+  size_t naks = 0;        // BL_ERR_SEQ naks received
+  size_t acks = 0;
+  size_t bytes = 0;       // DATA payload bytes written, resends included
+  size_t start = 0;       // image bytes the receiver already had (resumed)
+  size_t wire = 0;        // bytes written MANIFEST..last DATA, framing included
+  bool windowed = false;  // what actually ran (falls back to legacy)
+  double stream_s = 0.0;  // MANIFEST..DONE
+  double verify_s = 0.0;  // DONE..RESULT (the receiver's read-back)
+  bool have_result = false;
+  bl_result result{};
+};
+
+// send MANIFEST, stream `len` bytes as DATA, then DONE and wait for RESULT.
+// windowed mode keeps opts.window frames in flight and resends only what the
+// receiver naks or never acks; legacy mode blasts everything and learns at DONE.
+// returns true if a RESULT came back with BL_OK (false without a RESULT if the
+// link stalled)
+bool send_image(int fd, bl_manifest m, const uint8_t *data, size_t len, const xfer_opts &o,
+                xfer_stats &st);
+
+#endif // FW_UPDATE_LINK_H
@@ -0,0 +1,128 @@
+// see lz_enc.h
+
+#include "lz_enc.h"
+
+#include <algorithm>
+
+#include "bootloader/lz.h"
+
+namespace {
+
+constexpr size_t HASH_BITS = 16;
+constexpr int CHAIN_DEPTH = 128;
+constexpr size_t MF_LIMIT = 12;     // LZ4: no match starts in the last 12 bytes
+constexpr size_t LAST_LITERALS = 5; // LZ4: the last 5 bytes are literals
+
+uint32_t hash4(const uint8_t *p) {
+  uint32_t v = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+void put_len(std::vector<uint8_t> &out, size_t n) {
+  while (n >= 255U) {
+    out.push_back(255U);
+    n -= 255U;
+  }
+  out.push_back(static_cast<uint8_t>(n));
+}
+
+// one sequence: literals [lit, lit + nlit), then a match (mlen 0 = the last)
+void put_seq(std::vector<uint8_t> &out, const uint8_t *lit, size_t nlit, size_t off, size_t mlen) {
+  size_t ml = (mlen != 0U) ? mlen - BL_LZ_MIN_MATCH : 0U;
+  out.push_back(static_cast<uint8_t>((std::min<size_t>(nlit, 15U) << 4) | std::min<size_t>(ml, 15U)));
+  if (nlit >= 15U) {
+    put_len(out, nlit - 15U);
+  }
+  out.insert(out.end(), lit, lit + nlit);
+  if (mlen == 0U) {
+    return;
+  }
+  out.push_back(static_cast<uint8_t>(off));
+  out.push_back(static_cast<uint8_t>(off >> 8));
+  if (ml >= 15U) {
+    put_len(out, ml - 15U);
+  }
+}
+
+struct matcher {
+  const uint8_t *p;
+  size_t n;
+  std::vector<int64_t> head;
+  std::vector<int64_t> prev; // by position within the window
+
+  matcher(const uint8_t *data, size_t len)
+      : p(data), n(len), head(size_t{1} << HASH_BITS, -1), prev(BL_LZ_WINDOW, -1) {}
+
+  void insert(size_t i) {
+    uint32_t h = hash4(p + i);
+    prev[i & (BL_LZ_WINDOW - 1U)] = head[h];
+    head[h] = static_cast<int64_t>(i);
+  }
+
+  // longest match for position i ending by `end`; length 0 if none
+  size_t find(size_t i, size_t end, size_t &off) const {
+    size_t best = 0;
+    int64_t c = head[hash4(p + i)];
+    for (int d = 0; d < CHAIN_DEPTH && c >= 0; d++) {
+      size_t cand = static_cast<size_t>(c);
+      if (i - cand > BL_LZ_WINDOW) {
+        break;
+      }
+      size_t l = 0;
+      while (i + l < end && p[cand + l] == p[i + l]) {
+        l++;
+      }
+      if (l > best) {
+        best = l;
+        off = i - cand;
+      }
+      c = prev[cand & (BL_LZ_WINDOW - 1U)];
+    }
+    return (best >= BL_LZ_MIN_MATCH) ? best : 0U;
+  }
+};
+
+} // namespace
+
+std::vector<uint8_t> lz_compress(const std::vector<uint8_t> &in) {
+  std::vector<uint8_t> out;
+  const size_t n = in.size();
+  const uint8_t *p = in.data();
+  matcher m(p, n);
+  size_t anchor = 0;
+  if (n > MF_LIMIT) {
+    const size_t end = n - LAST_LITERALS;
+    size_t hashed = 0; // positions below this are in the chains
+    auto find = [&](size_t at, size_t &off) {
+      while (hashed < at) {
+        m.insert(hashed++);
+      }
+      return m.find(at, end, off);
+    };
+    size_t i = 0;
+    while (i + MF_LIMIT <= n) {
+      size_t off = 0;
+      size_t len = find(i, off);
+      if (len == 0U) {
+        i++;
+        continue;
+      }
+      // lazy: a longer match one byte on is worth a literal
+      size_t off2 = 0;
+      if (i + 1U + MF_LIMIT <= n) {
+        size_t len2 = find(i + 1U, off2);
+        if (len2 > len + 1U) {
+          i++;
+          len = len2;
+          off = off2;
+        }
+      }
+      put_seq(out, p + anchor, i - anchor, off, len);
+      i += len;
+      anchor = i;
+    }
+  }
+  put_seq(out, p + anchor, n - anchor, 0, 0);
+  return out;
+}
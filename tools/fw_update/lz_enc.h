@@ -0,0 +1,15 @@
+// host side of the compressed transport: compress an image blob into the
+// small-window LZ4 block bootloader/lz.h decodes (every match offset within
+// BL_LZ_WINDOW). hash chains with one step of lazy matching - compression runs
+// once, in mkupdate, so it can afford to look harder than LZ4's fast mode. the
+// output also follows LZ4's end-of-block rules, so stock decoders read it.
+
+#ifndef FW_UPDATE_LZ_ENC_H
+#define FW_UPDATE_LZ_ENC_H
+
+#include <cstdint>
+#include <vector>
+
+std::vector<uint8_t> lz_compress(const std::vector<uint8_t> &in);
+
+#endif // FW_UPDATE_LZ_ENC_H
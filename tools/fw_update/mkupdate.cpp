@@ -2,10 +2,29 @@
 // validate and XIP-boot. output layout matches the QSPI slot:
 //   [bl_image_header][pad to BL_IMAGE_OFFSET][app image]
 // the header carries the app length + crc32 so the bootloader can verify the
-// stored image independently of the transfer. update.bin --file sends this blob.
+// stored image independently of the transfer, and the pad a crc32 per block so
+// it can stop at the first bad one. update.bin --file sends this blob.
+//
+// --delta also writes a patch (bootloader/delta.h) from the blob installed on
+// the board - the .smup it was last updated with - to the new one. a rebuild
+// usually differs in a few percent of its bytes, so sending the patch with
+// update.bin --file <out.smdl> cuts the time on the wire accordingly.
+//
+// --lz also writes the blob compressed (bootloader/lz.h) for when there is no
+// installed image to diff against: code and bitstreams shrink by a third to
+// two thirds, and the bootloader decompresses as the frames arrive.
+//
+// --bundle puts files it wrote before - say the app's .smup and the FPGA's
+// bitstream .smup - into one bundle (bundle.h) that update.bin sends in one
+// session, with one handshake, and the board commits only once every part has
+// verified. the parts are reordered so the app goes first: its slot is not in
+// use until the commit, while the bitstream is written in place.
 //
 // usage: ./mkupdate.bin <app.bin> <out.smup> [APM|GW2AR18|GW5A25]
+//                       [--delta <installed.smup> <out.smdl>] [--lz <out.smlz>]
+//        ./mkupdate.bin --bundle <out.smbn> <part.smup|.smdl|.smlz>...
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
@@ -17,25 +36,178 @@
 #include "bootloader/protocol.h" // enum bl_target
 #include "bootloader/image.h"    // bl_image_header, BL_IMAGE_MAGIC, BL_IMAGE_OFFSET
 #include "bootloader/crc32.h"
+#include "bootloader/delta.h"    // bl_delta_header, BL_DELTA_MAGIC
+#include "bootloader/lz.h"       // bl_lz_header, BL_LZ_MAGIC
+
+#include "bundle.h"
+#include "delta_enc.h"
+#include "lz_enc.h"
+
+static bool read_file(const char *path, std::vector<uint8_t> &out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "open %s failed\n", path);
+    return false;
+  }
+  out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+static bool write_file(const char *path, const std::vector<uint8_t> &data) {
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(data.data()),
+            static_cast<std::streamsize>(data.size()));
+  if (!out) {
+    fprintf(stderr, "write %s failed\n", path);
+    return false;
+  }
+  return true;
+}
+
+// patch file: bl_delta_header, then the op stream from `base` to `blob`
+static int write_delta(const char *base_path, const char *out_path,
+                       const std::vector<uint8_t> &blob, const bl_image_header &h) {
+  std::vector<uint8_t> base;
+  if (!read_file(base_path, base)) {
+    return 1;
+  }
+  bl_image_header bh;
+  if (base.size() < sizeof(bh)) {
+    fprintf(stderr, "%s: not an image blob\n", base_path);
+    return 1;
+  }
+  memcpy(&bh, base.data(), sizeof(bh));
+  if (bh.magic != BL_IMAGE_MAGIC || bh.target != h.target ||
+      base.size() != BL_IMAGE_OFFSET + bh.length) {
+    fprintf(stderr, "%s: not an image blob for target %u\n", base_path, h.target);
+    return 1;
+  }
+
+  std::vector<uint8_t> ops = delta_encode(base, blob);
+  bl_delta_header dh{};
+  dh.magic = BL_DELTA_MAGIC;
+  dh.target = h.target;
+  dh.flags = 0;
+  dh.version = h.version;
+  dh.base_length = static_cast<uint32_t>(base.size());
+  dh.base_crc32 = bl_crc32(base.data(), base.size());
+  dh.image_length = static_cast<uint32_t>(blob.size());
+  dh.image_crc32 = bl_crc32(blob.data(), blob.size());
+
+  std::vector<uint8_t> file(sizeof(dh));
+  memcpy(file.data(), &dh, sizeof(dh));
+  file.insert(file.end(), ops.begin(), ops.end());
+  if (!write_file(out_path, file)) {
+    return 1;
+  }
+  printf("wrote %s: patch %zu bytes from base crc 0x%08X (%.1f%% of the blob)\n", out_path,
+         ops.size(), dh.base_crc32, 100.0 * static_cast<double>(ops.size()) / blob.size());
+  return 0;
+}
+
+// compressed file: bl_lz_header, then the block
+static int write_lz(const char *out_path, const std::vector<uint8_t> &blob,
+                    const bl_image_header &h) {
+  std::vector<uint8_t> block = lz_compress(blob);
+  bl_lz_header zh{};
+  zh.magic = BL_LZ_MAGIC;
+  zh.target = h.target;
+  zh.flags = 0;
+  zh.version = h.version;
+  zh.image_length = static_cast<uint32_t>(blob.size());
+  zh.image_crc32 = bl_crc32(blob.data(), blob.size());
+
+  std::vector<uint8_t> file(sizeof(zh));
+  memcpy(file.data(), &zh, sizeof(zh));
+  file.insert(file.end(), block.begin(), block.end());
+  if (!write_file(out_path, file)) {
+    return 1;
+  }
+  printf("wrote %s: compressed %zu bytes (%.1f%% of the blob)\n", out_path, block.size(),
+         100.0 * static_cast<double>(block.size()) / blob.size());
+  return 0;
+}
+
+// bundle file: the parts at `paths`, A/B ones first (bundle.h)
+static int write_bundle(const char *out_path, const std::vector<const char *> &paths) {
+  std::vector<std::vector<uint8_t>> files(paths.size());
+  std::vector<update_part> parts(paths.size());
+  std::vector<size_t> order(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    std::string why;
+    if (!read_file(paths[i], files[i])) {
+      return 1;
+    }
+    if (!load_part(files[i], parts[i], &why)) {
+      fprintf(stderr, "%s: %s\n", paths[i], why.c_str());
+      return 1;
+    }
+    order[i] = i;
+  }
+  std::stable_partition(order.begin(), order.end(),
+                        [&parts](size_t i) { return !in_place(parts[i].m.target); });
+  std::vector<std::vector<uint8_t>> sorted;
+  for (size_t i : order) {
+    sorted.push_back(files[i]);
+  }
+
+  std::vector<uint8_t> bundle;
+  std::string why;
+  if (!build_bundle(sorted, bundle, &why)) {
+    fprintf(stderr, "%s: %s\n", out_path, why.c_str());
+    return 1;
+  }
+  if (!write_file(out_path, bundle)) {
+    return 1;
+  }
+  printf("wrote %s: %zu parts, %zu bytes\n", out_path, order.size(), bundle.size());
+  for (size_t i : order) {
+    printf("  %s: target %u, %u bytes on the wire\n", paths[i], parts[i].m.target,
+           parts[i].m.length);
+  }
+  return 0;
+}
 
 int main(int argc, char **argv) {
-  if (argc < 3) {
-    fprintf(stderr, "usage: %s <app.bin> <out.smup> [APM|GW2AR18|GW5A25]\n",
-            argv[0]);
+  if (argc >= 2 && strcmp(argv[1], "--bundle") == 0) {
+    if (argc < 5) {
+      fprintf(stderr, "usage: %s --bundle <out.smbn> <part.smup|.smdl|.smlz>...\n", argv[0]);
+      return 2;
+    }
+    return write_bundle(argv[2], std::vector<const char *>(argv + 3, argv + argc));
+  }
+
+  const char *delta_base = nullptr;
+  const char *delta_out = nullptr;
+  const char *lz_out = nullptr;
+  std::vector<const char *> pos;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--delta") == 0 && i + 2 < argc) {
+      delta_base = argv[++i];
+      delta_out = argv[++i];
+    } else if (strcmp(argv[i], "--lz") == 0 && i + 1 < argc) {
+      lz_out = argv[++i];
+    } else {
+      pos.push_back(argv[i]);
+    }
+  }
+  if (pos.size() < 2U) {
+    fprintf(stderr,
+            "usage: %s <app.bin> <out.smup> [APM|GW2AR18|GW5A25]"
+            " [--delta <installed.smup> <out.smdl>] [--lz <out.smlz>]\n"
+            "       %s --bundle <out.smbn> <part.smup|.smdl|.smlz>...\n",
+            argv[0], argv[0]);
     return 2;
   }
 
-  std::ifstream in(argv[1], std::ios::binary);
-  if (!in) {
-    fprintf(stderr, "open %s failed\n", argv[1]);
+  std::vector<uint8_t> app;
+  if (!read_file(pos[0], app)) {
     return 1;
   }
-  std::vector<uint8_t> app((std::istreambuf_iterator<char>(in)),
-                           std::istreambuf_iterator<char>());
 
   uint16_t target = BL_TARGET_APM_H755;
-  if (argc >= 4) {
-    std::string t = argv[3];
+  if (pos.size() >= 3U) {
+    std::string t = pos[2];
     if (t == "GW2AR18") {
       target = BL_TARGET_FPGA_GW2AR18;
     } else if (t == "GW5A25") {
@@ -53,22 +225,24 @@ int main(int argc, char **argv) {
   h.header_crc32 = 0;
   h.header_crc32 = bl_crc32(&h, sizeof(h)); // over the header with the field zeroed
 
-  // blob: header at 0, app at BL_IMAGE_OFFSET, gap zero-filled
+  // blob: header at 0, app at BL_IMAGE_OFFSET, gap zero-filled but for the
+  // block crc table (image.h), which also sets the flags and the header crc
   std::vector<uint8_t> blob(BL_IMAGE_OFFSET + app.size(), 0);
   memcpy(blob.data(), &h, sizeof(h));
   memcpy(blob.data() + BL_IMAGE_OFFSET, app.data(), app.size());
+  bl_image_add_blocks(blob.data());
+  memcpy(&h, blob.data(), sizeof(h));
 
-  std::ofstream out(argv[2], std::ios::binary);
-  out.write(reinterpret_cast<const char *>(blob.data()),
-            static_cast<std::streamsize>(blob.size()));
-  if (!out) {
-    fprintf(stderr, "write %s failed\n", argv[2]);
+  if (!write_file(pos[1], blob)) {
     return 1;
   }
 
   printf("wrote %s: image %zu bytes @ +0x%X, blob %zu bytes, target %u, "
-         "image crc 0x%08X\n",
-         argv[2], app.size(), BL_IMAGE_OFFSET, blob.size(), target,
-         h.image_crc32);
-  return 0;
+         "image crc 0x%08X, %u-byte blocks\n",
+         pos[1], app.size(), BL_IMAGE_OFFSET, blob.size(), target,
+         h.image_crc32, 1U << BL_IMAGE_BLOCK_LOG(h.flags));
+  if (delta_base != nullptr && write_delta(delta_base, delta_out, blob, h) != 0) {
+    return 1;
+  }
+  return (lz_out != nullptr) ? write_lz(lz_out, blob, h) : 0;
 }
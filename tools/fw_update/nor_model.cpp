@@ -0,0 +1,120 @@
+// see nor_model.h
+
+#include "nor_model.h"
+
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using clk = std::chrono::steady_clock;
+
+namespace {
+
+bool busy_now(const nor_model &m) { return clk::now() < m.busy_until; }
+
+void go_busy(nor_model &m, double s) {
+  m.st.busy_s += s;
+  m.busy_until = clk::now() + std::chrono::duration_cast<clk::duration>(
+                                  std::chrono::duration<double>(s / m.t.scale));
+}
+
+int nor_erase(void *ctx, uint32_t off, uint32_t size) {
+  nor_model &m = *static_cast<nor_model *>(ctx);
+  if (busy_now(m) || (size != BL_NOR_SECTOR && size != BL_NOR_BLOCK) || off % size != 0U ||
+      off + size > m.size) {
+    m.st.misuse++;
+    return -1;
+  }
+  memset(m.mem + off, 0xFF, size);
+  if (size == BL_NOR_SECTOR) {
+    m.st.erases_4k++;
+    go_busy(m, m.t.erase_4k_s);
+  } else {
+    m.st.erases_64k++;
+    go_busy(m, m.t.erase_64k_s);
+  }
+  return 0;
+}
+
+int nor_program(void *ctx, uint32_t off, const uint8_t *p, uint32_t n) {
+  nor_model &m = *static_cast<nor_model *>(ctx);
+  if (busy_now(m) || n == 0U || n > BL_NOR_PAGE || off / BL_NOR_PAGE != (off + n - 1U) / BL_NOR_PAGE ||
+      off + n > m.size) {
+    m.st.misuse++;
+    return -1;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t cur = m.mem[off + i];
+    if ((p[i] & cur) != p[i]) {
+      m.st.misuse++; // needs a 0->1 flip: not erased
+    }
+    uint8_t v = cur & p[i];
+    if (static_cast<long>(off + i) == m.stuck_off) {
+      v &= static_cast<uint8_t>(~m.stuck_mask);
+    }
+    m.mem[off + i] = v;
+  }
+  m.st.pages++;
+  go_busy(m, m.t.page_s);
+  return 0;
+}
+
+int nor_busy(void *ctx) { return busy_now(*static_cast<nor_model *>(ctx)) ? 1 : 0; }
+
+int nor_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  nor_model &m = *static_cast<nor_model *>(ctx);
+  if (off + n > m.size) {
+    return -1;
+  }
+  // a read has to wait out a running erase/program, like the real part
+  std::this_thread::sleep_until(m.busy_until);
+  memcpy(p, m.mem + off, n);
+  m.st.bytes_read += n;
+  return 0;
+}
+
+} // namespace
+
+bool nor_model::open(const std::string &path, size_t sz, const nor_timing &tm) {
+  close();
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat sb;
+  bool fresh = fstat(fd, &sb) == 0 && static_cast<size_t>(sb.st_size) < sz;
+  if (ftruncate(fd, static_cast<off_t>(sz)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  mem = static_cast<uint8_t *>(p);
+  size = sz;
+  if (fresh) {
+    memset(mem, 0xFF, sz); // a new part ships erased
+  }
+  t = tm;
+  st = nor_stats{};
+  busy_until = clk::now();
+  ops.ctx = this;
+  ops.erase = nor_erase;
+  ops.program = nor_program;
+  ops.busy = nor_busy;
+  ops.read = nor_read;
+  return true;
+}
+
+void nor_model::close() {
+  if (mem != nullptr) {
+    munmap(mem, size);
+    mem = nullptr;
+  }
+}
@@ -0,0 +1,52 @@
+// file-backed model of a W25Q-class NOR flash for host tests: the whole part is
+// a file (mmap'd, so it survives the process and can be inspected), erase sets
+// bytes to 0xFF, program can only clear bits, and erase/program keep the part
+// busy for the datasheet time (scaled) so code that overlaps flash work with
+// reception sees realistic gaps. exposed to the bootloader code as a bl_nor.
+
+#ifndef FW_UPDATE_NOR_MODEL_H
+#define FW_UPDATE_NOR_MODEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bootloader/flash_stream.h"
+
+// W25Q128JV typical timings
+struct nor_timing {
+  double erase_4k_s = 0.045;
+  double erase_64k_s = 0.150;
+  double page_s = 0.0004;
+  double scale = 1.0; // divide every latency by this (speed the sim up)
+};
+
+struct nor_stats {
+  size_t erases_4k = 0;
+  size_t erases_64k = 0;
+  size_t pages = 0;
+  size_t bytes_read = 0;
+  double busy_s = 0.0;   // total modelled busy time (unscaled)
+  size_t misuse = 0;     // command while busy, page overrun, program of 0 bits
+};
+
+struct nor_model {
+  bl_nor ops{};
+  uint8_t *mem = nullptr;
+  size_t size = 0;
+  nor_timing t;
+  nor_stats st;
+  std::chrono::steady_clock::time_point busy_until{};
+  // fault injection: programming the byte at this offset sticks `stuck_mask`
+  // bits at 0 (-1 = off)
+  long stuck_off = -1;
+  uint8_t stuck_mask = 0;
+
+  // map `path` as a `size` byte part (created erased if new). false on error
+  bool open(const std::string &path, size_t size, const nor_timing &t = nor_timing{});
+  void close();
+  ~nor_model() { close(); }
+};
+
+#endif // FW_UPDATE_NOR_MODEL_H
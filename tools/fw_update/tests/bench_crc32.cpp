@@ -0,0 +1,84 @@
+// host benchmark: crc32 throughput over 1MB and 16MB buffers. compares the
+// shipped slicing-by-8 bl_crc32 against the old one-table byte loop, and the
+// per-byte bl_crc32_update call pattern the frame parser used to have.
+//
+//   make bench
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+
+namespace {
+
+uint32_t table[256];
+
+void build_table() {
+  for (uint32_t i = 0; i < 256U; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1U) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+    }
+    table[i] = c;
+  }
+}
+
+// the previous implementation: one dependent lookup per byte
+uint32_t crc32_bytewise(const uint8_t *p, size_t n) {
+  uint32_t c = 0xFFFFFFFFU;
+  for (size_t i = 0; i < n; i++) {
+    c = table[(c ^ p[i]) & 0xFFU] ^ (c >> 8);
+  }
+  return c ^ 0xFFFFFFFFU;
+}
+
+// how bl_frame_feed used to drive it: a call per received byte
+uint32_t crc32_per_call(const uint8_t *p, size_t n) {
+  uint32_t c = BL_CRC32_INIT;
+  for (size_t i = 0; i < n; i++) {
+    c = bl_crc32_update(c, p + i, 1);
+  }
+  return bl_crc32_final(c);
+}
+
+template <typename F>
+double mbps(F fn, const std::vector<uint8_t> &buf, uint32_t &out) {
+  // repeat until ~0.3s of work so 1MB runs are not all timer noise
+  auto t0 = std::chrono::steady_clock::now();
+  size_t done = 0;
+  double dt = 0.0;
+  do {
+    out = fn(buf.data(), buf.size());
+    done += buf.size();
+    dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (dt < 0.3);
+  return static_cast<double>(done) / (1024.0 * 1024.0) / dt;
+}
+
+} // namespace
+
+int main() {
+  build_table();
+  std::mt19937 rng(0xACE1u);
+
+  printf("%-6s  %-14s  %-14s  %-14s\n", "size", "slicing-by-8", "bytewise", "per-byte call");
+  int rc = 0;
+  for (size_t mb : {1, 16}) {
+    std::vector<uint8_t> buf(mb * 1024 * 1024);
+    for (auto &b : buf) {
+      b = static_cast<uint8_t>(rng());
+    }
+    uint32_t a, b, c;
+    double s8 = mbps([](const uint8_t *p, size_t n) { return bl_crc32(p, n); }, buf, a);
+    double bw = mbps(crc32_bytewise, buf, b);
+    double pc = mbps(crc32_per_call, buf, c);
+    printf("%3zuMB   %8.0f MB/s   %8.0f MB/s   %8.0f MB/s\n", mb, s8, bw, pc);
+    if (a != b || a != c) {
+      printf("  crc mismatch: %08X %08X %08X\n", a, b, c);
+      rc = 1;
+    }
+  }
+  return rc;
+}
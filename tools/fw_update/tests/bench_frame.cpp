@@ -0,0 +1,125 @@
+// host benchmark: receive-path throughput of the frame parser on a 1MB update
+// stream, the way the bootloader consumes it (2KB DMA chunks, payload into the
+// image buffer):
+//   per-byte : bl_frame_feed per byte, then memcpy payload -> image (old path)
+//   span+sink: bl_frame_feed_buf per chunk, payload written straight to the image
+//
+//   make bench                         (synthesized stream, as update.bin sends it)
+//   ./tests/bench_frame.bin <capture>  (a recorded raw UART capture instead)
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/frame.h"
+
+namespace {
+
+constexpr size_t IMAGE = 1024U * 1024U;
+constexpr size_t DMA_CHUNK = 2048U; // RXSZ in bl_update.c
+
+std::vector<uint8_t> img(IMAGE + BL_MAX_PAYLOAD);
+size_t placed = 0;
+
+uint8_t *sink(void *ctx, const bl_frame *hdr) {
+  (void)ctx;
+  return (hdr->type == BL_DATA) ? img.data() + placed : nullptr;
+}
+
+// returns bytes of DATA payload delivered
+size_t run_bytes(const std::vector<uint8_t> &s) {
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  placed = 0;
+  for (size_t off = 0; off < s.size(); off += DMA_CHUNK) {
+    size_t n = std::min(DMA_CHUNK, s.size() - off);
+    for (size_t i = 0; i < n; i++) {
+      if (bl_frame_feed(&rx, s[off + i]) == BL_FRAME_OK && rx.frame.type == BL_DATA) {
+        memcpy(img.data() + placed, rx.frame.payload, rx.frame.len);
+        placed += rx.frame.len;
+      }
+    }
+  }
+  return placed;
+}
+
+size_t run_spans(const std::vector<uint8_t> &s) {
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  bl_frame_rx_set_sink(&rx, sink, nullptr);
+  placed = 0;
+  for (size_t off = 0; off < s.size(); off += DMA_CHUNK) {
+    size_t n = std::min(DMA_CHUNK, s.size() - off);
+    size_t i = 0;
+    while (i < n) {
+      int st;
+      i += bl_frame_feed_buf(&rx, s.data() + off + i, n - i, &st);
+      if (st == BL_FRAME_OK && rx.frame.type == BL_DATA) {
+        placed += rx.frame.len;
+      }
+    }
+  }
+  return placed;
+}
+
+template <typename F>
+double mbps(F fn, const std::vector<uint8_t> &s, size_t &got) {
+  auto t0 = std::chrono::steady_clock::now();
+  size_t done = 0;
+  double dt = 0.0;
+  do {
+    got = fn(s);
+    done += s.size();
+    dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  } while (dt < 0.5);
+  return static_cast<double>(done) / (1024.0 * 1024.0) / dt;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> s;
+  if (argc > 1) {
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+      fprintf(stderr, "open %s failed\n", argv[1]);
+      return 1;
+    }
+    s.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  } else {
+    // HELLO, MANIFEST, 1MB of DATA, DONE - byte-for-byte what update.bin sends
+    std::mt19937 rng(0xACE1u);
+    std::vector<uint8_t> data(IMAGE);
+    for (auto &b : data) {
+      b = static_cast<uint8_t>(rng());
+    }
+    uint8_t fr[8U + BL_MAX_PAYLOAD + 4U];
+    bl_manifest m{};
+    m.magic = BL_MANIFEST_MAGIC;
+    m.length = IMAGE;
+    m.crc32 = bl_crc32(data.data(), data.size());
+    size_t n = bl_frame_encode(BL_MANIFEST, 0, &m, sizeof(m), fr, sizeof(fr));
+    s.insert(s.end(), fr, fr + n);
+    for (size_t off = 0; off < IMAGE; off += BL_MAX_PAYLOAD) {
+      n = bl_frame_encode(BL_DATA, static_cast<uint16_t>(off / BL_MAX_PAYLOAD), &data[off],
+                          BL_MAX_PAYLOAD, fr, sizeof(fr));
+      s.insert(s.end(), fr, fr + n);
+    }
+    n = bl_frame_encode(BL_DONE, 0, nullptr, 0, fr, sizeof(fr));
+    s.insert(s.end(), fr, fr + n);
+  }
+
+  size_t a = 0, b = 0;
+  double byte_rate = mbps(run_bytes, s, a);
+  double span_rate = mbps(run_spans, s, b);
+  printf("frame parser, %zu byte stream in %zu byte chunks\n", s.size(), DMA_CHUNK);
+  printf("  per-byte  : %7.0f MB/s  (%zu payload bytes)\n", byte_rate, a);
+  printf("  span+sink : %7.0f MB/s  (%zu payload bytes)  x%.1f\n", span_rate, b,
+         span_rate / byte_rate);
+  return (a == b) ? 0 : 1;
+}
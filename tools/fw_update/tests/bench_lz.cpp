@@ -0,0 +1,202 @@
+// host benchmark for the compressed transport (mkupdate --lz):
+//   ratio : what lz_compress (lz_enc.cpp) makes of each input, and how fast the
+//           bootloader's decoder (lib/bootloader/src/lz.c) runs on the host,
+//           fed 1KB DATA payloads into 4KB of output room like the session
+//   1 Mbaud: end-to-end board time on the simulated board (sim_board.h) for
+//           the same input sent plain and compressed
+//
+// inputs are the stored APM app (apm_app.smup), a SYNTHETIC FPGA bitstream and
+// random bytes. no real bitstream is checked in; the synthetic one is a model
+// of a GW5A-25-sized configuration - frames of tile columns, most columns of a
+// partly used part empty, used ones drawn from a small set of LUT/routing
+// patterns with some bits changed, a crc and padding per frame - so treat its
+// ratio as an estimate. a real .fs/.bin can be given on the command line.
+//
+//   make bench                          (apm_app.smup + the synthetic models)
+//   ./tests/bench_lz.bin <bitstream>    (a real bitstream as well)
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/lz.h"
+#include "bootloader/protocol.h"
+
+#include "lz_enc.h"
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *APM_IMAGE = "apm_app.smup";
+constexpr const char *PART_FILE = "tests/bench_lz.nor.bin";
+
+struct input {
+  std::string name;
+  uint16_t target;
+  bytes data;
+};
+
+bytes read_file(const char *path) {
+  std::ifstream f(path, std::ios::binary);
+  return bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+// the synthetic bitstream: a preamble, then frames of 48 tile columns x 24
+// bytes. 45% of the columns are in use, each one of 24 base patterns with a
+// few bits changed; the rest are zero
+bytes synthetic_bitstream() {
+  constexpr size_t FRAMES = 620, COLS = 48, COL = 24;
+  std::mt19937 rng(0x6A5Au);
+  bytes pat[24];
+  for (bytes &p : pat) {
+    p.resize(COL);
+    for (auto &x : p) {
+      x = static_cast<uint8_t>(rng() & rng()); // config bits are mostly 0
+    }
+  }
+  bytes b(64, 0xFF); // preamble
+  for (size_t f = 0; f < FRAMES; f++) {
+    size_t start = b.size();
+    b.push_back(static_cast<uint8_t>(f));
+    b.push_back(static_cast<uint8_t>(f >> 8));
+    for (size_t c = 0; c < COLS; c++) {
+      if (rng() % 100U >= 45U) {
+        b.insert(b.end(), COL, 0);
+        continue;
+      }
+      bytes col = pat[rng() % 24U];
+      for (int k = 0; k < 3; k++) {
+        col[rng() % COL] ^= static_cast<uint8_t>(1U << (rng() % 8U));
+      }
+      b.insert(b.end(), col.begin(), col.end());
+    }
+    uint32_t crc = bl_crc32(b.data() + start, b.size() - start);
+    b.push_back(static_cast<uint8_t>(crc));
+    b.push_back(static_cast<uint8_t>(crc >> 8));
+    b.insert(b.end(), 6, 0xFF);
+  }
+  return b;
+}
+
+// decompress `block` the way the session does; false if it doesn't rebuild `img`
+bool decode(const bytes &block, const bytes &img, bytes &out) {
+  static bl_lz z;
+  bl_lz_init(&z, static_cast<uint32_t>(img.size()));
+  out.resize(img.size());
+  size_t in = 0, o = 0;
+  int st = BL_LZ_MORE;
+  while (st != BL_LZ_DONE && st != BL_LZ_BAD) {
+    size_t n = std::min<size_t>(BL_MAX_PAYLOAD, block.size() - in);
+    size_t cap = std::min<size_t>(4096U, out.size() - o);
+    size_t used, made;
+    st = bl_lz_run(&z, block.data() + in, n, &used, out.data() + o, cap, &made);
+    in += used;
+    o += made;
+    if (st == BL_LZ_MORE && in == block.size()) {
+      return false;
+    }
+  }
+  return st == BL_LZ_DONE && out == img;
+}
+
+double decode_mbps(const bytes &block, const bytes &img) {
+  bytes out;
+  auto t0 = clk::now();
+  size_t done = 0;
+  double dt = 0.0;
+  do {
+    decode(block, img, out);
+    done += img.size();
+    dt = std::chrono::duration<double>(clk::now() - t0).count();
+  } while (dt < 0.3);
+  return static_cast<double>(done) / (1024.0 * 1024.0) / dt;
+}
+
+bl_manifest manifest(const input &in, const bytes *block) {
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = in.target;
+  m.version = 1;
+  const bytes &wire = block ? *block : in.data;
+  m.length = static_cast<uint32_t>(wire.size());
+  m.crc32 = bl_crc32(wire.data(), wire.size());
+  if (block) {
+    m.flags = BL_MANIFEST_F_LZ;
+    m.image_length = static_cast<uint32_t>(in.data.size());
+    m.image_crc32 = bl_crc32(in.data.data(), in.data.size());
+  }
+  return m;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<input> inputs;
+  bytes apm = read_file(APM_IMAGE);
+  if (apm.empty()) {
+    printf("%s not found, skipping it\n", APM_IMAGE);
+  } else {
+    inputs.push_back({APM_IMAGE, BL_TARGET_APM_H755, apm});
+  }
+  for (int i = 1; i < argc; i++) {
+    bytes b = read_file(argv[i]);
+    if (b.empty()) {
+      fprintf(stderr, "%s: unreadable\n", argv[i]);
+      return 1;
+    }
+    inputs.push_back({argv[i], BL_TARGET_FPGA_GW5A25, b});
+  }
+  inputs.push_back({"bitstream (SYNTHETIC)", BL_TARGET_FPGA_GW5A25, synthetic_bitstream()});
+  inputs.push_back({"random 256K", BL_TARGET_FPGA_GW5A25, random_bytes(256U * 1024U, 0x5EEDu)});
+
+  int fails = 0;
+  std::vector<bytes> blocks;
+  printf("lz compression, %u-byte window\n", BL_LZ_WINDOW);
+  printf("%-24s %9s %9s %7s %9s %12s\n", "input", "size", "lz", "ratio", "encode", "host decode");
+  for (const input &in : inputs) {
+    auto t0 = clk::now();
+    bytes block = lz_compress(in.data);
+    double enc = std::chrono::duration<double>(clk::now() - t0).count();
+    bytes out;
+    bool ok = decode(block, in.data, out);
+    printf("%-24s %9zu %9zu %6.1f%% %7.0fms %7.0f MB/s%s\n", in.name.c_str(), in.data.size(),
+           block.size(), 100.0 * static_cast<double>(block.size()) /
+                             static_cast<double>(in.data.size()),
+           enc * 1000.0, decode_mbps(block, in.data), ok ? "" : "  <-- FAIL");
+    fails += ok ? 0 : 1;
+    blocks.push_back(block);
+  }
+
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    return 1;
+  }
+  printf("\nend to end at %d baud, simulated board (board time)\n", BOARD_BAUD);
+  printf("%-24s %9s %9s %8s\n", "input", "plain", "lz", "speedup");
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const input &in = inputs[i];
+    double secs[2];
+    for (int lz = 0; lz < 2; lz++) {
+      uint32_t slot = (in.target == BL_TARGET_APM_H755) ? app_update_off(nor) : FPGA_ACTIVE_OFF;
+      bl_manifest m = manifest(in, lz ? &blocks[i] : nullptr);
+      sim_result r = sim_transfer(nor, m, lz ? blocks[i] : in.data);
+      secs[lz] = r.secs;
+      bool ok = r.st.have_result && r.st.result.status == BL_OK &&
+                memcmp(nor.mem + slot, in.data.data(), in.data.size()) == 0;
+      if (!ok) {
+        printf("%-24s %s transfer failed\n", in.name.c_str(), lz ? "lz" : "plain");
+        fails++;
+      }
+    }
+    printf("%-24s %8.2fs %8.2fs %7.2fx\n", in.name.c_str(), secs[0], secs[1], secs[0] / secs[1]);
+  }
+  nor.close();
+  unlink(PART_FILE);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// host benchmark for boot staging (modules/bootloader/bl_stage.c): what copying
+// an app image out of its QSPI slot into the internal-flash exec region costs,
+// in board time, done the old way and through the pipeline
+// (bootloader/stage_pipe.h):
+//
+//   passes    : bl_image_validate's crc over the slot, then erase every sector,
+//               then program word by word from the memory-mapped slot (the CPU
+//               waits for each), then a crc pass over the flash copy
+//   pipelined : the real bl_stage_pipe_run over a simulated bank 2 and QSPI -
+//               one pass, the slot read and crc'd while the flash works
+//
+// time is simulated, not measured: the flash ops set when the bank is free
+// again, each busy poll costs a register read, a source read costs its QSPI
+// transfer plus the crc of what it hands over, and each program also pays for
+// crc'ing the previous word back. the QSPI rates are the memory-mapped dual
+// read at the APM's clock (HCLK 240 MHz / 32, mcuconf) and at prescaler 4; the
+// flash costs are ballpark H7 figures. the pipeline's copy is checked against
+// the image.
+//
+//   make bench   (or: ./tests/bench_stage.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/stage_pipe.h"
+
+namespace {
+
+using bytes = std::vector<uint8_t>;
+
+struct timing {
+  const char *name;
+  double qspi_byte;               // memory-mapped read, per byte
+  double crc_byte = 4.0 / 480e6;  // slicing-by-8, ~4 cycles a byte
+  double iflash_byte = 1.0 / 480e6;
+  double erase_s = 1.0;           // one 128KB sector
+  double word_s = 16e-6;          // one 256-bit flash word
+  double poll_s = 50e-9;          // a flash register access
+};
+
+struct sim {
+  timing tm;
+  double t = 0.0;
+  double free_at = 0.0;           // the bank is busy until then
+  double flash_s = 0.0;           // erase + program time, for the report
+  double qspi_s = 0.0;
+  bytes exec;
+};
+
+int sim_erase(void *ctx, uint32_t off) {
+  sim &s = *static_cast<sim *>(ctx);
+  memset(s.exec.data() + off, 0xFF, BL_IFLASH_SECTOR);
+  s.t += s.tm.poll_s;
+  s.free_at = s.t + s.tm.erase_s;
+  s.flash_s += s.tm.erase_s;
+  return 0;
+}
+
+int sim_program(void *ctx, uint32_t off, const uint8_t *w) {
+  sim &s = *static_cast<sim *>(ctx);
+  memcpy(s.exec.data() + off, w, BL_IFLASH_WORD);
+  s.t += BL_IFLASH_WORD * (s.tm.iflash_byte + s.tm.crc_byte) + 8.0 * s.tm.poll_s;
+  s.free_at = s.t + s.tm.word_s;
+  s.flash_s += s.tm.word_s;
+  return 0;
+}
+
+int sim_busy(void *ctx) {
+  sim &s = *static_cast<sim *>(ctx);
+  s.t += s.tm.poll_s;
+  return (s.t < s.free_at) ? 1 : 0;
+}
+
+struct source {
+  sim *s;
+  const uint8_t *img;
+};
+
+int sim_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  source &src = *static_cast<source *>(ctx);
+  memcpy(p, src.img + off, n);
+  double q = n * src.s->tm.qspi_byte;
+  src.s->t += q + n * src.s->tm.crc_byte;
+  src.s->qspi_s += q;
+  return 0;
+}
+
+// the three-pass staging, same costs
+double passes(const timing &tm, uint32_t len) {
+  double t = len * (tm.qspi_byte + tm.crc_byte);                     // validate
+  t += ((len + BL_IFLASH_SECTOR - 1U) / BL_IFLASH_SECTOR) * tm.erase_s; // erase
+  uint32_t words = (len + BL_IFLASH_WORD - 1U) / BL_IFLASH_WORD;
+  t += words * (BL_IFLASH_WORD * tm.qspi_byte + tm.word_s);         // program
+  t += len * (tm.iflash_byte + tm.crc_byte);                         // verify
+  return t;
+}
+
+} // namespace
+
+int main() {
+  const timing profiles[] = {
+    {"dual 7.5 MHz (APM)", 8.0 / (2.0 * 7.5e6)},
+    {"dual 60 MHz", 8.0 / (2.0 * 60e6)},
+  };
+  const uint32_t sizes[] = {64U * 1024U, 192U * 1024U, 512U * 1024U, 1024U * 1024U};
+
+  std::mt19937 rng(0x57A6u);
+  bytes img(1024U * 1024U);
+  for (auto &x : img) {
+    x = static_cast<uint8_t>(rng());
+  }
+  static bl_stage_pipe pipe;
+  bool ok = true;
+
+  printf("%-20s %7s %9s %9s %9s %9s %9s %8s\n", "qspi", "image", "passes", "pipelined",
+         "saved", "flash", "qspi", "w/o erase");
+  for (const timing &tm : profiles) {
+    for (uint32_t len : sizes) {
+      sim s;
+      s.tm = tm;
+      s.exec.assign(1024U * 1024U, 0x00);
+      source src{&s, img.data()};
+      bl_iflash fl = {&s, sim_erase, sim_program, sim_busy, s.exec.data()};
+      bl_stage_src so = {&src, sim_read};
+      uint32_t crc = bl_crc32(img.data(), len);
+      int rc = bl_stage_pipe_run(&pipe, &fl, &so, len, crc, nullptr, 0U);
+      bool good = rc == 0 && memcmp(s.exec.data(), img.data(), len) == 0;
+      ok = ok && good;
+
+      double old_s = passes(tm, len);
+      double erase_s = pipe.erases * tm.erase_s;
+      // the part the pipeline can shorten: everything but the erases
+      printf("%-20s %6uK %8.0fms %8.0fms %8.0fms %8.0fms %8.0fms %7.2fx%s\n", tm.name, len / 1024U,
+             old_s * 1e3, s.t * 1e3, (old_s - s.t) * 1e3, s.flash_s * 1e3, s.qspi_s * 1e3,
+             (old_s - erase_s) / (s.t - erase_s), good ? "" : "  BAD COPY");
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// the simulated board the host tests and benches transfer to: a pty pair
+// stands in for the USB-UART, update.bin's link code sends on the master side,
+// and a thread on the slave side runs the virtual board (vboard.h: the
+// bootloader's session code against a file-backed W25Q128 model, erase/program
+// latencies included, so flash work overlaps reception the way it does on the
+// board). transfers start at MANIFEST - the tests skip the HELLO.
+//
+// a board can be made to die mid-transfer (kill_at): it stops answering, as
+// after a reset, and the next sim_transfer on the same part is the board
+// booting again.
+//
+// time runs 4x fast: the line is paced at 4 Mbaud and every flash latency is
+// divided by 4, which is the 1 Mbaud board link with datasheet-typical flash
+// timings. sim_transfer() reports board time.
+
+#ifndef FW_UPDATE_TESTS_SIM_BOARD_H
+#define FW_UPDATE_TESTS_SIM_BOARD_H
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/boot_ptr.h"
+#include "bootloader/memmap.h"
+#include "bootloader/protocol.h"
+
+#include "link.h"
+#include "nor_model.h"
+#include "test_util.h"
+#include "vboard.h"
+
+constexpr int BOARD_BAUD = 1000000;
+constexpr double TIME_SCALE = 4.0;
+constexpr int SIM_BAUD = static_cast<int>(BOARD_BAUD * TIME_SCALE);
+constexpr size_t PART = 16U * 1024U * 1024U; // W25Q128
+
+// QSPI slots the session may target (device offsets, modules/bootloader/memmap.c)
+const uint32_t APP_0_OFF = qspi_off(BL_SLOT_APP_0);
+const uint32_t APP_1_OFF = qspi_off(BL_SLOT_APP_1);
+const uint32_t FPGA_ACTIVE_OFF = qspi_off(BL_SLOT_FPGA_ACTIVE);
+const uint32_t SLOT_SIZE = bl_memmap[BL_SLOT_APP_1].size;
+const uint32_t PARAMS_OFF = qspi_off(BL_SLOT_PARAMS);
+
+using clk = std::chrono::steady_clock;
+
+// the app slot the next update goes into on `nor`: the one its boot pointer
+// (bootloader/boot_ptr.h) does not name, slot 0 on a fresh part
+inline uint32_t app_update_off(nor_model &nor) {
+  bl_boot b;
+  bl_boot_open(&b, &nor.ops, PARAMS_OFF + BL_PARAMS_BOOT, PARAMS_OFF + BL_PARAMS_BOOT_2);
+  return qspi_off(static_cast<enum bl_slot>(BL_SLOT_APP_0 + bl_boot_update_slot(&b)));
+}
+
+// the file-backed part a test's board runs on, at board time like the rest
+inline bool open_part(nor_model &nor, const std::string &path) {
+  nor_timing tm;
+  tm.scale = TIME_SCALE;
+  if (!nor.open(path, PART, tm)) {
+    perror(path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// ---- simulated board (slave side of the pty) ----
+
+// a vboard at board time TIME_SCALE x fast, without the HELLO, that keeps
+// swallowing what the host sends after its session until stop
+struct board : vboard {
+  board() {
+    o.baud = BOARD_BAUD;
+    o.scale = TIME_SCALE;
+    o.handshake = false;
+  }
+
+  void serve() {
+    run();
+    drain();
+  }
+};
+
+struct sim_cfg {
+  double ber = 0.0;
+  double prepare_s = 0.0; // the board's prepare step (vboard_opts::prepare_s)
+  bool windowed = true;
+  long kill_at = -1;    // the board dies after this many bytes (vboard_opts::kill_at)
+  bool resume = false;  // ask where to resume (BL_RESUME) and continue there
+  int stall_ms = 5000;  // host: no ack for this long ends the attempt (board time)
+  const encoded_image *pre = nullptr; // DATA frames encoded up front (xfer_opts::pre)
+};
+
+struct sim_result {
+  xfer_stats st;
+  double secs = 0.0;   // board time, MANIFEST..RESULT
+  uint32_t offer = 0;  // resume offset the board reported
+};
+
+// one transfer of `wire` under manifest `m` to a freshly booted board on `nor`
+inline sim_result sim_transfer(nor_model &nor, const bl_manifest &m,
+                               const std::vector<uint8_t> &wire, const sim_cfg &c = sim_cfg{}) {
+  sim_result r;
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return r;
+  }
+  board b;
+  b.fd = slave;
+  b.o.ber = c.ber;
+  b.o.prepare_s = c.prepare_s;
+  b.o.kill_at = c.kill_at;
+  b.nor = &nor;
+  std::thread th([&b] { b.serve(); });
+
+  xfer_opts xo;
+  xo.windowed = c.windowed;
+  xo.baud = SIM_BAUD;
+  xo.result_ms = 2000;
+  xo.stall_ms = static_cast<int>(c.stall_ms / TIME_SCALE);
+  xo.pre = c.pre;
+  auto t0 = clk::now();
+  if (c.resume) {
+    xo.resume = query_resume(master, m, r.offer) && r.offer > 0U;
+  }
+  send_image(master, m, wire.data(), wire.size(), xo, r.st);
+  r.secs = std::chrono::duration<double>(clk::now() - t0).count() * TIME_SCALE;
+
+  b.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  return r;
+}
+
+#endif // FW_UPDATE_TESTS_SIM_BOARD_H
@@ -0,0 +1,178 @@
+// host test for link tuning (update.bin --autotune), on the simulated board
+// (sim_board.h) with its line made worse with speed: above a knee rate the
+// bit-error rate climbs by so many decades per doubling (vboard_opts). the
+// board checks the host's tty rate against its own, so both ends really have to
+// move together, and a rate that never comes up falls back on both sides.
+//
+// each line model runs the search from the board's boot rate, then sends an
+// app image at the point it settled on. printed per model: what each step
+// measured, the chosen baud and payload, and the transfer's rate against the
+// same image at the boot rate. fails unless every search ends with both ends
+// on the same rate, the choice suits the model (want_* below), the tuned
+// transfer is not (beyond timing noise) slower than the untuned one, and the
+// image arrives intact.
+//
+//   make test   (or: ./tests/test_autotune.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/protocol.h"
+
+#include "custom_baud.h"
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_autotune.nor.bin";
+constexpr size_t APP_LEN = 192U * 1024U;
+
+struct model {
+  const char *name;
+  double ber;
+  int knee;        // board baud, 0 = flat
+  double slope;
+  int max_baud;    // the board's ceiling
+  // what a sane search picks here
+  int want_baud;
+  bool small_chunk; // below BL_MAX_PAYLOAD
+};
+
+// board rates; the host speaks in TIME_SCALE times these (sim_board.h)
+int host(int board_baud) { return static_cast<int>(board_baud * TIME_SCALE); }
+
+struct outcome {
+  tune_result tr;
+  bool tuned = false;
+  int board_baud = 0;      // the board's line after the search
+  xfer_stats st;
+  double secs = 0.0;       // board time, MANIFEST..RESULT
+};
+
+// one bootloader entry: tune (or not), then send `img`
+outcome run(nor_model &nor, const model &md, const bl_manifest &m, const std::vector<uint8_t> &img,
+            bool tune) {
+  outcome out;
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    fails++;
+    return out;
+  }
+  board b;
+  b.fd = slave;
+  b.tty_fd = slave;
+  b.o.ber = md.ber;
+  b.o.knee_baud = md.knee;
+  b.o.slope = md.slope;
+  b.o.max_baud = md.max_baud;
+  b.nor = &nor;
+  serial_setup(master, static_cast<unsigned>(host(BOARD_BAUD)));
+  std::thread th([&b] { b.serve(); });
+
+  xfer_opts xo;
+  xo.baud = host(BOARD_BAUD);
+  xo.result_ms = 2000;
+  if (tune) {
+    tune_opts to;
+    for (int &r : to.rates) {
+      r = host(r);
+    }
+    to.max_baud = host(to.max_baud);
+    out.tuned = autotune(master, host(BOARD_BAUD), to, out.tr);
+    xo.baud = out.tr.baud;
+    xo.chunk = out.tr.chunk;
+  }
+  auto t0 = clk::now();
+  send_image(master, m, img.data(), img.size(), xo, out.st);
+  out.secs = std::chrono::duration<double>(clk::now() - t0).count() * TIME_SCALE;
+
+  b.stop = true;
+  th.join();
+  out.board_baud = b.rep.baud;
+  ::close(slave);
+  ::close(master);
+  return out;
+}
+
+void models() {
+  std::vector<uint8_t> img = blob(random_bytes(APP_LEN, 0x70E5u));
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    fails++;
+    return;
+  }
+
+  const model list[] = {
+    // clean up to the board's ceiling: the fastest rate it takes, full frames
+    {"clean, board tops at 7.5M", 0.0, 0, 0.0, 7500000, 6000000, false},
+    // 2M clean, 3M at ~6e-5: small frames would get through at 3M, but every
+    // loss holds the window for a round trip - full frames at 2M do better
+    {"knee at 2M, 3 dec/octave", 0.0, 2000000, 3.0, 7500000, 2000000, false},
+    // past 2M nothing gets through: 3M never comes up, both fall back
+    {"wall at 2M", 0.0, 2000000, 40.0, 7500000, 2000000, false},
+    // the same noise everywhere: climb as far as the board goes, small frames
+    {"flat 2e-5, board tops at 2M", 2e-5, 0, 0.0, 2000000, 2000000, true},
+  };
+
+  printf("autotune from %d baud, %zu KB app after it (board time)\n", BOARD_BAUD,
+         img.size() / 1024U);
+  printf("%-30s %-44s %9s %5s %10s %10s\n", "line", "steps (baud: test frames through)",
+         "settled", "chunk", "tuned", "untuned");
+  for (const model &md : list) {
+    uint32_t at = app_update_off(nor);
+    memset(nor.mem + at, 0xFF, SLOT_SIZE);
+    outcome base = run(nor, md, m, img, false);
+    at = app_update_off(nor);
+    memset(nor.mem + at, 0xFF, SLOT_SIZE);
+    outcome t = run(nor, md, m, img, true);
+
+    std::string steps;
+    for (const tune_step &st : t.tr.steps) {
+      char s[32];
+      snprintf(s, sizeof(s), "%s%g:%s", steps.empty() ? "" : " ", st.baud / TIME_SCALE / 1e6,
+               st.up ? std::to_string(st.got).c_str() : "-");
+      steps += s;
+    }
+    int settled = static_cast<int>(t.tr.baud / TIME_SCALE);
+    auto rate = [&](const outcome &o) {
+      return (o.secs > 0.0) ? static_cast<double>(img.size()) / 1024.0 / o.secs : 0.0;
+    };
+    printf("%-30s %-44s %8.1fM %5u %5.1f KB/s %5.1f KB/s\n", md.name, steps.c_str(),
+           settled / 1e6, t.tr.chunk, rate(t), rate(base));
+
+    CHECK(t.tuned);
+    CHECK(t.board_baud == settled); // both ends on the same rate
+    CHECK(settled == md.want_baud);
+    CHECK((t.tr.chunk < BL_MAX_PAYLOAD) == md.small_chunk);
+    CHECK(rate(t) >= 0.9 * rate(base));
+    CHECK(t.st.have_result && t.st.result.status == BL_OK);
+    CHECK(memcmp(nor.mem + at, img.data(), img.size()) == 0);
+    CHECK(base.st.have_result && base.st.result.status == BL_OK);
+  }
+
+  nor.close();
+  unlink(PART_FILE);
+}
+
+} // namespace
+
+int main() {
+  models();
+  printf("test_autotune: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,436 @@
+// host test for the A/B boot pointer (bootloader/boot_ptr.h): the update side
+// of modules/bootloader/bl_update.c (the image goes into the slot the pointer
+// does not name, then the pointer is flipped to it) and the boot cascade of
+// bl_main.c (confirm the slot whose app said it came up, count a try on an
+// unconfirmed slot, boot the active slot or the other one), over a mocked QSPI
+// part holding both app slots and the params slot, with the app's side of the
+// confirmation word (bootloader/confirm.h) in a mocked backup SRAM. staging is
+// stood in for by bl_image_validate - what matters here is which slot boots.
+//
+// first a boot sequence: a part from before the pointer, updates, an image whose
+// app never comes up and is given up after BL_BOOT_TRIES boots, an update
+// whose slot image goes bad. then power-on boots, which lose the app's word:
+// they spend no try, and the first reset that keeps the word confirms. then
+// the power is cut at every flash operation of
+// an update and the boots after it, in turn, with the log empty and with it at
+// or near full (so the move to the other sector falls inside):
+// after each cut the board must boot, the old image if the pointer record did
+// not make it and the new one if it did, and it must keep booting. printed per
+// log fill: the flash operations in the window, which image booted after the
+// cuts, and the update's flash work next to what the copy from the active slot
+// to the fallback used to cost.
+//
+//   make test   (or: ./tests/test_boot.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/boot_ptr.h"
+#include "bootloader/confirm.h"
+#include "bootloader/crc32.h"
+#include "bootloader/image.h"
+#include "bootloader/memmap.h"
+#include "bootloader/protocol.h"
+
+#include "test_util.h"
+
+namespace {
+
+// the mocked part: the two app slots (shortened), then the params slot
+constexpr uint32_t SLOT = 0x10000U;
+constexpr uint32_t PARAMS = 2U * SLOT;
+constexpr uint32_t PART = PARAMS + 0x4000U;
+constexpr uint32_t APP_LEN = 24U * 1024U;
+
+// W25Q128 typical costs, for the printed comparison
+constexpr double ERASE_4K_S = 0.045;
+constexpr double PAGE_S = 0.0004;
+
+// instant NOR with a power cut: the `cut`th flash operation (from 1) is torn
+// part way and every operation after it fails. the board's backup SRAM word
+// rides along
+struct part {
+  bytes mem = bytes(PART, 0xFF);
+  bl_confirm ram{};
+  bl_nor ops{};
+  long cut = -1;
+  long n_ops = 0;
+  bool dead = false;
+  size_t erases = 0;
+  size_t pages = 0;
+
+  part() { wire(); }
+  // a copy is a second part, in the same state
+  part(const part &o)
+      : mem(o.mem), ram(o.ram), cut(o.cut), n_ops(o.n_ops), dead(o.dead), erases(o.erases), pages(o.pages) {
+    wire();
+  }
+  part &operator=(const part &) = delete;
+
+  void wire() {
+    ops.ctx = this;
+    ops.erase = erase;
+    ops.program = program;
+    ops.busy = busy;
+    ops.read = read;
+  }
+
+  // the next operation: false if there is no power for it. `torn` is set when
+  // it is the one the power goes during
+  bool step(bool &torn) {
+    if (dead) {
+      return false;
+    }
+    n_ops++;
+    torn = n_ops == cut;
+    dead = torn;
+    return true;
+  }
+
+  static int erase(void *ctx, uint32_t off, uint32_t size) {
+    part &p = *static_cast<part *>(ctx);
+    bool torn;
+    if (!p.step(torn)) {
+      return -1;
+    }
+    p.erases++;
+    memset(p.mem.data() + off, 0xFF, torn ? size / 2U : size);
+    return torn ? -1 : 0;
+  }
+
+  static int program(void *ctx, uint32_t off, const uint8_t *src, uint32_t n) {
+    part &p = *static_cast<part *>(ctx);
+    bool torn;
+    if (!p.step(torn)) {
+      return -1;
+    }
+    p.pages++;
+    uint32_t k = torn ? static_cast<uint32_t>(p.n_ops % n) : n; // bytes that made it
+    for (uint32_t i = 0; i < k; i++) {
+      p.mem[off + i] &= src[i];
+    }
+    return torn ? -1 : 0;
+  }
+
+  static int busy(void *) { return 0; }
+
+  static int read(void *ctx, uint32_t off, uint8_t *dst, uint32_t n) {
+    memcpy(dst, static_cast<part *>(ctx)->mem.data() + off, n);
+    return 0;
+  }
+
+  void power_on() {
+    cut = -1;
+    dead = false;
+  }
+};
+
+bytes blob(uint32_t version) {
+  return blob(random_bytes(APP_LEN, 0xB007u + version), BL_TARGET_APM_H755, version, false);
+}
+
+bl_boot open_ptr(part &p) {
+  bl_boot b;
+  CHECK(bl_boot_open(&b, &p.ops, PARAMS + BL_PARAMS_BOOT, PARAMS + BL_PARAMS_BOOT_2) == 0);
+  return b;
+}
+
+// the version of the valid image in slot s, 0 if none
+uint32_t version_in(const part &p, unsigned s) {
+  const uint8_t *at = p.mem.data() + s * SLOT;
+  if (bl_image_validate(at) != 0) {
+    return 0;
+  }
+  return reinterpret_cast<const bl_image_header *>(at)->version;
+}
+
+// what bl_main does first at every boot: the app the last one started came up,
+// so its slot is confirmed. a power-on boot finds garbage in the backup SRAM.
+// false if the power went
+bool take_confirm(part &p, bool power = false) {
+  if (power) {
+    memset(&p.ram, 0xA5, sizeof(p.ram));
+  }
+  unsigned up;
+  if (bl_confirm_take(&p.ram, &up) && !power) {
+    bl_boot b = open_ptr(p);
+    int rc = bl_boot_booted(&b, up);
+    if (p.dead) {
+      return false;
+    }
+    CHECK(rc == 0);
+  }
+  return true;
+}
+
+// the boot that takes the update (update mode comes after the confirmation),
+// then bl_update's app update: into the slot the pointer does not name (erase,
+// program page by page, read back), then flip the pointer. false if it did not
+// get that far
+bool update(part &p, const bytes &img) {
+  if (!take_confirm(p)) {
+    return false;
+  }
+  bl_boot b = open_ptr(p);
+  unsigned s = bl_boot_update_slot(&b);
+  uint32_t base = s * SLOT;
+  for (uint32_t o = 0; o < img.size(); o += BL_NOR_SECTOR) {
+    if (p.ops.erase(p.ops.ctx, base + o, BL_NOR_SECTOR) != 0) {
+      return false;
+    }
+  }
+  for (uint32_t o = 0; o < img.size(); o += BL_NOR_PAGE) {
+    uint32_t n = std::min<uint32_t>(BL_NOR_PAGE, static_cast<uint32_t>(img.size()) - o);
+    if (p.ops.program(p.ops.ctx, base + o, img.data() + o, n) != 0) {
+      return false;
+    }
+  }
+  if (memcmp(p.mem.data() + base, img.data(), img.size()) != 0) {
+    return false;
+  }
+  return bl_boot_install(&b, s) == 0;
+}
+
+enum { BOOT_GOLDEN = -1, BOOT_CUT = -2, BOOT_CRASH = -3 };
+
+// bl_main's cascade, and the app it starts confirming itself. `crash`: the
+// app dies before it gets that far (a fault on its way up, a watchdog).
+// `power`: a power-on boot. returns the slot booted, or one of the above
+int boot(part &p, bool crash = false, bool power = false) {
+  if (!take_confirm(p, power)) {
+    return BOOT_CUT;
+  }
+  bl_boot b = open_ptr(p);
+  unsigned first = 0;
+  int rc = bl_boot_begin(&b, !power, &first);
+  if (p.dead) {
+    return BOOT_CUT;
+  }
+  CHECK(rc == 0);
+  for (unsigned s : {first, first ^ 1U}) {
+    if (bl_image_validate(p.mem.data() + s * SLOT) != 0) {
+      continue;
+    }
+    bl_confirm_arm(&p.ram, s);
+    if (crash) {
+      return BOOT_CRASH;
+    }
+    bl_confirm_set(&p.ram);
+    return static_cast<int>(s);
+  }
+  return BOOT_GOLDEN;
+}
+
+// the version a boot runs, 0 for none
+uint32_t boots(part &p, bool crash = false, bool power = false) {
+  int s = boot(p, crash, power);
+  return (s >= 0) ? version_in(p, static_cast<unsigned>(s)) : 0U;
+}
+
+void sequence() {
+  part p;
+  bytes v1 = blob(1), v2 = blob(2), v3 = blob(3), v4 = blob(4);
+
+  // a part from before the pointer: the image in slot 1 boots, nothing written
+  memcpy(p.mem.data() + SLOT, v1.data(), v1.size());
+  CHECK(boots(p) == 1U);
+  bl_boot b = open_ptr(p);
+  CHECK(p.pages == 0U && b.cur.seq == 0U && b.cur.active == 1U);
+  CHECK(bl_boot_update_slot(&b) == 0U);
+
+  // an update lands in slot 0; slot 1 is not touched
+  CHECK(update(p, v2));
+  CHECK(version_in(p, 0) == 2U && version_in(p, 1) == 1U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 0U && !b.cur.confirmed && b.cur.tries == 0U);
+  CHECK(boots(p) == 2U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 0U && !b.cur.confirmed && b.cur.tries == 1U); // up, not written yet
+  CHECK(boots(p) == 2U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 0U && b.cur.confirmed);
+  size_t pages = p.pages;
+  CHECK(boots(p) == 2U);
+  CHECK(p.pages == pages); // a confirmed boot writes nothing
+
+  // v3's app never comes up: it has BL_BOOT_TRIES boots, then the pointer
+  // goes back to v2
+  CHECK(update(p, v3));
+  CHECK(version_in(p, 1) == 3U);
+  for (unsigned i = 1; i <= BL_BOOT_TRIES; i++) {
+    CHECK(boot(p, true) == BOOT_CRASH);
+    CHECK(open_ptr(p).cur.tries == i);
+  }
+  CHECK(boots(p) == 2U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 0U && b.cur.confirmed && b.cur.tries == 0U);
+
+  // the next update goes where v3 was, and a crash or two short of the limit
+  // still lets it confirm
+  CHECK(update(p, v4));
+  CHECK(version_in(p, 1) == 4U && version_in(p, 0) == 2U);
+  CHECK(boot(p, true) == BOOT_CRASH);
+  CHECK(boots(p) == 4U);
+  CHECK(!open_ptr(p).cur.confirmed);
+  CHECK(boots(p) == 4U); // the boot after the app came up writes it
+  CHECK(open_ptr(p).cur.confirmed);
+
+  // the active slot's image goes bad: the other one boots, and becomes active
+  // once its app has come up
+  p.mem[SLOT + BL_IMAGE_OFFSET + 77U] ^= 0x08;
+  CHECK(boots(p) == 2U);
+  CHECK(boots(p) == 2U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 0U && b.cur.confirmed);
+  CHECK(bl_boot_update_slot(&b) == 1U);
+
+  // an update that does not verify leaves the pointer alone
+  p.cut = p.n_ops + 5;
+  CHECK(!update(p, v3));
+  p.power_on();
+  CHECK(open_ptr(p).cur.active == 0U);
+  CHECK(boots(p) == 2U);
+
+  // a torn record is skipped and written past
+  b = open_ptr(p);
+  uint32_t seq = b.cur.seq;
+  p.cut = p.n_ops + 1;
+  CHECK(bl_boot_install(&b, 1U) != 0);
+  p.power_on();
+  b = open_ptr(p);
+  CHECK(b.cur.seq == seq && b.cur.active == 0U);
+  CHECK(bl_boot_install(&b, 1U) == 0);
+  b = open_ptr(p);
+  CHECK(b.cur.seq == seq + 1U && b.cur.active == 1U && !b.cur.confirmed);
+}
+
+// an update on a board that is only ever switched off and on: power-on boots
+// lose the app's word, so they neither count a try nor confirm. the update
+// stays however many there are, and the first reset that keeps the word (the
+// button, a software reset) confirms it
+void power_on_boots() {
+  part p;
+  bytes v1 = blob(1), v2 = blob(2);
+  memcpy(p.mem.data() + SLOT, v1.data(), v1.size());
+  CHECK(update(p, v2));
+  for (unsigned i = 0; i < 2U * BL_BOOT_TRIES; i++) {
+    CHECK(boots(p, false, true) == 2U);
+  }
+  bl_boot b = open_ptr(p);
+  CHECK(b.cur.active == 0U && !b.cur.confirmed && b.cur.tries == 0U);
+  CHECK(boots(p) == 2U);
+  CHECK(open_ptr(p).cur.confirmed);
+
+  // an app that came up, then the power: its word is gone, nothing written
+  CHECK(update(p, v1));
+  CHECK(boots(p) == 1U);
+  CHECK(boots(p, false, true) == 1U);
+  b = open_ptr(p);
+  CHECK(b.cur.active == 1U && !b.cur.confirmed && b.cur.tries == 1U);
+}
+
+// a part with v1 booted from slot 1 and `recs` records in the log
+part with_log(uint32_t recs) {
+  part p;
+  bytes v1 = blob(1);
+  memcpy(p.mem.data() + SLOT, v1.data(), v1.size());
+  bl_boot b = open_ptr(p);
+  for (uint32_t i = 0; i < recs; i++) {
+    // slot 1 unconfirmed and confirmed in turn, so each is a real write; the
+    // last one confirmed
+    CHECK((((recs - 1U - i) & 1U) ? bl_boot_install(&b, 1U) : bl_boot_booted(&b, 1U)) == 0);
+  }
+  p.erases = p.pages = 0;
+  p.n_ops = 0;
+  return p;
+}
+
+// the update and the two boots after it, with the power cut at flash
+// operation `cut` (-1: none). returns the version each later boot runs
+struct run_out {
+  long ops = 0;           // flash operations the window took
+  long install_op = 0;    // the pointer flip's
+  bool flipped = false;   // the update got to flip the pointer
+  bool moved = false;     // the log went on in its other sector
+  uint32_t after[3] = {}; // the versions booted after the power came back
+};
+
+run_out run_window(part p, long cut) {
+  run_out o;
+  bytes v2 = blob(2);
+  uint32_t sec = open_ptr(p).sec;
+  p.cut = cut;
+  o.flipped = update(p, v2);
+  o.install_op = p.n_ops;
+  if (!p.dead) {
+    boot(p);
+  }
+  if (!p.dead) {
+    boot(p);
+  }
+  o.ops = p.n_ops;
+  o.moved = open_ptr(p).sec != sec;
+  p.power_on();
+  o.after[0] = boots(p, false, true);
+  o.after[1] = boots(p);
+  o.after[2] = boots(p);
+  return o;
+}
+
+void power_cuts() {
+  printf("%-16s %5s %8s %12s %12s %10s\n", "log before", "ops", "flip at", "cut: old v1",
+         "cut: new v2", "log moves");
+  const uint32_t recs = static_cast<uint32_t>(BL_BOOT_RECS);
+  const uint32_t fills[] = {0U, recs - 2U, recs, 2U * recs};
+  for (uint32_t fill : fills) {
+    part start = with_log(fill);
+    run_out clean = run_window(start, -1);
+    CHECK(clean.flipped);
+    CHECK(clean.after[0] == 2U && clean.after[1] == 2U);
+
+    size_t olds = 0, news = 0;
+    for (long cut = 1; cut <= clean.ops; cut++) {
+      run_out o = run_window(start, cut);
+      // the new image boots once its pointer record is in, the old one before
+      uint32_t want = (cut > clean.install_op) ? 2U : 1U;
+      for (uint32_t v : o.after) {
+        CHECK(v == want);
+      }
+      (want == 1U ? olds : news)++;
+    }
+    CHECK(clean.moved == (fill != 0U));
+    char name[32];
+    snprintf(name, sizeof(name), "%u records", fill);
+    printf("%-16s %5ld %8ld %12zu %12zu %10s\n", name, clean.ops, clean.install_op, olds, news,
+           clean.moved ? "yes" : "no");
+  }
+}
+
+// what an update costs the part: the old scheme copied the active image down
+// to the fallback slot first (read, erase and program all of it); now it is
+// the image itself and one 16-byte record
+void cost() {
+  part p = with_log(0);
+  bytes v2 = blob(2);
+  CHECK(update(p, v2));
+  size_t img_sectors = (v2.size() + BL_NOR_SECTOR - 1U) / BL_NOR_SECTOR;
+  size_t img_pages = (v2.size() + BL_NOR_PAGE - 1U) / BL_NOR_PAGE;
+  CHECK(p.erases == img_sectors && p.pages == img_pages + 1U);
+  printf("update of a %zuK image: %zu erases, %zu programs (the image and 1 record); "
+         "the copy it replaces was another %zu erases, %zu programs, ~%.0fms\n",
+         v2.size() / 1024U, p.erases, p.pages, img_sectors, img_pages,
+         (img_sectors * ERASE_4K_S + img_pages * PAGE_S) * 1e3);
+}
+
+} // namespace
+
+int main() {
+  sequence();
+  power_on_boots();
+  power_cuts();
+  cost();
+  printf("test_boot: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+// host test for bundles (mkupdate --bundle, BL_BUNDLE): an app image and an
+// FPGA bitstream in one session to the simulated board (sim_board.h), against
+// the same two images as two separate updates, each its own bootloader entry
+// with its own HELLO and resume query as update.bin runs them.
+//
+// the board runs with its handshake on, so a session costs what it does with
+// update.bin. printed: the round trips (a request the host waits on the answer
+// to) and the board time of both ways, and how much of it was not the images'
+// own streaming and verifying. fails unless both images land either way, the
+// bundle takes fewer round trips and less of that overhead, and the app is
+// committed (the boot pointer flipped to it) only when the whole bundle
+// verified: not when the bitstream fails its crc, not when the board is lost
+// mid-bundle, not when a bundle names one target twice. also: a DONE repeated
+// because its RESULT was lost (a held part's, the last one's after the commit,
+// a single image's), the board's limits on BL_BUNDLE, and the bundle file
+// itself (bundle.h).
+//
+//   make test   (or: ./tests/test_bundle.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/protocol.h"
+
+#include "bundle.h"
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_bundle.nor.bin";
+constexpr size_t APP_LEN = 128U * 1024U;
+constexpr size_t FPGA_LEN = 256U * 1024U;
+
+// one bootloader entry on `nor`, HELLO first, as a board the host talks to
+struct entry {
+  int master = -1, slave = -1;
+  board b;
+  std::thread th;
+
+  entry(nor_model &nor, long kill_at = -1) {
+    if (!open_pty(master, slave)) {
+      perror("pty");
+      fails++;
+      return;
+    }
+    b.fd = slave;
+    b.nor = &nor;
+    b.o.handshake = true;
+    b.o.kill_at = kill_at;
+    th = std::thread([this] { b.serve(); });
+  }
+
+  ~entry() {
+    b.stop = true;
+    if (th.joinable()) {
+      th.join();
+    }
+    ::close(slave);
+    ::close(master);
+  }
+};
+
+struct run_stats {
+  int trips = 0;          // requests the host waited on the answer to
+  double secs = 0.0;      // board time, HELLO..the last RESULT
+  double images_s = 0.0;  //   of it the images' MANIFEST..RESULT
+  std::vector<xfer_stats> st; // per part
+};
+
+xfer_opts opts() {
+  xfer_opts o;
+  o.baud = SIM_BAUD;
+  o.result_ms = 2000;
+  return o;
+}
+
+// HELLO and the receiver's settle time, as update.bin's transfer() does it
+bool hello(int fd, run_stats &r) {
+  bl_hello ack{};
+  r.trips++;
+  bool ok = handshake(fd, &ack) && ack.version >= 9U;
+  usleep(20000);
+  return ok;
+}
+
+void image(int fd, const update_part &p, const xfer_opts &o, run_stats &r) {
+  xfer_stats st;
+  send_image(fd, p.m, p.data.data(), p.data.size(), o, st);
+  r.trips += 2; // MANIFEST -> its ack, DONE -> RESULT
+  r.images_s += (st.stream_s + st.verify_s) * TIME_SCALE;
+  r.st.push_back(st);
+}
+
+// each part its own session, one bootloader entry each
+run_stats separate(nor_model &nor, const std::vector<update_part> &parts) {
+  run_stats r;
+  auto t0 = clk::now();
+  for (const update_part &p : parts) {
+    entry e(nor);
+    if (!hello(e.master, r)) {
+      fails++;
+      return r;
+    }
+    uint32_t have = 0;
+    r.trips++;
+    query_resume(e.master, p.m, have);
+    image(e.master, p, opts(), r);
+  }
+  r.secs = std::chrono::duration<double>(clk::now() - t0).count() * TIME_SCALE;
+  return r;
+}
+
+// all of them as one bundle on `e`. false if the board did not take it
+bool bundle_on(entry &e, const std::vector<update_part> &parts, run_stats &r) {
+  if (!hello(e.master, r)) {
+    return false;
+  }
+  r.trips++;
+  if (!start_bundle(e.master, static_cast<uint16_t>(parts.size()))) {
+    return false;
+  }
+  for (const update_part &p : parts) {
+    image(e.master, p, opts(), r);
+    if (!r.st.back().have_result || r.st.back().result.status != BL_OK) {
+      break;
+    }
+  }
+  return true;
+}
+
+run_stats bundled(nor_model &nor, const std::vector<update_part> &parts) {
+  run_stats r;
+  auto t0 = clk::now();
+  entry e(nor);
+  CHECK(bundle_on(e, parts, r));
+  r.secs = std::chrono::duration<double>(clk::now() - t0).count() * TIME_SCALE;
+  return r;
+}
+
+bool all_ok(const run_stats &r, size_t n) {
+  if (r.st.size() != n) {
+    return false;
+  }
+  for (const xfer_stats &st : r.st) {
+    if (!st.have_result || st.result.status != BL_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the parts as update.bin sends them, from the bundle file mkupdate writes
+std::vector<update_part> parts_of(const std::vector<uint8_t> &app_blob,
+                                  const std::vector<uint8_t> &fpga_blob) {
+  std::vector<uint8_t> file;
+  std::vector<std::vector<uint8_t>> files;
+  std::vector<update_part> parts(2);
+  CHECK(build_bundle({app_blob, fpga_blob}, file));
+  CHECK(parse_bundle(file.data(), file.size(), files));
+  for (size_t i = 0; i < files.size() && i < parts.size(); i++) {
+    CHECK(load_part(files[i], parts[i]));
+  }
+  return parts;
+}
+
+// app + bitstream, both ways: what lands, what it costs
+void versus(nor_model &nor, const std::vector<update_part> &parts,
+            const std::vector<uint8_t> &app_blob, const std::vector<uint8_t> &fpga_blob) {
+  uint32_t at = app_update_off(nor);
+  run_stats one = separate(nor, parts);
+  CHECK(all_ok(one, parts.size()));
+  CHECK(memcmp(nor.mem + at, app_blob.data(), app_blob.size()) == 0);
+  CHECK(memcmp(nor.mem + FPGA_ACTIVE_OFF, fpga_blob.data(), fpga_blob.size()) == 0);
+  CHECK(app_update_off(nor) != at); // committed
+
+  at = app_update_off(nor);
+  run_stats bun = bundled(nor, parts);
+  CHECK(all_ok(bun, parts.size()));
+  CHECK(memcmp(nor.mem + at, app_blob.data(), app_blob.size()) == 0);
+  CHECK(memcmp(nor.mem + FPGA_ACTIVE_OFF, fpga_blob.data(), fpga_blob.size()) == 0);
+  CHECK(app_update_off(nor) != at);
+
+  printf("app %zu KB + bitstream %zu KB at %d baud (board time)\n", app_blob.size() / 1024U,
+         fpga_blob.size() / 1024U, BOARD_BAUD);
+  printf("  %-10s %6s %9s %9s\n", "", "trips", "total", "overhead");
+  printf("  %-10s %6d %8.0fms %8.0fms\n", "separate", one.trips, one.secs * 1000.0,
+         (one.secs - one.images_s) * 1000.0);
+  printf("  %-10s %6d %8.0fms %8.0fms\n", "bundle", bun.trips, bun.secs * 1000.0,
+         (bun.secs - bun.images_s) * 1000.0);
+  CHECK(bun.trips < one.trips);
+  CHECK(bun.secs - bun.images_s < one.secs - one.images_s);
+}
+
+// nothing is committed unless every part verified
+void atomic(nor_model &nor, const std::vector<update_part> &parts) {
+  // the bitstream fails its crc: the app verified, but the pointer stays
+  std::vector<update_part> bad = parts;
+  bad[1].m.crc32 ^= 1U;
+  uint32_t at = app_update_off(nor);
+  {
+    run_stats r;
+    entry e(nor);
+    CHECK(bundle_on(e, bad, r));
+    CHECK(r.st.size() == 2U && r.st[0].result.status == BL_OK);
+    CHECK(r.st.size() == 2U && r.st[1].have_result && r.st[1].result.status == BL_ERR_CRC);
+  }
+  CHECK(app_update_off(nor) == at);
+
+  // the board is lost in the middle of the bitstream
+  {
+    run_stats r;
+    entry e(nor, static_cast<long>(parts[0].data.size() + parts[1].data.size() / 2U));
+    bundle_on(e, parts, r);
+    CHECK(r.st.size() == 2U && !r.st[1].have_result);
+  }
+  CHECK(app_update_off(nor) == at);
+
+  // one target twice: the second image is refused before its slot is touched
+  std::vector<update_part> twice = {parts[0], parts[0]};
+  {
+    run_stats r;
+    entry e(nor);
+    CHECK(bundle_on(e, twice, r));
+    CHECK(r.st.size() == 2U && r.st[1].have_result && r.st[1].result.status == BL_ERR_TARGET);
+  }
+  CHECK(app_update_off(nor) == at);
+
+  // and the board takes the next bundle whole
+  run_stats r = bundled(nor, parts);
+  CHECK(all_ok(r, parts.size()));
+  CHECK(app_update_off(nor) != at);
+}
+
+// `p`'s DONE sent again, as finish() does when its RESULT was lost: the status
+// of the RESULT that answers it, or -1 if none comes
+int done_again(int fd, const update_part &p) {
+  uint16_t seq = static_cast<uint16_t>((p.data.size() + BL_MAX_PAYLOAD - 1U) / BL_MAX_PAYLOAD);
+  if (!send_frame(fd, BL_DONE, seq, nullptr, 0)) {
+    return -1;
+  }
+  bl_frame f;
+  auto until = clk::now() + std::chrono::seconds(1);
+  while (clk::now() < until) {
+    if (recv_frame(fd, 100, f) && f.type == BL_RESULT && f.len >= sizeof(bl_result)) {
+      bl_result res;
+      memcpy(&res, f.payload, sizeof(res));
+      return res.status;
+    }
+  }
+  return -1;
+}
+
+// a DONE again (its RESULT was lost) gets the verdict again: for a held part,
+// and the bundle goes on; for the last part, with the commit already made, and
+// so for a single image; a failed last part gets its failure again.
+// BL_BUNDLE outside the board's limits is refused
+void protocol(nor_model &nor, const std::vector<update_part> &parts) {
+  {
+    run_stats r;
+    entry e(nor);
+    CHECK(hello(e.master, r));
+    CHECK(!start_bundle(e.master, 1U));
+    CHECK(!start_bundle(e.master, BL_BUNDLE_MAX + 1U));
+    CHECK(start_bundle(e.master, 2U));
+    CHECK(!start_bundle(e.master, 2U)); // already in one
+    uint32_t at = app_update_off(nor);
+    image(e.master, parts[0], opts(), r);
+    CHECK(all_ok(r, 1U));
+    CHECK(done_again(e.master, parts[0]) == BL_OK);
+    image(e.master, parts[1], opts(), r);
+    CHECK(all_ok(r, 2U));
+    CHECK(app_update_off(nor) != at); // committed
+    CHECK(done_again(e.master, parts[1]) == BL_OK);
+    CHECK(done_again(e.master, parts[1]) == BL_OK);
+  }
+  {
+    run_stats r;
+    entry e(nor);
+    CHECK(hello(e.master, r));
+    uint32_t at = app_update_off(nor);
+    image(e.master, parts[0], opts(), r);
+    CHECK(all_ok(r, 1U));
+    CHECK(app_update_off(nor) != at);
+    CHECK(done_again(e.master, parts[0]) == BL_OK);
+  }
+  {
+    std::vector<update_part> bad = parts;
+    bad[1].m.crc32 ^= 1U;
+    run_stats r;
+    entry e(nor);
+    CHECK(bundle_on(e, bad, r));
+    CHECK(r.st.size() == 2U && r.st[1].result.status == BL_ERR_CRC);
+    CHECK(done_again(e.master, bad[1]) == BL_ERR_CRC);
+  }
+}
+
+// the bundle file: what goes in comes out, and damage is caught
+void file(const std::vector<uint8_t> &app_blob, const std::vector<uint8_t> &fpga_blob) {
+  std::vector<uint8_t> f;
+  std::vector<std::vector<uint8_t>> files;
+  std::string why;
+  CHECK(build_bundle({app_blob, fpga_blob}, f));
+  CHECK(parse_bundle(f.data(), f.size(), files));
+  CHECK(files.size() == 2U && files[0] == app_blob && files[1] == fpga_blob);
+
+  CHECK(!build_bundle({app_blob}, f, &why));
+  CHECK(!build_bundle({app_blob, app_blob}, f, &why));
+  CHECK(why.find("two parts") != std::string::npos);
+  CHECK(!build_bundle({app_blob, std::vector<uint8_t>(64, 0xEE)}, f, &why));
+
+  CHECK(build_bundle({app_blob, fpga_blob}, f));
+  std::vector<uint8_t> d = f;
+  d[sizeof(bundle_header) + 4U] ^= 0x10U; // an index entry
+  CHECK(!parse_bundle(d.data(), d.size(), files, &why));
+  CHECK(why.find("index") != std::string::npos);
+  d = f;
+  d[d.size() - 100U] ^= 0x01U; // the bitstream
+  CHECK(!parse_bundle(d.data(), d.size(), files, &why));
+  CHECK(!parse_bundle(f.data(), f.size() - 1U, files, &why));
+  CHECK(!parse_bundle(app_blob.data(), app_blob.size(), files, &why));
+}
+
+} // namespace
+
+int main() {
+  std::vector<uint8_t> app_blob = blob(random_bytes(APP_LEN, 0xA9Bu));
+  std::vector<uint8_t> fpga_blob = blob(random_bytes(FPGA_LEN, 0xF9Au), BL_TARGET_FPGA_GW2AR18);
+  file(app_blob, fpga_blob);
+
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    return 1;
+  }
+  std::vector<update_part> parts = parts_of(app_blob, fpga_blob);
+  versus(nor, parts, app_blob, fpga_blob);
+  atomic(nor, parts);
+  protocol(nor, parts);
+  nor.close();
+  unlink(PART_FILE);
+
+  printf("test_bundle: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,469 @@
+// host test for the channels on the update line (protocol.h, bl_channel): the
+// shared transmit scheduler (bootloader/channel.h), link_engine's per-class
+// queues and demultiplexer, and the board's log and telemetry.
+//
+// the loopback: a pty pair, link_engine on the master side saturating it with
+// bulk DATA while log lines and telemetry records are queued too and a control
+// frame is queued every few ms; on the slave side a reader paced to the line
+// rate (as the board's uart is) timestamps every frame as it arrives. fails
+// unless every frame arrives intact on its channel and in order within it, log
+// / telemetry / bulk split the line by their quanta while all three are
+// backlogged, and no control frame waits longer than the frame being written
+// plus what the engine keeps ahead of the line. the same stream with the engine
+// unpaced (everything handed to the tty at once) is printed for comparison.
+// also: the scheduler on its own, the engine routing channel frames away from
+// the update's inbox, and a v10 board (vboard) narrating a transfer - a v9 host
+// gets nothing of it.
+//
+//   make test   (or: ./tests/test_channels.bin)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "bootloader/channel.h"
+#include "bootloader/frame.h"
+#include "bootloader/protocol.h"
+
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_channels.nor.bin";
+constexpr size_t BULK = 400;        // DATA frames, full payload
+constexpr size_t LOGS = 300;        // log lines
+constexpr size_t TELS = 300;        // telemetry records
+constexpr size_t CTLS = 100;        // control frames, one every CTL_MS
+constexpr int CTL_MS = 7;
+constexpr size_t LOG_TEXT = 80;
+constexpr double MAX_FRAME = 8.0 + BL_MAX_PAYLOAD + 4.0;
+
+// log line i: its number, padded out to LOG_TEXT
+void log_text(unsigned i, char (&text)[LOG_TEXT + 1]) {
+  memset(text, '.', LOG_TEXT);
+  text[LOG_TEXT] = '\0';
+  int n = snprintf(text, sizeof(text), "log line %u ", i);
+  text[n] = '.';
+}
+
+double ms_since(clk::time_point t0, clk::time_point t) {
+  return std::chrono::duration<double, std::milli>(t - t0).count();
+}
+
+// every class backlogged: each gets its quantum's share of the bytes, and a
+// queued control frame always goes first
+void sched_shares() {
+  bl_sched s;
+  bl_sched_init(&s);
+  const uint32_t len[BL_TX_CLASSES] = {20U, 8U + LOG_TEXT + 4U, 8U + sizeof(bl_telemetry) + 4U,
+                                       static_cast<uint32_t>(MAX_FRAME)};
+  double bytes[BL_TX_CLASSES] = {0};
+  for (int i = 0; i < 20000; i++) {
+    uint32_t head[BL_TX_CLASSES] = {(i % 7 == 0) ? len[0] : 0U, len[1], len[2], len[3]};
+    int c = bl_sched_pick(&s, head);
+    CHECK(c >= 0);
+    if (c < 0) {
+      return;
+    }
+    CHECK(head[BL_TX_CONTROL] == 0U || c == BL_TX_CONTROL);
+    bytes[c] += len[c];
+  }
+  double q = 0.0, b = 0.0;
+  for (unsigned c = BL_TX_LOG; c < BL_TX_CLASSES; c++) {
+    q += s.quantum[c];
+    b += bytes[c];
+  }
+  printf("scheduler, all backlogged:");
+  for (unsigned c = BL_TX_LOG; c < BL_TX_CLASSES; c++) {
+    printf("  %.1f%% (quantum %.1f%%)", 100.0 * bytes[c] / b, 100.0 * s.quantum[c] / q);
+    CHECK(std::fabs(bytes[c] / b - s.quantum[c] / q) < 0.01);
+  }
+  printf("\n");
+
+  // a class that sat idle banks no credit: back in the queue, it gets its
+  // quantum like the others instead of a burst
+  uint32_t head[BL_TX_CLASSES] = {0U, 0U, len[2], len[3]};
+  for (int i = 0; i < 50; i++) {
+    bl_sched_pick(&s, head);
+  }
+  head[BL_TX_LOG] = len[1];
+  int run = 0, longest = 0;
+  for (int i = 0; i < 200; i++) {
+    run = (bl_sched_pick(&s, head) == BL_TX_LOG) ? run + 1 : 0;
+    longest = std::max(longest, run);
+  }
+  CHECK(longest <= 2); // 128 bytes of credit a round: one 92-byte line, two at most
+  uint32_t none[BL_TX_CLASSES] = {0U, 0U, 0U, 0U};
+  CHECK(bl_sched_pick(&s, none) == -1);
+}
+
+struct rx_rec {
+  uint8_t ch, type;
+  uint16_t seq, len;
+  clk::time_point at;   // when the line delivered its last byte
+  int64_t queued_ns;    // control frames: when the sender queued it
+};
+
+// the slave side: read at the line's pace, parse, timestamp
+void paced_reader(int fd, size_t want, std::vector<rx_rec> &out, bool &intact) {
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  uint8_t buf[256];
+  auto due = clk::now();
+  auto quiet = clk::now();
+  while (out.size() < want && clk::now() - quiet < std::chrono::seconds(3)) {
+    // bytes already waiting kept the line busy; only a line that went idle
+    // starts over from now
+    struct pollfd p = {fd, POLLIN, 0};
+    bool busy = ::poll(&p, 1, 0) > 0;
+    if (!busy && ::poll(&p, 1, 20) <= 0) {
+      continue;
+    }
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      continue;
+    }
+    if (!busy) {
+      due = std::max(due, clk::now());
+    }
+    due += std::chrono::duration_cast<clk::duration>(std::chrono::duration<double>(n * 10.0 / SIM_BAUD));
+    std::this_thread::sleep_until(due);
+    quiet = clk::now();
+    size_t pos = 0;
+    while (pos < static_cast<size_t>(n)) {
+      int st;
+      pos += bl_frame_feed_buf(&rx, buf + pos, static_cast<size_t>(n) - pos, &st);
+      if (st == BL_FRAME_BAD_CRC || st == BL_FRAME_BAD_LEN) {
+        intact = false;
+      }
+      if (st != BL_FRAME_OK) {
+        continue;
+      }
+      const bl_frame &f = rx.frame;
+      rx_rec r{f.flags, f.type, f.seq, f.len, clk::now(), 0};
+      if (f.type == BL_PROBE && f.len == sizeof(int64_t)) {
+        memcpy(&r.queued_ns, f.payload, sizeof(int64_t));
+      } else if (f.type == BL_DATA) {
+        intact = intact && f.len == BL_MAX_PAYLOAD && f.payload[0] == static_cast<uint8_t>(f.seq) &&
+                 f.payload[BL_MAX_PAYLOAD - 1U] == static_cast<uint8_t>(f.seq >> 8);
+      } else if (f.type == BL_LOG) {
+        char want_text[LOG_TEXT + 1];
+        log_text(f.seq, want_text);
+        intact = intact && f.len == LOG_TEXT && memcmp(f.payload, want_text, LOG_TEXT) == 0;
+      } else if (f.type == BL_TELEMETRY) {
+        bl_telemetry t;
+        memcpy(&t, f.payload, sizeof(t));
+        intact = intact && f.len == sizeof(t) && t.frames == f.seq;
+      }
+      out.push_back(r);
+    }
+  }
+}
+
+struct loop_stats {
+  double ctl_p50 = 0.0, ctl_max = 0.0; // ms, queued .. delivered
+  double share[BL_TX_CLASSES] = {0};   // of the non-control bytes while all were backlogged
+  double secs = 0.0;
+  size_t ahead = 0;                    // what the engine keeps ahead of the line
+  bool complete = false, intact = true, ordered = true, on_channel = true;
+};
+
+loop_stats loopback(bool paced) {
+  loop_stats ls;
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    fails++;
+    return ls;
+  }
+  std::vector<rx_rec> got;
+  const size_t total = BULK + LOGS + TELS + CTLS;
+  std::thread rd([&] { paced_reader(slave, total, got, ls.intact); });
+
+  auto t0 = clk::now();
+  {
+    link_engine e(master);
+    e.line_baud = paced ? SIM_BAUD : 0;
+    ls.ahead = e.ahead;
+    std::vector<uint8_t> pl(BL_MAX_PAYLOAD);
+    for (size_t i = 0; i < BULK; i++) {
+      std::fill(pl.begin(), pl.end(), 0x5A);
+      pl[0] = static_cast<uint8_t>(i);
+      pl[BL_MAX_PAYLOAD - 1U] = static_cast<uint8_t>(i >> 8);
+      e.queue(BL_DATA, static_cast<uint16_t>(i), pl.data(), BL_MAX_PAYLOAD);
+    }
+    for (size_t i = 0; i < LOGS; i++) {
+      char text[LOG_TEXT + 1];
+      log_text(static_cast<unsigned>(i), text);
+      e.queue_ch(BL_CH_LOG, BL_LOG, static_cast<uint16_t>(i), text, LOG_TEXT);
+    }
+    for (size_t i = 0; i < TELS; i++) {
+      bl_telemetry t{};
+      t.frames = static_cast<uint32_t>(i);
+      e.queue_ch(BL_CH_TELEMETRY, BL_TELEMETRY, static_cast<uint16_t>(i), &t, sizeof(t));
+    }
+    size_t ctl = 0;
+    auto next_ctl = clk::now();
+    while (!e.broken && (e.queued() != 0U || ctl < CTLS)) {
+      if (ctl < CTLS && clk::now() >= next_ctl) {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t0).count();
+        e.queue(BL_PROBE, static_cast<uint16_t>(ctl++), &ns, sizeof(ns));
+        next_ctl += std::chrono::milliseconds(CTL_MS);
+      }
+      bl_frame f;
+      e.pump(1, f);
+    }
+  }
+  rd.join();
+  ls.secs = std::chrono::duration<double>(clk::now() - t0).count();
+  ::close(slave);
+  ::close(master);
+
+  ls.complete = got.size() == total;
+  // each class in order, on its own channel; the control latencies; and the
+  // shares up to where the first of log / telemetry / bulk ran dry
+  size_t count[BL_TX_CLASSES] = {0};
+  const size_t last[BL_TX_CLASSES] = {CTLS, LOGS, TELS, BULK};
+  double bytes[BL_TX_CLASSES] = {0};
+  bool backlogged = true;
+  std::vector<double> lat;
+  for (const rx_rec &r : got) {
+    uint8_t c = bl_tx_class(r.ch, r.type);
+    const uint8_t want_type[BL_TX_CLASSES] = {BL_PROBE, BL_LOG, BL_TELEMETRY, BL_DATA};
+    ls.on_channel = ls.on_channel && r.type == want_type[c];
+    ls.ordered = ls.ordered && r.seq == count[c];
+    count[c]++;
+    if (c == BL_TX_CONTROL) {
+      lat.push_back(ms_since(t0, r.at) - r.queued_ns / 1e6);
+      continue;
+    }
+    if (backlogged) {
+      bytes[c] += 8.0 + r.len + 4.0;
+      backlogged = count[c] < last[c];
+    }
+  }
+  std::sort(lat.begin(), lat.end());
+  if (!lat.empty()) {
+    ls.ctl_p50 = lat[lat.size() / 2U];
+    ls.ctl_max = lat.back();
+  }
+  double b = bytes[BL_TX_LOG] + bytes[BL_TX_TELEMETRY] + bytes[BL_TX_BULK];
+  for (unsigned c = BL_TX_LOG; c < BL_TX_CLASSES; c++) {
+    ls.share[c] = (b > 0.0) ? bytes[c] / b : 0.0;
+  }
+  return ls;
+}
+
+void saturated() {
+  bl_sched s;
+  bl_sched_init(&s);
+  double q = s.quantum[BL_TX_LOG] + s.quantum[BL_TX_TELEMETRY] + s.quantum[BL_TX_BULK];
+  const double frame_ms = MAX_FRAME * 10.0 / SIM_BAUD * 1000.0;
+
+  printf("loopback at %d baud, %zu DATA + %zu log + %zu telemetry frames, a control frame "
+         "every %d ms:\n",
+         SIM_BAUD, BULK, LOGS, TELS, CTL_MS);
+  printf("  %-8s %8s %14s %14s %8s %8s %8s\n", "engine", "time", "control p50", "control max",
+         "log", "telem", "bulk");
+  for (bool paced : {true, false}) {
+    loop_stats ls = loopback(paced);
+    printf("  %-8s %7.2fs %11.2f ms %11.2f ms %7.1f%% %7.1f%% %7.1f%%\n",
+           paced ? "paced" : "unpaced", ls.secs, ls.ctl_p50, ls.ctl_max,
+           100.0 * ls.share[BL_TX_LOG], 100.0 * ls.share[BL_TX_TELEMETRY],
+           100.0 * ls.share[BL_TX_BULK]);
+    CHECK(ls.complete);
+    CHECK(ls.intact);
+    CHECK(ls.ordered);
+    CHECK(ls.on_channel);
+    if (!paced) {
+      continue; // what the tty already took is out of the scheduler's hands
+    }
+    // the frame under way, `ahead` bytes of backlog, the control frame itself,
+    // and a few ms of pty and thread wakeups
+    double bound = frame_ms + ls.ahead * 10.0 / SIM_BAUD * 1000.0 + 8.0;
+    printf("  (paced: a control frame waits %.2f ms at most by the line; quanta %.1f%% / "
+           "%.1f%% / %.1f%%)\n",
+           bound - 8.0, 100.0 * s.quantum[BL_TX_LOG] / q, 100.0 * s.quantum[BL_TX_TELEMETRY] / q,
+           100.0 * s.quantum[BL_TX_BULK] / q);
+    CHECK(ls.ctl_max < bound);
+    for (unsigned c = BL_TX_LOG; c < BL_TX_CLASSES; c++) {
+      CHECK(std::fabs(ls.share[c] - s.quantum[c] / q) < 0.02);
+    }
+  }
+}
+
+// frames on the other channels go to on_channel (or nowhere), never into the
+// update's inbox, and the update's own frames still come out in order
+void demux() {
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    fails++;
+    return;
+  }
+  for (bool handler : {true, false}) {
+    link_engine e(master);
+    std::vector<bl_frame> aux;
+    if (handler) {
+      e.on_channel = [&aux](const bl_frame &f) { aux.push_back(f); };
+    }
+    for (uint16_t i = 0; i < 30U; i++) {
+      bl_ack a{i, 8U, 0U};
+      send_frame(slave, BL_ACK, 0, &a, sizeof(a));
+      char text[32];
+      int n = snprintf(text, sizeof(text), "line %u", i);
+      send_frame(slave, BL_LOG, i, text, static_cast<uint16_t>(n), BL_CH_LOG);
+      bl_telemetry t{};
+      t.bytes = i * 1024U;
+      send_frame(slave, BL_TELEMETRY, i, &t, sizeof(t), BL_CH_TELEMETRY);
+    }
+    std::vector<bl_frame> in;
+    bl_frame f;
+    while (e.pump(100, f)) {
+      in.push_back(f);
+    }
+    CHECK(in.size() == 30U);
+    for (size_t i = 0; i < in.size(); i++) {
+      bl_ack a;
+      memcpy(&a, in[i].payload, sizeof(a));
+      CHECK(in[i].type == BL_ACK && in[i].flags == BL_CH_UPDATE && a.next == i);
+    }
+    CHECK(aux.size() == (handler ? 60U : 0U));
+    size_t logs = 0, tels = 0;
+    for (const bl_frame &x : aux) {
+      if (x.flags == BL_CH_LOG && x.type == BL_LOG) {
+        std::string text(reinterpret_cast<const char *>(x.payload), x.len);
+        CHECK(text == "line " + std::to_string(logs++));
+      } else if (x.flags == BL_CH_TELEMETRY && x.type == BL_TELEMETRY) {
+        bl_telemetry t;
+        memcpy(&t, x.payload, sizeof(t));
+        CHECK(t.bytes == tels++ * 1024U);
+      } else {
+        CHECK(false);
+      }
+    }
+  }
+  ::close(slave);
+  ::close(master);
+}
+
+// a transfer to a vboard after a HELLO of `host_ver`: what the board said on
+// its channels meanwhile
+struct narrated {
+  bool ok = false;
+  std::vector<std::string> lines;
+  std::vector<bl_telemetry> tel;
+};
+
+narrated board_session(nor_model &nor, uint16_t host_ver, const std::vector<uint8_t> &wire) {
+  narrated r;
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    fails++;
+    return r;
+  }
+  board b;
+  b.fd = slave;
+  b.nor = &nor;
+  b.o.handshake = true;
+  std::thread th([&b] { b.serve(); });
+
+  bl_hello h = {host_ver, BL_MAX_PAYLOAD};
+  bl_frame f;
+  send_frame(master, BL_HELLO, 0, &h, sizeof(h));
+  if (recv_frame(master, 1000, f) && f.type == BL_HELLO_ACK) {
+    usleep(20000);
+    bl_manifest m{};
+    m.magic = BL_MANIFEST_MAGIC;
+    m.target = BL_TARGET_APM_H755;
+    m.version = 1;
+    m.length = static_cast<uint32_t>(wire.size());
+    m.crc32 = bl_crc32(wire.data(), wire.size());
+    xfer_opts o;
+    o.baud = SIM_BAUD;
+    o.result_ms = 2000;
+    o.on_channel = [&r](const bl_frame &x) {
+      if (x.type == BL_LOG) {
+        r.lines.emplace_back(reinterpret_cast<const char *>(x.payload), x.len);
+      } else if (x.type == BL_TELEMETRY && x.len == sizeof(bl_telemetry)) {
+        bl_telemetry t;
+        memcpy(&t, x.payload, sizeof(t));
+        r.tel.push_back(t);
+      }
+    };
+    xfer_stats st;
+    r.ok = send_image(master, m, wire.data(), wire.size(), o, st);
+  }
+  b.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  return r;
+}
+
+void board_narrates() {
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    fails++;
+    return;
+  }
+  std::vector<uint8_t> app(192U * 1024U);
+  for (size_t i = 0; i < app.size(); i++) {
+    app[i] = static_cast<uint8_t>(i * 7U + (i >> 9));
+  }
+  std::vector<uint8_t> wire = blob(app);
+
+  narrated v10 = board_session(nor, BL_PROTO_VERSION, wire);
+  CHECK(v10.ok);
+  bool manifest_line = false;
+  for (const std::string &l : v10.lines) {
+    manifest_line = manifest_line || l.rfind("update: manifest target=1", 0) == 0;
+  }
+  CHECK(manifest_line);
+  // a record every BL_TELEMETRY_MS of the ~2 s transfer, each later than the
+  // last, none claiming more than the image
+  CHECK(v10.tel.size() >= 4U);
+  for (size_t i = 0; i < v10.tel.size(); i++) {
+    CHECK(v10.tel[i].bytes <= wire.size());
+    CHECK(v10.tel[i].bad == 0U);
+    if (i > 0U) {
+      CHECK(v10.tel[i].ms > v10.tel[i - 1U].ms && v10.tel[i].frames >= v10.tel[i - 1U].frames);
+    }
+  }
+  uint32_t peak = 0;
+  for (const bl_telemetry &t : v10.tel) {
+    peak = std::max(peak, t.bytes);
+  }
+  printf("v10 host: %zu log lines, %zu telemetry records (last at %u ms, %u bytes in)\n",
+         v10.lines.size(), v10.tel.size(), v10.tel.empty() ? 0U : v10.tel.back().ms, peak);
+  for (const std::string &l : v10.lines) {
+    printf("  board: %s\n", l.c_str());
+  }
+
+  narrated v9 = board_session(nor, 9U, wire);
+  CHECK(v9.ok);
+  CHECK(v9.lines.empty() && v9.tel.empty());
+  printf("v9 host: %zu log lines, %zu telemetry records\n", v9.lines.size(), v9.tel.size());
+
+  nor.close();
+  unlink(PART_FILE);
+}
+
+} // namespace
+
+int main() {
+  sched_shares();
+  saturated();
+  demux();
+  board_narrates();
+  printf("test_channels: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+// host test for delta updates: the patch encoder (delta_enc.cpp, what mkupdate
+// --delta runs) against the bootloader's decoder (lib/bootloader/src/delta.c).
+// every patch is applied the way the session applies it - patch bytes in
+// arbitrary pieces, output into small windows, the base only through the
+// decoder's read cache - and must rebuild the image exactly. malformed patches
+// must be refused without reading outside the base or writing past the image.
+//
+// then reports what a delta saves on the wire for rebuilds of the APM app
+// (apm_app.smup, the stored image): a constant tweak, a function that grew
+// (code after it moves, and every absolute address into it is retargeted the
+// way the linker would), and a new 6KB feature. line time is at the board's
+// 1 Mbaud with frame overhead.
+//
+//   make test   (or: ./tests/test_delta.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/delta.h"
+#include "bootloader/image.h"
+#include "bootloader/protocol.h"
+
+#include "delta_enc.h"
+#include "test_util.h"
+
+namespace {
+
+constexpr int BOARD_BAUD = 1000000;
+constexpr const char *APM_IMAGE = "apm_app.smup";
+
+// apply `patch` to `base` in random pieces: input runs of 1..max_in bytes,
+// output room of 1..max_out bytes. returns the final status; the image in out
+int apply(const bytes &base, const bytes &patch, uint32_t out_len, bytes &out, std::mt19937 &rng,
+          size_t max_in, size_t max_out, bool &base_ok) {
+  bl_delta d;
+  bl_delta_init(&d, static_cast<uint32_t>(base.size()), out_len);
+  out.assign(out_len + 64U, 0xEE); // slack to catch overruns
+  size_t in = 0, o = 0;
+  base_ok = true;
+  for (int guard = 0; guard < 100000000; guard++) {
+    size_t n = std::min<size_t>(1U + rng() % max_in, patch.size() - in);
+    size_t cap = std::min<size_t>(1U + rng() % max_out, out.size() - o);
+    size_t used, made;
+    int st = bl_delta_run(&d, patch.data() + in, n, &used, out.data() + o, cap, &made);
+    in += used;
+    o += made;
+    if (o > out_len) {
+      base_ok = false; // wrote past the image
+      return BL_DELTA_BAD;
+    }
+    if (st == BL_DELTA_BASE) {
+      if (d.want_n == 0U || d.want_off + d.want_n > base.size()) {
+        base_ok = false;
+        return BL_DELTA_BAD;
+      }
+      memcpy(d.base_buf, base.data() + d.want_off, d.want_n);
+      bl_delta_base_loaded(&d);
+    } else if (st == BL_DELTA_MORE && in == patch.size()) {
+      return BL_DELTA_MORE; // patch ran out
+    } else if (st == BL_DELTA_DONE || st == BL_DELTA_BAD) {
+      out.resize(o);
+      return st;
+    }
+  }
+  return BL_DELTA_BAD;
+}
+
+// random edits: overwrites, inserts, deletes
+bytes mutate(const bytes &src, std::mt19937 &rng, int edits) {
+  bytes b = src;
+  for (int e = 0; e < edits; e++) {
+    size_t at = b.empty() ? 0 : rng() % b.size();
+    size_t n = 1U + rng() % 300U;
+    switch (rng() % 3U) {
+      case 0:
+        for (size_t i = at; i < std::min(b.size(), at + n); i++) {
+          b[i] = static_cast<uint8_t>(rng());
+        }
+        break;
+      case 1: {
+        bytes ins = random_bytes(n, rng);
+        b.insert(b.begin() + static_cast<long>(at), ins.begin(), ins.end());
+        break;
+      }
+      default:
+        b.erase(b.begin() + static_cast<long>(at),
+                b.begin() + static_cast<long>(std::min(b.size(), at + n)));
+        break;
+    }
+  }
+  return b;
+}
+
+void round_trips() {
+  std::mt19937 rng(0xDE17u);
+  int ok = 0, total = 0;
+  for (int round = 0; round < 60; round++) {
+    // mostly low-entropy bases (code-like repetition), some random
+    bytes base = random_bytes(static_cast<size_t>(rng() % 50000U), rng);
+    if (round % 2 == 0) {
+      for (auto &x : base) {
+        x &= 0x0F;
+      }
+    }
+    bytes img = mutate(base, rng, static_cast<int>(rng() % 12U));
+    if (round == 0) {
+      img.clear(); // empty image
+    } else if (round == 1) {
+      base.clear(); // nothing to copy from
+    }
+    bytes patch = delta_encode(base, img);
+    bytes out;
+    bool base_ok;
+    int st = apply(base, patch, static_cast<uint32_t>(img.size()), out, rng, 1U + rng() % 700U,
+                   1U + rng() % 5000U, base_ok);
+    total++;
+    if (st == BL_DELTA_DONE && base_ok && out == img) {
+      ok++;
+    } else {
+      printf("  round %d: status %d, base %zu -> image %zu, patch %zu\n", round, st,
+             base.size(), img.size(), patch.size());
+    }
+  }
+  printf("round trips: %d/%d rebuilt exactly\n", ok, total);
+  CHECK(ok == total);
+}
+
+// flipped bytes and truncations: never read outside the base, never write past
+// the image, and never report DONE with the wrong image
+void corrupted() {
+  std::mt19937 rng(0xBADDu);
+  bytes base = random_bytes(20000, rng);
+  bytes img = mutate(base, rng, 8);
+  bytes good = delta_encode(base, img);
+  int refused = 0, wrong_done = 0, unsafe = 0;
+  for (int round = 0; round < 2000; round++) {
+    bytes patch = good;
+    if (round % 4 == 0) {
+      patch.resize(rng() % patch.size());
+    } else {
+      for (int k = 0; k < 1 + static_cast<int>(rng() % 3U); k++) {
+        patch[rng() % patch.size()] ^= static_cast<uint8_t>(1U + rng() % 255U);
+      }
+    }
+    bytes out;
+    bool base_ok;
+    int st = apply(base, patch, static_cast<uint32_t>(img.size()), out, rng, 64, 512, base_ok);
+    if (!base_ok) {
+      unsafe++;
+    } else if (st == BL_DELTA_DONE && out != img) {
+      wrong_done++; // a flipped literal - the image crc catches these
+    } else if (st != BL_DELTA_DONE) {
+      refused++;
+    }
+  }
+  printf("corrupted patches: %d refused, %d rebuilt a wrong image (caught by the image "
+         "crc), %d out of bounds\n",
+         refused, wrong_done, unsafe);
+  CHECK(unsafe == 0);
+  CHECK(refused > 0);
+}
+
+// `n` new bytes at `at`: everything after moves up, and every aligned word that
+// points into flash past `at` is retargeted (literal pools, vector table,
+// function pointers), approximating the app as linked at 0x08000000
+bytes grow(const bytes &app, size_t at, const bytes &ins) {
+  const uint32_t flash = 0x08000000U;
+  bytes b = app;
+  for (size_t i = 0; i + 4U <= b.size(); i += 4U) {
+    uint32_t w;
+    memcpy(&w, &b[i], 4);
+    if (w >= flash + at && w < flash + app.size()) {
+      w += static_cast<uint32_t>(ins.size());
+      memcpy(&b[i], &w, 4);
+    }
+  }
+  b.insert(b.begin() + static_cast<long>(at), ins.begin(), ins.end());
+  return b;
+}
+
+double line_secs(size_t n) {
+  double frames = static_cast<double>((n + BL_MAX_PAYLOAD - 1U) / BL_MAX_PAYLOAD);
+  return (static_cast<double>(n) + frames * (8.0 + 4.0)) * 10.0 / BOARD_BAUD;
+}
+
+void apm_rebuilds() {
+  std::ifstream f(APM_IMAGE, std::ios::binary);
+  bytes stored((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  bl_image_header h;
+  if (stored.size() < BL_IMAGE_OFFSET) {
+    printf("%s not found, skipping the apm rebuild report\n", APM_IMAGE);
+    return;
+  }
+  memcpy(&h, stored.data(), sizeof(h));
+  bytes app(stored.begin() + BL_IMAGE_OFFSET, stored.end());
+  std::mt19937 rng(0xA9A9u);
+
+  struct rebuild {
+    const char *name;
+    bytes app;
+  };
+  std::vector<rebuild> cases;
+  {
+    bytes a = app; // a few constants change
+    for (size_t at : {app.size() / 5, app.size() / 2, app.size() * 4 / 5}) {
+      a[at] ^= 0x5A;
+      a[at + 1] ^= 0x01;
+    }
+    cases.push_back({"constant tweak", a});
+  }
+  cases.push_back({"function +48 bytes", grow(app, app.size() * 2 / 5, random_bytes(48, rng))});
+  {
+    // new code looks like old code: 6KB lifted from elsewhere, lightly changed
+    bytes feat(app.begin() + static_cast<long>(app.size() / 7),
+               app.begin() + static_cast<long>(app.size() / 7 + 6144U));
+    for (size_t i = 0; i < feat.size(); i += 1U + rng() % 16U) {
+      feat[i] = static_cast<uint8_t>(rng());
+    }
+    cases.push_back({"new 6KB feature", grow(app, app.size() * 7 / 10, feat)});
+  }
+
+  printf("\napm app rebuilds (%s, %zu bytes), line time at %d baud\n", APM_IMAGE, app.size(),
+         BOARD_BAUD);
+  printf("%-20s %10s %10s %8s %9s %9s\n", "rebuild", "blob", "patch", "patch%", "full", "delta");
+  for (const rebuild &c : cases) {
+    bytes image = blob(c.app, BL_TARGET_APM_H755, 1, false);
+    bytes patch = delta_encode(stored, image);
+    bytes out;
+    bool base_ok;
+    int st = apply(stored, patch, static_cast<uint32_t>(image.size()), out, rng, 1024, 4096,
+                   base_ok);
+    bool ok = st == BL_DELTA_DONE && base_ok && out == image && patch.size() * 4U < image.size();
+    printf("%-20s %10zu %10zu %7.2f%% %8.2fs %8.2fs%s\n", c.name, image.size(), patch.size(),
+           100.0 * static_cast<double>(patch.size()) / static_cast<double>(image.size()),
+           line_secs(image.size()), line_secs(patch.size()), ok ? "" : "  <-- FAIL");
+    if (!ok) {
+      fails++;
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  round_trips();
+  corrupted();
+  apm_rebuilds();
+  printf("test_delta: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,386 @@
+// host test for the FPGA's boot-time load (bootloader/fpga_load.h): the
+// sequencing, timeouts and golden fallback, over a mocked configuration port
+// whose DMA completes on a simulated clock, a mocked FPGA that raises DONE only
+// for an intact bitstream and answers the magic a little after, and a DAC mute
+// whose every change is logged against that clock.
+//
+// a bitstream here ends in a crc32 of the rest, standing in for the FPGA's own
+// check: the mock FPGA configures only if what the port delivered is intact.
+// cases: the active bitstream loads; a bad header, a corrupt bitstream, a
+// failed or hung DMA chunk and a design with the wrong magic each fall back to
+// golden; both bad leave the DAC muted. the DAC is let go only once the magic
+// reads back, never before. a pause (the QSPI map off for a record write)
+// keeps chunks off the map and costs no timeout. last, the load overlapped
+// with a mocked app stage against one run after it: printed per case, the
+// FPGA's wait after the stage.
+//
+//   make test   (or: ./tests/test_fpga_load.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/fpga_load.h"
+#include "bootloader/image.h"
+#include "bootloader/protocol.h"
+
+#include "test_util.h"
+
+namespace {
+
+constexpr uint32_t SLOT_SIZE = 0x00100000U; // BL_SLOT_FPGA_ACTIVE / _GOLDEN
+constexpr double SPI_BYTES_MS = 3125.0;     // 25 MHz
+constexpr double SPIN_MS = 0.001;           // what one look at the clock costs
+constexpr double WORD_MS = 0.016;           // one H7 flash word program
+constexpr double DONE_DELAY_MS = 2.0;       // last byte -> DONE
+constexpr double MAGIC_DELAY_MS = 5.0;      // DONE -> the design answers
+
+// a bitstream the mock FPGA accepts: random, then a crc32 of the rest
+bytes bitstream(size_t n, uint32_t seed) {
+  bytes b = random_bytes(n, seed);
+  uint32_t c = bl_crc32(b.data(), n - 4U);
+  memcpy(b.data() + n - 4U, &c, 4U);
+  return b;
+}
+
+// a slot around `bits`, as mkupdate builds it
+bytes slot(const bytes &bits, uint16_t target = BL_TARGET_FPGA_GW2AR18) {
+  return in_slot(blob(bits, target, 1, false), SLOT_SIZE);
+}
+
+struct mute_event {
+  double t;
+  int on;
+};
+
+// the port, the DMA, the FPGA, the DAC and the clock
+struct mock {
+  double now = 0.0;
+  // the port
+  bool open = false;     // between begin and end
+  bytes got;             // what the FPGA received since its last reset
+  double dma_end = 0.0;  // the chunk in flight finishes then
+  bool inflight = false;
+  unsigned chunks = 0;
+  unsigned begins = 0;
+  uint32_t max_chunk = 0;
+  int fail_chunk = -1;   // this chunk (from 0, counting all) reports an error
+  int hang_chunk = -1;   // this one never finishes
+  // the FPGA
+  bool configured = false;
+  double done_at = 0.0;
+  uint16_t design_magic = BL_FPGA_MAGIC; // what core.magic reads once it runs
+  // the map (bl_stage.c's record write takes it away)
+  bool map_off = false;
+  unsigned map_faults = 0;
+  // the DAC
+  std::vector<mute_event> mutes;
+  bool magic_seen = false; // a read returned BL_FPGA_MAGIC
+  double magic_at = 0.0;
+
+  static mock &of(void *ctx) { return *static_cast<mock *>(ctx); }
+
+  static int begin(void *ctx) {
+    mock &m = of(ctx);
+    m.begins++;
+    m.inflight = false; // a transfer a failed load left behind is stopped
+    m.open = true;
+    m.configured = false;
+    m.got.clear();
+    m.now += 3.0; // RECONFIG_N, the FPGA's init
+    return 0;
+  }
+  static int send(void *ctx, const uint8_t *p, uint32_t n) {
+    mock &m = of(ctx);
+    if (m.map_off || !m.open || m.inflight) {
+      m.map_faults++;
+    }
+    m.got.insert(m.got.end(), p, p + n);
+    m.dma_end = m.now + n / SPI_BYTES_MS;
+    m.inflight = true;
+    m.max_chunk = (n > m.max_chunk) ? n : m.max_chunk;
+    m.chunks++;
+    return 0;
+  }
+  static int busy(void *ctx) {
+    mock &m = of(ctx);
+    int k = static_cast<int>(m.chunks) - 1;
+    if (k == m.fail_chunk) {
+      m.inflight = false;
+      return -1;
+    }
+    if (k == m.hang_chunk || m.now < m.dma_end) {
+      if (m.map_off) {
+        m.map_faults++; // the DMA is reading a map that is gone
+      }
+      return 1;
+    }
+    m.inflight = false;
+    return 0;
+  }
+  static int end(void *ctx) {
+    mock &m = of(ctx);
+    m.open = false;
+    size_t n = m.got.size();
+    uint32_t c = 0;
+    if (n > 4U) {
+      memcpy(&c, m.got.data() + n - 4U, 4U);
+    }
+    m.configured = n > 4U && bl_crc32(m.got.data(), n - 4U) == c;
+    m.done_at = m.now + DONE_DELAY_MS;
+    return 0;
+  }
+  static int done(void *ctx) {
+    mock &m = of(ctx);
+    return (m.configured && m.now >= m.done_at) ? 1 : 0;
+  }
+  static uint16_t magic(void *ctx) {
+    mock &m = of(ctx);
+    uint16_t v = (m.configured && m.now >= m.done_at + MAGIC_DELAY_MS) ? m.design_magic : 0xFFFFU;
+    if (v == BL_FPGA_MAGIC && !m.magic_seen) {
+      m.magic_seen = true;
+      m.magic_at = m.now;
+    }
+    return v;
+  }
+  static void mute(void *ctx, int on) {
+    mock &m = of(ctx);
+    m.mutes.push_back({m.now, on});
+  }
+  static uint32_t ms(void *ctx) {
+    mock &m = of(ctx);
+    m.now += SPIN_MS;
+    return static_cast<uint32_t>(m.now);
+  }
+};
+
+bl_fpga_ops ops_for(mock &m) {
+  return {&m, mock::begin, mock::send, mock::busy, mock::end, mock::done, mock::magic, mock::mute,
+          mock::ms};
+}
+
+// the DAC: muted first, let go at most once and only after the magic read
+// back, and only if the load came up
+void check_mute(const mock &m, int state) {
+  CHECK(!m.mutes.empty() && m.mutes.front().on == 1 && m.mutes.front().t == 0.0);
+  unsigned lets = 0;
+  for (const mute_event &e : m.mutes) {
+    if (e.on == 0) {
+      lets++;
+      CHECK(m.magic_seen && e.t >= m.magic_at);
+    }
+  }
+  CHECK(lets == ((state == BL_FPGA_READY) ? 1U : 0U));
+}
+
+struct outcome {
+  int state;
+  bl_fpga f;
+  mock m;
+};
+
+// one load from `active` and `golden`, finished with nothing else going on
+void run(outcome &o, const bytes &active, const bytes &golden) {
+  const bl_fpga_ops ops = ops_for(o.m);
+  bl_fpga_begin(&o.f, &ops, active.empty() ? nullptr : active.data(), golden.data());
+  o.state = bl_fpga_finish(&o.f);
+  o.f.ops = nullptr; // ops was on this stack
+  check_mute(o.m, o.state);
+  CHECK(o.m.map_faults == 0U);
+}
+
+// the FPGA holds exactly `bits`
+bool holds(const mock &m, const bytes &bits) { return m.configured && m.got == bits; }
+
+const char *const why_names[] = {"ok", "header", "port", "dma", "done", "magic"};
+
+void report(const char *name, const outcome &o) {
+  printf("  %-24s %-6s slot %u  active: %-6s golden: %-6s %3u chunks %3u begins  %7.1f ms\n", name,
+         (o.state == BL_FPGA_READY) ? "READY" : "FAILED", static_cast<unsigned>(o.f.cur),
+         why_names[o.f.why[0]], why_names[o.f.why[1]], o.m.chunks, o.m.begins, o.m.now);
+}
+
+void cases() {
+  const bytes a_bits = bitstream(700000U, 1U);
+  const bytes g_bits = bitstream(650000U, 2U);
+  const bytes a = slot(a_bits);
+  const bytes g = slot(g_bits);
+
+  printf("loads:\n");
+  {
+    outcome o;
+    run(o, a, g);
+    report("active", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 0U && o.f.why[0] == BL_FPGA_OK);
+    CHECK(holds(o.m, a_bits));
+    CHECK(o.m.begins == 1U);
+    CHECK(o.m.chunks == (a_bits.size() + BL_FPGA_CHUNK - 1U) / BL_FPGA_CHUNK);
+    CHECK(o.m.max_chunk == BL_FPGA_CHUNK);
+  }
+  {
+    bytes bad = a;
+    bad[4] ^= 0x01U; // the header's crc no longer agrees
+    outcome o;
+    run(o, bad, g);
+    report("bad header", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_HEADER);
+    CHECK(o.m.begins == 1U); // nothing of the bad one was sent
+    CHECK(holds(o.m, g_bits));
+  }
+  {
+    outcome o;
+    run(o, bytes(), g);
+    report("no active slot", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_HEADER);
+  }
+  {
+    outcome o;
+    run(o, slot(a_bits, BL_TARGET_APM_H755), g);
+    report("an app in the slot", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_HEADER);
+  }
+  {
+    bytes bad = a;
+    bad[BL_IMAGE_OFFSET + 300000U] ^= 0x80U; // header fine, bitstream not
+    outcome o;
+    run(o, bad, g);
+    report("corrupt bitstream", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_DONE);
+    CHECK(o.m.begins == 2U && holds(o.m, g_bits));
+  }
+  {
+    outcome o;
+    o.m.fail_chunk = 7;
+    run(o, a, g);
+    report("dma error", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_DMA);
+    CHECK(holds(o.m, g_bits));
+  }
+  {
+    outcome o;
+    o.m.hang_chunk = 3;
+    run(o, a, g);
+    report("dma hang", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_DMA);
+    CHECK(holds(o.m, g_bits));
+  }
+  {
+    // a bitstream for the wrong board: it configures, the design does not
+    // answer. the golden one then answers (the mock's magic is per design, so
+    // switch it when the golden load begins)
+    outcome o;
+    o.m.design_magic = 0x0000U;
+    const bl_fpga_ops ops = ops_for(o.m);
+    bl_fpga_begin(&o.f, &ops, a.data(), g.data());
+    while (o.f.cur == 0U && bl_fpga_poll(&o.f) != BL_FPGA_FAILED) {
+    }
+    o.m.design_magic = BL_FPGA_MAGIC;
+    o.state = bl_fpga_finish(&o.f);
+    o.f.ops = nullptr;
+    check_mute(o.m, o.state);
+    report("wrong magic", o);
+    CHECK(o.state == BL_FPGA_READY && o.f.cur == 1U && o.f.why[0] == BL_FPGA_E_MAGIC);
+    CHECK(holds(o.m, g_bits));
+  }
+  {
+    bytes bad_a = a;
+    bad_a[BL_IMAGE_OFFSET + 10U] ^= 0x01U;
+    bytes bad_g = g;
+    bad_g[0] ^= 0x01U;
+    outcome o;
+    run(o, bad_a, bad_g);
+    report("both bad", o);
+    CHECK(o.state == BL_FPGA_FAILED && o.f.why[0] == BL_FPGA_E_DONE &&
+          o.f.why[1] == BL_FPGA_E_HEADER);
+    CHECK(o.m.mutes.size() == 1U); // muted, and left that way
+  }
+}
+
+// the record write: pause, the map off for longer than a chunk may take, back
+void pause() {
+  const bytes bits = bitstream(700000U, 3U);
+  const bytes a = slot(bits);
+  const bytes g = slot(bitstream(650000U, 4U));
+  mock m;
+  const bl_fpga_ops ops = ops_for(m);
+  bl_fpga f;
+  bl_fpga_begin(&f, &ops, a.data(), g.data());
+  while (m.chunks < 5U) {
+    bl_fpga_poll(&f);
+  }
+  CHECK(m.inflight);
+  bl_fpga_pause(&f);
+  CHECK(!m.inflight); // waited out
+  unsigned before = m.chunks;
+  m.map_off = true;
+  double off = m.now;
+  while (m.now < off + 3.0 * BL_FPGA_CHUNK_MS) {
+    bl_fpga_poll(&f); // the staging loop goes on polling meanwhile
+    m.now += WORD_MS;
+  }
+  CHECK(m.chunks == before);
+  m.map_off = false;
+  bl_fpga_resume(&f);
+  CHECK(bl_fpga_finish(&f) == BL_FPGA_READY);
+  CHECK(f.cur == 0U && f.why[0] == BL_FPGA_OK && holds(m, bits));
+  CHECK(m.map_faults == 0U);
+  check_mute(m, f.state);
+}
+
+// the boot: an app stage of `words` flash word programs with the load polled
+// from each wait, then finished. returns the FPGA's wait after the stage
+double boot(const bytes &a, const bytes &g, unsigned words, double *stage_ms) {
+  mock m;
+  const bl_fpga_ops ops = ops_for(m);
+  bl_fpga f;
+  bl_fpga_begin(&f, &ops, a.data(), g.data());
+  double start = m.now;
+  for (unsigned i = 0; i < words; i++) {
+    m.now += WORD_MS;
+    bl_fpga_poll(&f);
+  }
+  double staged = m.now;
+  CHECK(bl_fpga_finish(&f) == BL_FPGA_READY);
+  CHECK(m.map_faults == 0U);
+  *stage_ms = staged - start;
+  return m.now - staged;
+}
+
+void overlap() {
+  const bytes a = slot(bitstream(700000U, 5U));
+  const bytes g = slot(bitstream(650000U, 6U));
+  double alone_stage = 0.0;
+  double alone = boot(a, g, 0U, &alone_stage); // the load on its own
+  printf("boot, a 700000-byte bitstream (%.1f ms alone):\n", alone);
+  printf("  %-26s %10s %12s %12s\n", "stage", "stage ms", "fpga after", "serial");
+  const unsigned apps[] = {0U, 4096U, 16384U, 24576U};
+  for (unsigned words : apps) {
+    double stage = 0.0;
+    double after = boot(a, g, words, &stage);
+    char name[40];
+    if (words == 0U) {
+      snprintf(name, sizeof(name), "skipped (exec holds it)");
+    } else {
+      snprintf(name, sizeof(name), "%u KB copied", words * 32U / 1024U);
+    }
+    printf("  %-26s %10.1f %10.1fms %10.1fms\n", name, stage, after, stage + alone);
+    // the load runs under the stage: only what is left of it shows after
+    if (stage > alone) {
+      CHECK(after < DONE_DELAY_MS + MAGIC_DELAY_MS + 2.0);
+    } else {
+      CHECK(after < alone - stage + 2.0);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  cases();
+  pause();
+  overlap();
+  printf("test_fpga_load: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
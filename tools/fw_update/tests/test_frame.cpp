@@ -0,0 +1,125 @@
+// host unit test: the span parser (bl_frame_feed_buf) must report exactly what
+// the byte parser reports - same frames, same crc/len errors, same resyncs -
+// however the stream is chunked. also checks the payload sink: sunk payloads
+// land at the sink's pointer and never in rx->frame.payload.
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/frame.h"
+
+#include "test_util.h"
+
+namespace {
+
+struct event {
+  int status;
+  uint8_t type;
+  uint16_t seq;
+  uint16_t len;
+  uint32_t crc; // of the payload as delivered
+};
+
+// a noisy stream: frames of random size with line garbage (including stray
+// SOF bytes) between them, and some frames corrupted
+std::vector<uint8_t> make_stream(std::mt19937 &rng) {
+  std::vector<uint8_t> s;
+  uint8_t pl[BL_MAX_PAYLOAD];
+  uint8_t fr[8U + BL_MAX_PAYLOAD + 4U];
+  for (int k = 0; k < 300; k++) {
+    int junk = rng() % 6;
+    for (int j = 0; j < junk; j++) {
+      s.push_back((rng() & 1U) ? 0xA5 : static_cast<uint8_t>(rng()));
+    }
+    uint16_t len = static_cast<uint16_t>(rng() % (BL_MAX_PAYLOAD + 1U));
+    for (uint16_t j = 0; j < len; j++) {
+      pl[j] = static_cast<uint8_t>(rng());
+    }
+    size_t n = bl_frame_encode(BL_DATA, static_cast<uint16_t>(k), pl, len, fr, sizeof(fr));
+    if (rng() % 8 == 0) {
+      fr[2 + rng() % (n - 2)] ^= static_cast<uint8_t>(1U << (rng() % 8));
+    }
+    s.insert(s.end(), fr, fr + n);
+  }
+  return s;
+}
+
+std::vector<event> parse_bytes(const std::vector<uint8_t> &s) {
+  std::vector<event> ev;
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  for (uint8_t b : s) {
+    int st = bl_frame_feed(&rx, b);
+    if (st != BL_FRAME_MORE) {
+      const bl_frame &f = rx.frame;
+      ev.push_back({st, f.type, f.seq, f.len, bl_crc32(rx.dst, st == BL_FRAME_OK ? f.len : 0)});
+    }
+  }
+  return ev;
+}
+
+uint8_t sink_buf[BL_MAX_PAYLOAD];
+
+uint8_t *sink(void *ctx, const bl_frame *hdr) {
+  (void)ctx;
+  return (hdr->seq & 1U) ? sink_buf : nullptr; // odd frames go to the sink
+}
+
+std::vector<event> parse_spans(const std::vector<uint8_t> &s, std::mt19937 &rng, bool use_sink) {
+  std::vector<event> ev;
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  if (use_sink) {
+    bl_frame_rx_set_sink(&rx, sink, nullptr);
+  }
+  size_t off = 0;
+  while (off < s.size()) {
+    size_t n = std::min<size_t>(1 + rng() % 3000, s.size() - off);
+    size_t i = 0;
+    while (i < n) {
+      int st;
+      i += bl_frame_feed_buf(&rx, s.data() + off + i, n - i, &st);
+      if (st != BL_FRAME_MORE) {
+        const bl_frame &f = rx.frame;
+        if (use_sink && st == BL_FRAME_OK && f.len > 0) {
+          CHECK(rx.dst == ((f.seq & 1U) ? sink_buf : rx.frame.payload));
+        }
+        ev.push_back({st, f.type, f.seq, f.len, bl_crc32(rx.dst, st == BL_FRAME_OK ? f.len : 0)});
+      }
+    }
+    off += n;
+  }
+  return ev;
+}
+
+bool same(const std::vector<event> &a, const std::vector<event> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].status != b[i].status || a[i].seq != b[i].seq || a[i].len != b[i].len ||
+        (a[i].status == BL_FRAME_OK && a[i].crc != b[i].crc)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(0xF00Du);
+  for (int trial = 0; trial < 20; trial++) {
+    std::vector<uint8_t> s = make_stream(rng);
+    std::vector<event> ref = parse_bytes(s);
+    CHECK(ref.size() > 200U);
+    CHECK(same(ref, parse_spans(s, rng, false)));
+    CHECK(same(ref, parse_spans(s, rng, true)));
+  }
+
+  printf("test_frame: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
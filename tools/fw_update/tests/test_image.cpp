@@ -0,0 +1,237 @@
+// host test for the image block crc table (bootloader/image.h): mkupdate's
+// table (bl_image_add_blocks), validation that stops at the first bad block, a
+// re-check of any range of blocks, and the staging pipeline (stage_pipe.h)
+// stopping at the first bad block of its source.
+//
+// how much of a slot a check reads is measured, not worked out: the image sits
+// in pages that start out unreadable, and each first touch of a page is counted
+// and opened (4KB pages, the size of a NOR sector). printed per image size and
+// corruption point: bytes read before the image is rejected with the table and
+// without it (the same image built without one, checked on image_crc32).
+//
+//   make test   (or: ./tests/test_image.bin)
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/image.h"
+#include "bootloader/protocol.h"
+#include "bootloader/stage_pipe.h"
+
+#include "test_util.h"
+
+namespace {
+
+// a slot in pages that count their first read
+struct watched {
+  uint8_t *p = nullptr;
+  size_t size = 0;
+};
+
+long page_size = 4096;
+volatile sig_atomic_t touched = 0;
+
+void on_fault(int, siginfo_t *si, void *) {
+  uintptr_t a = reinterpret_cast<uintptr_t>(si->si_addr) & ~static_cast<uintptr_t>(page_size - 1);
+  mprotect(reinterpret_cast<void *>(a), static_cast<size_t>(page_size), PROT_READ);
+  touched = touched + 1;
+}
+
+watched watch(const bytes &slot) {
+  watched w;
+  w.size = (slot.size() + page_size - 1) / page_size * page_size;
+  void *m = mmap(nullptr, w.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  w.p = static_cast<uint8_t *>(m);
+  memcpy(w.p, slot.data(), slot.size());
+  return w;
+}
+
+// bytes of `w` that `check` reads (whole pages)
+template <typename F> size_t bytes_read(watched &w, F check) {
+  mprotect(w.p, w.size, PROT_NONE);
+  touched = 0;
+  check();
+  mprotect(w.p, w.size, PROT_READ | PROT_WRITE);
+  return static_cast<size_t>(touched) * static_cast<size_t>(page_size);
+}
+
+void unwatch(watched &w) { munmap(w.p, w.size); }
+
+bytes slot_for(size_t len, uint32_t seed, bool table) {
+  return blob(random_bytes(len, seed), BL_TARGET_APM_H755, 1, table);
+}
+
+const bl_image_header *hdr(const bytes &s) {
+  return reinterpret_cast<const bl_image_header *>(s.data());
+}
+
+// the table's shape across sizes: 4KB blocks until it would not fit the pad
+void table_shape() {
+  struct {
+    size_t len;
+    uint32_t want_block;
+  } cases[] = {{1U, 4096U},
+               {4096U, 4096U},
+               {100000U, 4096U},
+               {BL_IMAGE_BLOCKS_MAX * 4096U, 4096U},
+               {BL_IMAGE_BLOCKS_MAX * 4096U + 1U, 8192U},
+               {1024U * 1024U, 16384U}};
+  for (const auto &c : cases) {
+    bytes s = slot_for(c.len, 0x7AB1u, true);
+    uint32_t bs = 0;
+    CHECK(bl_image_blocks(s.data(), &bs) != nullptr);
+    CHECK(bs == c.want_block);
+    CHECK(bl_image_check_header(s.data()) == 0);
+    CHECK(bl_image_validate(s.data()) == 0);
+  }
+}
+
+void early_exit() {
+  printf("%-8s %-12s %12s %12s\n", "image", "bad byte at", "read, table", "read, crc");
+  const size_t sizes[] = {192U * 1024U, 1024U * 1024U};
+  const double where[] = {0.0, 0.3, 0.999};
+  for (size_t len : sizes) {
+    bytes good = slot_for(len, 0xB10Cu, true);
+    bytes plain = slot_for(len, 0xB10Cu, false);
+    watched wg = watch(good);
+    size_t all = bytes_read(wg, [&] { CHECK(bl_image_validate(wg.p) == 0); });
+    CHECK(all >= len);
+    unwatch(wg);
+
+    uint32_t bs = 0;
+    bl_image_blocks(good.data(), &bs);
+    for (double f : where) {
+      size_t at = static_cast<size_t>(f * static_cast<double>(len));
+      bytes bad = good;
+      bytes badp = plain;
+      bad[BL_IMAGE_OFFSET + at] ^= 0x10;
+      badp[BL_IMAGE_OFFSET + at] ^= 0x10;
+      watched wb = watch(bad);
+      watched wp = watch(badp);
+      size_t with = bytes_read(wb, [&] { CHECK(bl_image_validate(wb.p) == -3); });
+      size_t without = bytes_read(wp, [&] { CHECK(bl_image_validate(wp.p) == -3); });
+      printf("%6zuK %11zuK %11zuK %11zuK\n", len / 1024U, at / 1024U, with / 1024U,
+             without / 1024U);
+      // the table check reads through the bad block and no further
+      size_t end_of_block = BL_IMAGE_OFFSET + (at / bs + 1U) * bs;
+      size_t ps = static_cast<size_t>(page_size);
+      CHECK(with <= (end_of_block + ps - 1U) / ps * ps);
+      CHECK(without >= len);
+      // and a re-check names it
+      CHECK(bl_image_check_blocks(bad.data(), 0U, 1000U) == static_cast<int32_t>(at / bs));
+      unwatch(wb);
+      unwatch(wp);
+    }
+  }
+}
+
+// re-checking part of an image reads only that part
+void partial() {
+  size_t len = 512U * 1024U;
+  bytes s = slot_for(len, 0x9A87u, true);
+  uint32_t bs = 0;
+  bl_image_blocks(s.data(), &bs);
+  uint32_t count = static_cast<uint32_t>((len + bs - 1U) / bs);
+  s[BL_IMAGE_OFFSET + 40U * bs + 7U] ^= 0x01;
+
+  CHECK(bl_image_check_blocks(s.data(), 0U, 40U) == 40);     // all good before it
+  CHECK(bl_image_check_blocks(s.data(), 38U, 5U) == 40);     // finds it
+  CHECK(bl_image_check_blocks(s.data(), 41U, 1000U) == static_cast<int32_t>(count)); // clipped
+  CHECK(bl_image_check_blocks(s.data(), count + 3U, 2U) == static_cast<int32_t>(count));
+
+  watched w = watch(s);
+  size_t one = bytes_read(w, [&] { CHECK(bl_image_check_blocks(w.p, 10U, 1U) == 11); });
+  printf("re-check of one %uK block: %zuK read\n", bs / 1024U, one / 1024U);
+  CHECK(one <= 2U * static_cast<size_t>(page_size) + bs); // the header and table page, and the block
+  unwatch(w);
+}
+
+// a damaged table is no table: the image still validates on image_crc32, and
+// an image without one (an older mkupdate) validates as before
+void fallbacks() {
+  bytes s = slot_for(300U * 1024U, 0xFA11u, true);
+  s[BL_IMAGE_BLOCKS_AT + 8U] ^= 0x01;
+  uint32_t bs = 0;
+  CHECK(bl_image_blocks(s.data(), &bs) == nullptr);
+  CHECK(bl_image_check_blocks(s.data(), 0U, 1U) == -1);
+  CHECK(bl_image_validate(s.data()) == 0);
+  s[BL_IMAGE_OFFSET + 5U] ^= 0x01;
+  CHECK(bl_image_validate(s.data()) == -3);
+
+  bytes old = slot_for(300U * 1024U, 0xFA11u, false);
+  CHECK((hdr(old)->flags & BL_IMAGE_F_BLOCKS) == 0U);
+  CHECK(bl_image_blocks(old.data(), &bs) == nullptr);
+  CHECK(bl_image_validate(old.data()) == 0);
+}
+
+// staging stops at the source's first bad block, before erasing the sectors
+// past it
+bytes exec_mem;
+
+int x_erase(void *, uint32_t off) {
+  memset(exec_mem.data() + off, 0xFF, BL_IFLASH_SECTOR);
+  return 0;
+}
+int x_program(void *, uint32_t off, const uint8_t *w) {
+  memcpy(exec_mem.data() + off, w, BL_IFLASH_WORD);
+  return 0;
+}
+int x_busy(void *) { return 0; }
+int x_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  memcpy(p, static_cast<const uint8_t *>(ctx) + off, n);
+  return 0;
+}
+
+void staging() {
+  size_t len = 1024U * 1024U;
+  bytes s = slot_for(len, 0x57A6u, true);
+  const bl_image_header *h = hdr(s);
+  uint32_t bs = 0;
+  const uint32_t *blocks = bl_image_blocks(s.data(), &bs);
+  exec_mem.assign(len, 0);
+  static bl_stage_pipe pipe;
+  bl_iflash fl = {nullptr, x_erase, x_program, x_busy, exec_mem.data()};
+
+  bl_stage_src src = {s.data() + BL_IMAGE_OFFSET, x_read};
+  CHECK(bl_stage_pipe_run(&pipe, &fl, &src, h->length, h->image_crc32, blocks, bs) == 0);
+  CHECK(memcmp(exec_mem.data(), s.data() + BL_IMAGE_OFFSET, len) == 0);
+
+  size_t at = 200U * 1024U + 3U;
+  s[BL_IMAGE_OFFSET + at] ^= 0x80;
+  int rc = bl_stage_pipe_run(&pipe, &fl, &src, h->length, h->image_crc32, blocks, bs);
+  uint32_t erases_with = pipe.erases;
+  uint32_t read_with = pipe.read;
+  CHECK(rc == -3);
+  CHECK(read_with == (at / bs + 1U) * bs);
+  rc = bl_stage_pipe_run(&pipe, &fl, &src, h->length, h->image_crc32, nullptr, 0U);
+  CHECK(rc == -3);
+  printf("staging a 1024K image bad at %zuK: stops after %uK read, %u sector erases "
+         "(without the table: %uK, %u)\n",
+         at / 1024U, read_with / 1024U, erases_with, pipe.read / 1024U, pipe.erases);
+  CHECK(erases_with < pipe.erases);
+}
+
+} // namespace
+
+int main() {
+  page_size = sysconf(_SC_PAGESIZE);
+  struct sigaction sa = {};
+  sa.sa_sigaction = on_fault;
+  sa.sa_flags = SA_SIGINFO;
+  sigaction(SIGSEGV, &sa, nullptr);
+
+  table_shape();
+  early_exit();
+  partial();
+  fallbacks();
+  staging();
+  printf("test_image: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
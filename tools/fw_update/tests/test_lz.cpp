@@ -0,0 +1,180 @@
+// host test for the compressed transport: the encoder (lz_enc.cpp, what
+// mkupdate --lz runs) against the bootloader's decoder (lib/bootloader/src/lz.c).
+// every block is decompressed the way the session does it - compressed bytes in
+// arbitrary pieces, output into small windows - and must give the image back
+// exactly. every match must stay within the 4KB window, and malformed blocks
+// must be refused without writing past the image.
+//
+//   make test   (or: ./tests/test_lz.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/lz.h"
+
+#include "lz_enc.h"
+#include "test_util.h"
+
+namespace {
+
+// decompress `block` in random pieces: input runs of 1..max_in bytes, output
+// room of 1..max_out bytes. returns the final status; the image in out, and
+// overrun set if anything was written past out_len
+int apply(const bytes &block, uint32_t out_len, bytes &out, std::mt19937 &rng, size_t max_in,
+          size_t max_out, bool &overrun) {
+  static bl_lz z;
+  bl_lz_init(&z, out_len);
+  out.assign(out_len + 64U, 0xEE); // slack to catch overruns
+  size_t in = 0, o = 0;
+  overrun = false;
+  for (int guard = 0; guard < 100000000; guard++) {
+    size_t n = std::min<size_t>(1U + rng() % max_in, block.size() - in);
+    size_t cap = std::min<size_t>(1U + rng() % max_out, out.size() - o);
+    size_t used, made;
+    int st = bl_lz_run(&z, block.data() + in, n, &used, out.data() + o, cap, &made);
+    in += used;
+    o += made;
+    if (o > out_len) {
+      overrun = true;
+      return BL_LZ_BAD;
+    }
+    if (st == BL_LZ_MORE && in == block.size()) {
+      return BL_LZ_MORE; // block ran out
+    }
+    if (st == BL_LZ_DONE || st == BL_LZ_BAD) {
+      out.resize(o);
+      return st;
+    }
+  }
+  return BL_LZ_BAD;
+}
+
+// runs, short repeats, repeats just inside and just outside the window
+bytes structured(size_t n, std::mt19937 &rng) {
+  bytes b;
+  while (b.size() < n) {
+    switch (rng() % 4U) {
+      case 0: {
+        bytes r = random_bytes(1U + rng() % 200U, rng);
+        b.insert(b.end(), r.begin(), r.end());
+        break;
+      }
+      case 1:
+        b.insert(b.end(), 1U + rng() % 600U, static_cast<uint8_t>(rng()));
+        break;
+      default: {
+        size_t back = 1U + rng() % (BL_LZ_WINDOW + 512U);
+        size_t len = 1U + rng() % 300U;
+        for (size_t i = 0; i < len && back <= b.size(); i++) {
+          b.push_back(b[b.size() - back]);
+        }
+        break;
+      }
+    }
+  }
+  b.resize(n);
+  return b;
+}
+
+// walk the block's sequences: the largest match offset it uses
+size_t max_offset(const bytes &block) {
+  size_t i = 0, most = 0;
+  auto len = [&](size_t l) {
+    if (l == 15U) {
+      uint8_t x;
+      do {
+        x = block[i++];
+        l += x;
+      } while (x == 255U);
+    }
+    return l;
+  };
+  while (i < block.size()) {
+    uint8_t token = block[i++];
+    i += len(token >> 4);
+    if (i >= block.size()) {
+      break;
+    }
+    size_t off = block[i] | (block[i + 1] << 8);
+    i += 2;
+    most = std::max(most, off);
+    len(token & 0x0FU);
+  }
+  return most;
+}
+
+void round_trips() {
+  std::mt19937 rng(0x1247u);
+  int ok = 0, total = 0;
+  size_t widest = 0;
+  for (int round = 0; round < 80; round++) {
+    size_t n = rng() % 60000U;
+    bytes img = (round % 3 == 0) ? random_bytes(n, rng) : structured(n, rng);
+    if (round == 0) {
+      img.clear();
+    } else if (round == 1) {
+      img.assign(5, 0x42); // shorter than LZ4's last literals
+    }
+    bytes block = lz_compress(img);
+    widest = std::max(widest, max_offset(block));
+    bytes out;
+    bool overrun;
+    int st = apply(block, static_cast<uint32_t>(img.size()), out, rng, 1U + rng() % 1100U,
+                   1U + rng() % 5000U, overrun);
+    total++;
+    if (st == BL_LZ_DONE && !overrun && out == img) {
+      ok++;
+    } else {
+      printf("  round %d: status %d, image %zu, block %zu\n", round, st, img.size(),
+             block.size());
+    }
+  }
+  printf("round trips: %d/%d decompressed exactly, largest offset %zu\n", ok, total, widest);
+  CHECK(ok == total);
+  CHECK(widest <= BL_LZ_WINDOW);
+}
+
+// flipped bytes and truncations: never write past the image, never report DONE
+// with the wrong image unless a literal was hit (the image crc catches those)
+void corrupted() {
+  std::mt19937 rng(0xC0DEu);
+  bytes img = structured(30000, rng);
+  bytes good = lz_compress(img);
+  int refused = 0, wrong_done = 0, unsafe = 0;
+  for (int round = 0; round < 3000; round++) {
+    bytes block = good;
+    if (round % 4 == 0) {
+      block.resize(rng() % block.size());
+    } else {
+      for (int k = 0; k < 1 + static_cast<int>(rng() % 3U); k++) {
+        block[rng() % block.size()] ^= static_cast<uint8_t>(1U + rng() % 255U);
+      }
+    }
+    bytes out;
+    bool overrun;
+    int st = apply(block, static_cast<uint32_t>(img.size()), out, rng, 64, 512, overrun);
+    if (overrun) {
+      unsafe++;
+    } else if (st == BL_LZ_DONE && out != img) {
+      wrong_done++;
+    } else if (st != BL_LZ_DONE) {
+      refused++;
+    }
+  }
+  printf("corrupted blocks: %d refused, %d decompressed a wrong image (caught by the image "
+         "crc), %d overruns\n",
+         refused, wrong_done, unsafe);
+  CHECK(unsafe == 0);
+  CHECK(refused > 0);
+}
+
+} // namespace
+
+int main() {
+  round_trips();
+  corrupted();
+  printf("test_lz: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
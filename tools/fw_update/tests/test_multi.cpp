@@ -0,0 +1,96 @@
+// host test for parallel flashing (update.bin --dev with a list or glob): one
+// app image to several simulated boards at once (sim_board.h: each its own pty,
+// session thread and W25Q128 part), every sender queueing the same DATA frames
+// encoded once (encoded_image), as update.bin does. the boards don't share a
+// line, so the rack should take about as long as one board: fails unless every
+// board ends with the image in its active slot and the parallel run stays
+// within 1.5x of a single transfer.
+//
+//   make test   (or: ./tests/test_multi.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/protocol.h"
+
+#include "sim_board.h"
+
+namespace {
+
+constexpr int BOARDS = 4;
+constexpr size_t APP_LEN = 256U * 1024U;
+
+std::string part_file(int i) { return "tests/test_multi." + std::to_string(i) + ".nor.bin"; }
+
+void rack() {
+  std::vector<uint8_t> img = blob(random_bytes(APP_LEN, 0x4ACCu));
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+
+  nor_model nor[BOARDS];
+  for (int i = 0; i < BOARDS; i++) {
+    if (!open_part(nor[i], part_file(i))) {
+      fails++;
+      return;
+    }
+  }
+
+  sim_result one = sim_transfer(nor[0], m, img);
+  CHECK(one.st.have_result && one.st.result.status == BL_OK);
+
+  encoded_image pre;
+  pre.build(img.data(), img.size(), BL_MAX_PAYLOAD);
+  sim_cfg c;
+  c.pre = &pre;
+  sim_result r[BOARDS];
+  uint32_t at[BOARDS]; // the app slot each board's update goes into
+  for (int i = 0; i < BOARDS; i++) {
+    at[i] = app_update_off(nor[i]);
+  }
+  std::vector<std::thread> th;
+  auto t0 = clk::now();
+  for (int i = 0; i < BOARDS; i++) {
+    th.emplace_back([&, i] { r[i] = sim_transfer(nor[i], m, img, c); });
+  }
+  for (std::thread &t : th) {
+    t.join();
+  }
+  double wall = std::chrono::duration<double>(clk::now() - t0).count() * TIME_SCALE;
+
+  printf("%zu KB image, %d boards in parallel at %d baud (board time)\n", img.size() / 1024U,
+         BOARDS, BOARD_BAUD);
+  printf("%-8s %-6s %8s %8s\n", "board", "result", "time", "resent");
+  for (int i = 0; i < BOARDS; i++) {
+    bool ok = r[i].st.have_result && r[i].st.result.status == BL_OK &&
+              memcmp(nor[i].mem + at[i], img.data(), img.size()) == 0;
+    printf("%-8d %-6s %7.2fs %8zu\n", i, ok ? "OK" : "FAIL", r[i].secs, r[i].st.resent);
+    CHECK(ok);
+  }
+  printf("rack: %.2fs, one board alone: %.2fs, %zu KB of DATA frames encoded once\n", wall,
+         one.secs, pre.wire.size() / 1024U);
+  CHECK(wall < 1.5 * one.secs);
+
+  for (int i = 0; i < BOARDS; i++) {
+    nor[i].close();
+    unlink(part_file(i).c_str());
+  }
+}
+
+} // namespace
+
+int main() {
+  rack();
+  printf("test_multi: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
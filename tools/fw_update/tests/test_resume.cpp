@@ -0,0 +1,212 @@
+// host test for resumable transfers, on the simulated board (sim_board.h). an
+// app image is sent while the board dies at random points - it stops answering
+// as if reset, the host notices the stall, and the board boots again on the
+// same part - until one attempt gets through. the same kill schedule is run
+// twice: restarting from byte zero every time, and asking the board where to
+// resume (BL_RESUME) and sending only the rest. printed: DATA bytes on the wire
+// over all attempts, and how many of them were resent (everything past the
+// image size: frames in flight when the board died, and the part since the last
+// logged sector).
+//
+// both runs must end with the image in the other app slot, the boot pointer
+// flipped to it once, and the image that was installed before untouched in the
+// slot that was active (a resumed transfer must keep going into the same slot).
+// then the progress log itself: a torn last mark falls back to the one before,
+// and another image gets offset 0.
+//
+//   make test   (or: ./tests/test_resume.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/protocol.h"
+#include "bootloader/resume_log.h"
+
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_resume.nor.bin";
+constexpr size_t APP_LEN = 512U * 1024U;
+constexpr int KILLS = 4;
+constexpr int STALL_MS = 1000; // host gives up on a dead board (board time)
+
+bl_manifest manifest_for(const bytes &img) {
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+  return m;
+}
+
+// a fresh part: an older image installed in the active slot (slot 1, with no
+// boot pointer yet), empty logs
+void reset_part(nor_model &nor, const bytes &old) {
+  memset(nor.mem + APP_0_OFF, 0xFF, 2U * SLOT_SIZE);
+  memset(nor.mem + PARAMS_OFF, 0xFF, 4U * BL_NOR_SECTOR);
+  memcpy(nor.mem + APP_1_OFF, old.data(), old.size());
+}
+
+// what a freshly booted board answers to BL_RESUME for `m`
+uint32_t offer_for(nor_model &nor, const bl_manifest &m) {
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return 0;
+  }
+  board b;
+  b.fd = slave;
+  b.nor = &nor;
+  std::thread th([&b] { b.serve(); });
+  uint32_t off = 0;
+  CHECK(query_resume(master, m, off));
+  b.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  return off;
+}
+
+struct run_stats {
+  int attempts = 0;
+  size_t sent = 0;  // DATA payload bytes, all attempts
+  double secs = 0.0;
+  bool ok = false;
+  uint32_t last_offer = 0;
+  bool offers_grow = true;
+};
+
+// `fracs`: each attempt dies after receiving this share of what it had to send
+run_stats run(nor_model &nor, const bytes &img, const bytes &old, bool resume,
+              const std::vector<double> &fracs) {
+  run_stats rs;
+  reset_part(nor, old);
+  bl_manifest m = manifest_for(img);
+  for (size_t k = 0; k <= fracs.size(); k++) {
+    uint32_t have = resume ? offer_for(nor, m) : 0U;
+    sim_cfg c;
+    c.resume = resume;
+    c.stall_ms = STALL_MS;
+    if (k < fracs.size()) {
+      // frames carry 12 bytes of overhead each; close enough for a kill point
+      c.kill_at = static_cast<long>(fracs[k] * static_cast<double>(img.size() - have));
+    }
+    sim_result r = sim_transfer(nor, m, img, c);
+    rs.attempts++;
+    rs.sent += r.st.bytes;
+    rs.secs += r.secs;
+    if (resume) {
+      rs.offers_grow = rs.offers_grow && r.offer == have && r.offer >= rs.last_offer;
+      rs.last_offer = r.offer;
+    }
+    if (r.st.have_result) {
+      rs.ok = r.st.result.status == BL_OK;
+      break;
+    }
+  }
+  bl_boot bp;
+  bl_boot_open(&bp, &nor.ops, PARAMS_OFF + BL_PARAMS_BOOT, PARAMS_OFF + BL_PARAMS_BOOT_2);
+  rs.ok = rs.ok && memcmp(nor.mem + APP_0_OFF, img.data(), img.size()) == 0 &&
+          memcmp(nor.mem + APP_1_OFF, old.data(), old.size()) == 0 && bp.cur.active == 0U &&
+          !bp.cur.confirmed && bp.cur.seq == 1U;
+  return rs;
+}
+
+// the host's stall notices are expected here
+int quiet_stderr() {
+  fflush(stderr);
+  int saved = dup(STDERR_FILENO);
+  int devnull = ::open("/dev/null", O_WRONLY);
+  dup2(devnull, STDERR_FILENO);
+  ::close(devnull);
+  return saved;
+}
+
+void restore_stderr(int saved) {
+  fflush(stderr);
+  dup2(saved, STDERR_FILENO);
+  ::close(saved);
+}
+
+void kill_schedule() {
+  bytes app = random_bytes(APP_LEN, 0x7E57u);
+  bytes img = blob(app);
+  bytes old = blob(random_bytes(300000, 0x01Du));
+  std::mt19937 rng(0xDEADu);
+  std::uniform_real_distribution<double> u(0.1, 0.9);
+  std::vector<double> fracs;
+  for (int k = 0; k < KILLS; k++) {
+    fracs.push_back(u(rng));
+  }
+
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    fails++;
+    return;
+  }
+
+  int saved = quiet_stderr();
+  run_stats restart = run(nor, img, old, false, fracs);
+  run_stats resume = run(nor, img, old, true, fracs);
+  restore_stderr(saved);
+
+  printf("%zu KB image, board killed %d times at random points, %d baud (board time)\n",
+         img.size() / 1024U, KILLS, BOARD_BAUD);
+  printf("%-10s %-6s %8s %10s %10s %8s\n", "mode", "result", "attempts", "sent", "resent",
+         "time");
+  for (int i = 0; i < 2; i++) {
+    const run_stats &r = i ? resume : restart;
+    size_t resent = (r.sent > img.size()) ? r.sent - img.size() : 0U;
+    printf("%-10s %-6s %8d %9zuK %9zuK %7.2fs\n", i ? "resume" : "restart", r.ok ? "OK" : "FAIL",
+           r.attempts, r.sent / 1024U, resent / 1024U, r.secs);
+  }
+  CHECK(restart.ok && restart.attempts == KILLS + 1);
+  CHECK(resume.ok && resume.attempts == KILLS + 1);
+  CHECK(resume.offers_grow);
+  CHECK(resume.sent < restart.sent);
+  // per kill: the window in flight and its resends until the stall, plus up to
+  // two staged sectors that never reached the log
+  CHECK(resume.sent <= img.size() + KILLS * 96U * 1024U);
+
+  // a torn last mark: the scan stops there and offers the mark before it
+  bl_manifest m = manifest_for(img);
+  reset_part(nor, old);
+  sim_cfg c;
+  c.stall_ms = STALL_MS;
+  c.kill_at = static_cast<long>(img.size() / 2U);
+  saved = quiet_stderr();
+  sim_transfer(nor, m, img, c);
+  restore_stderr(saved);
+  uint32_t full = offer_for(nor, m);
+  bl_rlog l;
+  bl_rlog_open(&l, &nor.ops, PARAMS_OFF + BL_PARAMS_RESUME_LOG, &m);
+  nor.mem[PARAMS_OFF + BL_PARAMS_RESUME_LOG + (l.n - 1U) * sizeof(bl_rlog_rec) + 6U] ^= 0x40;
+  uint32_t torn = offer_for(nor, m);
+  printf("log: offer %u, %u after tearing the last mark\n", full, torn);
+  CHECK(full > 0U && torn + BL_NOR_SECTOR == full);
+
+  // another image (or another target) gets nothing
+  bl_manifest other = manifest_for(old);
+  bl_manifest fpga = m;
+  fpga.target = BL_TARGET_FPGA_GW5A25;
+  CHECK(offer_for(nor, other) == 0U);
+  CHECK(offer_for(nor, fpga) == 0U);
+
+  nor.close();
+  unlink(PART_FILE);
+}
+
+} // namespace
+
+int main() {
+  kill_schedule();
+  printf("test_resume: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+// host test for the boot-time staging shortcut (bootloader/stage_rec.h): the
+// boot cascade of modules/bootloader/bl_main.c and the steps of bl_stage.c,
+// mirrored over two mocked QSPI app slots, a mocked exec region and the staging
+// record. bl_stage.c drives the H7 flash and the QSPI memory map and is not
+// built here; stage() below keeps its order - plan, clear the record, the copy
+// (the real bootloader/stage_pipe.h pass, on an instant mocked flash), record -
+// and can cut the power after any step. the cascade checks only headers, so a
+// slot whose image is bad is caught by that copy.
+//
+// a boot sequence runs through first boot, reboots, updates (A/B: into the slot
+// that is not active, which becomes active - bootloader/boot_ptr.h), the same
+// image in the other slot, a slot with a bad image and the fallback to the
+// other one, power cuts while staging, a corrupt record, an exec region
+// reflashed behind the bootloader's back and an image too big for exec. each
+// boot must run the image the cascade picked, and copy only when exec does not
+// already hold it. printed per boot: the plan, the flash work done, and what
+// the stage step costs at rough H7 flash timings.
+//
+//   make test   (or: ./tests/test_stage.bin)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bootloader/crc32.h"
+#include "bootloader/image.h"
+#include "bootloader/memmap.h"
+#include "bootloader/protocol.h"
+#include "bootloader/stage_pipe.h"
+#include "bootloader/stage_rec.h"
+
+#include "test_util.h"
+
+namespace {
+
+constexpr uint32_t EXEC_SIZE = 0x00100000U; // BL_SLOT_APP_EXEC (memmap.c)
+constexpr uint32_t SLOT_SIZE = 0x00100000U; // BL_SLOT_APP_0 / _1
+constexpr uint32_t SECTOR = 0x20000U;       // STM32H7_FLASH_SECTOR_SIZE
+constexpr uint32_t WORD = 32U;              // STM32H7_FLASH_WORD_BYTES
+
+// ballpark H7 internal-flash costs (x64 parallelism), for the printed estimate
+constexpr double ERASE_SECTOR_S = 1.0;
+constexpr double PROGRAM_WORD_S = 16e-6;
+constexpr double CRC_BYTE_S = 4.0 / 480e6;  // slicing-by-8 at ~4 cycles a byte
+
+enum cut { CUT_NONE, CUT_AFTER_CLEAR, CUT_MID_PROGRAM, CUT_BEFORE_RECORD };
+
+struct board {
+  bytes slot[2];                      // BL_SLOT_APP_0, BL_SLOT_APP_1
+  int active = 1;                     // the boot pointer's slot
+  bytes exec = bytes(EXEC_SIZE, 0xFF);
+  bytes rec = bytes(sizeof(bl_stage_rec), 0xFF); // BL_PARAMS_STAGED
+  bool torn = false;                  // exec holds a half-programmed flash word
+  // per boot
+  size_t erases = 0;
+  size_t words = 0;
+  size_t exec_read = 0;               // bytes of exec crc'd
+  size_t rec_erases = 0;
+  uint32_t cut_word = ~0U;            // the power goes while programming this one
+
+  const bl_stage_rec *record() const { return reinterpret_cast<const bl_stage_rec *>(rec.data()); }
+};
+
+const bl_image_header *header(const bytes &slot) {
+  return reinterpret_cast<const bl_image_header *>(slot.data());
+}
+
+// bl_iflash over the mocked exec region: instant, and it can lose power
+int exec_erase(void *ctx, uint32_t off) {
+  board &b = *static_cast<board *>(ctx);
+  memset(b.exec.data() + off, 0xFF, SECTOR);
+  return 0;
+}
+
+int exec_program(void *ctx, uint32_t off, const uint8_t *w) {
+  board &b = *static_cast<board *>(ctx);
+  memcpy(b.exec.data() + off, w, WORD);
+  if (off / WORD == b.cut_word) {
+    b.exec[off] ^= 0x5A; // what is left of the word being programmed
+    b.torn = true;
+    return -1;
+  }
+  return 0;
+}
+
+int exec_busy(void *) { return 0; }
+
+int slot_read(void *ctx, uint32_t off, uint8_t *p, uint32_t n) {
+  memcpy(p, static_cast<const uint8_t *>(ctx) + off, n);
+  return 0;
+}
+
+// bl_stage_app, step for step. returns what it returns (1 skipped, 0 staged,
+// negative error); a cut returns -9 with the board left as the power found it
+int stage(board &b, int s, cut at) {
+  const bl_image_header *h = header(b.slot[s]);
+  // the plan may read exec only when the record vouches for it: on the H7 a
+  // torn word is a bus fault, not a mismatch
+  const bl_stage_rec *r = b.record();
+  bool vouched = bl_stage_rec_ok(r) && r->target == h->target && r->version == h->version &&
+                 r->length == h->length && r->image_crc32 == h->image_crc32;
+  CHECK(!(vouched && b.torn));
+  enum bl_stage_plan plan = bl_stage_plan(b.record(), h, b.exec.data(), EXEC_SIZE);
+  if (vouched && h->length <= EXEC_SIZE) {
+    b.exec_read += h->length;
+  }
+  if (plan == BL_STAGE_TOO_BIG) {
+    return -1;
+  }
+  if (plan == BL_STAGE_SKIP) {
+    return 1;
+  }
+
+  if (b.rec != bytes(sizeof(bl_stage_rec), 0xFF)) {
+    b.rec.assign(sizeof(bl_stage_rec), 0xFF);
+    b.rec_erases++;
+  }
+  if (at == CUT_AFTER_CLEAR) {
+    return -9;
+  }
+  b.torn = false;
+  b.cut_word = (at == CUT_MID_PROGRAM) ? (h->length / WORD) / 2U : ~0U;
+  bl_iflash fl = {&b, exec_erase, exec_program, exec_busy, b.exec.data()};
+  bl_stage_src src = {b.slot[s].data() + BL_IMAGE_OFFSET, slot_read};
+  static bl_stage_pipe pipe;
+  uint32_t bs = 0U;
+  const uint32_t *blocks = bl_image_blocks(b.slot[s].data(), &bs);
+  int rc = bl_stage_pipe_run(&pipe, &fl, &src, h->length, h->image_crc32, blocks, bs);
+  b.erases += pipe.erases;
+  b.words += pipe.words;
+  b.exec_read += pipe.done;
+  if (b.torn) {
+    return -9;
+  }
+  if (rc != 0) {
+    return (rc == -3) ? -5 : -3;
+  }
+  if (at == CUT_BEFORE_RECORD) {
+    return -9;
+  }
+  bl_stage_rec rec;
+  bl_stage_rec_make(&rec, h, static_cast<uint16_t>(s ? BL_SLOT_APP_1 : BL_SLOT_APP_0));
+  memcpy(b.rec.data(), &rec, sizeof(rec));
+  return 0;
+}
+
+struct boot_out {
+  int slot = -1;   // the slot booted (-1: stayed in the bootloader / power cut)
+  int staged = 0;  // bl_stage_app's answer for it
+};
+
+// an app update: into the slot that is not active, and the pointer flips to it
+void install(board &b, const bytes &img) {
+  b.active ^= 1;
+  b.slot[b.active] = img;
+}
+
+// bl_main's cascade: the active slot, then the other one; the one that boots
+// is the active one after
+boot_out boot(board &b, cut at) {
+  b.erases = b.words = b.exec_read = b.rec_erases = 0;
+  boot_out o;
+  for (int s : {b.active, b.active ^ 1}) {
+    if (bl_image_check_header(b.slot[s].data()) != 0) {
+      continue;
+    }
+    o.staged = stage(b, s, at);
+    if (o.staged == -9) {
+      return o;
+    }
+    if (o.staged < 0) {
+      continue;
+    }
+    o.slot = s;
+    b.active = s;
+    break;
+  }
+  return o;
+}
+
+// exec holds the image slot s's header describes
+bool runs(const board &b, int s) {
+  const bl_image_header *h = header(b.slot[s]);
+  return !b.torn && bl_crc32(b.exec.data(), h->length) == h->image_crc32;
+}
+
+void sequence() {
+  board b;
+  bytes v1 = random_bytes(192U * 1024U, 0x5A6Eu);
+  bytes v2 = random_bytes(320U * 1024U, 0x5A6Fu);
+  b.slot[0] = bytes(SLOT_SIZE, 0xFF);
+  b.slot[1] = in_slot(blob(v1, BL_TARGET_APM_H755, 1), SLOT_SIZE);
+
+  struct step {
+    const char *what;
+    cut at;
+    int want_slot;   // -1: the power went mid-stage
+    int want_staged;
+  };
+
+  printf("%-40s %-8s %7s %9s %9s %10s\n", "boot", "stage", "erases", "program", "exec crc",
+         "stage est");
+  auto run = [&](const step &st) {
+    boot_out o = boot(b, st.at);
+    const char *plan = (o.staged == 1) ? "skip" : (o.staged == 0) ? "copy" : "cut";
+    double est = static_cast<double>(b.erases) * ERASE_SECTOR_S +
+                 static_cast<double>(b.words) * PROGRAM_WORD_S +
+                 static_cast<double>(b.exec_read) * CRC_BYTE_S;
+    printf("%-40s %-8s %7zu %8zuK %8zuK %8.0fms\n", st.what, plan, b.erases,
+           b.words * WORD / 1024U, b.exec_read / 1024U, est * 1e3);
+    CHECK(o.slot == st.want_slot);
+    CHECK(o.staged == st.want_staged);
+    if (o.slot >= 0) {
+      CHECK(runs(b, o.slot));
+    }
+    if (o.staged == 1) {
+      CHECK(b.erases == 0U && b.words == 0U && b.rec_erases == 0U);
+    }
+  };
+
+  run({"first boot", CUT_NONE, 1, 0});
+  run({"reboot, same image", CUT_NONE, 1, 1});
+  run({"reboot, same image", CUT_NONE, 1, 1});
+
+  // an update: v2 goes into slot 0, v1 stays in slot 1 as the fallback
+  install(b, in_slot(blob(v2, BL_TARGET_APM_H755, 2), SLOT_SIZE));
+  run({"after an update (v2)", CUT_NONE, 0, 0});
+  run({"reboot, same image", CUT_NONE, 0, 1});
+
+  // a bit flips in slot 0's image: exec holds the good copy, that still boots
+  b.slot[0][BL_IMAGE_OFFSET + 100U] ^= 0x01;
+  run({"slot 0 image bad, exec holds it", CUT_NONE, 0, 1});
+  // v2 is sent again and lands in slot 1: the record is about the image, not
+  // the slot, so exec still holds it
+  install(b, in_slot(blob(v2, BL_TARGET_APM_H755, 2), SLOT_SIZE));
+  run({"v2 again, now in slot 1", CUT_NONE, 1, 1});
+  // a new image whose slot copy is bad: caught by the copy, the fallback is v2
+  install(b, in_slot(blob(v1, BL_TARGET_APM_H755, 9), SLOT_SIZE));
+  b.slot[0][BL_IMAGE_OFFSET + 100U] ^= 0x01;
+  run({"slot 0 image bad, fallback v2", CUT_NONE, 1, 0});
+
+  // power cuts while staging v1 (v3 header): each next boot copies again
+  install(b, in_slot(blob(v1, BL_TARGET_APM_H755, 3), SLOT_SIZE));
+  run({"power cut after clearing the record", CUT_AFTER_CLEAR, -1, -9});
+  CHECK(!bl_stage_rec_ok(b.record()));
+  run({"next boot", CUT_NONE, 0, 0});
+  install(b, in_slot(blob(v2, BL_TARGET_APM_H755, 4), SLOT_SIZE));
+  run({"power cut mid-program", CUT_MID_PROGRAM, -1, -9});
+  CHECK(b.torn && !bl_stage_rec_ok(b.record()));
+  run({"next boot", CUT_NONE, 1, 0});
+  install(b, in_slot(blob(v1, BL_TARGET_APM_H755, 5), SLOT_SIZE));
+  run({"power cut before the record", CUT_BEFORE_RECORD, -1, -9});
+  run({"next boot", CUT_NONE, 0, 0});
+
+  // a record hit by a bit flip is no record
+  b.rec[10] ^= 0x04;
+  run({"corrupt record", CUT_NONE, 0, 0});
+
+  // a debugger flashed something else into exec: the record still matches, the
+  // exec crc does not
+  b.exec[4096] ^= 0xFF;
+  run({"exec reflashed behind the record", CUT_NONE, 0, 0});
+  run({"reboot, same image", CUT_NONE, 0, 1});
+
+  // a header that claims more than exec holds is refused, the fallback boots
+  bytes big = b.slot[0];
+  bl_image_header *h = reinterpret_cast<bl_image_header *>(big.data());
+  h->length = EXEC_SIZE + 1U;
+  h->header_crc32 = 0U;
+  h->header_crc32 = bl_crc32(h, sizeof(*h));
+  bl_stage_rec r;
+  bl_stage_rec_make(&r, h, BL_SLOT_APP_1);
+  CHECK(bl_stage_plan(&r, h, b.exec.data(), EXEC_SIZE) == BL_STAGE_TOO_BIG);
+}
+
+// the record's fields: any one of them differing means copy
+void record_fields() {
+  bytes app = random_bytes(4096U, 0xF1E1u);
+  bytes s = in_slot(blob(app, BL_TARGET_APM_H755, 7), SLOT_SIZE);
+  bytes exec(EXEC_SIZE, 0xFF);
+  memcpy(exec.data(), app.data(), app.size());
+  bl_image_header h = *header(s);
+  bl_stage_rec r;
+  bl_stage_rec_make(&r, &h, BL_SLOT_APP_1);
+  CHECK(bl_stage_plan(&r, &h, exec.data(), EXEC_SIZE) == BL_STAGE_SKIP);
+
+  bl_image_header o = h;
+  o.target = BL_TARGET_FPGA_GW5A25;
+  CHECK(bl_stage_plan(&r, &o, exec.data(), EXEC_SIZE) == BL_STAGE_COPY);
+  o = h;
+  o.version++;
+  CHECK(bl_stage_plan(&r, &o, exec.data(), EXEC_SIZE) == BL_STAGE_COPY);
+  o = h;
+  o.length -= 4U;
+  CHECK(bl_stage_plan(&r, &o, exec.data(), EXEC_SIZE) == BL_STAGE_COPY);
+  o = h;
+  o.image_crc32 ^= 1U;
+  CHECK(bl_stage_plan(&r, &o, exec.data(), EXEC_SIZE) == BL_STAGE_COPY);
+
+  // the slot it came from is not part of the match
+  bl_stage_rec_make(&r, &h, BL_SLOT_APP_0);
+  CHECK(bl_stage_plan(&r, &h, exec.data(), EXEC_SIZE) == BL_STAGE_SKIP);
+
+  bl_stage_rec erased;
+  memset(&erased, 0xFF, sizeof(erased));
+  CHECK(!bl_stage_rec_ok(&erased));
+  CHECK(bl_stage_plan(&erased, &h, exec.data(), EXEC_SIZE) == BL_STAGE_COPY);
+}
+
+} // namespace
+
+int main() {
+  sequence();
+  record_fields();
+  printf("test_stage: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,370 @@
+// host test for the stream-to-flash receiver, run against the simulated board
+// (sim_board.h: the session on a pty, a timed W25Q128 model, board time at 1
+// Mbaud). it compares each transfer against the old buffer-then-write path
+// (same line time, then every 4KB sector erased and every page programmed
+// after DONE).
+//
+// the delta cases install an image in the active slot first and send a patch
+// (delta_enc.h) for a rebuild of it: the session rebuilds the new one from
+// there into the other slot, as any app update goes (boot_ptr.h), and both
+// slots are checked after - the installed image must be untouched.
+//
+// the lz cases send the image compressed (lz_enc.h) and check the slot holds
+// it decompressed.
+//
+// then a DATA frame whose len is not what its seq carries, on a lowered
+// payload size: it must not be placed over the frames after it, which are
+// already in.
+//
+// last, a board that accepts the manifest with window 0 and goes silent (reset
+// or unplugged while it prepares): the host must give up after stall_ms, not
+// probe it forever.
+//
+//   make test   (or: ./tests/test_stream.bin)
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/lz.h"
+#include "bootloader/protocol.h"
+
+#include "delta_enc.h"
+#include "lz_enc.h"
+#include "sim_board.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_stream.nor.bin";
+
+struct run_cfg {
+  const char *name;
+  uint16_t target = BL_TARGET_APM_H755;
+  size_t len = 0;
+  double ber = 0.0;
+  bool windowed = true;
+  double prepare_s = 0.0;
+  long stuck_at = -1; // offset into the target slot of a stuck-at-0 bit
+  uint16_t expect = BL_OK;
+  int delta = 0; // 1: patch against the installed image, 2: ... against another one
+  bool lz = false; // compressed transport
+};
+
+struct outcome {
+  bool got = false;
+  uint16_t status = 0;
+  double secs = 0.0; // board time, MANIFEST..RESULT
+  size_t resent = 0;
+  size_t wire = 0; // DATA bytes
+  nor_stats st;
+  bool slot_ok = false;
+};
+
+outcome run_case(nor_model &nor, const run_cfg &c) {
+  outcome o;
+  std::vector<uint8_t> img = random_bytes(c.len, static_cast<uint32_t>(c.len) ^ 0xACE1u);
+
+  uint32_t slot_off = (c.target == BL_TARGET_APM_H755) ? app_update_off(nor) : FPGA_ACTIVE_OFF;
+  uint32_t active_off = (slot_off == APP_0_OFF) ? APP_1_OFF : APP_0_OFF;
+  nor.st = nor_stats{};
+  nor.stuck_off = (c.stuck_at >= 0) ? static_cast<long>(slot_off) + c.stuck_at : -1;
+  nor.stuck_mask = 0x10;
+  if (c.stuck_at >= 0) {
+    img[static_cast<size_t>(c.stuck_at)] |= nor.stuck_mask; // make it bite
+  }
+
+  // delta: install a base image, send a patch for a rebuild of it (a few
+  // constants changed, 700 bytes of code inserted halfway)
+  std::vector<uint8_t> base, patch;
+  if (c.delta != 0) {
+    base = blob(img);
+    std::vector<uint8_t> app = img;
+    for (size_t i = 0; i < app.size(); i += 100000U) {
+      app[i] ^= 0x5A;
+    }
+    app.insert(app.begin() + static_cast<long>(app.size() / 2), img.begin(), img.begin() + 700);
+    img = blob(app);
+    std::vector<uint8_t> installed = (c.delta == 1) ? base : blob(std::vector<uint8_t>(100, 7));
+    memcpy(nor.mem + active_off, installed.data(), installed.size());
+    patch = delta_encode(base, img);
+  } else if (c.lz) {
+    // random bytes don't compress; give 5/8 of every 64 a code-like repetition
+    for (size_t i = 0; i < img.size(); i++) {
+      if (i % 64U < 40U) {
+        img[i] = static_cast<uint8_t>(i / 64U % 7U);
+      }
+    }
+    patch = lz_compress(img);
+  }
+
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = c.target;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+  const std::vector<uint8_t> &wire = (c.delta != 0 || c.lz) ? patch : img;
+  if (c.lz) {
+    m.flags = BL_MANIFEST_F_LZ;
+    m.length = static_cast<uint32_t>(patch.size());
+    m.crc32 = bl_crc32(patch.data(), patch.size());
+    m.image_length = static_cast<uint32_t>(img.size());
+    m.image_crc32 = bl_crc32(img.data(), img.size());
+  } else if (c.delta != 0) {
+    m.flags = BL_MANIFEST_F_DELTA;
+    m.length = static_cast<uint32_t>(patch.size());
+    m.crc32 = bl_crc32(patch.data(), patch.size());
+    m.base_crc32 = bl_crc32(base.data(), base.size());
+    m.image_length = static_cast<uint32_t>(img.size());
+    m.image_crc32 = bl_crc32(img.data(), img.size());
+  }
+
+  sim_cfg sc;
+  sc.ber = c.ber;
+  sc.prepare_s = c.prepare_s;
+  sc.windowed = c.windowed;
+  sim_result r = sim_transfer(nor, m, wire, sc);
+  o.secs = r.secs;
+  o.got = r.st.have_result;
+  o.status = r.st.result.status;
+  o.resent = r.st.resent;
+  o.wire = wire.size();
+
+  o.st = nor.st;
+  o.slot_ok = memcmp(nor.mem + slot_off, img.data(), img.size()) == 0;
+  if (c.delta != 0) {
+    o.slot_ok = o.slot_ok && memcmp(nor.mem + active_off, base.data(), base.size()) == 0;
+  }
+  return o;
+}
+
+// the old path: the whole image over the line, then erase every 4KB sector and
+// program every page with nothing else going on
+double buffered_secs(size_t len, const nor_timing &t) {
+  double line = static_cast<double>(len) * (8.0 + 4.0 + BL_MAX_PAYLOAD) / BL_MAX_PAYLOAD * 10.0 /
+                BOARD_BAUD;
+  double sectors = static_cast<double>((len + BL_NOR_SECTOR - 1U) / BL_NOR_SECTOR);
+  double pages = static_cast<double>((len + BL_NOR_PAGE - 1U) / BL_NOR_PAGE);
+  return line + sectors * t.erase_4k_s + pages * t.page_s;
+}
+
+const char *status_name(uint16_t s) {
+  static const char *names[] = {"OK",      "ERR_CRC",   "ERR_TARGET", "ERR_SIZE",
+                                "ERR_SEQ", "ERR_PROTO", "ERR_FLASH",  "ERR_BASE"};
+  return (s < sizeof(names) / sizeof(names[0])) ? names[s] : "?";
+}
+
+// wait up to 2 s for a frame of `type` (ACK: one that opens at least `window`;
+// RESULT: or a fatal NAK), skipping whatever else the board sends
+bool wait_for(int fd, frame_reader &rd, uint8_t type, bl_frame &f, uint16_t window = 0) {
+  auto until = clk::now() + std::chrono::seconds(2);
+  while (clk::now() < until) {
+    if (!recv_frame(fd, rd, 100, f)) {
+      continue;
+    }
+    bl_result r{};
+    memcpy(&r, f.payload, (f.len < sizeof(r)) ? f.len : sizeof(r));
+    if (type == BL_RESULT && f.type == BL_NAK && r.status != BL_ERR_SEQ) {
+      return true; // a fatal NAK is a verdict too
+    }
+    bl_ack a{};
+    memcpy(&a, f.payload, (f.len < sizeof(a)) ? f.len : sizeof(a));
+    if (f.type == type && (type != BL_ACK || a.window >= window)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 8 frames of 256 bytes: 0, 2 and 3 go in, then seq 1 twice its size (its own
+// bytes and 256 that are not seq 2's), then seq 1 as it should be and the
+// rest. the image has to come out whole
+bool bad_len(nor_model &nor) {
+  constexpr uint16_t CHUNK = 256;
+  constexpr uint16_t FRAMES = 8;
+  std::vector<uint8_t> img = random_bytes(FRAMES * CHUNK, 0xBAD1u);
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return false;
+  }
+  board b;
+  b.fd = slave;
+  b.nor = &nor;
+  std::thread th([&b] { b.serve(); });
+
+  frame_reader rd;
+  bl_frame f;
+  bl_link l = {0U, CHUNK, 0U};
+  send_frame(master, BL_LINK, 0, &l, sizeof(l));
+  bool ok = wait_for(master, rd, BL_LINK, f);
+  memcpy(&l, f.payload, sizeof(l));
+  ok = ok && l.payload == CHUNK;
+
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.flags = BL_MANIFEST_F_WINDOWED;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+  send_frame(master, BL_MANIFEST, 0, &m, sizeof(m));
+  ok = ok && wait_for(master, rd, BL_ACK, f, FRAMES);
+
+  auto data = [&](uint16_t seq) {
+    send_frame(master, BL_DATA, seq, img.data() + seq * CHUNK, CHUNK);
+  };
+  data(0);
+  data(2);
+  data(3);
+  std::vector<uint8_t> bad(img.begin() + CHUNK, img.begin() + 2 * CHUNK);
+  bad.resize(2U * CHUNK, 0xA5);
+  send_frame(master, BL_DATA, 1, bad.data(), static_cast<uint16_t>(bad.size()));
+  for (uint16_t seq = 1; seq < FRAMES; seq++) {
+    if (seq != 2U && seq != 3U) {
+      data(seq);
+    }
+  }
+  send_frame(master, BL_DONE, 0, nullptr, 0);
+  ok = ok && wait_for(master, rd, BL_RESULT, f);
+  bl_result r{};
+  memcpy(&r, f.payload, sizeof(r));
+
+  b.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  printf("%-30s %-10s\n", "frame len not its seq's", ok ? status_name(r.status) : "no result");
+  return ok && f.type == BL_RESULT && r.status == BL_OK;
+}
+
+// the slave side acks the MANIFEST with window 0 and then only swallows what
+// comes; send_image has to return within stall_ms and change. the host runs in
+// a child, so one that still probes after 10 s is killed, not waited on
+bool silent_at_hold() {
+  constexpr int STALL_MS = 1000;
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return false;
+  }
+  std::vector<uint8_t> img = random_bytes(64U * 1024U, 0x5111u);
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+
+  auto t0 = clk::now();
+  pid_t host = fork();
+  if (host == 0) {
+    xfer_opts xo;
+    xo.baud = SIM_BAUD;
+    xo.stall_ms = STALL_MS;
+    xfer_stats st;
+    bool sent = send_image(master, m, img.data(), img.size(), xo, st);
+    _exit((!sent && st.windowed) ? 0 : 1);
+  }
+
+  frame_reader rd;
+  bl_frame f;
+  int status = 0;
+  bool gave_up = false;
+  while (host > 0 && clk::now() - t0 < std::chrono::seconds(10)) {
+    if (recv_frame(slave, rd, 10, f) && f.type == BL_MANIFEST) {
+      bl_ack a{};
+      a.window = 0; // accepted, hold
+      send_frame(slave, BL_ACK, 0, &a, sizeof(a));
+    }
+    if (waitpid(host, &status, WNOHANG) == host) {
+      gave_up = true;
+      break;
+    }
+  }
+  double secs = std::chrono::duration<double>(clk::now() - t0).count();
+  if (host > 0 && !gave_up) {
+    kill(host, SIGKILL);
+    waitpid(host, &status, 0);
+  }
+  ::close(slave);
+  ::close(master);
+  printf("%-30s %-10s %7.2fs\n", "silent at window 0", gave_up ? "gave up" : "still probing",
+         secs);
+  return gave_up && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+         secs < 3.0 * STALL_MS / 1000.0;
+}
+
+} // namespace
+
+int main() {
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    return 1;
+  }
+
+  const run_cfg cases[] = {
+    {"1MB app, clean line", BL_TARGET_APM_H755, 1024U * 1024U, 0.0, true, 0.5},
+    {"odd-size fpga, ber 2e-5", BL_TARGET_FPGA_GW5A25, 300001U, 2e-5, true, 0.0},
+    {"stuck bit in the slot", BL_TARGET_APM_H755, 64U * 1024U, 0.0, true, 0.0,
+     5000, BL_ERR_FLASH},
+    {"image > slot", BL_TARGET_APM_H755, SLOT_SIZE + 4096U, 0.0, true, 0.0, -1, BL_ERR_SIZE},
+    {"plain (unwindowed) stream", BL_TARGET_APM_H755, 8192U, 0.0, false, 0.0, -1, BL_ERR_PROTO},
+    {"delta, 1MB app rebuild", BL_TARGET_APM_H755, 1000000U, 0.0, true, 0.5, -1, BL_OK, 1},
+    {"delta, other image installed", BL_TARGET_APM_H755, 65536U, 0.0, true, 0.0, -1, BL_ERR_BASE,
+     2},
+    {"lz, 1MB app", BL_TARGET_APM_H755, 1024U * 1024U, 0.0, true, 0.5, -1, BL_OK, 0, true},
+    {"lz fpga, ber 2e-5", BL_TARGET_FPGA_GW5A25, 300001U, 2e-5, true, 0.0, -1, BL_OK, 0, true},
+  };
+
+  // quiet the fallback notice of the unwindowed case
+  fflush(stderr);
+  int saved = dup(STDERR_FILENO);
+  int devnull = ::open("/dev/null", O_WRONLY);
+
+  printf("stream-to-flash receiver, W25Q128 model, board time (%d baud)\n", BOARD_BAUD);
+  printf("%-30s %-10s %8s %8s %10s %7s %7s %7s %s\n", "case", "result", "wire", "time",
+         "buffered", "4k/64k", "pages", "resent", "");
+  for (const run_cfg &c : cases) {
+    dup2(devnull, STDERR_FILENO);
+    outcome o = run_case(nor, c);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+
+    bool ok = o.got && o.status == c.expect && o.st.misuse == 0U;
+    if (c.expect == BL_OK) {
+      ok = ok && o.slot_ok;
+    }
+    char erases[32];
+    snprintf(erases, sizeof(erases), "%zu/%zu", o.st.erases_4k, o.st.erases_64k);
+    char buffered[32] = "-";
+    if (c.expect == BL_OK) {
+      snprintf(buffered, sizeof(buffered), "%.2fs", buffered_secs(c.len, nor.t));
+    }
+    printf("%-30s %-10s %7zuK %7.2fs %10s %7s %7zu %7zu %s\n", c.name,
+           o.got ? status_name(o.status) : "no result", (o.wire + 1023U) / 1024U, o.secs, buffered,
+           erases, o.st.pages, o.resent, ok ? "" : " <-- FAIL");
+    if (!ok) {
+      fails++;
+    }
+  }
+  if (!bad_len(nor)) {
+    fails++;
+  }
+  if (!silent_at_hold()) {
+    fails++;
+  }
+  nor.close();
+  unlink(PART_FILE);
+
+  printf("test_stream: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+// host test for the boot trace (bootloader/boot_trace.h, trace_dec.h): the
+// record the bootloader keeps across a reset, the host's decoding of it, and
+// BL_TRACE on the simulated board (sim_board.h).
+//
+// boots are simulated, not run: each is a bl_trace_begin on the same area (the
+// backup SRAM the board keeps across a reset) and marks at made-up cycle
+// counts, some of them across a counter wrap, and an update window longer than
+// several wraps, timed on a clock sampled the way bl_update_run polls it. the
+// last one's decoded table is printed.
+//
+//   make test   (or: ./tests/test_trace.bin)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bootloader/boot_trace.h"
+#include "bootloader/protocol.h"
+
+#include "sim_board.h"
+#include "trace_dec.h"
+
+namespace {
+
+constexpr const char *PART_FILE = "tests/test_trace.nor.bin";
+constexpr uint32_t HZ = 480000000U;
+constexpr uint32_t PER_MS = HZ / 1000U;
+
+struct phase_ms {
+  uint16_t phase;
+  uint16_t arg;
+  double ms;
+};
+
+// the phases of a boot that reaches the app, as bl_main marks them
+const phase_ms typical[] = {
+  {BL_TRACE_QSPI, 1U, 2.0},
+  {BL_TRACE_UPDATE, 0U, 5000.0},
+  {BL_TRACE_BOOT, 1U, 0.5},
+  {BL_TRACE_HEADER, 1U | BL_TRACE_ARG_BAD, 0.02}, // the active slot is bad
+  {BL_TRACE_HEADER, 0U, 0.02},
+  {BL_TRACE_STAGE, 0U, 1750.0},
+  {BL_TRACE_JUMP, 0U, 1.0},
+};
+
+// one boot on `a`, its counter starting at `c0`. stops before the jump if
+// `reach_app` is false (a reset in the update window)
+void boot(bl_trace_area &a, uint32_t c0, bool reach_app) {
+  uint32_t c = c0;
+  bl_trace_begin(&a, HZ, c);
+  for (const phase_ms &p : typical) {
+    if (p.phase == BL_TRACE_HEADER && !reach_app) {
+      return;
+    }
+    c += static_cast<uint32_t>(std::llround(p.ms * PER_MS));
+    bl_trace_mark(&a.cur, p.phase, p.arg, c);
+  }
+}
+
+// the record itself: begin on garbage, marks, crc, overflow
+void record() {
+  bl_trace_area a;
+  std::mt19937 rng(0xB007u);
+  for (size_t i = 0; i < sizeof(a); i++) {
+    reinterpret_cast<uint8_t *>(&a)[i] = static_cast<uint8_t>(rng()); // power-on RAM
+  }
+  bl_trace_begin(&a, HZ, 100U);
+  CHECK(bl_trace_check(&a.cur) == 0);
+  CHECK(bl_trace_check(&a.last) != 0); // nothing reached the app yet
+  CHECK(a.cur.boot == 1U);
+  CHECK(a.cur.count == 1U && a.cur.marks[0].phase == BL_TRACE_RESET);
+  CHECK(a.cur.marks[0].cycles == 100U);
+
+  bl_trace_mark(&a.cur, BL_TRACE_QSPI, 1U, 100U + 5U * PER_MS);
+  CHECK(bl_trace_check(&a.cur) == 0);
+  CHECK(bl_trace_span(&a.cur, 1U) == 5U * PER_MS);
+  CHECK(bl_trace_span(&a.cur, 0U) == 0U);
+  CHECK((a.cur.flags & BL_TRACE_F_JUMPED) == 0U);
+
+  bl_boot_trace bad = a.cur;
+  reinterpret_cast<uint8_t *>(&bad)[20] ^= 0x04;
+  CHECK(bl_trace_check(&bad) != 0);
+  bad = a.cur;
+  bad.count = BL_TRACE_MARKS + 1U;
+  CHECK(bl_trace_check(&bad) != 0);
+
+  // marks past the end are counted, the record stays intact
+  for (unsigned i = 0; i < BL_TRACE_MARKS + 3U; i++) {
+    bl_trace_mark(&a.cur, BL_TRACE_APP + i, 0U, 200U + i);
+  }
+  CHECK(a.cur.count == BL_TRACE_MARKS);
+  CHECK(a.cur.dropped == 5U); // 2 marks in use, 16 + 3 more
+  CHECK(bl_trace_check(&a.cur) == 0);
+}
+
+// across resets: `last` is the most recent boot that reached the app
+void handoff() {
+  bl_trace_area a{};
+  boot(a, 0U, true);
+  CHECK((a.cur.flags & BL_TRACE_F_JUMPED) != 0U);
+  bl_boot_trace first = a.cur;
+
+  // the app adds a mark of its own, then the board is reset into the update
+  // window: the next boot keeps the whole record, app mark included
+  bl_trace_mark(&a.cur, BL_TRACE_APP + 1U, 7U, a.cur.marks[a.cur.count - 1U].cycles + PER_MS);
+  bl_boot_trace with_app = a.cur;
+  boot(a, 0U, false);
+  CHECK(memcmp(&a.last, &with_app, sizeof(with_app)) == 0);
+  CHECK(a.cur.boot == first.boot + 1U);
+
+  // another reset before the app: `last` is still that boot
+  boot(a, 0U, false);
+  CHECK(memcmp(&a.last, &with_app, sizeof(with_app)) == 0);
+  CHECK(a.cur.boot == first.boot + 2U);
+
+  // and a boot that gets there replaces it
+  boot(a, 0U, true);
+  boot(a, 0U, false);
+  CHECK(a.last.boot == first.boot + 3U);
+  CHECK(a.last.count == sizeof(typical) / sizeof(typical[0]) + 1U);
+}
+
+// the host's decoding, with the counter wrapping during the update window
+void decode() {
+  bl_trace_area a{};
+  uint32_t c0 = 0xFFFFFFFFU - 1000U * PER_MS; // wraps 1s into the window
+  boot(a, c0, true);
+  std::vector<uint8_t> raw(sizeof(a.cur));
+  memcpy(raw.data(), &a.cur, sizeof(a.cur));
+
+  boot_timeline tl;
+  std::string why;
+  CHECK(decode_trace(raw.data(), raw.size(), tl, &why));
+  CHECK(tl.rows.size() == sizeof(typical) / sizeof(typical[0]) + 1U);
+  double total = 0.0;
+  for (size_t i = 0; i < tl.rows.size() && i <= sizeof(typical) / sizeof(typical[0]); i++) {
+    double want = (i == 0U) ? 0.0 : typical[i - 1U].ms;
+    total += want;
+    CHECK(std::fabs(tl.rows[i].ms - want) < 0.001);
+    CHECK(std::fabs(tl.rows[i].at_ms - total) < 0.001);
+    CHECK(tl.rows[i].phase == ((i == 0U) ? BL_TRACE_RESET : typical[i - 1U].phase));
+  }
+  CHECK(std::fabs(tl.total_ms - total) < 0.001);
+  std::string table = format_trace(tl);
+  CHECK(table.find("app_1 bad") != std::string::npos);
+  CHECK(table.find("app_0 copied") != std::string::npos);
+  fputs(table.c_str(), stdout);
+
+  // not a trace: nothing kept, cut short, damaged
+  CHECK(!decode_trace(raw.data(), 0U, tl, &why));
+  CHECK(!decode_trace(raw.data(), raw.size() - 1U, tl, &why));
+  raw[30] ^= 0x01;
+  CHECK(!decode_trace(raw.data(), raw.size(), tl, &why));
+  CHECK(why.find("crc") != std::string::npos);
+}
+
+// an update window of 30 s (the app asked for it) and one with a long
+// transfer: several wraps of the counter, sampled every few ms as
+// bl_update_run polls, come back whole from the mark, and through the decoder
+void long_window() {
+  for (double secs : {30.0, 125.5}) {
+    bl_trace_area a{};
+    uint32_t c = 0xF0000000U;
+    bl_trace_begin(&a, HZ, c);
+    c += 2U * PER_MS;
+    bl_trace_mark(&a.cur, BL_TRACE_QSPI, 1U, c);
+    bl_trace_clock clk;
+    bl_trace_clock_start(&clk, &a.cur);
+    uint64_t cycles = static_cast<uint64_t>(secs * HZ);
+    for (uint64_t t = 0; t < cycles;) {
+      uint64_t step = std::min<uint64_t>(cycles - t, 5U * PER_MS + (t % 7U) * 1000U);
+      t += step;
+      c += static_cast<uint32_t>(step);
+      bl_trace_clock_poll(&clk, c);
+    }
+    bl_trace_mark(&a.cur, BL_TRACE_UPDATE, 1U | bl_trace_clock_arg(&clk), c);
+    CHECK(bl_trace_span(&a.cur, 2U) == cycles);
+    CHECK(bl_trace_span(&a.cur, 1U) == 2U * PER_MS); // other phases keep their arg
+
+    boot_timeline tl;
+    CHECK(decode_trace(reinterpret_cast<const uint8_t *>(&a.cur), sizeof(a.cur), tl, nullptr));
+    CHECK(tl.rows.size() == 3U && std::fabs(tl.rows[2].ms - secs * 1000.0) < 0.001);
+    printf("update window of %.1f s (%u wraps): traced %.3f s\n", secs,
+           static_cast<unsigned>(cycles >> 32), tl.rows[2].ms / 1000.0);
+  }
+}
+
+// BL_TRACE on the simulated board: what it holds comes back byte for byte, and
+// a board with no intact trace answers empty
+bool fetch_from(nor_model &nor, const bl_boot_trace *t, std::vector<uint8_t> &raw) {
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    fails++;
+    return false;
+  }
+  board b;
+  b.fd = slave;
+  b.nor = &nor;
+  b.trace = t;
+  std::thread th([&b] { b.serve(); });
+  bool ok = fetch_trace(master, raw);
+  b.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  return ok;
+}
+
+void over_link() {
+  nor_model nor;
+  if (!open_part(nor, PART_FILE)) {
+    fails++;
+    return;
+  }
+  bl_trace_area a{};
+  boot(a, 12345U, true);
+  boot(a, 0U, false); // the reset into the window the host talks to
+
+  std::vector<uint8_t> raw;
+  CHECK(fetch_from(nor, &a.last, raw));
+  CHECK(raw.size() == sizeof(bl_boot_trace));
+  CHECK(raw.size() == sizeof(bl_boot_trace) && memcmp(raw.data(), &a.last, raw.size()) == 0);
+  boot_timeline tl;
+  CHECK(decode_trace(raw.data(), raw.size(), tl));
+
+  CHECK(fetch_from(nor, nullptr, raw));
+  CHECK(raw.empty());
+  bl_boot_trace bad = a.last;
+  bad.marks[2].cycles++;
+  CHECK(fetch_from(nor, &bad, raw));
+  CHECK(raw.empty());
+  unlink(PART_FILE);
+}
+
+} // namespace
+
+int main() {
+  record();
+  handoff();
+  decode();
+  long_window();
+  over_link();
+  printf("test_trace: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
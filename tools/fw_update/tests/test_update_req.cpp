@@ -0,0 +1,155 @@
+// host test for the update request (bootloader/update_req.h): what the app
+// leaves in backup SRAM and the plan the bootloader makes from it and the reset
+// cause - the update window each boot gets.
+//
+// every reset cause against every state the request word can be in at reset
+// (nothing, power-on garbage, a request, a request with a damaged field, a
+// request for no reason), then: a request is good for one boot, and one left
+// over from before a reset it does not belong to is dropped and reported. the
+// window per cause is printed.
+//
+//   make test   (or: ./tests/test_update_req.bin)
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "bootloader/update_req.h"
+
+#include "test_util.h"
+
+namespace {
+
+const char *const cause_names[] = {"power-on", "pin", "software", "watchdog", "other"};
+constexpr unsigned CAUSES = sizeof(cause_names) / sizeof(cause_names[0]);
+
+enum word_state { W_ZERO, W_GARBAGE, W_REQUEST, W_BAD_MAGIC, W_BAD_NMAGIC, W_BAD_NREASON, W_NONE };
+const char *const word_names[] = {"zero",       "garbage",     "request",  "bad magic",
+                                  "bad nmagic", "bad nreason", "reason 0"};
+constexpr unsigned WORDS = sizeof(word_names) / sizeof(word_names[0]);
+
+bl_update_req make_word(word_state w, std::mt19937 &rng) {
+  bl_update_req r;
+  memset(&r, 0, sizeof(r));
+  switch (w) {
+    case W_ZERO:
+      break;
+    case W_GARBAGE:
+      for (size_t i = 0; i < sizeof(r); i++) {
+        reinterpret_cast<uint8_t *>(&r)[i] = static_cast<uint8_t>(rng());
+      }
+      break;
+    case W_REQUEST:
+      bl_update_req_set(&r, BL_REQ_HOST);
+      break;
+    case W_BAD_MAGIC:
+      bl_update_req_set(&r, BL_REQ_HOST);
+      r.magic ^= 0x00010000U;
+      break;
+    case W_BAD_NMAGIC:
+      bl_update_req_set(&r, BL_REQ_HOST);
+      r.nmagic ^= 0x80000000U;
+      break;
+    case W_BAD_NREASON:
+      bl_update_req_set(&r, BL_REQ_COMMAND);
+      r.nreason ^= 0x0001U;
+      break;
+    case W_NONE:
+      bl_update_req_set(&r, BL_REQ_NONE);
+      break;
+  }
+  return r;
+}
+
+// every cause x every word: the window, the reason, the stale flag, and the
+// word cleared afterwards
+void plans() {
+  std::mt19937 rng(0x5EEDu);
+  for (unsigned c = 0; c < CAUSES; c++) {
+    auto cause = static_cast<bl_reset_cause>(c);
+    for (unsigned w = 0; w < WORDS; w++) {
+      bl_update_req r = make_word(static_cast<word_state>(w), rng);
+      bl_boot_plan p;
+      memset(&p, 0xA5, sizeof(p));
+      bl_update_req_take(&r, cause, &p);
+
+      bool asked = (w == W_REQUEST);
+      if (asked && cause == BL_RESET_SOFTWARE) {
+        CHECK(p.listen_ms == BL_REQ_LISTEN_MS);
+        CHECK(p.reason == BL_REQ_HOST);
+        CHECK(p.stale == 0U);
+      } else {
+        CHECK(p.listen_ms == ((cause == BL_RESET_PIN) ? BL_PIN_LISTEN_MS : 0U));
+        CHECK(p.reason == BL_REQ_NONE);
+        CHECK(p.stale == (asked ? 1U : 0U));
+      }
+      CHECK(r.magic == 0U && r.nmagic == 0U);
+    }
+  }
+}
+
+// a request is taken once: the boot after it (another software reset, the
+// app's own) goes straight to the app
+void one_boot() {
+  bl_update_req r;
+  memset(&r, 0, sizeof(r));
+  bl_update_req_set(&r, BL_REQ_COMMAND);
+  bl_boot_plan p;
+  bl_update_req_take(&r, BL_RESET_SOFTWARE, &p);
+  CHECK(p.listen_ms == BL_REQ_LISTEN_MS && p.reason == BL_REQ_COMMAND);
+  bl_update_req_take(&r, BL_RESET_SOFTWARE, &p);
+  CHECK(p.listen_ms == 0U && p.reason == BL_REQ_NONE && p.stale == 0U);
+
+  // a request the watchdog beat to the reset is not honoured, and not kept
+  // for the next software reset either
+  bl_update_req_set(&r, BL_REQ_APP);
+  bl_update_req_take(&r, BL_RESET_WATCHDOG, &p);
+  CHECK(p.listen_ms == 0U && p.stale == 1U);
+  bl_update_req_take(&r, BL_RESET_SOFTWARE, &p);
+  CHECK(p.listen_ms == 0U && p.stale == 0U);
+
+  // the button with a request pending: the button's window, the request
+  // reported stale
+  bl_update_req_set(&r, BL_REQ_HOST);
+  bl_update_req_take(&r, BL_RESET_PIN, &p);
+  CHECK(p.listen_ms == BL_PIN_LISTEN_MS && p.reason == BL_REQ_NONE && p.stale == 1U);
+}
+
+// power-on garbage never reads as a request (a run of random words)
+void garbage() {
+  std::mt19937 rng(0xB0075u);
+  unsigned honoured = 0U;
+  for (unsigned i = 0; i < 100000U; i++) {
+    bl_update_req r = make_word(W_GARBAGE, rng);
+    bl_boot_plan p;
+    bl_update_req_take(&r, BL_RESET_SOFTWARE, &p);
+    honoured += (p.listen_ms != 0U) ? 1U : 0U;
+  }
+  CHECK(honoured == 0U);
+}
+
+void print_windows() {
+  printf("update window per boot:\n");
+  printf("  %-9s %12s %12s\n", "reset", "no request", "request");
+  for (unsigned c = 0; c < CAUSES; c++) {
+    bl_update_req r;
+    memset(&r, 0, sizeof(r));
+    bl_boot_plan none, asked;
+    bl_update_req_take(&r, static_cast<bl_reset_cause>(c), &none);
+    bl_update_req_set(&r, BL_REQ_HOST);
+    bl_update_req_take(&r, static_cast<bl_reset_cause>(c), &asked);
+    printf("  %-9s %10lums %10lums%s\n", cause_names[c], static_cast<unsigned long>(none.listen_ms),
+           static_cast<unsigned long>(asked.listen_ms), asked.stale ? "  (stale)" : "");
+  }
+}
+
+} // namespace
+
+int main() {
+  plans();
+  one_boot();
+  garbage();
+  print_windows();
+  printf("test_update_req: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
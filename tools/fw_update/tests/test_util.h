@@ -0,0 +1,98 @@
+// what every host test here needs: the CHECK counter, seeded random payloads,
+// image blobs as mkupdate builds them and the pty pair that stands in for the
+// USB-UART. sim_board.h builds the simulated board on top of this; tests that
+// run without one (frame, window, boot, stage ...) include it on its own.
+//
+// a CHECK that fails prints where and counts into `fails`; main returns
+// nonzero if anything did, so `make test` stops there.
+
+#ifndef FW_UPDATE_TESTS_TEST_UTIL_H
+#define FW_UPDATE_TESTS_TEST_UTIL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/image.h"
+#include "bootloader/protocol.h"
+
+inline int fails = 0;
+
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                     \
+      fails++;                                                                                     \
+    }                                                                                              \
+  } while (0)
+
+using bytes = std::vector<uint8_t>;
+
+// n bytes off `rng`, one draw a byte
+inline bytes random_bytes(size_t n, std::mt19937 &rng) {
+  bytes b(n);
+  for (auto &x : b) {
+    x = static_cast<uint8_t>(rng());
+  }
+  return b;
+}
+
+// ... off a generator of its own, seeded with `seed`
+inline bytes random_bytes(size_t n, uint32_t seed) {
+  std::mt19937 rng(seed);
+  return random_bytes(n, rng);
+}
+
+// an image blob around `app`, as mkupdate builds it: the header, zeros up to
+// BL_IMAGE_OFFSET, then the app. `table` adds the per-block crc table
+// (bootloader/image.h) the way mkupdate does; without it the blob is what an
+// older mkupdate made
+inline bytes blob(const bytes &app, uint16_t target = BL_TARGET_APM_H755, uint32_t version = 1,
+                  bool table = true) {
+  bl_image_header h{};
+  h.magic = BL_IMAGE_MAGIC;
+  h.target = target;
+  h.version = version;
+  h.length = static_cast<uint32_t>(app.size());
+  h.image_crc32 = bl_crc32(app.data(), app.size());
+  h.header_crc32 = bl_crc32(&h, sizeof(h));
+  bytes b(BL_IMAGE_OFFSET + app.size(), 0);
+  memcpy(b.data(), &h, sizeof(h));
+  memcpy(b.data() + BL_IMAGE_OFFSET, app.data(), app.size());
+  if (table) {
+    bl_image_add_blocks(b.data());
+  }
+  return b;
+}
+
+// `b` as it sits in a slot of `size` bytes: erased flash after it
+inline bytes in_slot(bytes b, size_t size) {
+  b.resize(size, 0xFF);
+  return b;
+}
+
+// a raw pty pair: the host side on `master`, the board's UART on `slave`
+inline bool open_pty(int &master, int &slave) {
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    return false;
+  }
+  slave = ::open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0) {
+    return false;
+  }
+  struct termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+  return true;
+}
+
+#endif // FW_UPDATE_TESTS_TEST_UTIL_H
@@ -0,0 +1,353 @@
+// host loopback test for the windowed DATA transfer. a pty pair stands in for
+// the USB-UART: update.bin's link code drives the master side, and a receiver
+// thread on the slave side runs the span parser + bl_rxwin bookkeeping into a
+// RAM image, in both transfer modes (the board's flash-streaming receiver only
+// takes windowed transfers; tests/test_stream.cpp covers it). the receiver
+// paces itself to a simulated baud and flips bits at a given bit-error rate
+// before parsing, so corrupted frames are dropped exactly like on the wire.
+//
+// for each error rate it sends one image the old way (blast, verdict at DONE,
+// start over on failure) and once windowed, and prints effective throughput.
+// fails if a windowed transfer does not complete with the right crc. last, a
+// receiver that gives up partway (a fatal NAK in the middle of a plain stream)
+// must be heard while the host is still sending, not at DONE.
+//
+//   make test   (or: ./tests/test_window.bin)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bootloader/crc32.h"
+#include "bootloader/frame.h"
+#include "bootloader/protocol.h"
+#include "bootloader/window.h"
+
+#include "link.h"
+#include "test_util.h"
+
+namespace {
+
+constexpr int SIM_BAUD = 4000000;
+constexpr size_t IMAGE = 128U * 1024U;
+constexpr uint16_t RX_WINDOW = 16;
+constexpr int LEGACY_TRIES = 3;
+
+using clk = std::chrono::steady_clock;
+
+// ---- simulated receiver (slave side of the pty) ----
+
+struct receiver {
+  int fd = -1;
+  double ber = 0.0;
+  uint32_t give_up_at = 0; // plain stream: NAK BL_ERR_SIZE once this much is in
+  std::atomic<bool> stop{false};
+
+  // session state, RAM-buffered
+  bl_frame_rx rx;
+  bl_manifest man{};
+  bool have_man = false;
+  bool windowed = false;
+  bl_rxwin win{};
+  bool ack_due = false;
+  uint32_t recv = 0;
+  std::vector<uint8_t> img;
+
+  void reply(uint8_t type, const void *pl, uint16_t len) { send_frame(fd, type, 0, pl, len); }
+
+  void send_ack() {
+    bl_ack a;
+    bl_rxwin_ack(&win, &a);
+    reply(BL_ACK, &a, sizeof(a));
+    ack_due = false;
+  }
+
+  void handle(const bl_frame &f) {
+    switch (f.type) {
+      case BL_HELLO: {
+        have_man = false;
+        bl_hello h = {BL_PROTO_VERSION, BL_MAX_PAYLOAD};
+        reply(BL_HELLO_ACK, &h, sizeof(h));
+        break;
+      }
+      case BL_MANIFEST:
+        memcpy(&man, f.payload, sizeof(man));
+        img.assign(man.length, 0);
+        recv = 0;
+        have_man = true;
+        windowed = (man.flags & BL_MANIFEST_F_WINDOWED) != 0U;
+        if (windowed) {
+          bl_rxwin_init(&win, RX_WINDOW);
+          send_ack();
+        }
+        break;
+      case BL_DATA: {
+        if (!have_man) {
+          break;
+        }
+        if (!windowed) {
+          // legacy: append in arrival order, a dropped frame shows up at DONE
+          if (recv + f.len <= img.size() && rx.dst != img.data() + recv) {
+            memcpy(img.data() + recv, rx.dst, f.len);
+          }
+          recv += f.len;
+          if (give_up_at != 0U && recv >= give_up_at) {
+            bl_result r = {BL_ERR_SIZE, f.seq, recv};
+            reply(BL_NAK, &r, sizeof(r));
+            have_man = false;
+          }
+          break;
+        }
+        uint32_t off = static_cast<uint32_t>(f.seq) * BL_MAX_PAYLOAD;
+        if (off + f.len > man.length) {
+          break;
+        }
+        if (bl_rxwin_accept(&win, f.seq) == BL_WIN_NEW) {
+          if (rx.dst != img.data() + off) {
+            memcpy(img.data() + off, rx.dst, f.len);
+          }
+          recv += f.len;
+        }
+        ack_due = true;
+        uint16_t miss;
+        if (bl_rxwin_gap(&win, &miss)) {
+          bl_result r = {BL_ERR_SEQ, miss, recv};
+          reply(BL_NAK, &r, sizeof(r));
+        }
+        break;
+      }
+      case BL_DONE: {
+        uint16_t st = BL_OK;
+        if (!have_man) {
+          st = BL_ERR_PROTO;
+        } else if (recv != man.length) {
+          st = BL_ERR_SIZE;
+        } else if (bl_crc32(img.data(), img.size()) != man.crc32) {
+          st = BL_ERR_CRC;
+        }
+        bl_result r = {st, 0, recv};
+        reply(BL_RESULT, &r, sizeof(r));
+        have_man = false;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // same placement rule as session.c's data_sink: only not-yet-good slots
+  static uint8_t *sink(void *ctx, const bl_frame *hdr) {
+    receiver *r = static_cast<receiver *>(ctx);
+    if (hdr->type != BL_DATA || !r->have_man) {
+      return nullptr;
+    }
+    if (!r->windowed) {
+      return (r->recv + hdr->len <= r->img.size()) ? r->img.data() + r->recv : nullptr;
+    }
+    uint32_t off = static_cast<uint32_t>(hdr->seq) * BL_MAX_PAYLOAD;
+    if (off + hdr->len > r->man.length || !bl_rxwin_want(&r->win, hdr->seq)) {
+      return nullptr;
+    }
+    return r->img.data() + off;
+  }
+
+  void run() {
+    bl_frame_rx_init(&rx);
+    bl_frame_rx_set_sink(&rx, sink, this);
+    std::mt19937 rng(0x5EEDu);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const double p_byte = ber * 8.0;
+    uint8_t buf[256];
+    uint64_t bytes = 0;
+    auto t0 = clk::now();
+
+    while (!stop) {
+      struct pollfd p = {fd, POLLIN, 0};
+      if (::poll(&p, 1, 20) <= 0) {
+        continue;
+      }
+      ssize_t n = ::read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        continue;
+      }
+      // pace to the simulated line rate: 10 bits per byte on the wire
+      bytes += static_cast<uint64_t>(n);
+      auto due = t0 + std::chrono::duration<double>(static_cast<double>(bytes) * 10.0 / SIM_BAUD);
+      std::this_thread::sleep_until(due);
+
+      for (ssize_t i = 0; i < n; i++) {
+        if (p_byte > 0.0 && u(rng) < p_byte) {
+          buf[i] ^= static_cast<uint8_t>(1U << (rng() & 7U));
+        }
+      }
+      size_t i = 0;
+      while (i < static_cast<size_t>(n)) {
+        int st;
+        i += bl_frame_feed_buf(&rx, buf + i, static_cast<size_t>(n) - i, &st);
+        if (st == BL_FRAME_OK) {
+          handle(rx.frame);
+        }
+      }
+      // like bl_update_run: one ack per received chunk, not per frame
+      if (windowed && ack_due) {
+        send_ack();
+      }
+    }
+  }
+};
+
+struct outcome {
+  bool ok = false;
+  int attempts = 0;
+  double secs = 0.0;
+  size_t wire_frames = 0;
+  size_t resent = 0;
+};
+
+outcome run_case(double ber, bool windowed, const std::vector<uint8_t> &img) {
+  int master, slave;
+  outcome o;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return o;
+  }
+  receiver r;
+  r.fd = slave;
+  r.ber = ber;
+  std::thread th([&r] { r.run(); });
+
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+
+  xfer_opts xo;
+  xo.windowed = windowed;
+  xo.window = RX_WINDOW;
+  xo.baud = SIM_BAUD;
+  xo.result_ms = 1000;
+
+  auto t0 = clk::now();
+  int tries = windowed ? 1 : LEGACY_TRIES;
+  for (o.attempts = 1; o.attempts <= tries; o.attempts++) {
+    bl_hello ack{};
+    if (!handshake(master, &ack)) {
+      continue; // the hello itself got hit
+    }
+    xfer_stats st;
+    o.ok = send_image(master, m, img.data(), img.size(), xo, st);
+    o.wire_frames += st.frames;
+    o.resent += st.resent;
+    if (o.ok) {
+      break;
+    }
+  }
+  o.secs = std::chrono::duration<double>(clk::now() - t0).count();
+
+  r.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  return o;
+}
+
+// a plain stream to a receiver that gives up after 16KB: the host has to stop
+// on its NAK, with no more than what the pty had already taken still going out
+bool early_nak(const std::vector<uint8_t> &img) {
+  int master, slave;
+  if (!open_pty(master, slave)) {
+    perror("pty");
+    return false;
+  }
+  receiver r;
+  r.fd = slave;
+  r.give_up_at = 16U * 1024U;
+  std::thread th([&r] { r.run(); });
+
+  bl_manifest m{};
+  m.magic = BL_MANIFEST_MAGIC;
+  m.target = BL_TARGET_APM_H755;
+  m.version = 1;
+  m.length = static_cast<uint32_t>(img.size());
+  m.crc32 = bl_crc32(img.data(), img.size());
+  xfer_opts xo;
+  xo.windowed = false;
+  xo.baud = SIM_BAUD;
+  xfer_stats st;
+  send_image(master, m, img.data(), img.size(), xo, st);
+
+  r.stop = true;
+  th.join();
+  ::close(slave);
+  ::close(master);
+  printf("receiver gives up at %u KB: host stopped after %zu of %zu KB, status %u\n",
+         r.give_up_at / 1024U, st.bytes / 1024U, img.size() / 1024U, st.result.status);
+  return st.have_result && st.result.status == BL_ERR_SIZE && st.bytes < img.size() / 2U;
+}
+
+} // namespace
+
+int main() {
+  std::vector<uint8_t> img(IMAGE);
+  std::mt19937 rng(0xACE1u);
+  for (auto &b : img) {
+    b = static_cast<uint8_t>(rng());
+  }
+
+  // quiet the per-handshake "link established" lines
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  FILE *devnull = fopen("/dev/null", "w");
+
+  const double bers[] = {0.0, 1e-6, 1e-5, 5e-5};
+  std::vector<outcome> res;
+  for (double ber : bers) {
+    dup2(fileno(devnull), STDOUT_FILENO);
+    outcome legacy = run_case(ber, false, img);
+    outcome win = run_case(ber, true, img);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    res.push_back(legacy);
+    res.push_back(win);
+  }
+
+  double line = IMAGE / 1024.0 / (IMAGE * (8.0 + 4.0 + BL_MAX_PAYLOAD) / BL_MAX_PAYLOAD * 10.0 /
+                                  SIM_BAUD);
+  printf("windowed transfer, %zu KB image @ %d baud sim (line max %.0f KB/s)\n", IMAGE / 1024,
+         SIM_BAUD, line);
+  printf("%-8s  %-28s  %-28s\n", "ber", "stop-at-the-end", "windowed");
+  for (size_t i = 0; i < sizeof(bers) / sizeof(bers[0]); i++) {
+    const outcome &l = res[2 * i];
+    const outcome &w = res[2 * i + 1];
+    char lb[64], wb[64];
+    if (l.ok) {
+      snprintf(lb, sizeof(lb), "%6.1f KB/s (%d tries)", IMAGE / 1024.0 / l.secs, l.attempts);
+    } else {
+      snprintf(lb, sizeof(lb), "failed after %d tries", LEGACY_TRIES);
+    }
+    snprintf(wb, sizeof(wb), "%6.1f KB/s (%zu resent)", IMAGE / 1024.0 / w.secs, w.resent);
+    printf("%-8g  %-28s  %-28s%s\n", bers[i], lb, w.ok ? wb : "FAILED", w.ok ? "" : "  <--");
+    if (!w.ok) {
+      fails++;
+    }
+  }
+
+  if (!early_nak(img)) {
+    fails++;
+  }
+
+  printf("test_window: %s\n", fails ? "FAIL" : "PASS");
+  return fails ? 1 : 0;
+}
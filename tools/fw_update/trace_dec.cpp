@@ -0,0 +1,108 @@
+// see trace_dec.h
+
+#include "trace_dec.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// what a mark's arg says, per phase
+std::string describe(const trace_row &r) {
+  char b[64];
+  unsigned slot = r.arg & 0xFFU;
+  bool bad = (r.arg & BL_TRACE_ARG_BAD) != 0U;
+  switch (r.phase) {
+    case BL_TRACE_RESET:
+      return "counter starts";
+    case BL_TRACE_QSPI:
+      return r.arg ? "up" : "init FAILED";
+    case BL_TRACE_UPDATE:
+      return (r.arg & 1U) ? "a host session ran" : "no host";
+    case BL_TRACE_BOOT:
+      snprintf(b, sizeof(b), "app_%u first", slot);
+      return b;
+    case BL_TRACE_HEADER:
+      snprintf(b, sizeof(b), "app_%u %s", slot, bad ? "bad" : "ok");
+      return b;
+    case BL_TRACE_STAGE:
+      snprintf(b, sizeof(b), "app_%u %s", slot,
+               bad ? "FAILED" : ((r.arg & BL_TRACE_ARG_SKIP) ? "skipped, exec held it" : "copied"));
+      return b;
+    case BL_TRACE_JUMP:
+      return "to the app";
+    case BL_TRACE_FPGA:
+      if (r.arg & BL_TRACE_ARG_SKIP) {
+        return "not loaded, left to the app";
+      }
+      if (bad) {
+        return "no bitstream came up, DAC muted";
+      }
+      return slot ? "fpga_golden up" : "fpga_active up";
+    default:
+      snprintf(b, sizeof(b), "mark %u, arg %u", static_cast<unsigned>(r.phase - BL_TRACE_APP),
+               static_cast<unsigned>(r.arg));
+      return (r.phase >= BL_TRACE_APP) ? b : "?";
+  }
+}
+
+} // namespace
+
+bool decode_trace(const uint8_t *p, size_t n, boot_timeline &out, std::string *why) {
+  auto fail = [why](const char *s) {
+    if (why != nullptr) {
+      *why = s;
+    }
+    return false;
+  };
+  out = boot_timeline{};
+  if (n == 0U) {
+    return fail("the board kept no trace (none reached the app since power-on)");
+  }
+  if (n < sizeof(bl_boot_trace)) {
+    return fail("short trace payload");
+  }
+  memcpy(&out.t, p, sizeof(out.t));
+  if (bl_trace_check(&out.t) != 0) {
+    return fail("trace fails its magic/crc check");
+  }
+  if (out.t.cpu_hz == 0U) {
+    return fail("trace has no counter rate");
+  }
+  double ms_per_cycle = 1000.0 / out.t.cpu_hz;
+  double at = 0.0;
+  for (unsigned i = 0; i < out.t.count; i++) {
+    trace_row r;
+    r.phase = out.t.marks[i].phase;
+    r.arg = out.t.marks[i].arg;
+    r.ms = bl_trace_span(&out.t, i) * ms_per_cycle;
+    at += r.ms;
+    r.at_ms = at;
+    out.rows.push_back(r);
+  }
+  out.total_ms = at;
+  return true;
+}
+
+std::string format_trace(const boot_timeline &tl) {
+  std::string s;
+  char line[160];
+  snprintf(line, sizeof(line), "boot trace: boot %u since power-on, %.0f MHz cycle counter\n",
+           tl.t.boot, tl.t.cpu_hz / 1e6);
+  s += line;
+  snprintf(line, sizeof(line), "  %-9s %10s %10s\n", "phase", "took", "ends at");
+  s += line;
+  for (const trace_row &r : tl.rows) {
+    snprintf(line, sizeof(line), "  %-9s %8.2fms %8.2fms  %s\n", bl_trace_phase_name(r.phase),
+             r.ms, r.at_ms, describe(r).c_str());
+    s += line;
+  }
+  snprintf(line, sizeof(line), "  %-9s %8.2fms%s\n", "total", tl.total_ms,
+           (tl.t.flags & BL_TRACE_F_JUMPED) ? "" : "  (did not reach the app)");
+  s += line;
+  if (tl.t.dropped > 0U) {
+    snprintf(line, sizeof(line), "  %u later marks did not fit\n", tl.t.dropped);
+    s += line;
+  }
+  return s;
+}
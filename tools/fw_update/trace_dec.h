@@ -0,0 +1,35 @@
+// host side of the boot trace (format in bootloader/boot_trace.h): a BL_TRACE
+// payload checked and turned into how long each boot phase took, and the table
+// update.bin --boot-trace prints. used by update.bin and the host tests.
+
+#ifndef FW_UPDATE_TRACE_DEC_H
+#define FW_UPDATE_TRACE_DEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bootloader/boot_trace.h"
+
+struct trace_row {
+  uint16_t phase = 0;  // enum bl_trace_phase
+  uint16_t arg = 0;
+  double at_ms = 0.0;  // end of the phase, since the counter started
+  double ms = 0.0;     // the phase
+};
+
+struct boot_timeline {
+  bl_boot_trace t{};
+  std::vector<trace_row> rows; // one per mark, BL_TRACE_RESET first
+  double total_ms = 0.0;       // counter start .. the last mark
+};
+
+// decode a BL_TRACE payload. false if it is not an intact trace (`why` says
+// what is wrong with it)
+bool decode_trace(const uint8_t *p, size_t n, boot_timeline &out, std::string *why = nullptr);
+
+// one line per phase, then the total
+std::string format_trace(const boot_timeline &tl);
+
+#endif // FW_UPDATE_TRACE_DEC_H
@@ -3,12 +3,26 @@
 // run like:
 //   ./update.bin --dev /dev/ttyUSB0 --component [APM | ACM] --file foo.bin
 //
+// a rack of boards at once (one session per port, in parallel):
+//   ./update.bin --dev '/dev/ttyUSB*' --file foo.bin
+//
+// find the fastest baud and payload the link carries cleanly, then use them:
+//   ./update.bin --dev /dev/ttyUSB0 --baud 1000000 --autotune --file foo.bin
+//
+// the app and the FPGA bitstream in one session (mkupdate --bundle):
+//   ./update.bin --dev /dev/ttyUSB0 --file release.smbn
+//
+// how the board's last boot went (reset it into the bootloader first):
+//   ./update.bin --dev /dev/ttyUSB0 --boot-trace
+//
 // test/benchmark mode streams dummy bytes to exercise the STM32 USART3 RX
 // benchmark (test_uart3_rx_bench.c):
 //   ./update.bin --dev /dev/ttyUSB0 --test
 //   ./update.bin --dev /dev/ttyUSB0 --test --baud 2000000 --size 4M
 
 #include <algorithm>
+#include <atomic>
+#include <cstdarg>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
@@ -16,12 +30,15 @@
 #include <iterator>
 #include <random>
 #include <string>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <chrono>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <glob.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -30,7 +47,10 @@
 #include "bootloader/frame.h"
 #include "bootloader/image.h"
 
+#include "bundle.h"
 #include "custom_baud.h"
+#include "link.h"
+#include "trace_dec.h"
 
 namespace {
 
@@ -64,25 +84,6 @@ size_t parse_size(const std::string &s) {
   return static_cast<size_t>(std::stod(num) * static_cast<double>(mult));
 }
 
-// open the serial device and configure it raw 8N1, no flow control, at an exact
-// baud via termios2 (see custom_baud.c) - any integer, not just the fixed
-// Bxxxxxx constants, so 6M/7.5M etc. work
-int open_serial(const std::string &dev, int baud) {
-  int fd = ::open(dev.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
-  if (fd < 0) {
-    std::cerr << "open " << dev << ": " << std::strerror(errno) << "\n";
-    return -1;
-  }
-  if (serial_setup(fd, (unsigned)baud) != 0) {
-    std::cerr << "serial_setup " << baud << ": " << std::strerror(errno) << "\n";
-    ::close(fd);
-    return -1;
-  }
-  return fd;
-}
-
-bool handshake(int fd); // defined below; used by run_test
-
 // blast `size` dummy bytes and report host-side throughput + checksum
 int run_test(const std::string &dev, int baud, size_t size) {
   std::vector<uint8_t> data(size);
@@ -141,241 +142,479 @@ int run_test(const std::string &dev, int baud, size_t size) {
   return 0;
 }
 
-// send one framed packet, retrying short writes
-bool send_frame(int fd, uint8_t type, uint16_t seq, const void *pl,
-                uint16_t len) {
-  uint8_t tx[8U + BL_MAX_PAYLOAD + 4U];
-  size_t n = bl_frame_encode(type, seq, pl, len, tx, sizeof(tx));
-  if (n == 0) {
-    return false;
-  }
-  size_t off = 0;
-  while (off < n) {
-    ssize_t w = ::write(fd, tx + off, n - off);
-    if (w < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      return false;
+// how update.bin drives the link (the --baud/--window/... options)
+struct link_cfg {
+  int baud = 2000000;
+  uint16_t window = 16;
+  bool resume = true; // continue an interrupted plain transfer (v6 receivers)
+  int retries = 0;    // after a lost link, wait for the board and resume
+  bool tune = false;  // --autotune: negotiate baud and payload first (v7 receivers)
+  tune_opts to;
+};
+
+std::mutex g_out; // several boards print at once: whole lines only
+
+// one board's part in an update: its device, how it went, and the prefix its
+// lines get when several boards run at once
+struct board_run {
+  std::string dev;
+  std::string tag;                   // "[/dev/ttyUSB1] " in parallel runs
+  const encoded_image *pre = nullptr; // one per part
+  std::atomic<size_t> progress{0};   // DATA bytes sent
+  std::atomic<bool> done{false};
+  xfer_stats st;                     // the last part's
+  size_t sent = 0;                   // DATA bytes over all parts and attempts
+  int rc = 1;
+  double secs = 0.0;                 // open..RESULT
+
+  void say(FILE *f, const char *fmt, ...) const __attribute__((format(printf, 3, 4))) {
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    std::lock_guard<std::mutex> lk(g_out);
+    fprintf(f, "%s%s", tag.c_str(), line);
+  }
+};
+
+// --autotune: what each step measured and where the link settled
+void report_tune(const board_run &b, const tune_result &r, bool ok) {
+  for (const tune_step &st : r.steps) {
+    if (!st.up) {
+      b.say(stdout, "autotune: %8d baud  did not come up\n", st.baud);
+      continue;
     }
-    off += static_cast<size_t>(w);
+    b.say(stdout, "autotune: %8d baud  %2d/%d test frames, bit-error rate %s%.1e\n", st.baud,
+          st.got, st.sent, (st.got == st.sent) ? "< " : "",
+          (st.got == st.sent) ? 1.0 / (8.0 * (BL_MAX_PAYLOAD + 12.0) * st.sent) : st.ber);
+  }
+  if (!ok) {
+    b.say(stderr, "autotune: the board stopped answering\n");
+    return;
   }
-  return true;
+  b.say(stdout, "autotune: settled on %d baud, %u-byte DATA payload (%.1f KB/s predicted)\n",
+        r.baud, r.chunk, r.rate / 1024.0);
 }
 
-// wait up to timeout_ms for one complete frame; feeds a local parser so a frame
-// split across reads still assembles
-bool recv_frame(int fd, int timeout_ms, bl_frame &out) {
-  bl_frame_rx rx;
-  bl_frame_rx_init(&rx);
-  auto deadline = std::chrono::steady_clock::now() +
-                  std::chrono::milliseconds(timeout_ms);
-  uint8_t buf[256];
-  while (std::chrono::steady_clock::now() < deadline) {
-    ssize_t n = ::read(fd, buf, sizeof(buf));
-    if (n < 0) {
-      if (errno == EAGAIN || errno == EINTR) {
-        usleep(1000);
-        continue;
-      }
-      return false;
+// handshake done at c.baud: tune the link if asked and the board can. sets the
+// rate and payload the transfer runs at; false if the board was lost
+bool tune_link(int fd, const bl_hello &ack, const link_cfg &c, const board_run &b, int &baud,
+               uint16_t &chunk) {
+  baud = c.baud;
+  chunk = static_cast<uint16_t>(std::min<unsigned>(BL_MAX_PAYLOAD, ack.max_payload));
+  if (!c.tune) {
+    return true;
+  }
+  if (ack.version < 7U) {
+    b.say(stdout, "autotune: the board speaks v%u, needs v7 - staying at %d baud\n", ack.version,
+          c.baud);
+    return true;
+  }
+  tune_result r;
+  bool ok = autotune(fd, c.baud, c.to, r);
+  report_tune(b, r, ok);
+  baud = r.baud;
+  chunk = r.chunk;
+  return ok;
+}
+
+const char *status_name(uint16_t s) {
+  static const char *names[] = {"OK",      "ERR_CRC",   "ERR_TARGET", "ERR_SIZE",
+                                "ERR_SEQ", "ERR_PROTO", "ERR_FLASH",  "ERR_BASE"};
+  return (s < sizeof(names) / sizeof(names[0])) ? names[s] : "?";
+}
+
+// handshake, then one framed transfer of each part (its `data` under its
+// manifest `m`) - several parts as a bundle (BL_BUNDLE, v9), committed by the
+// board only once the last one verified. windowed (ack/nak + selective resend)
+// when the mcu speaks proto v2 and --window > 0, otherwise the original
+// stream-then-verdict. a plain image on its own first asks how much of it the
+// board already has from an interrupted transfer (v6) and sends only the rest;
+// if the link is lost, --retries waits for the board to come back (reset it)
+// and resumes again - a bundle starts over. prints the RESULT + link stats
+int transfer(int fd, const std::vector<update_part> &parts, const link_cfg &c, board_run &b) {
+  const bool bundle = parts.size() > 1U;
+  const bl_manifest &m = parts[0].m;
+  bool plain = !bundle && (m.flags & (BL_MANIFEST_F_DELTA | BL_MANIFEST_F_LZ)) == 0U;
+  xfer_stats &st = b.st;
+  bool ok = false;
+  size_t sent = 0;
+  size_t total = 0; // bytes of the parts
+  double hs_s = 0.0, stream_s = 0.0, verify_s = 0.0;
+  int baud = c.baud;
+  for (const update_part &p : parts) {
+    total += p.data.size();
+  }
+  for (int attempt = 0; attempt <= c.retries; attempt++) {
+    auto t0 = std::chrono::steady_clock::now();
+    if (baud != c.baud) {
+      serial_setup(fd, static_cast<unsigned>(c.baud)); // a reset board is back at its own rate
+      baud = c.baud;
+    }
+    bl_hello ack{};
+    bool linked = handshake(fd, &ack);
+    // waiting for a reset board: its bootloader listens for a HELLO at boot. a
+    // running app takes the first HELLO as its cue to reset into update mode
+    // (bootloader/update_req.h) and leaves the answer to its bootloader
+    for (int i = 0; !linked && i < (attempt > 0 ? 30 : 1); i++) {
+      linked = handshake(fd, &ack);
+    }
+    if (!linked) {
+      return 1;
     }
-    if (n == 0) {
-      usleep(1000);
+    usleep(20000); // let the firmware arm its stream receiver after the ack
+
+    xfer_opts o;
+    if (!tune_link(fd, ack, c, b, baud, o.chunk)) {
       continue;
     }
-    for (ssize_t i = 0; i < n; i++) {
-      if (bl_frame_feed(&rx, buf[i]) == BL_FRAME_OK) {
-        out = rx.frame;
-        return true;
+    o.windowed = c.window > 0U && ack.version >= 2U;
+    o.window = c.window;
+    o.baud = baud;
+    o.progress = &b.progress;
+    // a v10 board narrates on its log channel; its telemetry is not shown
+    o.on_channel = [&b](const bl_frame &f) {
+      if (f.type == BL_LOG) {
+        b.say(stdout, "board: %.*s\n", static_cast<int>(f.len),
+              reinterpret_cast<const char *>(f.payload));
+      }
+    };
+    uint32_t have = 0;
+    if (plain && c.resume && o.windowed && ack.version >= 6U && query_resume(fd, m, have) &&
+        have > 0U) {
+      b.say(stdout, "resuming: the board has %u of %zu bytes\n", have, parts[0].data.size());
+      o.resume = true;
+    }
+    if (bundle && ack.version < 9U) {
+      b.say(stderr, "the board speaks v%u, a bundle needs v9\n", ack.version);
+      return 1;
+    }
+    if (bundle && !start_bundle(fd, static_cast<uint16_t>(parts.size()))) {
+      b.say(stderr, "the board did not take a %zu-part bundle\n", parts.size());
+      return 1;
+    }
+    hs_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    stream_s = verify_s = 0.0;
+    for (size_t i = 0; i < parts.size(); i++) {
+      const update_part &p = parts[i];
+      o.pre = (b.pre != nullptr) ? &b.pre[i] : nullptr;
+      ok = send_image(fd, p.m, p.data.data(), p.data.size(), o, st);
+      sent += st.bytes;
+      stream_s += st.stream_s;
+      verify_s += st.verify_s;
+      if (bundle && st.have_result) {
+        b.say(stdout, "part %zu/%zu (target %u): RESULT status=%u bytes=%u\n", i + 1U,
+              parts.size(), p.m.target, st.result.status, st.result.bytes);
       }
+      if (!ok) {
+        break;
+      }
+    }
+    if (st.have_result) {
+      break;
     }
+    b.say(stderr, "link lost after %zu bytes%s\n", st.bytes,
+          (attempt < c.retries) ? (bundle ? ", waiting for the board to take the bundle again"
+                                          : ", waiting for the board to resume")
+                                : "");
   }
-  return false;
+  if (!st.have_result) {
+    b.say(stderr, "no RESULT frame\n");
+    return 1;
+  }
+  double dt = (stream_s + verify_s > 0.0) ? stream_s + verify_s : 1e-6;
+  b.say(stdout, "RESULT status=%u bytes=%u  (%.1f KB/s framed)\n", st.result.status,
+        st.result.bytes, (static_cast<double>(total - st.start) / 1024.0) / dt);
+  // handshake includes the 20ms the firmware gets to arm its receiver
+  b.say(stdout, "phases: handshake %.1f ms, stream %.1f ms, verify %.1f ms\n", hs_s * 1000.0,
+        stream_s * 1000.0, verify_s * 1000.0);
+  if (st.stream_s > 0.0) {
+    b.say(stdout, "line util: %.1f %% while streaming (%zu bytes framed)\n",
+          (static_cast<double>(st.wire) / st.stream_s) / (baud / 10.0) * 100.0, st.wire);
+  }
+  if (st.windowed) {
+    b.say(stdout, "windowed: %zu frames sent, %zu resent, %zu naks, %zu acks\n", st.frames,
+          st.resent, st.naks, st.acks);
+  }
+  if (bundle) {
+    b.say(stdout, "bundle: %zu parts %s\n", parts.size(),
+          ok ? "committed together" : "not committed - the board is as it was");
+  } else if (sent != st.bytes || st.start != 0U) {
+    b.say(stdout, "resumed: %zu DATA bytes over all attempts for a %zu byte image\n", sent,
+          total);
+  }
+  b.sent = sent;
+  return ok ? 0 : 1;
 }
 
-// HELLO/HELLO_ACK: prove the link and learn the mcu's protocol version
-bool handshake(int fd) {
-  bl_hello h;
-  h.version = BL_PROTO_VERSION;
-  h.max_payload = BL_MAX_PAYLOAD;
-  if (!send_frame(fd, BL_HELLO, 0, &h, sizeof(h))) {
-    std::cerr << "failed to send HELLO\n";
-    return false;
-  }
-  tcdrain(fd);
-
-  bl_frame f;
-  if (recv_frame(fd, 1000, f) && f.type == BL_HELLO_ACK) {
-    bl_hello ack;
-    memcpy(&ack, f.payload, sizeof(ack));
-    printf("link established: mcu proto v%u, max payload %u\n", ack.version,
-           ack.max_payload);
-    return true;
+// open the board's port and run the transfer
+void run_board(board_run &b, const std::vector<update_part> &parts, const link_cfg &c) {
+  auto t0 = std::chrono::steady_clock::now();
+  int fd = open_serial(b.dev, c.baud);
+  if (fd >= 0) {
+    b.rc = transfer(fd, parts, c, b);
+    ::close(fd);
   }
-  std::cerr << "no HELLO_ACK (check wiring, baud, and that the framed receiver "
-               "firmware is running)\n";
-  return false;
+  b.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  b.done = true;
+}
+
+// --dev: a comma-separated list, each entry a path or a glob
+// (/dev/ttyUSB*). a glob that matches nothing is an error
+std::vector<std::string> expand_devs(const std::string &spec) {
+  std::vector<std::string> devs;
+  size_t pos = 0;
+  while (pos <= spec.size()) {
+    size_t end = spec.find(',', pos);
+    std::string item = spec.substr(pos, (end == std::string::npos) ? std::string::npos : end - pos);
+    pos = (end == std::string::npos) ? spec.size() + 1U : end + 1U;
+    if (item.empty()) {
+      continue;
+    }
+    if (item.find_first_of("*?[") == std::string::npos) {
+      devs.push_back(item);
+      continue;
+    }
+    glob_t g;
+    if (glob(item.c_str(), 0, nullptr, &g) != 0) {
+      std::cerr << item << ": no device matches\n";
+      return {};
+    }
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+      devs.push_back(g.gl_pathv[i]);
+    }
+    globfree(&g);
+  }
+  std::sort(devs.begin(), devs.end());
+  devs.erase(std::unique(devs.begin(), devs.end()), devs.end());
+  return devs;
+}
+
+// send the parts to every board. one device runs inline; several run a thread
+// per port, all sending from one encoded copy of each part's DATA frames, with
+// a progress line while they go and a per-board summary at the end
+int flash(const std::vector<std::string> &devs, const std::vector<update_part> &parts,
+          const link_cfg &c) {
+  std::vector<board_run> runs(devs.size());
+  if (devs.size() == 1U) {
+    runs[0].dev = devs[0];
+    run_board(runs[0], parts, c);
+    return runs[0].rc;
+  }
+
+  std::vector<encoded_image> pre(parts.size());
+  size_t total = 0;
+  for (size_t i = 0; i < parts.size(); i++) {
+    pre[i].build(parts[i].data.data(), parts[i].data.size(), BL_MAX_PAYLOAD);
+    total += parts[i].data.size();
+  }
+  std::vector<std::thread> th;
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < devs.size(); i++) {
+    runs[i].dev = devs[i];
+    runs[i].tag = "[" + devs[i] + "] ";
+    runs[i].pre = pre.data();
+    th.emplace_back(run_board, std::ref(runs[i]), std::cref(parts), std::cref(c));
+  }
+
+  const bool tty = isatty(STDERR_FILENO) != 0;
+  for (;;) {
+    size_t done = 0, sent = 0;
+    for (const board_run &b : runs) {
+      done += b.done ? 1U : 0U;
+      sent += b.progress;
+    }
+    if (done == runs.size()) {
+      break;
+    }
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (tty && t > 0.0) {
+      std::lock_guard<std::mutex> lk(g_out);
+      fprintf(stderr, "\r%zu/%zu boards done, %.2f of %.2f MB sent, %.1f KB/s   ", done,
+              runs.size(), sent / 1048576.0, runs.size() * total / 1048576.0,
+              sent / 1024.0 / t);
+    }
+    usleep(200000);
+  }
+  for (std::thread &t : th) {
+    t.join();
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  if (tty) {
+    fprintf(stderr, "\n");
+  }
+
+  printf("\n%-24s %-10s %10s %9s %10s\n", "device", "result", "sent", "time", "rate");
+  size_t ok = 0;
+  total = 0;
+  for (const board_run &b : runs) {
+    const xfer_stats &st = b.st;
+    const char *res = st.have_result ? status_name(st.result.status) : "no result";
+    total += b.sent;
+    ok += (b.rc == 0) ? 1U : 0U;
+    printf("%-24s %-10s %9zuK %8.2fs %7.1f KB/s\n", b.dev.c_str(), res, b.sent / 1024U,
+           b.secs, (b.secs > 0.0) ? b.sent / 1024.0 / b.secs : 0.0);
+  }
+  printf("%zu/%zu boards OK, %zu KB in %.2fs: %.1f KB/s aggregate\n", ok, runs.size(),
+         total / 1024U, wall, total / 1024.0 / wall);
+  return (ok == runs.size()) ? 0 : 1;
 }
 
 // full framed transfer of dummy data: HELLO, MANIFEST, streamed DATA, DONE,
 // then read back the RESULT verdict. exercises test_fw_receiver.c end to end
-int run_stream(const std::string &dev, int baud, size_t size, uint16_t target) {
-  std::vector<uint8_t> data(size);
+int run_stream(const std::vector<std::string> &devs, const link_cfg &c, size_t size, uint16_t target) {
+  std::vector<update_part> parts(1);
+  std::vector<uint8_t> &data = parts[0].data;
+  data.resize(size);
   std::mt19937 rng(0xACE1u);
   for (size_t i = 0; i < size; i++) {
     data[i] = static_cast<uint8_t>(rng());
   }
   uint32_t crc = bl_crc32(data.data(), data.size());
 
-  std::cout << "dev " << dev << "  baud " << baud << "  size " << size
+  std::cout << "devs " << devs.size() << "  baud " << c.baud << "  size " << size
             << " bytes  target " << target << "\n";
   printf("image crc32: 0x%08X\n", crc);
 
-  int fd = open_serial(dev, baud);
-  if (fd < 0) {
-    return 1;
-  }
-  if (!handshake(fd)) {
-    ::close(fd);
-    return 1;
-  }
-  usleep(20000); // let the firmware arm its stream receiver after the ack
-
-  bl_manifest m;
+  bl_manifest &m = parts[0].m;
   m.magic = BL_MANIFEST_MAGIC;
   m.target = target;
-  m.reserved = 0;
+  m.flags = 0;
   m.version = 1;
   m.length = static_cast<uint32_t>(size);
   m.crc32 = crc;
-  if (!send_frame(fd, BL_MANIFEST, 0, &m, sizeof(m))) {
-    ::close(fd);
-    return 1;
-  }
-
-  auto t0 = std::chrono::steady_clock::now();
-  uint16_t seq = 0;
-  size_t off = 0;
-  while (off < size) {
-    uint16_t chunk =
-        static_cast<uint16_t>(std::min<size_t>(BL_MAX_PAYLOAD, size - off));
-    if (!send_frame(fd, BL_DATA, seq++, data.data() + off, chunk)) {
-      ::close(fd);
-      return 1;
-    }
-    off += chunk;
-  }
-  send_frame(fd, BL_DONE, seq, nullptr, 0);
-  tcdrain(fd);
-  auto t1 = std::chrono::steady_clock::now();
+  return flash(devs, parts, c);
+}
 
-  int rc = 1;
-  bl_frame f;
-  if (recv_frame(fd, 2000, f) && f.type == BL_RESULT) {
-    bl_result r;
-    memcpy(&r, f.payload, sizeof(r));
-    double dt = std::chrono::duration<double>(t1 - t0).count();
-    if (dt <= 0.0) {
-      dt = 1e-6;
-    }
-    printf("RESULT status=%u bytes=%u  (%.1f KB/s framed)\n", r.status, r.bytes,
-           (static_cast<double>(size) / 1024.0) / dt);
-    rc = (r.status == BL_OK) ? 0 : 1;
+// what is about to go out for one file: a patch from mkupdate --delta (only
+// the op stream goes on the wire; the bootloader refuses it with BL_ERR_BASE
+// unless the installed image is the one it was made from), a compressed blob
+// from --lz (decompressed into the slot as it arrives), or an image blob
+void describe(const std::string &name, const update_part &p) {
+  const bl_manifest &m = p.m;
+  if ((m.flags & BL_MANIFEST_F_DELTA) != 0U) {
+    std::cout << "patch " << name << "  " << m.length << " bytes  target " << m.target
+              << "  rebuilds " << m.image_length << " bytes\n";
+    printf("base crc32: 0x%08X  image crc32: 0x%08X\n", m.base_crc32, m.image_crc32);
+  } else if ((m.flags & BL_MANIFEST_F_LZ) != 0U) {
+    std::cout << "compressed " << name << "  " << m.length << " bytes  target " << m.target
+              << "  decompresses to " << m.image_length << " bytes\n";
+    printf("image crc32: 0x%08X\n", m.image_crc32);
   } else {
-    std::cerr << "no RESULT frame\n";
+    std::cout << "file " << name << "  " << m.length << " bytes  target " << m.target
+              << "  image " << m.length - BL_IMAGE_OFFSET << "\n";
+    printf("blob crc32: 0x%08X\n", m.crc32);
   }
-  ::close(fd);
-  return rc;
 }
 
-// send a real image blob (built by mkupdate: bl_image_header + app). the target
-// is read from the blob's header. streams it as one framed transfer and reports
-// the RESULT.
-int run_file(const std::string &dev, int baud, const std::string &path) {
+// send what mkupdate built: an image blob (bl_image_header + app, the target
+// read from the header), a patch (--delta), a compressed blob (--lz) - or a
+// bundle of those (--bundle), sent in one session. reports the RESULT
+int run_file(const std::vector<std::string> &devs, const link_cfg &c, const std::string &path) {
   std::ifstream in(path, std::ios::binary);
   if (!in) {
     std::cerr << "open " << path << "\n";
     return 1;
   }
-  std::vector<uint8_t> blob((std::istreambuf_iterator<char>(in)),
+  std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)),
                             std::istreambuf_iterator<char>());
-  if (blob.size() < sizeof(bl_image_header)) {
-    std::cerr << path << ": too small to be an image blob\n";
-    return 1;
-  }
-  bl_image_header h;
-  memcpy(&h, blob.data(), sizeof(h));
-  if (h.magic != BL_IMAGE_MAGIC) {
-    std::cerr << path << ": bad magic - run mkupdate first\n";
-    return 1;
-  }
-
-  uint32_t crc = bl_crc32(blob.data(), blob.size());
-  std::cout << "file " << path << "  " << blob.size() << " bytes  target "
-            << h.target << "  image " << h.length << "\n";
-  printf("blob crc32: 0x%08X\n", crc);
-
-  int fd = open_serial(dev, baud);
-  if (fd < 0) {
-    return 1;
-  }
-  if (!handshake(fd)) {
-    ::close(fd);
-    return 1;
-  }
-  usleep(20000);
-
-  bl_manifest m;
-  m.magic = BL_MANIFEST_MAGIC;
-  m.target = h.target;
-  m.reserved = 0;
-  m.version = h.version;
-  m.length = static_cast<uint32_t>(blob.size());
-  m.crc32 = crc;
-  if (!send_frame(fd, BL_MANIFEST, 0, &m, sizeof(m))) {
-    ::close(fd);
+  std::vector<std::vector<uint8_t>> files;
+  std::string why;
+  uint32_t magic = 0;
+  if (file.size() >= sizeof(magic)) {
+    memcpy(&magic, file.data(), sizeof(magic));
+  }
+  if (magic != BUNDLE_MAGIC) {
+    files.push_back(std::move(file));
+  } else if (!parse_bundle(file.data(), file.size(), files, &why)) {
+    std::cerr << path << ": " << why << "\n";
     return 1;
+  } else {
+    std::cout << "bundle " << path << "  " << files.size() << " parts\n";
   }
 
-  uint16_t seq = 0;
-  size_t off = 0;
-  while (off < blob.size()) {
-    uint16_t chunk =
-        static_cast<uint16_t>(std::min<size_t>(BL_MAX_PAYLOAD, blob.size() - off));
-    if (!send_frame(fd, BL_DATA, seq++, blob.data() + off, chunk)) {
-      ::close(fd);
+  std::vector<update_part> parts(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string name = (files.size() > 1U) ? path + "[" + std::to_string(i) + "]" : path;
+    if (!load_part(files[i], parts[i], &why)) {
+      std::cerr << name << ": " << why << "\n";
       return 1;
     }
-    off += chunk;
+    describe(name, parts[i]);
   }
-  send_frame(fd, BL_DONE, seq, nullptr, 0);
+  return flash(devs, parts, c);
+}
 
-  int rc = 1;
-  bl_frame f;
-  if (recv_frame(fd, 4000, f) && f.type == BL_RESULT) {
-    bl_result r;
-    memcpy(&r, f.payload, sizeof(r));
-    printf("RESULT status=%u bytes=%u\n", r.status, r.bytes);
-    rc = (r.status == BL_OK) ? 0 : 1;
-  } else {
-    std::cerr << "no RESULT frame\n";
+// --boot-trace: where the board's last boot to the app spent its time
+// (BL_TRACE, v8 receivers). the bootloader answers in its update window, so
+// the board is reset into it first - the boot before that reset is the one
+// reported
+int run_trace(const std::vector<std::string> &devs, const link_cfg &c) {
+  int rc = 0;
+  for (const std::string &d : devs) {
+    int fd = open_serial(d, c.baud);
+    if (fd < 0) {
+      rc = 1;
+      continue;
+    }
+    if (devs.size() > 1U) {
+      printf("%s: ", d.c_str());
+    }
+    bl_hello ack{};
+    std::vector<uint8_t> raw;
+    boot_timeline tl;
+    std::string why;
+    if (!handshake(fd, &ack)) {
+      rc = 1;
+    } else if (ack.version < 8U) {
+      printf("the board speaks v%u, a boot trace needs v8\n", ack.version);
+      rc = 1;
+    } else if (!fetch_trace(fd, raw)) {
+      std::cerr << "no BL_TRACE answer\n";
+      rc = 1;
+    } else if (!decode_trace(raw.data(), raw.size(), tl, &why)) {
+      printf("%s\n", why.c_str());
+      rc = 1;
+    } else {
+      fputs(format_trace(tl).c_str(), stdout);
+    }
+    ::close(fd);
   }
-  ::close(fd);
   return rc;
 }
 
 void usage(const char *prog) {
   std::cout
       << "usage: " << prog << " --dev <path> [options]\n"
-      << "  --dev <path>        serial device (e.g. /dev/ttyUSB0)\n"
-      << "  --hello             framed HELLO handshake, print link status\n"
+      << "  --dev <path>        serial device (e.g. /dev/ttyUSB0); except for --test,\n"
+      << "                      also a comma-separated list or a glob\n"
+      << "                      ('/dev/ttyUSB*'): all boards are flashed in parallel\n"
+      << "  --hello             framed HELLO handshake, print link status (with\n"
+      << "                      --autotune: also tune the link, report the result)\n"
       << "  --stream            full framed dummy transfer (HELLO..DONE + RESULT)\n"
       << "  --test              raw dummy bytes (pairs with the raw RX benchmark fw)\n"
+      << "  --boot-trace        where the last boot to the app spent its time (reset\n"
+      << "                      the board first: its bootloader answers)\n"
       << "  --baud <n>          baud rate (default 2000000)\n"
       << "  --size <n[K|M]>     payload size for --test/--stream (default 1M)\n"
+      << "  --window <n>        DATA frames in flight, acked + resent selectively\n"
+      << "                      (default 16, 0 = stream everything, verdict at DONE;\n"
+      << "                      the v3 bootloader streams to flash and needs > 0)\n"
+      << "  --no-resume         send a plain image from byte zero even if the board\n"
+      << "                      holds part of it from an interrupted transfer\n"
+      << "  --retries <n>       after a lost link, wait for the board (reset it) and\n"
+      << "                      resume, up to n times (default 0)\n"
+      << "  --autotune          before sending, step the baud up from --baud while\n"
+      << "                      measuring the error rate, and settle both ends on the\n"
+      << "                      fastest clean baud and DATA payload size (v7 boards)\n"
+      << "  --max-baud <n>      never go above this (default 12000000)\n"
       << "  --component <name>  APM | ACM   (update mode, not yet implemented)\n"
-      << "  --file <path>       image to send (update mode, not yet implemented)\n"
+      << "  --file <path>       image to send: a .smup blob, a .smdl patch against\n"
+      << "                      the installed image (mkupdate --delta), a\n"
+      << "                      compressed .smlz (mkupdate --lz), or a .smbn bundle\n"
+      << "                      of those (mkupdate --bundle), sent in one session\n"
       << "  --help              this message\n"
       << "\n"
       << "note: --hello/--stream need the framed receiver fw (test_fw_receiver);\n"
@@ -388,11 +627,12 @@ int main(int argc, char **argv) {
   std::string dev;
   std::string component;
   std::string file;
-  int baud = 2000000;
+  link_cfg lc;
   size_t size = 1024 * 1024;
   bool test = false;
   bool hello = false;
   bool stream = false;
+  bool trace = false;
 
   for (int i = 1; i < argc; i++) {
     std::string a = argv[i];
@@ -412,10 +652,22 @@ int main(int argc, char **argv) {
       hello = true;
     } else if (a == "--stream") {
       stream = true;
+    } else if (a == "--boot-trace") {
+      trace = true;
     } else if (a == "--baud") {
-      baud = std::stoi(next("--baud"));
+      lc.baud = std::stoi(next("--baud"));
     } else if (a == "--size") {
       size = parse_size(next("--size"));
+    } else if (a == "--window") {
+      lc.window = static_cast<uint16_t>(std::stoi(next("--window")));
+    } else if (a == "--no-resume") {
+      lc.resume = false;
+    } else if (a == "--retries") {
+      lc.retries = std::stoi(next("--retries"));
+    } else if (a == "--autotune") {
+      lc.tune = true;
+    } else if (a == "--max-baud") {
+      lc.to.max_baud = std::stoi(next("--max-baud"));
     } else if (a == "--component") {
       component = next("--component");
     } else if (a == "--file") {
@@ -435,6 +687,10 @@ int main(int argc, char **argv) {
     usage(argv[0]);
     return 2;
   }
+  std::vector<std::string> devs = expand_devs(dev);
+  if (devs.empty()) {
+    return 2;
+  }
 
   // map --component to a manifest target for framed transfers
   uint16_t target = BL_TARGET_APM_H755;
@@ -443,27 +699,46 @@ int main(int argc, char **argv) {
   }
 
   if (hello) {
-    int fd = open_serial(dev, baud);
-    if (fd < 0) {
-      return 1;
+    int rc = 0;
+    for (const std::string &d : devs) {
+      int fd = open_serial(d, lc.baud);
+      if (fd < 0) {
+        rc = 1;
+        continue;
+      }
+      if (devs.size() > 1U) {
+        printf("%s: ", d.c_str());
+      }
+      board_run b;
+      bl_hello ack{};
+      int baud;
+      uint16_t chunk;
+      rc |= (handshake(fd, &ack) && tune_link(fd, ack, lc, b, baud, chunk)) ? 0 : 1;
+      ::close(fd);
     }
-    bool ok = handshake(fd);
-    ::close(fd);
-    return ok ? 0 : 1;
+    return rc;
+  }
+
+  if (trace) {
+    return run_trace(devs, lc);
   }
 
   if (!file.empty()) {
-    return run_file(dev, baud, file);
+    return run_file(devs, lc, file);
   }
 
   if (stream) {
-    return run_stream(dev, baud, size, target);
+    return run_stream(devs, lc, size, target);
   }
 
   if (test) {
-    return run_test(dev, baud, size);
+    if (devs.size() != 1U) {
+      std::cerr << "--test takes one device\n";
+      return 2;
+    }
+    return run_test(devs[0], lc.baud, size);
   }
 
-  std::cerr << "pick a mode: --file, --hello, --stream, or --test (see --help)\n";
+  std::cerr << "pick a mode: --file, --hello, --boot-trace, --stream, or --test (see --help)\n";
   return 1;
 }
@@ -0,0 +1,384 @@
+// see vboard.h
+
+#include "vboard.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bootloader/frame.h"
+#include "bootloader/image.h"
+
+#include "custom_baud.h"
+#include "link.h"
+
+vboard::clk::duration vboard::board(double s) const {
+  return std::chrono::duration_cast<clk::duration>(std::chrono::duration<double>(s / o.scale));
+}
+
+// bl_update.c's say: the console, and the host's log channel while mirroring
+void vboard::say(const char *fmt, ...) {
+  char line[96]; // LOG_LINE
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (console != nullptr) {
+    fprintf(console, "%s\n", line);
+    fflush(console);
+  }
+  if (mirror && log_q.size() < 4U) { // LOG_LINES
+    log_q.emplace_back(line);
+  }
+}
+
+// bl_update.c's aux_poll: one queued line or a due telemetry record
+void vboard::aux_poll() {
+  if (!mirror) {
+    return;
+  }
+  uint32_t head[BL_TX_CLASSES] = {0};
+  if (!log_q.empty()) {
+    head[BL_TX_LOG] = static_cast<uint32_t>(8U + log_q.front().size() + 4U);
+  }
+  if (clk::now() - tel_t0 >= board(BL_TELEMETRY_MS / 1000.0)) {
+    head[BL_TX_TELEMETRY] = 8U + sizeof(bl_telemetry) + 4U;
+  }
+  int c = bl_sched_pick(&sched, head);
+  if (c == BL_TX_LOG) {
+    std::string l = std::move(log_q.front());
+    log_q.pop_front();
+    send(BL_CH_LOG, BL_LOG, l.data(), static_cast<uint16_t>(l.size()));
+  } else if (c == BL_TX_TELEMETRY) {
+    tel_t0 = clk::now();
+    bl_telemetry t;
+    double ms = std::chrono::duration<double>(tel_t0 - sess_t0).count() * o.scale * 1000.0;
+    bl_session_telemetry(&sess, static_cast<uint32_t>(ms), &t);
+    send(BL_CH_TELEMETRY, BL_TELEMETRY, &t, sizeof(t));
+  }
+}
+
+double vboard::ber_now() const {
+  double b = o.ber;
+  if (o.knee_baud > 0 && line > o.knee_baud) {
+    b += o.knee_ber * std::pow(10.0, o.slope * std::log2(static_cast<double>(line) / o.knee_baud));
+  }
+  return std::min(b, 0.5);
+}
+
+// the host's tty on the line's rate (within 2%)
+bool vboard::host_in_step() const {
+  unsigned host;
+  if (tty_fd < 0 || serial_baud(tty_fd, &host) != 0) {
+    return true;
+  }
+  double want = line * o.scale;
+  return std::fabs(host - want) <= want * 0.02;
+}
+
+// bl_update.c's check_trial
+void vboard::check_trial() {
+  if (trial_line == 0) {
+    return;
+  }
+  if (sess.frames != trial_frames) {
+    trial_line = 0;
+  } else if (clk::now() - trial_t0 >= board(BL_LINK_TRIAL_MS / 1000.0)) {
+    say("update: nothing at %d baud, back to %d", line, trial_line);
+    line = trial_line;
+    trial_line = 0;
+  }
+}
+
+// hold `n` bytes just read until the line could have delivered them: 10 bits a
+// byte, and an idle line banks no time - except what the loop spent blocked in
+// replies, when the uart kept receiving. with `live`, the session is polled
+// every tick meanwhile, as the board's loop does while DMA fills the next chunk
+bool vboard::pace(size_t n, bool live) {
+  due = std::max(due, clk::now() - blocked) + board(static_cast<double>(n) * 10.0 / line);
+  blocked = clk::duration::zero();
+  while (clk::now() < due) {
+    if (live && bl_session_poll(&sess) < 0) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::min<clk::duration>(board(0.001), due - clk::now()));
+  }
+  return true;
+}
+
+// send_frame: blocks for the frame's tx time, then sleeps reply_ms (and then
+// moves the line if a BL_LINK answer just went out). a host on another rate
+// reads noise
+void vboard::send(uint8_t ch, uint8_t type, const void *pl, uint16_t len) {
+  auto t0 = clk::now();
+  if (host_in_step()) {
+    send_frame(fd, type, 0, pl, len, ch);
+  } else {
+    uint8_t junk[8U + sizeof(bl_result) + 4U];
+    for (auto &x : junk) {
+      x = static_cast<uint8_t>(noise());
+    }
+    (void)!::write(fd, junk, std::min<size_t>(sizeof(junk), 8U + len + 4U));
+  }
+  double tx = (8.0 + len + 4.0) * 10.0 / line;
+  std::this_thread::sleep_for(board(tx + o.reply_ms / 1000.0));
+  blocked += clk::now() - t0;
+  if (next_line != 0) {
+    trial_line = line;
+    line = next_line;
+    next_line = 0;
+    trial_t0 = clk::now();
+    trial_frames = sess.frames;
+  }
+}
+
+void vboard::reply(uint8_t type, const void *pl, uint16_t len) { send(BL_CH_UPDATE, type, pl, len); }
+
+// wait_hello, without the window: listen until a HELLO or stop
+bool vboard::wait_hello() {
+  bl_frame_rx rx;
+  bl_frame_rx_init(&rx);
+  uint8_t buf[64];
+  while (!stop) {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (::poll(&p, 1, 20) <= 0) {
+      continue;
+    }
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5)); // no host on the pty
+      continue;
+    }
+    pace(static_cast<size_t>(n), false);
+    for (ssize_t i = 0; i < n; i++) {
+      if (bl_frame_feed(&rx, buf[i]) == BL_FRAME_OK && rx.frame.type == BL_HELLO) {
+        bl_hello hh;
+        memcpy(&hh, rx.frame.payload, sizeof(hh));
+        host_ver = hh.version;
+        if (host_fd >= 0) {
+          tcflush(host_fd, TCIFLUSH);
+        }
+        bl_hello h = {BL_PROTO_VERSION, BL_MAX_PAYLOAD};
+        reply(BL_HELLO_ACK, &h, sizeof(h));
+        return true; // the stream receiver is armed after the ack; the rest is lost
+      }
+    }
+  }
+  return false;
+}
+
+// boot_open: the boot pointer's log sectors
+void vboard::boot_open() {
+  bl_boot_open(&boot, &nor->ops, qspi_off(BL_SLOT_PARAMS) + BL_PARAMS_BOOT,
+               qspi_off(BL_SLOT_PARAMS) + BL_PARAMS_BOOT_2);
+}
+
+// ---- bl_update.c's session callbacks ----
+
+void vboard::sess_send(void *ctx, uint8_t type, const void *pl, uint16_t len) {
+  static_cast<vboard *>(ctx)->reply(type, pl, len);
+}
+
+int vboard::sess_slot(void *ctx, uint16_t target, uint32_t *off, uint32_t *size) {
+  vboard *b = static_cast<vboard *>(ctx);
+  enum bl_slot slot;
+  switch (target) {
+    case BL_TARGET_APM_H755:
+      b->boot_open();
+      slot = static_cast<enum bl_slot>(BL_SLOT_APP_0 + bl_boot_update_slot(&b->boot));
+      break;
+    case BL_TARGET_FPGA_GW2AR18:
+    case BL_TARGET_FPGA_GW5A25:
+      slot = BL_SLOT_FPGA_ACTIVE;
+      break;
+    default:
+      return -1;
+  }
+  *off = qspi_off(slot);
+  *size = bl_memmap[slot].size;
+  return 0;
+}
+
+void vboard::sess_prepare(void *ctx, const bl_manifest *m) {
+  vboard *b = static_cast<vboard *>(ctx);
+  b->say("update: manifest target=%u len=%u%s -> %s", m->target, m->length,
+         (m->flags & BL_MANIFEST_F_DELTA) ? " (delta)"
+         : (m->flags & BL_MANIFEST_F_LZ)  ? " (lz)"
+                                          : "",
+         (m->target == BL_TARGET_APM_H755)
+           ? bl_memmap[BL_SLOT_APP_0 + bl_boot_update_slot(&b->boot)].name
+           : "fpga_active");
+  if (b->o.prepare_s > 0.0) {
+    std::this_thread::sleep_for(b->board(b->o.prepare_s));
+  }
+}
+
+int vboard::sess_base(void *ctx, uint16_t target, uint32_t *off, uint32_t *len) {
+  vboard *b = static_cast<vboard *>(ctx);
+  if (target != BL_TARGET_APM_H755) {
+    return -1;
+  }
+  enum bl_slot active = static_cast<enum bl_slot>(BL_SLOT_APP_0 + b->boot.cur.active);
+  bl_image_header h;
+  uint32_t at = qspi_off(active);
+  if (b->nor->ops.read(b->nor->ops.ctx, at, reinterpret_cast<uint8_t *>(&h), sizeof(h)) != 0 ||
+      h.magic != BL_IMAGE_MAGIC || h.length > bl_memmap[active].size - BL_IMAGE_OFFSET) {
+    return -1;
+  }
+  *off = at;
+  *len = BL_IMAGE_OFFSET + h.length;
+  return 0;
+}
+
+int vboard::sess_log(void *ctx, uint32_t *off) {
+  (void)ctx;
+  *off = qspi_off(BL_SLOT_PARAMS) + BL_PARAMS_RESUME_LOG;
+  return 0;
+}
+
+void vboard::sess_idle(void *ctx) {
+  vboard *b = static_cast<vboard *>(ctx);
+  std::this_thread::sleep_for(b->board(0.001));
+}
+
+// the host asks in its own terms (board rates times scale, like its --baud)
+int vboard::sess_set_baud(void *ctx, uint32_t baud) {
+  vboard *b = static_cast<vboard *>(ctx);
+  int want = static_cast<int>(std::lround(baud / b->o.scale));
+  if (want <= 0 || want > b->o.max_baud) {
+    return -1;
+  }
+  b->next_line = want;
+  return 0;
+}
+
+int vboard::sess_commit(void *ctx, const bl_manifest *m) {
+  vboard *b = static_cast<vboard *>(ctx);
+  if (m->target != BL_TARGET_APM_H755) {
+    return 0;
+  }
+  unsigned slot = bl_boot_update_slot(&b->boot);
+  if (bl_boot_install(&b->boot, slot) != 0) {
+    b->say("update: writing the boot pointer failed");
+    return -1;
+  }
+  b->say("update: next boot from %s", bl_memmap[BL_SLOT_APP_0 + slot].name);
+  return 0;
+}
+
+const bl_boot_trace *vboard::sess_trace(void *ctx) {
+  return static_cast<vboard *>(ctx)->trace;
+}
+
+// bl_update_run from the HELLO on
+bool vboard::run() {
+  rep = vboard_report{};
+  due = clk::now();
+  blocked = clk::duration::zero();
+  line = o.baud;
+  next_line = 0;
+  trial_line = 0;
+  noise.seed(0x5EEDu);
+  host_ver = 0;
+  mirror = false;
+  if (o.handshake && !wait_hello()) {
+    return false;
+  }
+  rep.linked = true;
+  ops = {this,      sess_send, sess_slot,     sess_prepare, sess_idle,
+         sess_base, sess_log,  sess_set_baud, sess_commit,  sess_trace};
+  bl_session_init(&sess, &ops, &nor->ops);
+  log_q.clear();
+  bl_sched_init(&sched);
+  sess_t0 = tel_t0 = clk::now();
+  mirror = host_ver >= 10U;
+  say("update: host connected (v%u), receiving...", host_ver);
+
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  uint8_t buf[2048]; // RXSZ: what one DMA chunk holds
+  auto quiet = clk::now();
+  clk::time_point t0{}, t1{};
+
+  // consume chunks until the session stalls. while the flash has work queued,
+  // poll every tick even without data. once it is over, stay until the line
+  // goes quiet as bl_update.c does: a DONE again gets its verdict again
+  while (!stop) {
+    int pending = bl_session_poll(&sess);
+    if (pending < 0) {
+      break; // flash error, nak sent
+    }
+    check_trial();
+    aux_poll();
+    struct pollfd p = {fd, POLLIN, 0};
+    ssize_t n = (::poll(&p, 1, pending ? 0 : 20) > 0) ? ::read(fd, buf, sizeof(buf)) : 0;
+    if (n <= 0) {
+      if (clk::now() - quiet >= board(o.stall_ms / 1000.0)) {
+        if (!rep.over) {
+          rep.stalled = true;
+          say("update: stalled, aborting");
+        }
+        break;
+      }
+      if (pending || n < 0) {
+        std::this_thread::sleep_for(board(0.001));
+      }
+      continue;
+    }
+    if (rep.rx_bytes == 0U) {
+      t0 = clk::now();
+    }
+    if (!pace(static_cast<size_t>(n), true)) {
+      break;
+    }
+    quiet = clk::now();
+    const bool in_step = host_in_step();
+    const double p_byte = ber_now() * 8.0;
+    for (ssize_t i = 0; i < n; i++) {
+      if (!in_step) {
+        buf[i] = static_cast<uint8_t>(noise());
+      } else if (p_byte > 0.0 && u(noise) < p_byte) {
+        buf[i] ^= static_cast<uint8_t>(1U << (noise() & 7U));
+      }
+    }
+    if (o.kill_at >= 0 && rep.rx_bytes + static_cast<size_t>(n) >= static_cast<size_t>(o.kill_at)) {
+      n = o.kill_at - static_cast<long>(rep.rx_bytes);
+      rep.killed = true;
+    }
+    rep.rx_bytes += static_cast<size_t>(n);
+    if (bl_session_feed(&sess, buf, static_cast<size_t>(n)) && !rep.over) {
+      rep.over = true;
+      t1 = clk::now();
+    }
+    if (rep.killed) {
+      break; // gone without a word
+    }
+  }
+
+  mirror = false;
+  rep.status = sess.status;
+  rep.baud = line;
+  rep.recv = sess.recv;
+  if (rep.rx_bytes != 0U) {
+    rep.secs = std::chrono::duration<double>((rep.over ? t1 : clk::now()) - t0).count() * o.scale;
+  }
+  if (!rep.killed) {
+    say("update: done, status=%u, %u bytes", rep.status, rep.recv);
+  }
+  return true;
+}
+
+void vboard::drain() {
+  uint8_t buf[256];
+  while (!stop) {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (::poll(&p, 1, 5) > 0 && ::read(fd, buf, sizeof(buf)) <= 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+}
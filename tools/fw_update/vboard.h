@@ -0,0 +1,157 @@
+// virtual board: the bootloader's update receiver (modules/bootloader/bl_update.c)
+// on the host. it runs what bl_update_run runs - wait for a HELLO, answer
+// HELLO_ACK, then feed the line to the session (lib/bootloader/src/session.c
+// and everything it drives) until it is over and the line quiet, or it stalls -
+// with bl_update.c's session callbacks rebuilt on the slots of
+// modules/bootloader/memmap.c and a file-backed W25Q128 (nor_model.h) in place
+// of the QSPI part. bl_update.c itself is ChibiOS code (UART4 DMA, mailboxes,
+// bsp console) and is not built here; run() mirrors its loop, and each callback
+// says which one it stands in for.
+//
+// what it costs is modelled, so a transfer takes as long as on the board:
+//   - the line is paced to the board's baud, 10 bits a byte
+//   - a reply blocks the loop like send_reply does: the frame's tx time, then
+//     its 2ms sleep (the uart keeps receiving meanwhile)
+//   - erase/program keep the part busy for the datasheet time (nor_timing)
+//   - idle waits are the board's 1ms tick
+//   - a v10 host gets the console lines and telemetry on their channels, one
+//     frame per pass of the loop, each a blocking send like a reply
+//   - BL_LINK baud changes take effect after the answer and fall back after
+//     BL_LINK_TRIAL_MS without an intact frame, as bl_update.c does; with
+//     tty_fd set, a host whose tty is on another rate than the board's line
+//     reads and sends garbage
+// everything can run `scale` times faster than the board; times reported are
+// board time.
+//
+// used by vmcu.bin (a board on a pty, for update.bin --dev /dev/pts/N) and by
+// the host tests and benches (tests/sim_board.h).
+
+#ifndef FW_UPDATE_VBOARD_H
+#define FW_UPDATE_VBOARD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+
+#include "bootloader/boot_ptr.h"
+#include "bootloader/boot_trace.h"
+#include "bootloader/channel.h"
+#include "bootloader/memmap.h"
+#include "bootloader/protocol.h"
+#include "bootloader/session.h"
+
+#include "nor_model.h"
+
+// where the QSPI part is memory-mapped (qspi_memmap's base); slot bases in
+// bl_memmap are absolute, the session works in device offsets
+constexpr uint32_t QSPI_BASE = 0x90000000U;
+
+inline uint32_t qspi_off(enum bl_slot s) { return bl_memmap[s].base - QSPI_BASE; }
+
+struct vboard_opts {
+  int baud = 1000000;     // UPD_BAUD
+  double scale = 1.0;     // run this many times faster than the board (the
+                          // nor_model's timing.scale should match)
+  double ber = 0.0;       // bit-error rate on what the host sends
+  // the line gets worse with speed: above knee_baud (0 = never) the bit-error
+  // rate rises from knee_ber by `slope` decades per doubling, on top of ber
+  int knee_baud = 0;
+  double knee_ber = 1e-6;
+  double slope = 3.0;
+  int max_baud = 7500000; // fastest rate BL_LINK may set: the UART4 kernel clock
+                          // (PCLK1, 120 MHz) / 16
+  bool handshake = true;  // wait for HELLO and answer HELLO_ACK first
+  int stall_ms = 5000;    // UPD_STALL_MS: no bytes for this long ends the session
+  int reply_ms = 2;       // send_reply's sleep after each frame
+  double prepare_s = 0.0; // the prepare step holds the host this long (the
+                          // board's has nothing to do: updates go A/B)
+  long kill_at = -1;      // stop answering after this many received bytes, like
+                          // a board that was reset mid-transfer (-1 = never)
+};
+
+// how one bootloader entry went (board time)
+struct vboard_report {
+  bool linked = false;    // got a HELLO (or handshake off)
+  bool over = false;      // the session ended itself (RESULT or fatal NAK)
+  bool stalled = false;
+  bool killed = false;
+  uint16_t status = 0;    // the session's status
+  uint32_t recv = 0;      // image bytes it took
+  size_t rx_bytes = 0;    // bytes off the line after the handshake
+  double secs = 0.0;      // first byte after the handshake .. end
+  int baud = 0;           // the line's rate at the end (BL_LINK may move it)
+};
+
+struct vboard {
+  int fd = -1;
+  vboard_opts o;
+  nor_model *nor = nullptr;
+  FILE *console = nullptr; // bl_update's bsp_printf lines go here (null = off)
+  int host_fd = -1;        // a pty's other side held open here: on a HELLO, what
+                           // the last host left unread there is dropped
+  int tty_fd = -1;         // the pty side whose termios the host sets: its rate is
+                           // compared with the line's (times scale, like the
+                           // host's --baud). -1 = assume they match
+  const bl_boot_trace *trace = nullptr; // what BL_TRACE answers with - the last
+                                        // boot's, as bl_main passes it (null = none)
+  std::atomic<bool> stop{false};
+  vboard_report rep;
+
+  // one bootloader entry: the handshake (unless off), then the session until the
+  // line is quiet after it is over, it stalls, the board dies or stop is set.
+  // false if stop came first
+  bool run();
+
+  // after run(): keep swallowing what the host sends until stop, like the line
+  // to a board that stopped listening
+  void drain();
+
+  bl_session sess;
+  bl_session_ops ops{};
+  bl_boot boot{};          // the boot pointer, read at each app manifest
+
+ private:
+  using clk = std::chrono::steady_clock;
+  clk::time_point due{};       // when the line has delivered what was read
+  clk::duration blocked{};     // spent in replies since the last read
+  int line = 0;                // the line's baud now (o.baud at each entry)
+  int next_line = 0;           // BL_LINK: switch after the reply going out
+  int trial_line = 0;          // on trial: fall back to this (0 = settled)
+  clk::time_point trial_t0{};
+  uint32_t trial_frames = 0;
+  std::mt19937 noise{0x5EEDu};
+  uint16_t host_ver = 0;       // the HELLO's bl_hello.version
+  bool mirror = false;         // a session with a v10 host: log/telemetry to it
+  std::deque<std::string> log_q; // lines not yet sent (LOG_LINES at most)
+  bl_sched sched;
+  clk::time_point sess_t0{};
+  clk::time_point tel_t0{};    // when the last BL_TELEMETRY went out
+
+  clk::duration board(double s) const;
+  void say(const char *fmt, ...);
+  void aux_poll();
+  double ber_now() const;
+  bool host_in_step() const;
+  void check_trial();
+  bool pace(size_t n, bool live);
+  bool wait_hello();
+  void send(uint8_t ch, uint8_t type, const void *pl, uint16_t len);
+  void reply(uint8_t type, const void *pl, uint16_t len);
+  void boot_open();
+
+  static void sess_send(void *ctx, uint8_t type, const void *pl, uint16_t len);
+  static int sess_slot(void *ctx, uint16_t target, uint32_t *off, uint32_t *size);
+  static void sess_prepare(void *ctx, const bl_manifest *m);
+  static int sess_base(void *ctx, uint16_t target, uint32_t *off, uint32_t *len);
+  static int sess_log(void *ctx, uint32_t *off);
+  static void sess_idle(void *ctx);
+  static int sess_set_baud(void *ctx, uint32_t baud);
+  static int sess_commit(void *ctx, const bl_manifest *m);
+  static const bl_boot_trace *sess_trace(void *ctx);
+};
+
+#endif // FW_UPDATE_VBOARD_H
@@ -0,0 +1,252 @@
+// virtual MCU: the bootloader's update receiver on Linux, behind a pty, so
+// update.bin can be pointed at it like at the board's USB-UART:
+//
+//   ./vmcu.bin                                   (prints its /dev/pts/N)
+//   ./update.bin --dev /dev/pts/N --baud 1000000 --file apm_app.smup
+//
+// the board is a vboard (vboard.h): the real session code over the slots of
+// modules/bootloader/memmap.c, on a W25Q128 kept in a file (--part, created
+// erased; it persists across runs, so what was installed stays installed -
+// delta updates and resumes work against it). the line is paced to the board's
+// baud and the flash takes datasheet time, so every transfer also reports what
+// it costs on the board: line utilisation, flash work and busy time. each HELLO
+// is a bootloader entry; it keeps listening after a session (--once: exits).
+// a BL_TRACE (update.bin --boot-trace) gets a made-up boot trace: there is no
+// boot here to time.
+//
+// the board listens at --baud, and update.bin must talk at the same rate (its
+// tty's speed is checked on every read; a mismatch is noise both ways).
+// --autotune moves both: --knee/--knee-ber/--slope make the line worse with
+// speed, so the search has something to find.
+//
+// --scale runs everything faster (board times are still reported); give
+// update.bin --baud times the scale (all its rates are in those terms).
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "nor_model.h"
+#include "vboard.h"
+
+namespace {
+
+constexpr size_t PART = 16U * 1024U * 1024U; // W25Q128
+
+vboard *g_board = nullptr;
+
+void on_signal(int) {
+  if (g_board != nullptr) {
+    g_board->stop = true;
+  }
+}
+
+// W25Q128JV datasheet maximums (typical ones are nor_timing's defaults)
+nor_timing max_timing() {
+  nor_timing t;
+  t.erase_4k_s = 0.400;
+  t.erase_64k_s = 2.000;
+  t.page_s = 0.003;
+  return t;
+}
+
+const char *status_name(uint16_t s) {
+  static const char *names[] = {"OK",      "ERR_CRC",   "ERR_TARGET", "ERR_SIZE",
+                                "ERR_SEQ", "ERR_PROTO", "ERR_FLASH",  "ERR_BASE"};
+  return (s < sizeof(names) / sizeof(names[0])) ? names[s] : "?";
+}
+
+void report(const vboard &b, const nor_stats &st) {
+  const vboard_report &r = b.rep;
+  double secs = (r.secs > 0.0) ? r.secs : 1e-9;
+  double line = static_cast<double>(r.rx_bytes) * 10.0 / r.baud;
+  printf("session: %s%s, %u image bytes, %zu bytes on the line in %.2fs (board time)\n",
+         r.over ? status_name(r.status) : "no result", r.stalled ? " (stalled)" : "", r.recv,
+         r.rx_bytes, r.secs);
+  printf("  rate %.1f KB/s, line busy %.1f%%", static_cast<double>(r.recv) / 1024.0 / secs,
+         100.0 * line / secs);
+  if (r.baud != b.o.baud) {
+    printf(", line at %d baud", r.baud);
+  }
+  printf("\n  flash: %zu 4K + %zu 64K erases, %zu pages, %.2fs busy%s\n", st.erases_4k,
+         st.erases_64k, st.pages, st.busy_s, st.misuse ? "  MISUSE" : "");
+  fflush(stdout);
+}
+
+// the trace BL_TRACE answers with (update.bin --boot-trace). a vmcu never
+// boots an app, so this is a made-up last boot, shaped like the board's
+// console shows one: QSPI up, the update window with no host, the active
+// slot's header, a stage skipped because exec held the image, the FPGA's
+// whole load (the stage left nothing for it to overlap), the jump
+bl_boot_trace made_up_trace() {
+  const uint32_t hz = 480000000U; // STM32_SYS_CK
+  bl_trace_area a{};
+  uint32_t c = 0;
+  bl_trace_begin(&a, hz, c);
+  auto mark = [&](double ms, uint16_t phase, uint16_t arg) {
+    c += static_cast<uint32_t>(ms * (hz / 1000U));
+    bl_trace_mark(&a.cur, phase, arg, c);
+  };
+  mark(2.1, BL_TRACE_QSPI, 1U);
+  mark(5002.7, BL_TRACE_UPDATE, 0U);
+  mark(0.4, BL_TRACE_BOOT, 0U);
+  mark(0.01, BL_TRACE_HEADER, 0U);
+  mark(2.9, BL_TRACE_STAGE, BL_TRACE_ARG_SKIP);
+  mark(190.2, BL_TRACE_FPGA, 0U);
+  mark(1.3, BL_TRACE_JUMP, 0U);
+  return a.cur;
+}
+
+void usage(const char *prog) {
+  std::cout
+      << "usage: " << prog << " [options]\n"
+      << "  --part <path>       flash image file (default vmcu.nor.bin, created erased)\n"
+      << "  --baud <n>          the board's line rate (default 1000000, UPD_BAUD)\n"
+      << "  --scale <x>         run x times faster than the board (default 1)\n"
+      << "  --flash typ|max     datasheet typical (default) or maximum erase/program\n"
+      << "                      times\n"
+      << "  --ber <p>           bit-error rate on what the host sends (default 0)\n"
+      << "  --knee <baud>       above this the bit-error rate climbs (default: never)\n"
+      << "  --knee-ber <p>      ... starting from this (default 1e-6)\n"
+      << "  --slope <d>         ... by this many decades per doubling (default 3)\n"
+      << "  --max-baud <n>      fastest rate the board agrees to (default 7500000)\n"
+      << "  --link <path>       also symlink the pty here (e.g. /tmp/ttyVMCU)\n"
+      << "  --once              exit after one session\n"
+      << "  --help              this message\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string part = "vmcu.nor.bin";
+  std::string link;
+  std::string flash = "typ";
+  vboard_opts o;
+  bool once = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto next = [&](const char *name) -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << name << " needs an argument\n";
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+
+    if (a == "--part") {
+      part = next("--part");
+    } else if (a == "--baud") {
+      o.baud = std::stoi(next("--baud"));
+    } else if (a == "--scale") {
+      o.scale = std::stod(next("--scale"));
+    } else if (a == "--flash") {
+      flash = next("--flash");
+    } else if (a == "--ber") {
+      o.ber = std::stod(next("--ber"));
+    } else if (a == "--knee") {
+      o.knee_baud = std::stoi(next("--knee"));
+    } else if (a == "--knee-ber") {
+      o.knee_ber = std::stod(next("--knee-ber"));
+    } else if (a == "--slope") {
+      o.slope = std::stod(next("--slope"));
+    } else if (a == "--max-baud") {
+      o.max_baud = std::stoi(next("--max-baud"));
+    } else if (a == "--link") {
+      link = next("--link");
+    } else if (a == "--once") {
+      once = true;
+    } else if (a == "--help" || a == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else {
+      std::cerr << "unknown option: " << a << "\n";
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if ((flash != "typ" && flash != "max") || o.baud <= 0 || o.scale <= 0.0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  nor_timing tm = (flash == "max") ? max_timing() : nor_timing{};
+  tm.scale = o.scale;
+  nor_model nor;
+  if (!nor.open(part, PART, tm)) {
+    perror(part.c_str());
+    return 1;
+  }
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("pty");
+    return 1;
+  }
+  std::string pts = ptsname(master);
+  // hold the slave open ourselves: raw from the start, and no hangup on the
+  // master each time update.bin closes it
+  int slave = ::open(pts.c_str(), O_RDWR | O_NOCTTY);
+  if (slave < 0) {
+    perror(pts.c_str());
+    return 1;
+  }
+  struct termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+  if (!link.empty()) {
+    unlink(link.c_str());
+    if (symlink(pts.c_str(), link.c_str()) != 0) {
+      perror(link.c_str());
+      return 1;
+    }
+  }
+
+  vboard b;
+  b.fd = master;
+  b.o = o;
+  b.nor = &nor;
+  b.console = stdout;
+  b.host_fd = slave;
+  b.tty_fd = slave;
+  bl_boot_trace last = made_up_trace();
+  b.trace = &last;
+  g_board = &b;
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  printf("vmcu: listening on %s%s%s - %d baud, flash %s, part %s%s\n", pts.c_str(),
+         link.empty() ? "" : " -> ", link.c_str(), o.baud, flash.c_str(), part.c_str(),
+         (o.scale != 1.0) ? " (time scaled)" : "");
+  printf("  app_1 @0x%06X  app_0 @0x%06X  fpga_active @0x%06X  params @0x%06X\n",
+         qspi_off(BL_SLOT_APP_1), qspi_off(BL_SLOT_APP_0), qspi_off(BL_SLOT_FPGA_ACTIVE),
+         qspi_off(BL_SLOT_PARAMS));
+  fflush(stdout);
+
+  while (!b.stop) {
+    nor.st = nor_stats{};
+    if (!b.run()) {
+      break;
+    }
+    report(b, nor.st);
+    if (once) {
+      break;
+    }
+  }
+
+  if (!link.empty()) {
+    unlink(link.c_str());
+  }
+  ::close(slave);
+  ::close(master);
+  nor.close();
+  return 0;
+}